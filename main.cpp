@@ -1,22 +1,128 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "bindlessHeap.hh"
+#include "callCapture.hh"
 #include "config.hh"
+#include "deletionQueue.hh"
+#include "drawStateRecorder.hh"
+#include "frameCapture.hh"
+#include "framePacer.hh"
+#include "jobSystem.hh"
+#include "memoryBudget.hh"
+#include "meshLoader.hh"
+#include "overlay.hh"
+#include "pipelineVariants.hh"
+#include "resolutionController.hh"
+#include "spscQueue.hh"
+#include "textureStreamer.hh"
+#include "timingSummary.hh"
+#include "tracer.hh"
+#include "tripleBuffer.hh"
+#include "uniformRing.hh"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+struct Options {
+    // Requested MSAA sample count, clamped to what the device supports;
+    // single-sampled unless --msaa asks for more
+    uint32_t msaaSamples = 1;
+    // Start with the depth-only pre-pass enabled (toggled with P at runtime)
+    bool depthPrePass = false;
+    // Number of stacked triangles drawn back to front to generate overdraw
+    uint32_t overdrawLayers = 1;
+    // Triangles drawn per pass, each with its own per-draw constants
+    uint32_t draws = 1;
+    // Per-draw constants through push constants instead of the uniform ring
+    bool pushDrawConstants = false;
+    // Output of the frame capture (.y4m, .png sequence or raw RGBA), empty
+    // to disable capture
+    std::string capturePath;
+    // Host readback buffers frames are copied into
+    uint32_t captureSlots = 3;
+    // Frame rate written in the Y4M header
+    uint32_t captureFrameRate = 60;
+    // Windows opened at startup (W opens another one at runtime)
+    uint32_t windows = 1;
+    // Image files streamed in the background, drawn in turn by the draws
+    std::vector<std::string> texturePaths;
+    // Device memory the streamed textures may occupy, in MiB
+    uint32_t textureBudgetMiB = 256;
+    // Fractions of a heap's budget past which memory pressure is high or
+    // critical: the streamed textures shrink to fit below the high one
+    float memoryHighWatermark = 0.80f;
+    float memoryCriticalWatermark = 0.95f;
+    // OBJ, glTF, GLB or .mesh file drawn instead of the built-in triangle
+    std::string meshPath;
+    // Job system worker threads, 0 for one per core but one
+    uint32_t jobThreads = 0;
+    // Create every MSAA, format and blend variant of the pipelines at
+    // startup, in parallel and serially, and report both times
+    bool pipelineVariants = false;
+    // Draws cycle through every material instead of all using the textured
+    // and vertex-coloured one
+    bool materials = false;
+    // Draw everything with the generic pipeline, never compiling
+    // specialised variants
+    bool genericPipeline = false;
+    // Create material variants as whole pipelines even where graphics
+    // pipeline libraries are supported
+    bool monolithicPipelines = false;
+    // Bake every state into the pipelines even where extended dynamic
+    // state could set it per draw
+    bool staticState = false;
+    // Chrome trace-event JSON written at exit, empty to start with tracing
+    // off (T starts it and writes trace.json at runtime)
+    std::string tracePath;
+    // Start with the statistics overlay shown (toggled with H at runtime)
+    bool hud = false;
+    // Binary trace of the created objects and recorded frames, replayed by
+    // vulkanReplay; empty to disable
+    std::string callCapturePath;
+    // Frames drawn before exiting, 0 to run until a window is closed
+    uint32_t frameLimit = 0;
+    // JSON timings written at exit (startup, frame, CPU and GPU times),
+    // empty to disable
+    std::string resultsPath;
+    // GLFW's null platform: windows are never shown and swap chains use
+    // VK_EXT_headless_surface, so that no display is needed
+    bool headless = false;
+    // Draw only when the image would change (input, an exposed window, the
+    // animation running, textures streaming in), idling otherwise
+    bool onDemand = false;
+    // Frames per second the render thread paces itself to, 0 for as many
+    // as presentation allows
+    double maxFrameRate = 0.0;
+    // GPU milliseconds per frame the render resolution adapts to hold, the
+    // scene being upscaled to the windows; 0 to always render at the window
+    // size. Needs timestamp queries.
+    double dynamicResolutionMs = 0.0;
+};
+
 const std::vector<const char *> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
@@ -110,6 +216,143 @@ void listRequiredInstanceExtensions(const std::vector<const char *> &extensions)
     }
 }
 
+static Options parseOptions(int argc, char **argv)
+{
+    Options options{};
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--msaa" && i + 1 < argc) {
+            options.msaaSamples =
+                static_cast<uint32_t>(std::stoul(argv[++i]));
+            if (options.msaaSamples == 0
+                || (options.msaaSamples & (options.msaaSamples - 1)) != 0)
+                throw std::runtime_error(
+                    "--msaa expects a power of two sample count!");
+        }
+        else if (arg == "--depth-prepass") {
+            options.depthPrePass = true;
+        }
+        else if (arg == "--capture" && i + 1 < argc) {
+            options.capturePath = argv[++i];
+        }
+        else if (arg == "--capture-calls" && i + 1 < argc) {
+            options.callCapturePath = argv[++i];
+        }
+        else if (arg == "--capture-slots" && i + 1 < argc) {
+            options.captureSlots =
+                std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--capture-fps" && i + 1 < argc) {
+            options.captureFrameRate =
+                std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--windows" && i + 1 < argc) {
+            options.windows =
+                std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--draws" && i + 1 < argc) {
+            options.draws =
+                std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--constants" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode != "push" && mode != "ring")
+                throw std::runtime_error("--constants expects push or ring!");
+            options.pushDrawConstants = mode == "push";
+        }
+        else if (arg == "--mesh" && i + 1 < argc) {
+            options.meshPath = argv[++i];
+        }
+        else if (arg == "--texture" && i + 1 < argc) {
+            options.texturePaths.emplace_back(argv[++i]);
+        }
+        else if (arg == "--texture-budget" && i + 1 < argc) {
+            options.textureBudgetMiB =
+                static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--memory-high" && i + 1 < argc) {
+            options.memoryHighWatermark = std::stof(argv[++i]);
+        }
+        else if (arg == "--memory-critical" && i + 1 < argc) {
+            options.memoryCriticalWatermark = std::stof(argv[++i]);
+        }
+        else if (arg == "--pipeline-variants") {
+            options.pipelineVariants = true;
+        }
+        else if (arg == "--materials") {
+            options.materials = true;
+        }
+        else if (arg == "--generic-pipeline") {
+            options.genericPipeline = true;
+        }
+        else if (arg == "--monolithic-pipelines") {
+            options.monolithicPipelines = true;
+        }
+        else if (arg == "--static-state") {
+            options.staticState = true;
+        }
+        else if (arg == "--hud") {
+            options.hud = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            options.frameLimit =
+                static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--results" && i + 1 < argc) {
+            options.resultsPath = argv[++i];
+        }
+        else if (arg == "--headless") {
+            options.headless = true;
+        }
+        else if (arg == "--on-demand") {
+            options.onDemand = true;
+        }
+        else if (arg == "--dynamic-resolution" && i + 1 < argc) {
+            options.dynamicResolutionMs = std::stod(argv[++i]);
+            if (!(options.dynamicResolutionMs >= 0.0))
+                throw std::runtime_error(
+                    "--dynamic-resolution expects a frame time in ms!");
+        }
+        else if (arg == "--max-fps" && i + 1 < argc) {
+            options.maxFrameRate = std::stod(argv[++i]);
+            if (!(options.maxFrameRate >= 0.0))
+                throw std::runtime_error("--max-fps expects a positive rate!");
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        }
+        else if (arg == "--job-threads" && i + 1 < argc) {
+            options.jobThreads =
+                static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--overdraw" && i + 1 < argc) {
+            options.overdrawLayers =
+                std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (!(options.memoryHighWatermark > 0.0f
+          && options.memoryHighWatermark <= options.memoryCriticalWatermark))
+        throw std::runtime_error(
+            "--memory-high must be positive and at most --memory-critical!");
+
+    // The streamer fills heap slots from its own threads, out of the trace
+    if (!options.callCapturePath.empty() && !options.texturePaths.empty())
+        throw std::runtime_error(
+            "--capture-calls cannot capture streamed textures!");
+    // Nor the upscaling blits
+    if (!options.callCapturePath.empty() && options.dynamicResolutionMs > 0.0)
+        throw std::runtime_error(
+            "--capture-calls cannot capture dynamic resolution!");
+
+    return options;
+}
+
 static std::vector<char> readFile(const std::string &filename)
 {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -132,6 +375,8 @@ class HelloTriangleApplication {
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        // Dedicated transfer family when there is one, else graphicsFamily
+        std::optional<uint32_t> transferFamily;
 
         [[nodiscard]] bool isComplete() const
         {
@@ -145,112 +390,888 @@ class HelloTriangleApplication {
         std::vector<VkPresentModeKHR> presentModes;
     };
 
+    // Attachment that only lives inside the render pass (never loaded nor
+    // stored), backed by lazily allocated memory when available.
+    struct TransientAttachment {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        bool lazilyAllocated = false;
+    };
+
+    // Where a window's scene is rendered at one of RENDER_SCALES below 1,
+    // then blitted to the swap chain image
+    struct ScaledTarget {
+        VkExtent2D extent{};
+        // Single-sample colour: the MSAA resolve target when multisampled
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        TransientAttachment colorAttachment;
+        TransientAttachment depthAttachment;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    };
+
+    // Everything that exists once per output window. The device, render
+    // pass, pipelines and pipeline cache are shared by all windows.
+    struct Window {
+        GLFWwindow *handle = nullptr;
+        // Queried on the main thread when opened; windows are not resizable
+        VkExtent2D framebufferSize{};
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+        VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+        std::vector<VkImage> images;
+        std::vector<VkImageView> imageViews;
+        VkExtent2D extent{};
+        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        TransientAttachment colorAttachment;
+        TransientAttachment depthAttachment;
+        std::vector<VkFramebuffer> framebuffers;
+        // Swap chain image only, for the overlay pass
+        std::vector<VkFramebuffer> overlayFramebuffers;
+        // With dynamic resolution, one per scale of RENDER_SCALES below 1,
+        // allocated up front so that changing scale allocates nothing
+        std::vector<ScaledTarget> scaledTargets;
+        // One per frame in flight
+        std::vector<VkSemaphore> imageAvailableSemaphores;
+        // Swap chain image acquired for the frame being recorded
+        uint32_t imageIndex = 0;
+    };
+
+    // Input handled by the render thread, sent by the main thread's event
+    // callbacks
+    struct InputEvent {
+        enum class Type
+        {
+            TOGGLE_DEPTH_PRE_PASS,
+            ADD_WINDOW,
+            TOGGLE_OVERLAY,
+        };
+
+        Type type = Type::TOGGLE_DEPTH_PRE_PASS;
+        // ADD_WINDOW: opened by the main thread, not rendered to yet
+        GLFWwindow *window = nullptr;
+        VkExtent2D framebufferSize{};
+    };
+
+    // Simulation state published by the main thread. The render thread
+    // extrapolates the time to the moment it records a frame, so animation
+    // stays smooth whatever the publishing rate.
+    struct SimulationSnapshot {
+        double time = 0.0;
+        std::chrono::steady_clock::time_point taken;
+        bool paused = false;
+    };
+
+    // Per-draw data, read from the uniform ring or from push constants.
+    // Must match the DrawData struct of triangle.vert.
+    struct DrawData {
+        float offsetScale[4]; // xy offset, z scale, w rotation speed
+        float color[4];
+        uint32_t textureIndex;
+        uint32_t material;
+        uint32_t padding[2];
+    };
+
+    // Per-frame data, allocated once per frame from the uniform ring
+    struct FrameUniforms {
+        float time;
+        float padding[3];
+    };
+
+    // Resource indices into the bindless heap, read by the shaders from push
+    // constants. Must match the push_constant block of the shaders.
+    struct DrawConstants {
+        uint32_t layerBufferIndex = 0;
+        uint32_t vertexBufferIndex = 0; // mesh vertices, when drawing one
+        uint32_t padding[2] = {};
+        // Fits the mesh into a unit cube: xyz centre, w scale
+        float meshCenterScale[4] = {};
+        // Only pushed when per-draw data does not go through the ring
+        DrawData draw{};
+    };
+
+    struct Texture {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t heapIndex = 0;
+    };
+
+    // Persistently mapped vertices of the overlay, one buffer per frame in
+    // flight so that building a frame's overlay never waits for the GPU
+    struct OverlayBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void *mapped = nullptr;
+        uint32_t heapIndex = 0;
+    };
+
+    // Push constants of overlay.vert and overlay.frag
+    struct OverlayConstants {
+        uint32_t atlasIndex;
+        uint32_t vertexBufferIndex;
+        float scale[2];
+    };
+
+    // Imported mesh. The vertex shader pulls vertices from the storage
+    // buffer through the bindless heap, so pipelines have no vertex input.
+    struct Mesh {
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory indexMemory = VK_NULL_HANDLE;
+        uint32_t indexCount = 0;
+    };
+
+    // Mesh loader output, written straight into mapped staging buffers
+    // created once the loader knows their sizes
+    struct StagingMeshDestination : MeshDestination {
+        HelloTriangleApplication *app = nullptr;
+        VkBuffer buffers[2] = {}; // indices, vertices
+        VkDeviceMemory memories[2] = {};
+        VkDeviceSize sizes[2] = {};
+        void *mapped[2] = {};
+
+        void *map(int slot, VkDeviceSize size)
+        {
+            // Zero-sized buffers are invalid
+            sizes[slot] = size;
+            app->createBuffer(std::max<VkDeviceSize>(size, 4),
+                              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                  | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              buffers[slot],
+                              memories[slot]);
+            vkMapMemory(app->device_,
+                        memories[slot],
+                        0,
+                        VK_WHOLE_SIZE,
+                        0,
+                        &mapped[slot]);
+            return mapped[slot];
+        }
+
+        uint32_t *indices(uint32_t count) override
+        {
+            return static_cast<uint32_t *>(map(0, count * sizeof(uint32_t)));
+        }
+
+        MeshVertex *vertices(uint32_t count) override
+        {
+            return static_cast<MeshVertex *>(
+                map(1, count * sizeof(MeshVertex)));
+        }
+    };
+
+    enum class BlendMode
+    {
+        REPLACE,
+        ALPHA,
+        ADDITIVE,
+    };
+
+    // Fragment shader features of a draw, see triangle.frag
+    static constexpr uint32_t MATERIAL_TEXTURE = 1;
+    static constexpr uint32_t MATERIAL_VERTEX_COLOR = 2;
+    static constexpr uint32_t MATERIAL_GRAYSCALE = 4;
+    static constexpr uint32_t MATERIAL_COUNT = 8;
+    // Specialisation of the generic pipeline, which reads the material of
+    // each draw at runtime
+    static constexpr uint32_t MATERIAL_GENERIC = ~0u;
+
+    struct PipelineState {
+        // Any render pass compatible with the ones the pipeline is used in
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        uint32_t subpass = 0;
+        // Depth-only pipelines have no fragment shader and no colour output
+        bool depthOnly = false;
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+        VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+        VkBool32 depthWriteEnable = VK_TRUE;
+        BlendMode blendMode = BlendMode::REPLACE;
+        uint32_t material = MATERIAL_GENERIC;
+        // Leaves the states stateRecorder_ sets dynamic. Pipelines with
+        // every state baked in must not be bound through it.
+        bool dynamicState = true;
+    };
+
+    // Persistently mapped buffer a rendered frame is copied into. It is
+    // handed to the capture writer once the frame has completed on the GPU.
+    struct CaptureSlot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void *mapped = nullptr;
+        // Owned by the GPU copy or the writer until cleared by the writer
+        std::atomic<bool> busy{ false };
+        // Copy recorded in a frame that has not been collected yet
+        bool copyPending = false;
+        // Frame in flight that recorded the copy
+        uint32_t frame = 0;
+    };
+
+    // Subpasses of renderPass_
+    static constexpr uint32_t DEPTH_PREPASS_SUBPASS = 0;
+    static constexpr uint32_t COLOR_SUBPASS = 1;
+
+    // Number of frames averaged in each overdraw report
+    static constexpr uint32_t STATISTICS_REPORT_FRAMES = 300;
+
+    // Capacity of the bindless descriptor arrays (clamped to device limits)
+    static constexpr uint32_t BINDLESS_SAMPLED_IMAGES = 16384;
+    static constexpr uint32_t BINDLESS_STORAGE_BUFFERS = 4096;
+
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+
+    // GPU zones of the trace: timestamps at the start of a frame's command
+    // buffer, after its render passes and at its end
+    static constexpr uint32_t TIMESTAMPS_PER_FRAME = 3;
+
+    // Overlay capacity, text and graph bars included
+    static constexpr size_t OVERLAY_MAX_QUADS = 2048;
+    // Frames shown by the overlay's frame time graph
+    static constexpr size_t FRAME_GRAPH_FRAMES = 120;
+
+    // Upper bound of minUniformBufferOffsetAlignment, used to size the ring
+    static constexpr VkDeviceSize MAX_UNIFORM_ALIGNMENT = 256;
+
+    // Longest wait for events on the main thread, so that simulation
+    // snapshots keep coming without input
+    static constexpr double SIMULATION_PERIOD = 1.0 / 120.0;
+
+    // Per-draw uniform copies per job: enough to outweigh the scheduling
+    static constexpr size_t DRAWS_PER_JOB = 512;
+
+    // Render resolutions of dynamic resolution, fractions of the window
+    // size. Each has its own targets, so they are few.
+    static constexpr float RENDER_SCALES[] = { 0.5f, 0.625f, 0.75f, 0.875f,
+                                               1.0f };
+    static constexpr size_t RENDER_SCALE_COUNT = std::size(RENDER_SCALES);
+
 private:
-    GLFWwindow *window_ = nullptr;
+    Options options_;
+    // Render thread only once it runs
+    std::vector<Window> windows_;
+    // Main thread only: GLFW windows may only be used from there
+    std::vector<GLFWwindow *> windowHandles_;
+    double simulationTime_ = 0.0;
+    std::chrono::steady_clock::time_point simulationClock_;
+    bool simulationPaused_ = false;
+    // Main thread to render thread
+    SpscQueue<InputEvent, 256> inputEvents_;
+    TripleBuffer<SimulationSnapshot> simulation_;
+    std::thread renderThread_;
+    std::atomic<bool> renderThreadStopping_{ false };
+    std::atomic<bool> renderThreadDone_{ false };
+    std::exception_ptr renderThreadError_;
+    // With --on-demand the render thread sleeps until the main thread asks
+    // for a redraw
+    std::mutex redrawMutex_;
+    std::condition_variable redrawCondition_;
+    bool redrawRequested_ = true;
+    std::unique_ptr<JobSystem> jobSystem_;
     VkInstance instance_ = VK_NULL_HANDLE;
     VkDebugUtilsMessengerEXT debugMessenger_ = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
     VkDevice device_ = VK_NULL_HANDLE;
-    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_ = VK_NULL_HANDLE;
     VkQueue presentQueue_ = VK_NULL_HANDLE;
-    VkSwapchainKHR swapChain_ = VK_NULL_HANDLE;
-    std::vector<VkImage> swapChainImages_;
-    VkFormat swapChainImageFormat_;
-    VkExtent2D swapChainExtent_;
-    std::vector<VkImageView> swapChainImagesViews_;
+    // Same as graphicsQueue_ when the device has no transfer-only family
+    VkQueue transferQueue_ = VK_NULL_HANDLE;
+    uint32_t graphicsFamily_ = 0;
+    uint32_t transferFamily_ = 0;
+    // Shared by every swap chain, as the render pass depends on it
+    VkSurfaceFormatKHR surfaceFormat_{};
+    VkSampleCountFlagBits msaaSamples_ = VK_SAMPLE_COUNT_1_BIT;
+    VkFormat depthFormat_;
     VkRenderPass renderPass_;
+    // renderPass_ leaving the scene ready to blit, for dynamic resolution
+    VkRenderPass scaledRenderPass_ = VK_NULL_HANDLE;
+    std::unique_ptr<ResolutionController> resolutionController_;
+    VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+    std::unique_ptr<BindlessHeap> bindlessHeap_;
+    // Checkerboard, drawn until a streamed texture becomes resident
+    Texture texture_;
+    std::unique_ptr<TextureStreamer> textureStreamer_;
+    std::vector<TextureHandle> streamedTextures_;
+    // Refreshed every frame; VK_EXT_memory_budget when available
+    std::unique_ptr<MemoryBudget> memoryBudget_;
+    // Objects released mid-run, destroyed once their frames complete
+    std::unique_ptr<DeletionQueue> deletionQueue_;
+    Mesh mesh_;
+    // Per-layer tint read by the vertex shader, one vec4 per instance
+    VkBuffer layerBuffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory layerBufferMemory_ = VK_NULL_HANDLE;
+    DrawConstants drawConstants_;
+    std::unique_ptr<UniformRing> uniformRing_;
+    std::vector<DrawData> draws_;
+    // Some draw rotates with the simulation time; set before the threads
+    // start
+    bool animated_ = false;
+    // Ring offsets of the frame being recorded
+    uint32_t frameUniformsOffset_ = 0;
+    std::vector<uint32_t> drawOffsets_;
+    // Where each draw's constants go in the ring this frame
+    std::vector<void *> drawUniformData_;
     VkPipelineLayout pipelineLayout_;
     VkPipeline graphicsPipeline_;
-    std::vector<VkFramebuffer> swapChainFramebuffers_;
+    VkPipeline depthPrePassPipeline_;
+    // Colour pass run after the pre-pass: EQUAL test, no depth writes
+    VkPipeline depthEqualPipeline_;
+    // States of graphicsPipeline_, depthPrePassPipeline_ and
+    // depthEqualPipeline_, from which their material variants derive
+    std::vector<PipelineState> passStates_;
+    // Kept for the variants compiled while running
+    VkShaderModule vertShaderModule_ = VK_NULL_HANDLE;
+    VkShaderModule fragShaderModule_ = VK_NULL_HANDLE;
+    std::unique_ptr<PipelineVariants> pipelineVariants_;
+    // With VK_EXT_graphics_pipeline_library, material variants are linked
+    // from parts keyed like the variants, and used until the optimised
+    // link done by pipelineVariants_ is ready
+    bool pipelineLibrarySupported_ = false;
+    std::unordered_map<uint64_t, VkPipeline> pipelineLibraries_;
+    // Destroyed through deletionQueue_ once the optimised link replaces them
+    std::unordered_map<uint64_t, VkPipeline> fastLinkedPipelines_;
+    uint32_t fastLinks_ = 0;
+    double fastLinkSeconds_ = 0.0;
+    std::unique_ptr<DrawStateRecorder> stateRecorder_;
+    bool depthPrePass_ = false;
+    bool pipelineStatisticsSupported_ = false;
+    VkQueryPool statisticsQueryPool_ = VK_NULL_HANDLE;
+    // Indexed by frame in flight, like the queries of the pool
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> statisticsQueryPending_{};
+    uint64_t fragmentInvocations_ = 0;
+    uint64_t vertexInvocations_ = 0;
+    uint64_t primitives_ = 0;
+    uint32_t statisticsFrames_ = 0;
+    VkQueryPool timestampQueryPool_ = VK_NULL_HANDLE;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> timestampQueryPending_{};
+    // Nanoseconds per tick, and the bits of a timestamp that are valid
+    double timestampPeriod_ = 1.0;
+    uint64_t timestampMask_ = ~0ull;
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps_ = nullptr;
+    // Tracer::now() minus GPU time, measured again with each report
+    bool gpuClockCalibrated_ = false;
+    int64_t gpuClockOffset_ = 0;
+    // Tracer::now() at each frame's submission
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> submitTimes_{};
+    // Statistics overlay, drawn over the first window by a render pass of
+    // its own. Everything it uses is created at startup.
+    bool overlayVisible_ = false;
+    std::unique_ptr<Overlay> overlay_;
+    Texture overlayAtlas_;
+    std::array<OverlayBuffer, MAX_FRAMES_IN_FLIGHT> overlayBuffers_{};
+    VkRenderPass overlayRenderPass_ = VK_NULL_HANDLE;
+    VkPipeline overlayPipeline_ = VK_NULL_HANDLE;
+    PipelineState overlayState_;
+    // Milliseconds between the latest frames, a ring starting at
+    // frameGraphNext_
+    std::array<float, FRAME_GRAPH_FRAMES> frameMilliseconds_{};
+    size_t frameGraphNext_ = 0;
+    std::chrono::steady_clock::time_point lastFrameStart_;
+    double cpuMilliseconds_ = 0.0;
+    double gpuMilliseconds_ = 0.0;
+    // Trace of the created objects and recorded frames, with --capture-calls
+    std::unique_ptr<CallCapture> callCapture_;
+    std::unique_ptr<FrameCaptureWriter> captureWriter_;
+    std::vector<CaptureSlot> captureSlots_;
+    bool captureCoherent_ = true;
+    uint64_t capturedFrames_ = 0;
+    uint64_t droppedFrames_ = 0;
+    std::chrono::steady_clock::time_point timingStart_;
+    double cpuFrameSeconds_ = 0.0;
+    uint32_t timedFrames_ = 0;
+    double recordSeconds_ = 0.0;
+    // Everything --results reports, in milliseconds. Startup lasts until
+    // the first frame is submitted.
+    uint64_t framesDrawn_ = 0;
+    std::chrono::steady_clock::time_point runStart_;
+    double startupMilliseconds_ = 0.0;
+    std::vector<double> frameIntervals_;
+    std::vector<double> cpuFrameMilliseconds_;
+    std::vector<double> gpuFrameMilliseconds_;
+    double pipelineVariantsMilliseconds_ = 0.0;
+    double pipelineVariantsSerialMilliseconds_ = 0.0;
     VkCommandPool commandPool_;
-    VkCommandBuffer commandBuffer_;
-    VkSemaphore imageAvailableSemaphore_;
-    VkSemaphore renderFinishedSemaphore_;
-    VkFence inFlightFence_;
+    std::vector<VkCommandBuffer> commandBuffers_;
+    // Signalled once for all windows: the present waits on it a single time
+    std::vector<VkSemaphore> renderFinishedSemaphores_;
+    std::vector<VkFence> inFlightFences_;
+    uint32_t currentFrame_ = 0;
 
 public:
+    explicit HelloTriangleApplication(const Options &options)
+        : options_(options)
+        , depthPrePass_(options.depthPrePass)
+        , overlayVisible_(options.hud)
+    {
+    }
+
     void run()
     {
+        Tracer::nameThread("main");
+        Tracer::setEnabled(!options_.tracePath.empty());
+        runStart_ = std::chrono::steady_clock::now();
+
         initWindow();
         initVulkan();
         mainLoop();
+        if (!options_.resultsPath.empty())
+            writeResults();
         cleanup();
+
+        if (Tracer::enabled())
+            writeTrace();
     }
 
 private:
     void initWindow()
     {
+        if (options_.headless) {
+#if GLFW_VERSION_MAJOR * 100 + GLFW_VERSION_MINOR >= 304
+            glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+            throw std::runtime_error("--headless needs GLFW 3.4 or later!");
+#endif
+        }
         if (!glfwInit())
             throw std::runtime_error("Failed to initialize GLFW!");
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
-        if ((window_ =
-                 glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr))
-            == nullptr)
+        windows_.resize(options_.windows);
+        for (auto &window : windows_) {
+            window.handle = openWindow(window.framebufferSize);
+        }
+    }
+
+    GLFWwindow *openWindow(VkExtent2D &framebufferSize)
+    {
+        size_t index = windowHandles_.size();
+        std::string title =
+            index == 0 ? "Vulkan" : "Vulkan " + std::to_string(index + 1);
+
+        GLFWwindow *window =
+            glfwCreateWindow(WIDTH, HEIGHT, title.c_str(), nullptr, nullptr);
+        if (window == nullptr)
             throw std::runtime_error("Failed to create GLFW window!");
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetWindowRefreshCallback(window, refreshCallback);
+
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        framebufferSize = { static_cast<uint32_t>(width),
+                            static_cast<uint32_t>(height) };
+        windowHandles_.push_back(window);
+        return window;
+    }
+
+    // Runs on the main thread, inside glfwWaitEventsTimeout
+    static void
+    keyCallback(GLFWwindow *window, int key, int, int action, int)
+    {
+        auto app = reinterpret_cast<HelloTriangleApplication *>(
+            glfwGetWindowUserPointer(window));
+        if (action != GLFW_PRESS)
+            return;
+
+        InputEvent event;
+        if (key == GLFW_KEY_P) {
+            event.type = InputEvent::Type::TOGGLE_DEPTH_PRE_PASS;
+            app->sendInput(event);
+        }
+        else if (key == GLFW_KEY_W) {
+            event.type = InputEvent::Type::ADD_WINDOW;
+            event.window = app->openWindow(event.framebufferSize);
+            app->sendInput(event);
+        }
+        else if (key == GLFW_KEY_H) {
+            event.type = InputEvent::Type::TOGGLE_OVERLAY;
+            app->sendInput(event);
+        }
+        else if (key == GLFW_KEY_SPACE) {
+            app->simulationPaused_ = !app->simulationPaused_;
+            // Before the redraw, which then sees the animation running
+            app->publishSimulation();
+            app->requestRedraw();
+        }
+        else if (key == GLFW_KEY_T) {
+            // Starts tracing, or stops it and writes what was recorded
+            if (!Tracer::enabled()) {
+                Tracer::setEnabled(true);
+                std::cout << "tracing started\n";
+                return;
+            }
+            Tracer::setEnabled(false);
+            try {
+                app->writeTrace();
+            }
+            catch (const std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+
+    // Runs on the main thread when a window's contents were lost, such as
+    // when it is uncovered
+    static void refreshCallback(GLFWwindow *window)
+    {
+        auto app = reinterpret_cast<HelloTriangleApplication *>(
+            glfwGetWindowUserPointer(window));
+        app->requestRedraw();
+    }
+
+    void writeResults()
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+        std::ofstream out(options_.resultsPath);
+        out << "{\n  \"device\": \"" << properties.deviceName
+            << "\",\n  \"frames\": " << framesDrawn_
+            << ",\n  \"startupMs\": " << startupMilliseconds_
+            << ",\n  \"frameMs\": ";
+        writeJson(out, summarizeTimings(frameIntervals_));
+        out << ",\n  \"cpuMs\": ";
+        writeJson(out, summarizeTimings(cpuFrameMilliseconds_));
+        out << ",\n  \"gpuMs\": ";
+        writeJson(out, summarizeTimings(gpuFrameMilliseconds_));
+        if (options_.pipelineVariants)
+            out << ",\n  \"pipelineVariantsMs\": "
+                << pipelineVariantsMilliseconds_
+                << ",\n  \"pipelineVariantsSerialMs\": "
+                << pipelineVariantsSerialMilliseconds_;
+        out << "\n}\n";
+        if (!out)
+            throw std::runtime_error("failed to write " + options_.resultsPath
+                                     + "!");
+        std::cout << "results written to " << options_.resultsPath << "\n";
+    }
+
+    void writeTrace()
+    {
+        std::string path =
+            options_.tracePath.empty() ? "trace.json" : options_.tracePath;
+        size_t events = Tracer::write(path);
+        std::cout << "trace: " << events << " events written to " << path
+                  << "\n";
+    }
+
+    void sendInput(const InputEvent &event)
+    {
+        // Only when the render thread is stuck far behind: better to lose
+        // a key press than to block event processing
+        if (!inputEvents_.push(event))
+            std::cerr << "input queue full, event dropped\n";
+        requestRedraw();
+    }
+
+    // Any thread; only --on-demand rendering waits for it
+    void requestRedraw()
+    {
+        {
+            std::lock_guard<std::mutex> lock(redrawMutex_);
+            redrawRequested_ = true;
+        }
+        redrawCondition_.notify_one();
+    }
+
+    // Whether frames differ even without input: some draw rotates and the
+    // animation runs, or streamed textures are still arriving
+    bool sceneChanging()
+    {
+        if (animated_ && !simulation_.latest().paused)
+            return true;
+        if (!textureStreamer_)
+            return false;
+        TextureStreamer::Statistics statistics =
+            textureStreamer_->statistics();
+        return statistics.uploading > 0
+               || statistics.decoded + statistics.failed
+                      < statistics.textures;
+    }
+
+    // --on-demand: blocks the render thread until the next frame would
+    // differ from the last one. False once the thread has to stop.
+    bool waitForRedraw()
+    {
+        std::unique_lock<std::mutex> lock(redrawMutex_);
+        bool idled = false;
+        while (!redrawRequested_ && !renderThreadStopping_
+               && !sceneChanging()) {
+            TRACE_ZONE("waitForRedraw");
+            redrawCondition_.wait(lock);
+            idled = true;
+        }
+        redrawRequested_ = false;
+
+        // The idle time is no frame time
+        if (idled) {
+            lastFrameStart_ = {};
+            resetFrameTiming();
+        }
+        return !renderThreadStopping_;
     }
 
     void initVulkan()
     {
+        TRACE_ZONE("initVulkan");
+        jobSystem_ = std::make_unique<JobSystem>(options_.jobThreads);
         createInstance();
 #ifndef NDEBUG
         setupDebugMessenger();
 #endif
-        createSurface();
+        for (auto &window : windows_) {
+            createSurface(window);
+        }
         pickPhysicalDevice();
         createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
+        selectSurfaceFormat();
+        depthFormat_ = findDepthFormat();
+        renderPass_ = createRenderPass(surfaceFormat_.format, msaaSamples_);
+        overlayRenderPass_ = createOverlayRenderPass(surfaceFormat_.format);
+        if (options_.dynamicResolutionMs > 0.0)
+            createResolutionController();
+        createPipelineCache();
+        createBindlessHeap();
+        createUniformRing();
         createGraphicPipeline();
-        createFramebuffers();
+        for (auto &window : windows_) {
+            createWindowResources(window);
+        }
         createCommandPool();
-        createCommandBuffer();
+        createCommandBuffers();
+        createTextureImage();
+        createOverlay();
+        createTextureStreamer();
+        createLayerBuffer();
+        createMesh();
+        createQueryPool();
+        createTimestampQueryPool();
+        createCaptureResources();
         createSyncObjects();
     }
 
+    // The main thread only pumps events and publishes simulation snapshots;
+    // a slow callback or message pump never delays a frame, and a long frame
+    // never delays input
     void mainLoop()
     {
-        while (!glfwWindowShouldClose(window_)) {
-            glfwPollEvents();
-            drawFrame();
+        simulationClock_ = std::chrono::steady_clock::now();
+        publishSimulation();
+        renderThread_ =
+            std::thread(&HelloTriangleApplication::renderLoop, this);
+
+        while (!shouldClose() && !renderThreadDone_) {
+            // Nothing to publish while paused or with nothing rotating:
+            // sleep until an event
+            if (options_.onDemand && (simulationPaused_ || !animated_))
+                glfwWaitEvents();
+            else
+                glfwWaitEventsTimeout(SIMULATION_PERIOD);
+            publishSimulation();
+        }
+
+        renderThreadStopping_ = true;
+        requestRedraw();
+        renderThread_.join();
+        if (renderThreadError_)
+            std::rethrow_exception(renderThreadError_);
+    }
+
+    void publishSimulation()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!simulationPaused_)
+            simulationTime_ +=
+                std::chrono::duration<double>(now - simulationClock_).count();
+        simulationClock_ = now;
+
+        SimulationSnapshot &snapshot = simulation_.back();
+        snapshot.time = simulationTime_;
+        snapshot.taken = now;
+        snapshot.paused = simulationPaused_;
+        simulation_.publish();
+    }
+
+    void renderLoop()
+    {
+        Tracer::nameThread("render");
+        try {
+            resetFrameTiming();
+            std::optional<FramePacer> pacer;
+            if (options_.maxFrameRate > 0.0)
+                pacer.emplace(options_.maxFrameRate);
+
+            while (!renderThreadStopping_
+                   && (options_.frameLimit == 0
+                       || framesDrawn_ < options_.frameLimit)) {
+                if (options_.onDemand && !waitForRedraw())
+                    break;
+                processInput();
+                if (pacer) {
+                    TRACE_ZONE("framePacing");
+                    pacer->wait();
+                }
+                drawFrame();
+            }
+
+            vkDeviceWaitIdle(device_);
+
+            reportTransientMemory();
+        }
+        catch (...) {
+            renderThreadError_ = std::current_exception();
+        }
+
+        // Wakes the main thread up if it is waiting for events
+        renderThreadDone_ = true;
+        glfwPostEmptyEvent();
+    }
+
+    void processInput()
+    {
+        InputEvent event;
+        while (inputEvents_.pop(event)) {
+            switch (event.type) {
+            case InputEvent::Type::TOGGLE_DEPTH_PRE_PASS:
+                depthPrePass_ = !depthPrePass_;
+                resetStatistics();
+                break;
+            case InputEvent::Type::ADD_WINDOW:
+                addWindow(event.window, event.framebufferSize);
+                break;
+            case InputEvent::Type::TOGGLE_OVERLAY:
+                overlayVisible_ = !overlayVisible_;
+                break;
+            }
         }
+    }
+
+    // Closing any window ends the application
+    bool shouldClose() const
+    {
+        return std::any_of(
+            windowHandles_.begin(),
+            windowHandles_.end(),
+            [](GLFWwindow *window) { return glfwWindowShouldClose(window); });
+    }
 
+    // Starts rendering to one more window while running, so that the cost
+    // of each additional swap chain shows up in the frame timing reports
+    void addWindow(GLFWwindow *handle, VkExtent2D framebufferSize)
+    {
         vkDeviceWaitIdle(device_);
+
+        windows_.emplace_back();
+        Window &window = windows_.back();
+        window.handle = handle;
+        window.framebufferSize = framebufferSize;
+        createSurface(window);
+        createWindowResources(window);
+
+        // The pending queries covered fewer pixels than are now rendered
+        statisticsQueryPending_.fill(false);
+        resetStatistics();
+        resetFrameTiming();
     }
 
     void cleanup()
     {
-        vkDestroyFence(device_, inFlightFence_, nullptr);
-        vkDestroySemaphore(device_, renderFinishedSemaphore_, nullptr);
-        vkDestroySemaphore(device_, imageAvailableSemaphore_, nullptr);
+        TRACE_ZONE("cleanup");
+        jobSystem_.reset();
+        destroyCaptureResources();
+        if (callCapture_) {
+            std::cout << "capture: " << callCapture_->frames()
+                      << " frames of calls written to "
+                      << options_.callCapturePath << "\n";
+            callCapture_.reset();
+        }
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            vkDestroyFence(device_, inFlightFences_[i], nullptr);
+            vkDestroySemaphore(device_, renderFinishedSemaphores_[i], nullptr);
+        }
+        if (statisticsQueryPool_ != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device_, statisticsQueryPool_, nullptr);
+        if (timestampQueryPool_ != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device_, timestampQueryPool_, nullptr);
         vkDestroyCommandPool(device_, commandPool_, nullptr);
-        for (size_t i = 0; i < swapChainImagesViews_.size(); i++) {
-            vkDestroyFramebuffer(device_, swapChainFramebuffers_[i], nullptr);
+        vkDestroyBuffer(device_, layerBuffer_, nullptr);
+        vkFreeMemory(device_, layerBufferMemory_, nullptr);
+        vkDestroyBuffer(device_, mesh_.indexBuffer, nullptr);
+        vkFreeMemory(device_, mesh_.indexMemory, nullptr);
+        vkDestroyBuffer(device_, mesh_.vertexBuffer, nullptr);
+        vkFreeMemory(device_, mesh_.vertexMemory, nullptr);
+        textureStreamer_.reset();
+        deletionQueue_.reset();
+        destroyTexture(texture_);
+        destroyOverlay();
+        for (auto &window : windows_) {
+            destroyWindowResources(window);
+        }
+        windows_.clear();
+        pipelineVariants_.reset();
+        for (const auto &entry : fastLinkedPipelines_) {
+            vkDestroyPipeline(device_, entry.second, nullptr);
         }
+        for (const auto &entry : pipelineLibraries_) {
+            vkDestroyPipeline(device_, entry.second, nullptr);
+        }
+        vkDestroyShaderModule(device_, fragShaderModule_, nullptr);
+        vkDestroyShaderModule(device_, vertShaderModule_, nullptr);
+        if (depthEqualPipeline_ != graphicsPipeline_)
+            vkDestroyPipeline(device_, depthEqualPipeline_, nullptr);
+        vkDestroyPipeline(device_, depthPrePassPipeline_, nullptr);
         vkDestroyPipeline(device_, graphicsPipeline_, nullptr);
+        vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
         vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+        uniformRing_.reset();
+        bindlessHeap_.reset();
+        vkDestroyRenderPass(device_, overlayRenderPass_, nullptr);
+        vkDestroyRenderPass(device_, scaledRenderPass_, nullptr);
         vkDestroyRenderPass(device_, renderPass_, nullptr);
-        for (auto imageView : swapChainImagesViews_) {
-            vkDestroyImageView(device_, imageView, nullptr);
-        }
-
-        vkDestroySwapchainKHR(device_, swapChain_, nullptr);
 #ifndef NDEBUG
         DestroyDebugUtilsMessengerEXT(instance_, debugMessenger_, nullptr);
 #endif
         vkDestroyDevice(device_, nullptr);
-        vkDestroySurfaceKHR(instance_, surface_, nullptr);
         vkDestroyInstance(instance_, nullptr);
 
-        glfwDestroyWindow(window_);
-
         glfwTerminate();
     }
 
+    void destroyWindowResources(Window &window)
+    {
+        for (auto semaphore : window.imageAvailableSemaphores) {
+            vkDestroySemaphore(device_, semaphore, nullptr);
+        }
+        for (auto framebuffer : window.framebuffers) {
+            vkDestroyFramebuffer(device_, framebuffer, nullptr);
+        }
+        for (auto framebuffer : window.overlayFramebuffers) {
+            vkDestroyFramebuffer(device_, framebuffer, nullptr);
+        }
+        for (auto &target : window.scaledTargets) {
+            destroyScaledTarget(target);
+        }
+        destroyTransientAttachment(window.depthAttachment);
+        destroyTransientAttachment(window.colorAttachment);
+        for (auto imageView : window.imageViews) {
+            vkDestroyImageView(device_, imageView, nullptr);
+        }
+
+        vkDestroySwapchainKHR(device_, window.swapChain, nullptr);
+        vkDestroySurfaceKHR(instance_, window.surface, nullptr);
+
+        glfwDestroyWindow(window.handle);
+    }
+
     static void populateDebugMessengerCreateInfo(
         VkDebugUtilsMessengerCreateInfoEXT &createInfo)
     {
@@ -318,7 +1339,8 @@ private:
         return requiredLayers.empty();
     }
 
-    static bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    static std::set<std::string>
+    availableDeviceExtensions(VkPhysicalDevice device)
     {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(
@@ -328,12 +1350,21 @@ private:
         vkEnumerateDeviceExtensionProperties(
             device, nullptr, &extensionCount, extensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(),
-                                                 deviceExtensions.end());
+        std::set<std::string> names;
         for (const auto &extension : extensions) {
-            requiredExtensions.erase(extension.extensionName);
+            names.insert(extension.extensionName);
+        }
+        return names;
+    }
+
+    static bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    {
+        std::set<std::string> available = availableDeviceExtensions(device);
+        for (const char *extension : deviceExtensions) {
+            if (!available.count(extension))
+                return false;
         }
-        return requiredExtensions.empty();
+        return true;
     }
 
     static void listAvailableExtensions()
@@ -361,6 +1392,7 @@ private:
 
     void createInstance()
     {
+        TRACE_ZONE("createInstance");
 #ifndef NDEBUG
         //----- check for validation layers if requested -----
         {
@@ -380,7 +1412,8 @@ private:
         applicationInfo.applicationVersion = VK_MAKE_API_VERSION(0, 1, 0, 0);
         applicationInfo.pEngineName = "No Engine";
         applicationInfo.engineVersion = VK_MAKE_API_VERSION(0, 1, 0, 0);
-        applicationInfo.apiVersion = VK_API_VERSION_1_0;
+        // 1.2 for descriptor indexing (bindless heap)
+        applicationInfo.apiVersion = VK_API_VERSION_1_2;
 
         //----- create InstanceCreateInfo struct and check for required
         // instanceExtensions -----
@@ -415,38 +1448,40 @@ private:
         }
     }
 
-    void createSurface()
+    void createSurface(Window &window)
     {
-        if (glfwCreateWindowSurface(instance_, window_, nullptr, &surface_)
+        TRACE_ZONE("createSurface");
+        if (glfwCreateWindowSurface(
+                instance_, window.handle, nullptr, &window.surface)
             != VK_SUCCESS) {
             throw std::runtime_error("Failed to create window surface!");
         }
     }
 
-    SwapChainSupportDetails
-    querySwapChainSupport(VkPhysicalDevice physicalDevice)
+    static SwapChainSupportDetails
+    querySwapChainSupport(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
     {
         SwapChainSupportDetails details;
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-            physicalDevice, surface_, &details.capabilities);
+            physicalDevice, surface, &details.capabilities);
 
         uint32_t formatCount;
         vkGetPhysicalDeviceSurfaceFormatsKHR(
-            physicalDevice, surface_, &formatCount, nullptr);
+            physicalDevice, surface, &formatCount, nullptr);
         if (formatCount != 0) {
             details.formats.resize(formatCount);
             vkGetPhysicalDeviceSurfaceFormatsKHR(
-                physicalDevice, surface_, &formatCount, details.formats.data());
+                physicalDevice, surface, &formatCount, details.formats.data());
         }
 
         uint32_t presentModeCount;
         vkGetPhysicalDeviceSurfacePresentModesKHR(
-            physicalDevice, surface_, &presentModeCount, nullptr);
+            physicalDevice, surface, &presentModeCount, nullptr);
         if (presentModeCount != 0) {
             details.presentModes.resize(presentModeCount);
             vkGetPhysicalDeviceSurfacePresentModesKHR(
                 physicalDevice,
-                surface_,
+                surface,
                 &presentModeCount,
                 details.presentModes.data());
         }
@@ -456,6 +1491,7 @@ private:
 
     void pickPhysicalDevice()
     {
+        TRACE_ZONE("pickPhysicalDevice");
         uint32_t deviceCount = 0;
         if (vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr)
             != VK_SUCCESS)
@@ -471,7 +1507,7 @@ private:
             throw std::runtime_error("Could not enumerate physical Devices!");
 
         for (const auto &device : devices) {
-            if (isDeviceSuitable(device, surface_)) {
+            if (isDeviceSuitable(device, windows_.front().surface)) {
                 physicalDevice_ = device;
                 break;
             }
@@ -479,6 +1515,26 @@ private:
         if (physicalDevice_ == VK_NULL_HANDLE) {
             throw std::runtime_error("Failed to find suitable GPU!");
         }
+
+        msaaSamples_ = getMaxUsableSampleCount(options_.msaaSamples);
+    }
+
+    VkSampleCountFlagBits getMaxUsableSampleCount(uint32_t requestedSamples)
+    {
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice_,
+                                      &physicalDeviceProperties);
+
+        VkSampleCountFlags counts =
+            physicalDeviceProperties.limits.framebufferColorSampleCounts
+            & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+
+        // Highest supported count that does not exceed the requested one
+        for (uint32_t samples = requestedSamples; samples > 1; samples >>= 1) {
+            if (counts & samples)
+                return static_cast<VkSampleCountFlagBits>(samples);
+        }
+        return VK_SAMPLE_COUNT_1_BIT;
     }
 
     static QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device,
@@ -512,6 +1568,17 @@ private:
             i++;
         }
 
+        // Transfer-only families map to the copy engines of discrete GPUs
+        indices.transferFamily = indices.graphicsFamily;
+        for (i = 0; i < queueFamilyCount; i++) {
+            VkQueueFlags flags = queueFamilies[i].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT)
+                && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                indices.transferFamily = i;
+                break;
+            }
+        }
+
         return indices;
     }
 
@@ -524,11 +1591,12 @@ private:
         bool swapChainAdequate = false;
         if (extensionsSupported) {
             SwapChainSupportDetails swapChainSupport =
-                querySwapChainSupport(device);
+                querySwapChainSupport(device, surface);
             swapChainAdequate = !swapChainSupport.presentModes.empty()
                 && !swapChainSupport.formats.empty();
         }
-        return indices.isComplete() && extensionsSupported && swapChainAdequate;
+        return indices.isComplete() && extensionsSupported && swapChainAdequate
+            && BindlessHeap::isSupported(device);
     }
 
     static uint32_t rateDeviceSuitability(VkPhysicalDevice device)
@@ -553,12 +1621,16 @@ private:
 
     void createLogicalDevice()
     {
+        TRACE_ZONE("createLogicalDevice");
         QueueFamilyIndices indices =
-            findQueueFamilies(physicalDevice_, surface_);
+            findQueueFamilies(physicalDevice_, windows_.front().surface);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies{ indices.graphicsFamily.value(),
-                                                indices.presentFamily.value() };
+        std::set<uint32_t> uniqueQueueFamilies{
+            indices.graphicsFamily.value(),
+            indices.presentFamily.value(),
+            indices.transferFamily.value()
+        };
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -573,7 +1645,15 @@ private:
             queueCreateInfos.emplace_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice_, &supportedFeatures);
+
+        // Needed to count shader invocations (overdraw, vertex reuse)
         VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.pipelineStatisticsQuery =
+            supportedFeatures.pipelineStatisticsQuery;
+        pipelineStatisticsSupported_ =
+            supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
 
         VkDeviceCreateInfo deviceCreateInfo{};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -581,10 +1661,113 @@ private:
         deviceCreateInfo.queueCreateInfoCount =
             static_cast<uint32_t>(queueCreateInfos.size());
 
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        BindlessHeap::requiredFeatures(features12);
+
+        // Optional: pipeline libraries link material variants from
+        // precompiled parts instead of compiling whole pipelines, and
+        // extended dynamic state sets per draw what would otherwise take a
+        // pipeline per combination
+        std::set<std::string> available =
+            availableDeviceExtensions(physicalDevice_);
+        bool libraries = !options_.monolithicPipelines
+            && options_.callCapturePath.empty()
+            && available.count(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)
+            && available.count(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        bool dynamicState = !options_.staticState
+            && available.count(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        bool dynamicState2 = !options_.staticState
+            && available.count(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+        bool dynamicState3 = !options_.staticState
+            && available.count(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        bool memoryBudget =
+            available.count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) > 0;
+        bool calibratedTimestamps =
+            available.count(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)
+            && calibrateableTimeDomain(VK_TIME_DOMAIN_DEVICE_EXT)
+            && calibrateableTimeDomain(VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT);
+
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+        libraryFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicFeatures{};
+        dynamicFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicFeatures2{};
+        dynamicFeatures2.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicFeatures3{};
+        dynamicFeatures3.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+        // The feature structures of the available extensions are queried,
+        // then those in use are chained again to enable them
+        void **next = nullptr;
+        auto chain = [&next](auto &features) {
+            *next = &features;
+            next = &features.pNext;
+        };
+
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        next = &features2.pNext;
+        if (libraries)
+            chain(libraryFeatures);
+        if (dynamicState)
+            chain(dynamicFeatures);
+        if (dynamicState2)
+            chain(dynamicFeatures2);
+        if (dynamicState3)
+            chain(dynamicFeatures3);
+        *next = nullptr;
+        vkGetPhysicalDeviceFeatures2(physicalDevice_, &features2);
+
+        pipelineLibrarySupported_ =
+            libraries && libraryFeatures.graphicsPipelineLibrary;
+        DrawStateRecorder::Support dynamicSupport;
+        dynamicSupport.extendedDynamicState =
+            dynamicState && dynamicFeatures.extendedDynamicState;
+        dynamicSupport.extendedDynamicState2 =
+            dynamicState2 && dynamicFeatures2.extendedDynamicState2;
+        dynamicSupport.extendedDynamicState3Blend = dynamicState3
+            && dynamicFeatures3.extendedDynamicState3ColorBlendEnable
+            && dynamicFeatures3.extendedDynamicState3ColorBlendEquation;
+
+        std::vector<const char *> extensions = deviceExtensions;
+        next = &features12.pNext;
+        if (pipelineLibrarySupported_) {
+            extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            extensions.push_back(
+                VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            chain(libraryFeatures);
+        }
+        if (dynamicSupport.extendedDynamicState) {
+            extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+            chain(dynamicFeatures);
+        }
+        if (dynamicSupport.extendedDynamicState2) {
+            extensions.push_back(
+                VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+            chain(dynamicFeatures2);
+        }
+        if (dynamicSupport.extendedDynamicState3Blend) {
+            extensions.push_back(
+                VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+            chain(dynamicFeatures3);
+        }
+        *next = nullptr;
+        if (calibratedTimestamps)
+            extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        if (memoryBudget)
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+        deviceCreateInfo.pNext = &features12;
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
         deviceCreateInfo.enabledExtensionCount =
-            static_cast<uint32_t>(deviceExtensions.size());
-        deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+            static_cast<uint32_t>(extensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
 #ifndef NDEBUG
         deviceCreateInfo.enabledLayerCount =
@@ -602,6 +1785,49 @@ private:
             device_, indices.graphicsFamily.value(), 0, &graphicsQueue_);
         vkGetDeviceQueue(
             device_, indices.presentFamily.value(), 0, &presentQueue_);
+        vkGetDeviceQueue(
+            device_, indices.transferFamily.value(), 0, &transferQueue_);
+        graphicsFamily_ = indices.graphicsFamily.value();
+        transferFamily_ = indices.transferFamily.value();
+
+        MemoryBudget::Watermarks watermarks;
+        watermarks.high = options_.memoryHighWatermark;
+        watermarks.critical = options_.memoryCriticalWatermark;
+        memoryBudget_ = std::make_unique<MemoryBudget>(
+            physicalDevice_, memoryBudget, watermarks);
+        deletionQueue_ = std::make_unique<DeletionQueue>(device_);
+
+        stateRecorder_ =
+            std::make_unique<DrawStateRecorder>(device_, dynamicSupport);
+        if (!options_.callCapturePath.empty()) {
+            callCapture_ = std::make_unique<CallCapture>(
+                options_.callCapturePath, dynamicSupport);
+            stateRecorder_->setCapture(callCapture_.get());
+        }
+        if (calibratedTimestamps)
+            getCalibratedTimestamps_ =
+                reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+                    vkGetDeviceProcAddr(device_,
+                                        "vkGetCalibratedTimestampsEXT"));
+    }
+
+    // Whether VK_EXT_calibrated_timestamps can sample domain. Tracer::now()
+    // is on the steady clock, CLOCK_MONOTONIC on Linux.
+    bool calibrateableTimeDomain(VkTimeDomainEXT domain) const
+    {
+        using GetDomains = PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT;
+        auto getTimeDomains = reinterpret_cast<GetDomains>(
+            vkGetInstanceProcAddr(
+                instance_, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+        if (!getTimeDomains)
+            return false;
+
+        uint32_t count = 0;
+        getTimeDomains(physicalDevice_, &count, nullptr);
+        std::vector<VkTimeDomainEXT> domains(count);
+        getTimeDomains(physicalDevice_, &count, domains.data());
+        return std::find(domains.begin(), domains.end(), domain)
+            != domains.end();
     }
 
     static VkSurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -626,7 +1852,9 @@ private:
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
-    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities)
+    static VkExtent2D
+    chooseSwapExtent(const Window &window,
+                     const VkSurfaceCapabilitiesKHR &capabilities)
     {
         if (capabilities.currentExtent.height
                 != std::numeric_limits<uint32_t>::max()
@@ -634,10 +1862,7 @@ private:
                 != std::numeric_limits<uint32_t>::max())
             return capabilities.currentExtent;
 
-        int width, height;
-        glfwGetFramebufferSize(window_, &width, &height);
-        VkExtent2D actualExtent{ static_cast<uint32_t>(width),
-                                 static_cast<uint32_t>(height) };
+        VkExtent2D actualExtent = window.framebufferSize;
 
         actualExtent.width = std::clamp(actualExtent.width,
                                         capabilities.minImageExtent.width,
@@ -649,17 +1874,72 @@ private:
         return actualExtent;
     }
 
-    void createSwapChain()
+    // The render pass and pipelines are shared, so every swap chain uses the
+    // format picked for the first window
+    void selectSurfaceFormat()
     {
+        TRACE_ZONE("selectSurfaceFormat");
         SwapChainSupportDetails swapChainSupportDetails =
-            querySwapChainSupport(physicalDevice_);
-
-        VkSurfaceFormatKHR surfaceFormat =
+            querySwapChainSupport(physicalDevice_, windows_.front().surface);
+        surfaceFormat_ =
             chooseSwapSurfaceFormat(swapChainSupportDetails.formats);
+    }
+
+    void createWindowResources(Window &window)
+    {
+        TRACE_ZONE("createWindowResources");
+        createSwapChain(window);
+        createImageViews(window);
+        createColorResources(window);
+        createDepthResources(window);
+        createFramebuffers(window);
+        if (resolutionController_)
+            createScaledTargets(window);
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        window.imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        for (auto &semaphore : window.imageAvailableSemaphores) {
+            if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &semaphore)
+                != VK_SUCCESS)
+                throw std::runtime_error("failed to create sync objects!");
+        }
+    }
+
+    void createSwapChain(Window &window)
+    {
+        QueueFamilyIndices indices =
+            findQueueFamilies(physicalDevice_, windows_.front().surface);
+
+        // All windows are presented from the queue picked for the first one
+        VkBool32 presentSupport = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice_,
+                                             indices.presentFamily.value(),
+                                             window.surface,
+                                             &presentSupport);
+        if (!presentSupport)
+            throw std::runtime_error(
+                "window cannot be presented from the present queue!");
+
+        SwapChainSupportDetails swapChainSupportDetails =
+            querySwapChainSupport(physicalDevice_, window.surface);
+
+        if (std::none_of(swapChainSupportDetails.formats.begin(),
+                         swapChainSupportDetails.formats.end(),
+                         [this](const VkSurfaceFormatKHR &format) {
+                             return format.format == surfaceFormat_.format
+                                 && format.colorSpace
+                                 == surfaceFormat_.colorSpace;
+                         }))
+            throw std::runtime_error(
+                "window does not support the shared swap chain format!");
+
+        VkSurfaceFormatKHR surfaceFormat = surfaceFormat_;
         VkPresentModeKHR presentMode =
             chooseSwapPresentMode(swapChainSupportDetails.presentModes);
         VkExtent2D extent2D =
-            chooseSwapExtent(swapChainSupportDetails.capabilities);
+            chooseSwapExtent(window, swapChainSupportDetails.capabilities);
 
         uint32_t imageCount =
             swapChainSupportDetails.capabilities.minImageCount + 1;
@@ -671,16 +1951,31 @@ private:
         VkSwapchainCreateInfoKHR createInfo{};
 
         createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface_;
+        createInfo.surface = window.surface;
         createInfo.minImageCount = imageCount;
         createInfo.imageFormat = surfaceFormat.format;
         createInfo.imageColorSpace = surfaceFormat.colorSpace;
         createInfo.imageExtent = extent2D;
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (!options_.capturePath.empty()) {
+            // Frames are copied out of the swap chain images
+            if (!(swapChainSupportDetails.capabilities.supportedUsageFlags
+                  & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+                throw std::runtime_error(
+                    "swap chain images cannot be captured on this surface!");
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+        if (resolutionController_) {
+            // The scene is blitted into the swap chain images
+            if (!(swapChainSupportDetails.capabilities.supportedUsageFlags
+                  & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+                throw std::runtime_error(
+                    "swap chain images cannot be upscaled into on this "
+                    "surface!");
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
 
-        QueueFamilyIndices indices =
-            findQueueFamilies(physicalDevice_, surface_);
         uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(),
                                           indices.presentFamily.value() };
 
@@ -702,44 +1997,241 @@ private:
         createInfo.clipped = VK_TRUE;
         createInfo.oldSwapchain = VK_NULL_HANDLE;
 
-        if (vkCreateSwapchainKHR(device_, &createInfo, nullptr, &swapChain_)
+        if (vkCreateSwapchainKHR(
+                device_, &createInfo, nullptr, &window.swapChain)
             != VK_SUCCESS) {
             throw std::runtime_error("Failed to create swap chain!");
         }
 
-        vkGetSwapchainImagesKHR(device_, swapChain_, &imageCount, nullptr);
-        swapChainImages_.resize(imageCount);
         vkGetSwapchainImagesKHR(
-            device_, swapChain_, &imageCount, swapChainImages_.data());
-
-        swapChainImageFormat_ = surfaceFormat.format;
-        swapChainExtent_ = extent2D;
-    }
-
-    void createImageViews()
-    {
-        swapChainImagesViews_.resize(swapChainImages_.size());
-        for (size_t i = 0; i < swapChainImages_.size(); i++) {
-            VkImageViewCreateInfo createInfo{};
-            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            createInfo.image = swapChainImages_[i];
-            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            createInfo.format = swapChainImageFormat_;
-            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            createInfo.subresourceRange.baseMipLevel = 0;
-            createInfo.subresourceRange.levelCount = 1;
-            createInfo.subresourceRange.baseArrayLayer = 0;
-            createInfo.subresourceRange.layerCount = 1;
-
-            if (vkCreateImageView(
-                    device_, &createInfo, nullptr, &swapChainImagesViews_[i])
-                != VK_SUCCESS)
-                throw std::runtime_error("failed to create image views!");
-        }
+            device_, window.swapChain, &imageCount, nullptr);
+        window.images.resize(imageCount);
+        vkGetSwapchainImagesKHR(
+            device_, window.swapChain, &imageCount, window.images.data());
+
+        if (callCapture_) {
+            // Replayed as images of their own, like other attachments
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = createInfo.imageFormat;
+            imageInfo.extent = { extent2D.width, extent2D.height, 1 };
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = createInfo.imageArrayLayers;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = createInfo.imageUsage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            for (VkImage image : window.images) {
+                callCapture_->image(image, imageInfo);
+            }
+        }
+
+        window.extent = extent2D;
+        window.presentMode = presentMode;
+    }
+
+    VkImageView createImageView(VkImage image,
+                                VkFormat format,
+                                VkImageAspectFlags aspectFlags)
+    {
+        VkImageViewCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = image;
+        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        createInfo.format = format;
+        createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.subresourceRange.aspectMask = aspectFlags;
+        createInfo.subresourceRange.baseMipLevel = 0;
+        createInfo.subresourceRange.levelCount = 1;
+        createInfo.subresourceRange.baseArrayLayer = 0;
+        createInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device_, &createInfo, nullptr, &imageView)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create image views!");
+
+        if (callCapture_)
+            callCapture_->imageView(imageView, createInfo);
+        return imageView;
+    }
+
+    void createImageViews(Window &window)
+    {
+        window.imageViews.resize(window.images.size());
+        for (size_t i = 0; i < window.images.size(); i++) {
+            window.imageViews[i] = createImageView(window.images[i],
+                                                   surfaceFormat_.format,
+                                                   VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    }
+
+    std::optional<uint32_t>
+    findMemoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+    {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memoryProperties);
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i))
+                && (memoryProperties.memoryTypes[i].propertyFlags & properties)
+                    == properties)
+                return i;
+        }
+        return std::nullopt;
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter,
+                            VkMemoryPropertyFlags properties)
+    {
+        std::optional<uint32_t> memoryType =
+            findMemoryTypeIndex(typeFilter, properties);
+        if (!memoryType.has_value())
+            throw std::runtime_error("failed to find suitable memory type!");
+        return memoryType.value();
+    }
+
+    // Allocates from a memory type that also has the preferred properties
+    // when possible. Returns the properties of the memory type used.
+    VkMemoryPropertyFlags
+    createBuffer(VkDeviceSize size,
+                 VkBufferUsageFlags usage,
+                 VkMemoryPropertyFlags properties,
+                 VkBuffer &buffer,
+                 VkDeviceMemory &bufferMemory,
+                 VkMemoryPropertyFlags preferredProperties = 0)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create buffer!");
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
+
+        std::optional<uint32_t> memoryType = findMemoryTypeIndex(
+            memRequirements.memoryTypeBits, properties | preferredProperties);
+        if (!memoryType.has_value())
+            memoryType =
+                findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType.value();
+
+        if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate buffer memory!");
+
+        vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memoryProperties);
+        VkMemoryPropertyFlags used =
+            memoryProperties.memoryTypes[memoryType.value()].propertyFlags;
+        if (callCapture_)
+            callCapture_->buffer(buffer, size, usage, used);
+        return used;
+    }
+
+    VkImage createImage(uint32_t width,
+                        uint32_t height,
+                        VkSampleCountFlagBits numSamples,
+                        VkFormat format,
+                        VkImageTiling tiling,
+                        VkImageUsageFlags usage)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = numSamples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkImage image;
+        if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS)
+            throw std::runtime_error("failed to create image!");
+
+        if (callCapture_)
+            callCapture_->image(image, imageInfo);
+        return image;
+    }
+
+    // Creates an attachment image that is never loaded nor stored and backs
+    // it with lazily allocated memory when the device exposes such a memory
+    // type, so tiled GPUs can keep it in on-chip memory.
+    TransientAttachment createTransientAttachment(VkExtent2D extent,
+                                                  VkSampleCountFlagBits samples,
+                                                  VkFormat format,
+                                                  VkImageUsageFlags usage,
+                                                  VkImageAspectFlags aspect)
+    {
+        TransientAttachment attachment{};
+        attachment.image = createImage(extent.width,
+                                       extent.height,
+                                       samples,
+                                       format,
+                                       VK_IMAGE_TILING_OPTIMAL,
+                                       VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT
+                                           | usage);
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(
+            device_, attachment.image, &memRequirements);
+
+        std::optional<uint32_t> memoryType = findMemoryTypeIndex(
+            memRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+        attachment.lazilyAllocated = memoryType.has_value();
+        if (!attachment.lazilyAllocated)
+            memoryType = findMemoryType(memRequirements.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType.value();
+
+        if (vkAllocateMemory(device_, &allocInfo, nullptr, &attachment.memory)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate image memory!");
+
+        vkBindImageMemory(device_, attachment.image, attachment.memory, 0);
+
+        attachment.size = memRequirements.size;
+        attachment.view = createImageView(attachment.image, format, aspect);
+        return attachment;
+    }
+
+    void destroyTransientAttachment(TransientAttachment &attachment)
+    {
+        if (attachment.image == VK_NULL_HANDLE)
+            return;
+
+        vkDestroyImageView(device_, attachment.view, nullptr);
+        vkDestroyImage(device_, attachment.image, nullptr);
+        vkFreeMemory(device_, attachment.memory, nullptr);
+        attachment = TransientAttachment{};
     }
 
     VkShaderModule createShaderModule(const std::vector<char> &code)
@@ -755,26 +2247,256 @@ private:
             != VK_SUCCESS) {
             throw std::runtime_error("failed to create shader module!");
         }
+        if (callCapture_)
+            callCapture_->shaderModule(shaderModule, code.data(), code.size());
         return shaderModule;
     }
 
-    void createRenderPass()
+    void createColorResources(Window &window)
+    {
+        if (msaaSamples_ == VK_SAMPLE_COUNT_1_BIT)
+            return;
+
+        // The multisampled image only lives inside the render pass: it is
+        // cleared on load, resolved into the swap chain image and never
+        // stored, so it can be transient.
+        window.colorAttachment =
+            createTransientAttachment(window.extent,
+                                      msaaSamples_,
+                                      surfaceFormat_.format,
+                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                                      VK_IMAGE_ASPECT_COLOR_BIT);
+
+        reportTransientMemory("MSAA colour target", window.colorAttachment);
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates,
+                                 VkImageTiling tiling,
+                                 VkFormatFeatureFlags features)
+    {
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(
+                physicalDevice_, format, &props);
+
+            if (tiling == VK_IMAGE_TILING_LINEAR
+                && (props.linearTilingFeatures & features) == features)
+                return format;
+            if (tiling == VK_IMAGE_TILING_OPTIMAL
+                && (props.optimalTilingFeatures & features) == features)
+                return format;
+        }
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    VkFormat findDepthFormat()
+    {
+        return findSupportedFormat(
+            { VK_FORMAT_D32_SFLOAT,
+              VK_FORMAT_D32_SFLOAT_S8_UINT,
+              VK_FORMAT_D24_UNORM_S8_UINT },
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    }
+
+    void createDepthResources(Window &window)
+    {
+        // Depth is only needed while rendering: cleared on load, never stored
+        window.depthAttachment = createTransientAttachment(
+            window.extent,
+            msaaSamples_,
+            depthFormat_,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        reportTransientMemory("depth buffer", window.depthAttachment);
+    }
+
+    void reportTransientMemory(const char *name,
+                               const TransientAttachment &attachment)
     {
+        if (attachment.image == VK_NULL_HANDLE)
+            return;
+
+        constexpr double mebibyte = 1024.0 * 1024.0;
+
+        std::cout << name << " (" << msaaSamples_ << "x): ";
+        if (!attachment.lazilyAllocated) {
+            std::cout << attachment.size / mebibyte
+                      << " MiB of device local memory (no lazily allocated "
+                         "memory type available)\n";
+            return;
+        }
+
+        VkDeviceSize committed = 0;
+        vkGetDeviceMemoryCommitment(device_, attachment.memory, &committed);
+        std::cout << attachment.size / mebibyte << " MiB requested, "
+                  << committed / mebibyte << " MiB committed, "
+                  << (attachment.size - committed) / mebibyte
+                  << " MiB saved by lazy allocation\n";
+    }
+
+    void reportTransientMemory()
+    {
+        for (const auto &window : windows_) {
+            reportTransientMemory("MSAA colour target", window.colorAttachment);
+            reportTransientMemory("depth buffer", window.depthAttachment);
+        }
+    }
+
+    // finalLayout is that of the single-sample colour attachment, presented
+    // by default
+    VkRenderPass createRenderPass(
+        VkFormat colorFormat,
+        VkSampleCountFlagBits samples,
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) const
+    {
+        bool multisampled = samples != VK_SAMPLE_COUNT_1_BIT;
+
         // Attachment description
 
         VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat_;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.format = colorFormat;
+        colorAttachment.samples = samples;
         colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        // With MSAA only the resolved image has to reach memory
+        colorAttachment.storeOp = multisampled
+            ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+            : VK_ATTACHMENT_STORE_OP_STORE;
 
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
         colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachment.finalLayout = multisampled
+            ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+            : finalLayout;
+
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = depthFormat_;
+        depthAttachment.samples = samples;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentDescription colorAttachmentResolve{};
+        colorAttachmentResolve.format = colorFormat;
+        colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachmentResolve.stencilStoreOp =
+            VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachmentResolve.finalLayout = finalLayout;
+
+        VkAttachmentDescription attachments[] = { colorAttachment,
+                                                  depthAttachment,
+                                                  colorAttachmentResolve };
+
+        // Subpasses: optional depth-only pre-pass, then the colour pass
 
-        // Subpass: only one subpass
+        VkAttachmentReference colorAttachmentRef{};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentResolveRef{};
+        colorAttachmentResolveRef.attachment = 2;
+        colorAttachmentResolveRef.layout =
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpasses[2]{};
+
+        // When the pre-pass is disabled this subpass is entered but empty
+        VkSubpassDescription &depthPrePass = subpasses[DEPTH_PREPASS_SUBPASS];
+        depthPrePass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        depthPrePass.colorAttachmentCount = 0;
+        depthPrePass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        VkSubpassDescription &colorPass = subpasses[COLOR_SUBPASS];
+        colorPass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        colorPass.colorAttachmentCount = 1;
+        colorPass.pColorAttachments = &colorAttachmentRef;
+        colorPass.pResolveAttachments =
+            multisampled ? &colorAttachmentResolveRef : nullptr;
+        colorPass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        VkRenderPassCreateInfo renderPassCreateInfo{};
+        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassCreateInfo.attachmentCount = multisampled ? 3 : 2;
+        renderPassCreateInfo.pAttachments = attachments;
+        renderPassCreateInfo.subpassCount = 2;
+        renderPassCreateInfo.pSubpasses = subpasses;
+
+        VkSubpassDependency dependencies[2]{};
+
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = DEPTH_PREPASS_SUBPASS;
+        dependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+            | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        // The previous frame's blit may still read an image left to blit
+        if (finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+            dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[0].srcAccessMask =
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+            | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // Depth written by the pre-pass is tested by the colour pass
+        dependencies[1].srcSubpass = DEPTH_PREPASS_SUBPASS;
+        dependencies[1].dstSubpass = COLOR_SUBPASS;
+        dependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask =
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask =
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstAccessMask =
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+        renderPassCreateInfo.dependencyCount = 2;
+        renderPassCreateInfo.pDependencies = dependencies;
+
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(
+                device_, &renderPassCreateInfo, nullptr, &renderPass)
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+        if (callCapture_)
+            callCapture_->renderPass(renderPass, renderPassCreateInfo);
+        return renderPass;
+    }
+
+    // Draws over the presentable image the main render pass left behind,
+    // whether or not that pass was multisampled
+    VkRenderPass createOverlayRenderPass(VkFormat colorFormat) const
+    {
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = colorFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkAttachmentReference colorAttachmentRef{};
         colorAttachmentRef.attachment = 0;
@@ -785,39 +2507,707 @@ private:
         subpass.colorAttachmentCount = 1;
         subpass.pColorAttachments = &colorAttachmentRef;
 
-        VkRenderPassCreateInfo renderPassCreateInfo{};
-        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassCreateInfo.attachmentCount = 1;
-        renderPassCreateInfo.pAttachments = &colorAttachment;
-        renderPassCreateInfo.subpassCount = 1;
-        renderPassCreateInfo.pSubpasses = &subpass;
-
+        // The main render pass wrote the image
         VkSubpassDependency dependency{};
         dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
         dependency.dstSubpass = 0;
         dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
         dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+        VkRenderPassCreateInfo renderPassCreateInfo{};
+        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassCreateInfo.attachmentCount = 1;
+        renderPassCreateInfo.pAttachments = &colorAttachment;
+        renderPassCreateInfo.subpassCount = 1;
+        renderPassCreateInfo.pSubpasses = &subpass;
         renderPassCreateInfo.dependencyCount = 1;
         renderPassCreateInfo.pDependencies = &dependency;
 
+        VkRenderPass renderPass;
         if (vkCreateRenderPass(
-                device_, &renderPassCreateInfo, nullptr, &renderPass_)
+                device_, &renderPassCreateInfo, nullptr, &renderPass)
             != VK_SUCCESS) {
-            throw std::runtime_error("failed to create render pass!");
+            throw std::runtime_error("failed to create overlay render pass!");
         }
+        if (callCapture_)
+            callCapture_->renderPass(renderPass, renderPassCreateInfo);
+        return renderPass;
+    }
+
+    // Pipelines created for any window (or variant) reuse each other's
+    // compiled state through this cache
+    void createPipelineCache()
+    {
+        TRACE_ZONE("createPipelineCache");
+        pipelineCache_ = createEmptyPipelineCache();
+    }
+
+    VkPipelineCache createEmptyPipelineCache() const
+    {
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+
+        VkPipelineCache cache;
+        if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &cache)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create pipeline cache!");
+        return cache;
     }
 
     void createGraphicPipeline()
     {
-        auto vertShaderCode = readFile(shaderPath / "triangle_vert.spv");
+        TRACE_ZONE("createGraphicPipeline");
+        auto vertShaderCode =
+            readFile(shaderPath
+                     / (options_.meshPath.empty() ? "triangle_vert.spv"
+                                                  : "mesh_vert.spv"));
         auto fragShaderCode = readFile(shaderPath / "triangle_frag.spv");
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        vertShaderModule_ = createShaderModule(vertShaderCode);
+        fragShaderModule_ = createShaderModule(fragShaderCode);
+
+        // Pipeline layout
+
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+        pipelineLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        // Set 0 is the bindless heap, draws pick resources by index
+        // set 1 is the uniform ring, reached through dynamic offsets
+        VkDescriptorSetLayout setLayouts[] = { bindlessHeap_->layout(),
+                                               uniformRing_->layout() };
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags =
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(DrawConstants);
+
+        pipelineLayoutCreateInfo.setLayoutCount = 2;
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(
+                device_, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout_)
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+        if (callCapture_)
+            callCapture_->pipelineLayout(pushConstantRange.stageFlags,
+                                         pushConstantRange.size);
+
+        if (options_.pipelineVariants)
+            reportPipelineVariants(vertShaderModule_, fragShaderModule_);
+
+        passStates_ = passStates(renderPass_, msaaSamples_);
+        std::vector<VkPipeline> pipelines =
+            createPipelines(passStates_, vertShaderModule_, fragShaderModule_);
+        graphicsPipeline_ = pipelines[0];
+        depthPrePassPipeline_ = pipelines[1];
+        depthEqualPipeline_ = pipelines[2];
+
+        const DrawStateRecorder::Support &support = stateRecorder_->support();
+        std::cout << "dynamic state:"
+                  << (support.extendedDynamicState
+                          ? " cull mode, front face, topology, depth"
+                          : "")
+                  << (support.extendedDynamicState2
+                          ? " depth bias, primitive restart"
+                          : "")
+                  << (support.extendedDynamicState3Blend ? " blending" : "")
+                  << (stateRecorder_->dynamicStates().size() == 2
+                          ? " viewport and scissor only"
+                          : "")
+                  << "; "
+                  << (depthEqualPipeline_ == graphicsPipeline_ ? 2 : 3)
+                  << " pipelines for the 3 passes\n";
+
+        if (options_.genericPipeline)
+            return;
+        pipelineVariants_ = std::make_unique<PipelineVariants>(device_);
+        if (pipelineLibrarySupported_)
+            createPipelineLibraries();
+    }
+
+    // Compiles the parts of every material variant of the colour passes,
+    // so that linking one at draw time never compiles a shader
+    void createPipelineLibraries()
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t pass : { 0, 2 }) {
+            for (uint32_t material = 0; material < MATERIAL_COUNT; material++) {
+                PipelineState variant = passStates_[pass];
+                variant.material = material;
+                pipelineLibraryParts(variant);
+            }
+        }
+        double libraryMs = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+        std::cout << "pipeline libraries: " << pipelineLibraries_.size()
+                  << " compiled in " << libraryMs << " ms\n";
+
+        if (options_.pipelineVariants)
+            reportLinkLatency();
+    }
+
+    static constexpr VkGraphicsPipelineLibraryFlagBitsEXT LIBRARY_PARTS[] = {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+    };
+
+    // The fields of state that part depends on, the others left at their
+    // defaults so that variants differing only there share the library
+    static PipelineState
+    libraryState(const PipelineState &state,
+                 VkGraphicsPipelineLibraryFlagBitsEXT part)
+    {
+        PipelineState partState{};
+        partState.dynamicState = state.dynamicState;
+        switch (part) {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+            partState.topology = state.topology;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            partState.renderPass = state.renderPass;
+            partState.subpass = state.subpass;
+            partState.cullMode = state.cullMode;
+            partState.frontFace = state.frontFace;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            partState = state;
+            partState.blendMode = BlendMode::REPLACE;
+            break;
+        default:
+            partState = state;
+            partState.depthCompareOp = VK_COMPARE_OP_LESS;
+            partState.depthWriteEnable = VK_TRUE;
+            partState.material = MATERIAL_GENERIC;
+            break;
+        }
+        return partState;
+    }
+
+    // Render thread. The four libraries of state, each compiled on first
+    // use only.
+    std::array<VkPipeline, 4> pipelineLibraryParts(const PipelineState &state)
+    {
+        std::array<VkPipeline, 4> libraries;
+        for (size_t i = 0; i < libraries.size(); i++) {
+            PipelineState partState = libraryState(state, LIBRARY_PARTS[i]);
+            uint64_t key = hashPipelineState(partState, LIBRARY_PARTS[i]);
+            auto it = pipelineLibraries_.find(key);
+            if (it == pipelineLibraries_.end()) {
+                VkPipeline library = createPipeline(partState,
+                                                    vertShaderModule_,
+                                                    fragShaderModule_,
+                                                    pipelineCache_,
+                                                    LIBRARY_PARTS[i]);
+                it = pipelineLibraries_.emplace(key, library).first;
+            }
+            libraries[i] = it->second;
+        }
+        return libraries;
+    }
+
+    // Fast linking only combines the compiled parts; link-time optimisation
+    // compiles the stages together again, for a pipeline as fast as a
+    // monolithic one
+    VkPipeline linkPipeline(const std::array<VkPipeline, 4> &libraries,
+                            bool optimize) const
+    {
+        VkPipelineLibraryCreateInfoKHR libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+        libraryInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+        libraryInfo.pLibraries = libraries.data();
+
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+        pipelineCreateInfo.sType =
+            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineCreateInfo.pNext = &libraryInfo;
+        if (optimize)
+            pipelineCreateInfo.flags =
+                VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+        pipelineCreateInfo.layout = pipelineLayout_;
+        pipelineCreateInfo.basePipelineIndex = -1;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device_,
+                                      pipelineCache_,
+                                      1,
+                                      &pipelineCreateInfo,
+                                      nullptr,
+                                      &pipeline)
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to link graphics pipeline!");
+        }
+        return pipeline;
+    }
+
+    // Creation latency of each material variant of the colour pass, as a
+    // whole pipeline without a cache and linked from the libraries
+    void reportLinkLatency()
+    {
+        double monolithicSeconds = 0.0;
+        double fastLinkSeconds = 0.0;
+        double optimizedSeconds = 0.0;
+        auto measure = [](double &seconds, auto &&create) {
+            auto start = std::chrono::steady_clock::now();
+            VkPipeline pipeline = create();
+            seconds += std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+            return pipeline;
+        };
+
+        std::vector<VkPipeline> pipelines;
+        for (uint32_t material = 0; material < MATERIAL_COUNT; material++) {
+            PipelineState variant = passStates_[0];
+            variant.material = material;
+            std::array<VkPipeline, 4> libraries = pipelineLibraryParts(variant);
+
+            pipelines.push_back(measure(monolithicSeconds, [&] {
+                return createPipeline(variant,
+                                      vertShaderModule_,
+                                      fragShaderModule_,
+                                      VK_NULL_HANDLE);
+            }));
+            pipelines.push_back(measure(fastLinkSeconds, [&] {
+                return linkPipeline(libraries, false);
+            }));
+            pipelines.push_back(measure(optimizedSeconds, [&] {
+                return linkPipeline(libraries, true);
+            }));
+        }
+        for (VkPipeline pipeline : pipelines) {
+            vkDestroyPipeline(device_, pipeline, nullptr);
+        }
+
+        double scale = 1000.0 / MATERIAL_COUNT;
+        std::cout << "material variant latency: " << monolithicSeconds * scale
+                  << " ms monolithic, " << fastLinkSeconds * scale
+                  << " ms fast-linked, " << optimizedSeconds * scale
+                  << " ms with link-time optimisation\n";
+    }
+
+    // The fields of state baked into its pipeline, those set dynamically
+    // reset to their defaults
+    PipelineState bakedState(PipelineState state) const
+    {
+        if (!state.dynamicState)
+            return state;
+
+        const PipelineState defaults{};
+        const DrawStateRecorder::Support &support = stateRecorder_->support();
+        if (support.extendedDynamicState) {
+            state.topology = defaults.topology;
+            state.cullMode = defaults.cullMode;
+            state.frontFace = defaults.frontFace;
+            state.depthCompareOp = defaults.depthCompareOp;
+            state.depthWriteEnable = defaults.depthWriteEnable;
+        }
+        if (support.extendedDynamicState3Blend)
+            state.blendMode = defaults.blendMode;
+        return state;
+    }
+
+    // The state stateRecorder_ sets for draws with the pipeline of state
+    static DrawStateRecorder::State drawState(const PipelineState &state)
+    {
+        VkPipelineColorBlendAttachmentState blend =
+            blendAttachment(state.blendMode);
+
+        DrawStateRecorder::State drawState;
+        drawState.cullMode = state.cullMode;
+        drawState.frontFace = state.frontFace;
+        drawState.topology = state.topology;
+        drawState.depthTestEnable = VK_TRUE;
+        drawState.depthWriteEnable = state.depthWriteEnable;
+        drawState.depthCompareOp = state.depthCompareOp;
+        drawState.blendEnable = blend.blendEnable;
+        drawState.blendEquation = { blend.srcColorBlendFactor,
+                                    blend.dstColorBlendFactor,
+                                    blend.colorBlendOp,
+                                    blend.srcAlphaBlendFactor,
+                                    blend.dstAlphaBlendFactor,
+                                    blend.alphaBlendOp };
+        return drawState;
+    }
+
+    static VkPipelineColorBlendAttachmentState
+    blendAttachment(BlendMode blendMode)
+    {
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+            | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
+            | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+        colorBlendAttachment.srcColorBlendFactor =
+            VK_BLEND_FACTOR_ONE; // Optional
+        colorBlendAttachment.dstColorBlendFactor =
+            VK_BLEND_FACTOR_ZERO; // Optional
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
+        colorBlendAttachment.srcAlphaBlendFactor =
+            VK_BLEND_FACTOR_ONE; // Optional
+        colorBlendAttachment.dstAlphaBlendFactor =
+            VK_BLEND_FACTOR_ZERO; // Optional
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+        if (blendMode != BlendMode::REPLACE) {
+            colorBlendAttachment.blendEnable = VK_TRUE;
+            colorBlendAttachment.srcColorBlendFactor =
+                blendMode == BlendMode::ALPHA ? VK_BLEND_FACTOR_SRC_ALPHA
+                                              : VK_BLEND_FACTOR_ONE;
+            colorBlendAttachment.dstColorBlendFactor =
+                blendMode == BlendMode::ALPHA
+                ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA
+                : VK_BLEND_FACTOR_ONE;
+            colorBlendAttachment.dstAlphaBlendFactor =
+                VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        }
+        return colorBlendAttachment;
+    }
+
+    // FNV-1a over every field baked into a pipeline, and salt: states that
+    // differ only in dynamic state share a pipeline
+    uint64_t hashPipelineState(const PipelineState &pipelineState,
+                               uint64_t salt = 0) const
+    {
+        PipelineState state = bakedState(pipelineState);
+        uint64_t hash = 0xCBF29CE484222325ull;
+        auto mix = [&hash](uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                hash ^= (value >> (8 * i)) & 0xFF;
+                hash *= 0x100000001B3ull;
+            }
+        };
+        mix(salt);
+        mix(reinterpret_cast<uint64_t>(state.renderPass));
+        mix(state.samples);
+        mix(state.subpass);
+        mix(state.depthOnly);
+        mix(state.topology);
+        mix(state.cullMode);
+        mix(state.frontFace);
+        mix(state.depthCompareOp);
+        mix(state.depthWriteEnable);
+        mix(static_cast<uint64_t>(state.blendMode));
+        mix(state.material);
+        mix(state.dynamicState);
+        return hash;
+    }
+
+    // The pipeline of state specialised for material. Until the variant has
+    // been compiled in the background that is the generic pipeline, or with
+    // pipeline libraries a variant linked on the spot.
+    VkPipeline materialPipeline(const PipelineState &state,
+                                uint32_t material,
+                                VkPipeline generic)
+    {
+        if (!pipelineVariants_)
+            return generic;
+
+        PipelineState variant = state;
+        variant.material = material;
+        if (pipelineLibrarySupported_)
+            return linkedMaterialPipeline(variant);
+        auto create = [this, variant] {
+            return createPipeline(
+                variant, vertShaderModule_, fragShaderModule_, pipelineCache_);
+        };
+        VkPipeline pipeline =
+            pipelineVariants_->find(hashPipelineState(variant), create);
+        return pipeline != VK_NULL_HANDLE ? pipeline : generic;
+    }
+
+    VkPipeline linkedMaterialPipeline(const PipelineState &variant)
+    {
+        uint64_t key = hashPipelineState(variant);
+        VkPipeline optimized = pipelineVariants_->find(key);
+        auto it = fastLinkedPipelines_.find(key);
+        if (optimized != VK_NULL_HANDLE) {
+            // Superseded: frames in flight may still draw with it
+            if (it != fastLinkedPipelines_.end()) {
+                deletionQueue_->destroy(it->second);
+                fastLinkedPipelines_.erase(it);
+            }
+            return optimized;
+        }
+        if (it != fastLinkedPipelines_.end())
+            return it->second;
+
+        std::array<VkPipeline, 4> libraries = pipelineLibraryParts(variant);
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline = linkPipeline(libraries, false);
+        fastLinkSeconds_ += std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+        fastLinkedPipelines_.emplace(key, pipeline);
+        fastLinks_++;
+
+        pipelineVariants_->find(
+            key, [this, libraries] { return linkPipeline(libraries, true); });
+        return pipeline;
+    }
+
+    void reportPipelineVariantStatistics() const
+    {
+        PipelineVariants::Statistics statistics =
+            pipelineVariants_->statistics();
+        std::cout << "material variants: ";
+        if (pipelineLibrarySupported_)
+            std::cout << fastLinks_ << " fast-linked in "
+                      << 1000.0 * fastLinkSeconds_ << " ms, ";
+        std::cout << statistics.ready << " of " << statistics.requested
+                  << (pipelineLibrarySupported_ ? " relinked optimised"
+                                                : " compiled")
+                  << " in the background in "
+                  << 1000.0 * statistics.compileSeconds << " ms";
+        if (statistics.failed > 0)
+            std::cout << ", " << statistics.failed << " failed";
+        std::cout << "\n";
+    }
+
+    // The states of the colour pass, the depth pre-pass and the colour pass
+    // after it, in this order
+    std::vector<PipelineState>
+    passStates(VkRenderPass renderPass,
+               VkSampleCountFlagBits samples,
+               BlendMode blendMode = BlendMode::REPLACE) const
+    {
+        PipelineState colorState{};
+        colorState.renderPass = renderPass;
+        colorState.samples = samples;
+        colorState.subpass = COLOR_SUBPASS;
+        colorState.blendMode = blendMode;
+        // Imported meshes wind counter-clockwise with Y up; mesh.vert flips
+        // Y for the framebuffer, which keeps them counter-clockwise on screen
+        colorState.frontFace = options_.meshPath.empty()
+            ? VK_FRONT_FACE_CLOCKWISE
+            : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+        PipelineState prePassState = colorState;
+        prePassState.subpass = DEPTH_PREPASS_SUBPASS;
+        prePassState.depthOnly = true;
+        prePassState.blendMode = BlendMode::REPLACE;
+
+        // After the pre-pass only the visible fragment of each pixel passes
+        PipelineState equalState = colorState;
+        equalState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+        equalState.depthWriteEnable = VK_FALSE;
+
+        return { colorState, prePassState, equalState };
+    }
+
+    // Creates the pipeline of each state, fanned out over the job system.
+    // States with the same baked state share one pipeline, which is then
+    // returned for each. Each job compiles into a cache of its own, so that
+    // drivers do not serialise on a shared cache's lock; the caches are
+    // then merged into pipelineCache_ for later creations to hit.
+    std::vector<VkPipeline>
+    createPipelines(const std::vector<PipelineState> &allStates,
+                    VkShaderModule vertShaderModule,
+                    VkShaderModule fragShaderModule)
+    {
+        std::vector<PipelineState> states;
+        std::vector<size_t> stateIndices;
+        std::unordered_map<uint64_t, size_t> indexOfHash;
+        for (const auto &state : allStates) {
+            auto inserted =
+                indexOfHash.emplace(hashPipelineState(state), states.size());
+            if (inserted.second)
+                states.push_back(state);
+            stateIndices.push_back(inserted.first->second);
+        }
+
+        std::vector<VkPipeline> pipelines(states.size(), VK_NULL_HANDLE);
+        size_t jobCount =
+            std::min<size_t>(states.size(), jobSystem_->threadCount() + 1);
+        std::vector<VkPipelineCache> caches(jobCount);
+        for (auto &cache : caches) {
+            cache = createEmptyPipelineCache();
+        }
+
+        JobSystem::Counter counter;
+        for (size_t job = 0; job < jobCount; job++) {
+            jobSystem_->run(
+                [&, job] {
+                    size_t begin = states.size() * job / jobCount;
+                    size_t end = states.size() * (job + 1) / jobCount;
+                    for (size_t i = begin; i < end; i++)
+                        pipelines[i] = createPipeline(states[i],
+                                                      vertShaderModule,
+                                                      fragShaderModule,
+                                                      caches[job]);
+                },
+                &counter);
+        }
+        jobSystem_->wait(counter);
+
+        if (jobCount > 0
+            && vkMergePipelineCaches(device_,
+                                     pipelineCache_,
+                                     static_cast<uint32_t>(jobCount),
+                                     caches.data())
+                != VK_SUCCESS)
+            throw std::runtime_error("failed to merge pipeline caches!");
+        for (VkPipelineCache cache : caches) {
+            vkDestroyPipelineCache(device_, cache, nullptr);
+        }
 
+        std::vector<VkPipeline> statePipelines;
+        for (size_t index : stateIndices) {
+            statePipelines.push_back(pipelines[index]);
+        }
+        return statePipelines;
+    }
+
+    // Every pass pipeline for each supported sample count, a few colour
+    // formats, each blend mode and single- and double-sided, with every
+    // state baked in: created once with createPipelines and once on this
+    // thread with a single cache. Both start from empty caches; the
+    // parallel run goes first so that driver-side caches can only favour
+    // the serial one. With extended dynamic state, the pipelines the same
+    // variants need when states are set per draw are created before, for
+    // the same reason. The merged caches warm pipelineCache_ for the
+    // pipelines the application uses.
+    void reportPipelineVariants(VkShaderModule vertShaderModule,
+                                VkShaderModule fragShaderModule)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+        VkSampleCountFlags sampleCounts =
+            properties.limits.framebufferColorSampleCounts
+            & properties.limits.framebufferDepthSampleCounts;
+
+        std::vector<VkFormat> formats = { surfaceFormat_.format };
+        for (VkFormat format : { VK_FORMAT_R8G8B8A8_UNORM,
+                                 VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+                                 VK_FORMAT_R16G16B16A16_SFLOAT }) {
+            VkFormatProperties formatProperties;
+            vkGetPhysicalDeviceFormatProperties(
+                physicalDevice_, format, &formatProperties);
+            VkFormatFeatureFlags required =
+                VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT
+                | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT;
+            if (format != surfaceFormat_.format
+                && (formatProperties.optimalTilingFeatures & required)
+                    == required)
+                formats.push_back(format);
+        }
+
+        std::vector<VkRenderPass> renderPasses;
+        std::vector<PipelineState> states;
+        for (VkFormat format : formats) {
+            for (uint32_t samples = VK_SAMPLE_COUNT_1_BIT;
+                 samples <= VK_SAMPLE_COUNT_8_BIT;
+                 samples <<= 1) {
+                if (!(sampleCounts & samples))
+                    continue;
+                auto sampleCount = static_cast<VkSampleCountFlagBits>(samples);
+                renderPasses.push_back(createRenderPass(format, sampleCount));
+
+                for (BlendMode blendMode : { BlendMode::REPLACE,
+                                             BlendMode::ALPHA,
+                                             BlendMode::ADDITIVE }) {
+                    for (auto state : passStates(
+                             renderPasses.back(), sampleCount, blendMode)) {
+                        // Pre-passes do not blend: one per render pass
+                        if (state.depthOnly && blendMode != BlendMode::REPLACE)
+                            continue;
+                        state.dynamicState = false;
+                        for (VkCullModeFlags cullMode :
+                             { VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_NONE }) {
+                            state.cullMode = cullMode;
+                            states.push_back(state);
+                        }
+                    }
+                }
+            }
+        }
+
+        auto destroyPipelines = [this](const std::vector<VkPipeline> &all) {
+            for (VkPipeline pipeline :
+                 std::set<VkPipeline>(all.begin(), all.end())) {
+                vkDestroyPipeline(device_, pipeline, nullptr);
+            }
+        };
+
+        size_t dynamicCount = 0;
+        double dynamicMs = 0.0;
+        if (stateRecorder_->dynamicStates().size() > 2) {
+            std::vector<PipelineState> dynamicStates = states;
+            for (auto &state : dynamicStates) {
+                state.dynamicState = true;
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::vector<VkPipeline> pipelines = createPipelines(
+                dynamicStates, vertShaderModule, fragShaderModule);
+            dynamicMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+            dynamicCount =
+                std::set<VkPipeline>(pipelines.begin(), pipelines.end())
+                    .size();
+            destroyPipelines(pipelines);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<VkPipeline> pipelines =
+            createPipelines(states, vertShaderModule, fragShaderModule);
+        double parallelMs = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+        destroyPipelines(pipelines);
+
+        VkPipelineCache serialCache = createEmptyPipelineCache();
+        start = std::chrono::steady_clock::now();
+        for (const auto &state : states) {
+            vkDestroyPipeline(device_,
+                              createPipeline(state,
+                                             vertShaderModule,
+                                             fragShaderModule,
+                                             serialCache),
+                              nullptr);
+        }
+        double serialMs = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        vkDestroyPipelineCache(device_, serialCache, nullptr);
+
+        for (VkRenderPass renderPass : renderPasses) {
+            vkDestroyRenderPass(device_, renderPass, nullptr);
+        }
+
+        pipelineVariantsMilliseconds_ = parallelMs;
+        pipelineVariantsSerialMilliseconds_ = serialMs;
+        std::cout << "pipeline variants: " << states.size() << " ("
+                  << formats.size() << " formats, " << renderPasses.size()
+                  << " render passes) in " << parallelMs << " ms on "
+                  << jobSystem_->threadCount() + 1 << " threads, "
+                  << serialMs << " ms serially (" << serialMs / parallelMs
+                  << "x)\n";
+        if (dynamicCount > 0)
+            std::cout << "with extended dynamic state the same variants take "
+                      << dynamicCount << " pipelines instead of "
+                      << states.size() << ", created in " << dynamicMs
+                      << " ms instead of " << parallelMs << " ms\n";
+    }
+
+    // A whole pipeline, or with libraryParts a library of only those parts
+    VkPipeline createPipeline(const PipelineState &state,
+                              VkShaderModule vertShaderModule,
+                              VkShaderModule fragShaderModule,
+                              VkPipelineCache cache,
+                              VkGraphicsPipelineLibraryFlagsEXT libraryParts =
+                                  0) const
+    {
         VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
         vertShaderStageInfo.sType =
             VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -825,16 +3215,47 @@ private:
         vertShaderStageInfo.module = vertShaderModule;
         vertShaderStageInfo.pName = "main";
 
+        // Constant 0 selects where the vertex shader reads per-draw data
+        // from, constant 1 the material of the fragment shader. Each stage
+        // ignores the constant it does not declare.
+        struct SpecializationData {
+            VkBool32 pushDrawData;
+            uint32_t material;
+        } specializationData{ options_.pushDrawConstants, state.material };
+        VkSpecializationMapEntry specializationEntries[] = {
+            { 0, offsetof(SpecializationData, pushDrawData), sizeof(VkBool32) },
+            { 1, offsetof(SpecializationData, material), sizeof(uint32_t) },
+        };
+
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = 2;
+        specializationInfo.pMapEntries = specializationEntries;
+        specializationInfo.dataSize = sizeof(SpecializationData);
+        specializationInfo.pData = &specializationData;
+        vertShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
         VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
         fragShaderStageInfo.sType =
             VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         fragShaderStageInfo.module = fragShaderModule;
         fragShaderStageInfo.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shaderStages[] = {
-            vertShaderStageInfo, fragShaderStageInfo
-        };
+        fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+        // Depth-only pipelines skip the fragment shader entirely
+        VkGraphicsPipelineLibraryFlagsEXT vertexParts =
+            VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+        VkGraphicsPipelineLibraryFlagsEXT fragmentParts =
+            VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+        bool vertexStage = !libraryParts || (libraryParts & vertexParts);
+        bool fragmentStage = !state.depthOnly
+            && (!libraryParts || (libraryParts & fragmentParts));
+        VkPipelineShaderStageCreateInfo shaderStages[2];
+        uint32_t stageCount = 0;
+        if (vertexStage)
+            shaderStages[stageCount++] = vertShaderStageInfo;
+        if (fragmentStage)
+            shaderStages[stageCount++] = fragShaderStageInfo;
 
         // Vertex Input (VBO)
 
@@ -851,7 +3272,7 @@ private:
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyCreateInfo{};
         inputAssemblyCreateInfo.sType =
             VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssemblyCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyCreateInfo.topology = state.topology;
         inputAssemblyCreateInfo.primitiveRestartEnable = VK_FALSE;
 
         // Viewport and scissors
@@ -871,8 +3292,8 @@ private:
         rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;
         rasterizerCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
         rasterizerCreateInfo.lineWidth = 1.0f;
-        rasterizerCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizerCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterizerCreateInfo.cullMode = state.cullMode;
+        rasterizerCreateInfo.frontFace = state.frontFace;
         rasterizerCreateInfo.depthBiasEnable = VK_FALSE;
         rasterizerCreateInfo.depthBiasConstantFactor = 0.0f; // Optional
         rasterizerCreateInfo.depthBiasClamp = 0.0f; // Optional
@@ -884,175 +3305,1490 @@ private:
         multisamplingCreateInfo.sType =
             VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
         multisamplingCreateInfo.sampleShadingEnable = VK_FALSE;
-        multisamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisamplingCreateInfo.rasterizationSamples = state.samples;
         multisamplingCreateInfo.minSampleShading = 1.0f; // Optional
         multisamplingCreateInfo.pSampleMask = nullptr; // Optional
         multisamplingCreateInfo.alphaToCoverageEnable = VK_FALSE; // Optional
         multisamplingCreateInfo.alphaToOneEnable = VK_FALSE; // Optional
 
-        // Color blending
+        // Depth test
+
+        VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo{};
+        depthStencilCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencilCreateInfo.depthTestEnable = VK_TRUE;
+        depthStencilCreateInfo.depthWriteEnable = state.depthWriteEnable;
+        depthStencilCreateInfo.depthCompareOp = state.depthCompareOp;
+        depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;
+        depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
+
+        // Color blending
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment =
+            blendAttachment(state.blendMode);
+
+        VkPipelineColorBlendStateCreateInfo colorBlendCreateInfo{};
+        colorBlendCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlendCreateInfo.logicOpEnable = VK_FALSE;
+        colorBlendCreateInfo.logicOp = VK_LOGIC_OP_COPY;
+        colorBlendCreateInfo.attachmentCount = state.depthOnly ? 0 : 1;
+        colorBlendCreateInfo.pAttachments = &colorBlendAttachment;
+        colorBlendCreateInfo.blendConstants[0] = 0.0f; // Optional
+        colorBlendCreateInfo.blendConstants[1] = 0.0f; // Optional
+        colorBlendCreateInfo.blendConstants[2] = 0.0f; // Optional
+        colorBlendCreateInfo.blendConstants[3] = 0.0f; // Optional
+
+        // Dynamic state: viewport and scissor will be specified at runtime,
+        // and with extended dynamic state what stateRecorder_ sets per draw
+
+        std::vector<VkDynamicState> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR,
+        };
+        if (state.dynamicState)
+            dynamicStates = stateRecorder_->dynamicStates();
+
+        VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+        dynamicStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicStateCreateInfo.dynamicStateCount = dynamicStates.size();
+        dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
+
+        VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+        libraryInfo.sType =
+            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        libraryInfo.flags = libraryParts;
+
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+        pipelineCreateInfo.sType =
+            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        if (libraryParts) {
+            pipelineCreateInfo.pNext = &libraryInfo;
+            pipelineCreateInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR
+                | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        }
+        pipelineCreateInfo.stageCount = stageCount;
+        pipelineCreateInfo.pStages = shaderStages;
+
+        pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;
+        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyCreateInfo;
+        pipelineCreateInfo.pViewportState = &viewportCreateInfo;
+        pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
+        pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
+        pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
+        pipelineCreateInfo.pColorBlendState = &colorBlendCreateInfo;
+        pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+
+        pipelineCreateInfo.layout = pipelineLayout_;
+
+        pipelineCreateInfo.renderPass = state.renderPass;
+        pipelineCreateInfo.subpass = state.subpass;
+
+        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineCreateInfo.basePipelineIndex = -1;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device_,
+                                      cache,
+                                      1,
+                                      &pipelineCreateInfo,
+                                      nullptr,
+                                      &pipeline)
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        if (callCapture_ && !libraryParts)
+            callCapture_->pipeline(pipeline, pipelineCreateInfo);
+        return pipeline;
+    }
+
+    // Framebuffer of the main render pass writing the scene to target
+    VkFramebuffer createSceneFramebuffer(VkRenderPass renderPass,
+                                         VkExtent2D extent,
+                                         const TransientAttachment &color,
+                                         const TransientAttachment &depth,
+                                         VkImageView target)
+    {
+        // Same order as the render pass: colour, depth, resolve
+        std::vector<VkImageView> attachments;
+        if (msaaSamples_ != VK_SAMPLE_COUNT_1_BIT) {
+            attachments.push_back(color.view);
+            attachments.push_back(depth.view);
+            attachments.push_back(target);
+        }
+        else {
+            attachments.push_back(target);
+            attachments.push_back(depth.view);
+        }
+
+        VkFramebufferCreateInfo framebufferCreateInfo{};
+        framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferCreateInfo.renderPass = renderPass;
+        framebufferCreateInfo.attachmentCount =
+            static_cast<uint32_t>(attachments.size());
+        framebufferCreateInfo.pAttachments = attachments.data();
+        framebufferCreateInfo.width = extent.width;
+        framebufferCreateInfo.height = extent.height;
+        framebufferCreateInfo.layers = 1;
+
+        VkFramebuffer framebuffer;
+        if (vkCreateFramebuffer(
+                device_, &framebufferCreateInfo, nullptr, &framebuffer)
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+        if (callCapture_)
+            callCapture_->framebuffer(framebuffer, framebufferCreateInfo);
+        return framebuffer;
+    }
+
+    void createFramebuffers(Window &window)
+    {
+        window.framebuffers.resize(window.imageViews.size());
+
+        for (size_t i = 0; i < window.imageViews.size(); i++) {
+            window.framebuffers[i] =
+                createSceneFramebuffer(renderPass_,
+                                       window.extent,
+                                       window.colorAttachment,
+                                       window.depthAttachment,
+                                       window.imageViews[i]);
+        }
+
+        window.overlayFramebuffers.resize(window.imageViews.size());
+        for (size_t i = 0; i < window.imageViews.size(); i++) {
+            VkFramebufferCreateInfo framebufferCreateInfo{};
+            framebufferCreateInfo.sType =
+                VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferCreateInfo.renderPass = overlayRenderPass_;
+            framebufferCreateInfo.attachmentCount = 1;
+            framebufferCreateInfo.pAttachments = &window.imageViews[i];
+            framebufferCreateInfo.width = window.extent.width;
+            framebufferCreateInfo.height = window.extent.height;
+            framebufferCreateInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device_,
+                                    &framebufferCreateInfo,
+                                    nullptr,
+                                    &window.overlayFramebuffers[i])
+                != VK_SUCCESS) {
+                throw std::runtime_error("failed to create framebuffer!");
+            }
+            if (callCapture_)
+                callCapture_->framebuffer(window.overlayFramebuffers[i],
+                                          framebufferCreateInfo);
+        }
+    }
+
+    // Dynamic resolution: the scene is rendered at one of RENDER_SCALES of
+    // the window size, picked from the GPU frame time, and blitted to the
+    // swap chain image with linear filtering. The overlay is drawn after
+    // the blit, at full resolution.
+    void createResolutionController()
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(
+            physicalDevice_, surfaceFormat_.format, &properties);
+        VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT
+            | VK_FORMAT_FEATURE_BLIT_DST_BIT
+            | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        if ((properties.optimalTilingFeatures & blit) != blit)
+            throw std::runtime_error(
+                "the surface format cannot be upscaled by a blit!");
+
+        scaledRenderPass_ =
+            createRenderPass(surfaceFormat_.format,
+                             msaaSamples_,
+                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+        ResolutionController::Settings settings;
+        settings.targetMilliseconds = options_.dynamicResolutionMs;
+        settings.scales.assign(std::begin(RENDER_SCALES),
+                               std::end(RENDER_SCALES));
+        // Frames in flight when the scale changes were recorded before
+        settings.settleFrames = MAX_FRAMES_IN_FLIGHT + 2;
+        resolutionController_ =
+            std::make_unique<ResolutionController>(settings);
+    }
+
+    void createScaledTargets(Window &window)
+    {
+        VkDeviceSize bytes = 0;
+        window.scaledTargets.resize(RENDER_SCALE_COUNT - 1);
+        for (size_t i = 0; i < window.scaledTargets.size(); i++) {
+            ScaledTarget &target = window.scaledTargets[i];
+            target.extent = { std::max(1u,
+                                       static_cast<uint32_t>(
+                                           window.extent.width
+                                           * RENDER_SCALES[i])),
+                              std::max(1u,
+                                       static_cast<uint32_t>(
+                                           window.extent.height
+                                           * RENDER_SCALES[i])) };
+
+            target.image = createImage(target.extent.width,
+                                       target.extent.height,
+                                       VK_SAMPLE_COUNT_1_BIT,
+                                       surfaceFormat_.format,
+                                       VK_IMAGE_TILING_OPTIMAL,
+                                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                                           | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            target.memory = allocateImageMemory(
+                target.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            target.view = createImageView(
+                target.image, surfaceFormat_.format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+            if (msaaSamples_ != VK_SAMPLE_COUNT_1_BIT)
+                target.colorAttachment = createTransientAttachment(
+                    target.extent,
+                    msaaSamples_,
+                    surfaceFormat_.format,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                    VK_IMAGE_ASPECT_COLOR_BIT);
+            target.depthAttachment = createTransientAttachment(
+                target.extent,
+                msaaSamples_,
+                depthFormat_,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                VK_IMAGE_ASPECT_DEPTH_BIT);
+
+            target.framebuffer =
+                createSceneFramebuffer(scaledRenderPass_,
+                                       target.extent,
+                                       target.colorAttachment,
+                                       target.depthAttachment,
+                                       target.view);
+
+            VkMemoryRequirements memRequirements;
+            vkGetImageMemoryRequirements(
+                device_, target.image, &memRequirements);
+            bytes += memRequirements.size + target.colorAttachment.size
+                + target.depthAttachment.size;
+        }
+
+        std::cout << "dynamic resolution: " << window.scaledTargets.size()
+                  << " reduced scales, " << (bytes >> 20)
+                  << " MiB of render targets\n";
+    }
+
+    void destroyScaledTarget(ScaledTarget &target)
+    {
+        vkDestroyFramebuffer(device_, target.framebuffer, nullptr);
+        destroyTransientAttachment(target.depthAttachment);
+        destroyTransientAttachment(target.colorAttachment);
+        vkDestroyImageView(device_, target.view, nullptr);
+        vkDestroyImage(device_, target.image, nullptr);
+        vkFreeMemory(device_, target.memory, nullptr);
+        target = ScaledTarget{};
+    }
+
+    void createCommandPool()
+    {
+        TRACE_ZONE("createCommandPool");
+        QueueFamilyIndices queueFamilyIndices =
+            findQueueFamilies(physicalDevice_, windows_.front().surface);
+
+        VkCommandPoolCreateInfo commandPoolCreateInfo{};
+        commandPoolCreateInfo.sType =
+            VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.flags =
+            VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        commandPoolCreateInfo.queueFamilyIndex =
+            queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(
+                device_, &commandPoolCreateInfo, nullptr, &commandPool_)
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+    }
+
+    void createCommandBuffers()
+    {
+        TRACE_ZONE("createCommandBuffers");
+        commandBuffers_.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool_;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount =
+            static_cast<uint32_t>(commandBuffers_.size());
+
+        if (vkAllocateCommandBuffers(
+                device_, &allocInfo, commandBuffers_.data())
+            != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+
+    void createBindlessHeap()
+    {
+        TRACE_ZONE("createBindlessHeap");
+        bindlessHeap_ =
+            std::make_unique<BindlessHeap>(physicalDevice_,
+                                           device_,
+                                           BINDLESS_SAMPLED_IMAGES,
+                                           BINDLESS_STORAGE_BUFFERS);
+        if (callCapture_)
+            callCapture_->heap(BINDLESS_SAMPLED_IMAGES,
+                               BINDLESS_STORAGE_BUFFERS);
+    }
+
+    // Per-draw data of a grid of options_.draws triangles (a single
+    // full-size one by default), and the ring holding it every frame
+    void createUniformRing()
+    {
+        TRACE_ZONE("createUniformRing");
+        uint32_t columns = static_cast<uint32_t>(
+            std::ceil(std::sqrt(static_cast<double>(options_.draws))));
+        float cell = 2.0f / static_cast<float>(columns);
+
+        draws_.resize(options_.draws);
+        for (uint32_t i = 0; i < options_.draws; i++) {
+            DrawData &draw = draws_[i];
+            bool grid = options_.draws > 1;
+            draw.offsetScale[0] =
+                grid ? -1.0f + cell * (static_cast<float>(i % columns) + 0.5f)
+                     : 0.0f;
+            draw.offsetScale[1] =
+                grid ? -1.0f + cell * (static_cast<float>(i / columns) + 0.5f)
+                     : 0.0f;
+            draw.offsetScale[2] = grid ? cell : 1.0f;
+            draw.offsetScale[3] =
+                grid ? 0.5f + 0.25f * static_cast<float>(i % 5) : 0.0f;
+            draw.color[0] = 1.0f - 0.5f * static_cast<float>(i % 2);
+            draw.color[1] = 1.0f - 0.25f * static_cast<float>(i % 3);
+            draw.color[2] = 1.0f - 0.2f * static_cast<float>(i % 4);
+            draw.color[3] = 1.0f;
+            draw.textureIndex = 0;
+            draw.material = options_.materials
+                ? i % MATERIAL_COUNT
+                : MATERIAL_TEXTURE | MATERIAL_VERTEX_COLOR;
+            animated_ = animated_ || draw.offsetScale[3] != 0.0f;
+        }
+        drawOffsets_.resize(options_.draws);
+
+        VkDeviceSize bytesPerFrame =
+            MAX_UNIFORM_ALIGNMENT * (1 + draws_.size());
+        uniformRing_ = std::make_unique<UniformRing>(physicalDevice_,
+                                                     device_,
+                                                     bytesPerFrame,
+                                                     MAX_FRAMES_IN_FLIGHT,
+                                                     sizeof(FrameUniforms),
+                                                     sizeof(DrawData));
+        if (callCapture_)
+            callCapture_->ring(bytesPerFrame,
+                               MAX_FRAMES_IN_FLIGHT,
+                               sizeof(FrameUniforms),
+                               sizeof(DrawData),
+                               uniformRing_->alignment());
+    }
+
+    // Fills the ring region of the current frame: one memcpy per draw, run
+    // as jobs counted by frameJobs
+    void writeFrameUniforms(JobSystem::Counter &frameJobs)
+    {
+        uniformRing_->beginFrame(currentFrame_);
+
+        const SimulationSnapshot &simulation = simulation_.latest();
+        double time = simulation.time;
+        if (!simulation.paused)
+            time += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - simulation.taken)
+                        .count();
+
+        FrameUniforms frame{};
+        frame.time = static_cast<float>(time);
+        frameUniformsOffset_ = uniformRing_->push(frame);
+
+        if (options_.pushDrawConstants)
+            return;
+
+        // Allocation is a bump of the ring head, only the copies are spread
+        drawUniformData_.resize(draws_.size());
+        for (size_t i = 0; i < draws_.size(); i++) {
+            drawOffsets_[i] =
+                uniformRing_->allocate(sizeof(DrawData), &drawUniformData_[i]);
+        }
+        jobSystem_->parallelFor(
+            draws_.size(),
+            DRAWS_PER_JOB,
+            [this](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    std::memcpy(
+                        drawUniformData_[i], &draws_[i], sizeof(DrawData));
+            },
+            frameJobs);
+    }
+
+    VkCommandBuffer beginSingleTimeCommands()
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool_;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate command buffers!");
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+
+    void endSingleTimeCommands(VkCommandBuffer commandBuffer)
+    {
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        if (vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to submit upload commands!");
+        vkQueueWaitIdle(graphicsQueue_);
+
+        vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+    }
+
+    VkDeviceMemory allocateImageMemory(VkImage image,
+                                       VkMemoryPropertyFlags properties)
+    {
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device_, image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex =
+            findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device_, &allocInfo, nullptr, &memory)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate image memory!");
+
+        vkBindImageMemory(device_, image, memory, 0);
+        return memory;
+    }
+
+    // Procedural checkerboard, drawn until a streamed texture is resident
+    void createTextureImage()
+    {
+        TRACE_ZONE("createTextureImage");
+        constexpr uint32_t size = 256;
+        constexpr uint32_t cell = 32;
+
+        std::vector<uint8_t> pixels(size * size * 4);
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                uint8_t value = ((x / cell + y / cell) % 2) ? 255 : 160;
+                uint8_t *pixel = &pixels[(y * size + x) * 4];
+                pixel[0] = value;
+                pixel[1] = value;
+                pixel[2] = value;
+                pixel[3] = 255;
+            }
+        }
+
+        texture_ = createTexture(pixels, size, size, VK_FORMAT_R8G8B8A8_SRGB);
+        for (auto &draw : draws_) {
+            draw.textureIndex = texture_.heapIndex;
+        }
+    }
+
+    // Uploads tightly packed pixels through a staging buffer and registers
+    // the texture in the bindless heap
+    Texture createTexture(const std::vector<uint8_t> &pixels,
+                          uint32_t width,
+                          uint32_t height,
+                          VkFormat format)
+    {
+        Texture texture;
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(pixels.size(),
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     stagingBuffer,
+                     stagingBufferMemory);
+
+        void *data;
+        vkMapMemory(device_, stagingBufferMemory, 0, pixels.size(), 0, &data);
+        std::copy(pixels.begin(), pixels.end(), static_cast<uint8_t *>(data));
+        vkUnmapMemory(device_, stagingBufferMemory);
+
+        texture.image = createImage(width,
+                                    height,
+                                    VK_SAMPLE_COUNT_1_BIT,
+                                    format,
+                                    VK_IMAGE_TILING_OPTIMAL,
+                                    VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                                        | VK_IMAGE_USAGE_SAMPLED_BIT);
+        texture.memory = allocateImageMemory(
+            texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (callCapture_)
+            callCapture_->imageData(
+                texture.image, pixels.data(), pixels.size());
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = texture.image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             1,
+                             &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { width, height, 1 };
+
+        vkCmdCopyBufferToImage(commandBuffer,
+                               stagingBuffer,
+                               texture.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               1,
+                               &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             1,
+                             &barrier);
+
+        endSingleTimeCommands(commandBuffer);
+
+        vkDestroyBuffer(device_, stagingBuffer, nullptr);
+        vkFreeMemory(device_, stagingBufferMemory, nullptr);
+
+        texture.view = createImageView(
+            texture.image, format, VK_IMAGE_ASPECT_COLOR_BIT);
+        texture.heapIndex = bindlessHeap_->addSampledImage(
+            texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        if (callCapture_)
+            callCapture_->heapImage(texture.view, texture.heapIndex);
+        return texture;
+    }
+
+    void destroyTexture(const Texture &texture)
+    {
+        vkDestroyImageView(device_, texture.view, nullptr);
+        vkDestroyImage(device_, texture.image, nullptr);
+        vkFreeMemory(device_, texture.memory, nullptr);
+    }
+
+    // Glyph atlas, vertex buffers and pipeline of the statistics overlay,
+    // created whether it starts shown or not so that showing it allocates
+    // nothing
+    void createOverlay()
+    {
+        TRACE_ZONE("createOverlay");
+        overlay_ = std::make_unique<Overlay>(OVERLAY_MAX_QUADS);
+        overlayAtlas_ = createTexture(Overlay::atlasPixels(),
+                                      Overlay::ATLAS_WIDTH,
+                                      Overlay::ATLAS_HEIGHT,
+                                      VK_FORMAT_R8G8B8A8_UNORM);
+
+        VkDeviceSize size = overlay_->maxVertices() * sizeof(OverlayVertex);
+        for (auto &buffer : overlayBuffers_) {
+            createBuffer(size,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                             | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                         buffer.buffer,
+                         buffer.memory);
+            vkMapMemory(device_, buffer.memory, 0, size, 0, &buffer.mapped);
+            buffer.heapIndex = bindlessHeap_->addStorageBuffer(buffer.buffer);
+            if (callCapture_)
+                callCapture_->heapBuffer(buffer.buffer, buffer.heapIndex);
+        }
+
+        auto vertShaderCode = readFile(shaderPath / "overlay_vert.spv");
+        auto fragShaderCode = readFile(shaderPath / "overlay_frag.spv");
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        // Its state goes through stateRecorder_ like the draws'. The depth
+        // state does not matter: the overlay pass has no depth attachment.
+        overlayState_.renderPass = overlayRenderPass_;
+        overlayState_.cullMode = VK_CULL_MODE_NONE;
+        overlayState_.depthWriteEnable = VK_FALSE;
+        overlayState_.blendMode = BlendMode::ALPHA;
+        overlayPipeline_ = createPipeline(
+            overlayState_, vertShaderModule, fragShaderModule, pipelineCache_);
+
+        vkDestroyShaderModule(device_, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device_, vertShaderModule, nullptr);
+    }
+
+    void destroyOverlay()
+    {
+        vkDestroyPipeline(device_, overlayPipeline_, nullptr);
+        for (auto &buffer : overlayBuffers_) {
+            vkUnmapMemory(device_, buffer.memory);
+            vkDestroyBuffer(device_, buffer.buffer, nullptr);
+            vkFreeMemory(device_, buffer.memory, nullptr);
+        }
+        destroyTexture(overlayAtlas_);
+    }
+
+    static const char *presentModeName(VkPresentModeKHR presentMode)
+    {
+        switch (presentMode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "fifo relaxed";
+
+        default:
+            return "other";
+        }
+    }
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-            | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
-            | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
-        colorBlendAttachment.srcColorBlendFactor =
-            VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstColorBlendFactor =
-            VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-        colorBlendAttachment.srcAlphaBlendFactor =
-            VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstAlphaBlendFactor =
-            VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+    // Lays this frame's statistics out into its overlay buffer
+    void buildOverlay()
+    {
+        Overlay &overlay = *overlay_;
+        overlay.clear();
+
+        const uint32_t background = Overlay::rgba(0, 0, 0, 160);
+        const uint32_t textColor = Overlay::rgba(255, 255, 255, 255);
+        const uint32_t graphColor = Overlay::rgba(80, 200, 80, 255);
+        const uint32_t slowColor = Overlay::rgba(230, 60, 60, 255);
+        const float margin = 8.0f;
+        const float line = overlay.lineHeight() + 4.0f;
+        const float width = 56.0f * Overlay::GLYPH_WIDTH;
+        const float graphHeight = 64.0f;
+
+        overlay.rect(margin,
+                     margin,
+                     width + 2.0f * margin,
+                     6.0f * line + graphHeight + 2.0f * margin,
+                     background);
+        float x = 2.0f * margin;
+        float y = 2.0f * margin;
+
+        float frameMs =
+            frameMilliseconds_[(frameGraphNext_ + FRAME_GRAPH_FRAMES - 1)
+                               % FRAME_GRAPH_FRAMES];
+        overlay.textf(x,
+                      y,
+                      textColor,
+                      "frame %.2f ms (%.0f fps)",
+                      frameMs,
+                      frameMs > 0.0f ? 1000.0f / frameMs : 0.0f);
+        y += line;
+        if (timestampQueryPool_ != VK_NULL_HANDLE && resolutionController_)
+            overlay.textf(x,
+                          y,
+                          textColor,
+                          "cpu %.2f ms  gpu %.2f ms  scale %.0f%%",
+                          cpuMilliseconds_,
+                          gpuMilliseconds_,
+                          100.0f * resolutionController_->scale());
+        else if (timestampQueryPool_ != VK_NULL_HANDLE)
+            overlay.textf(x,
+                          y,
+                          textColor,
+                          "cpu %.2f ms  gpu %.2f ms",
+                          cpuMilliseconds_,
+                          gpuMilliseconds_);
+        else
+            overlay.textf(
+                x, y, textColor, "cpu %.2f ms  gpu n/a", cpuMilliseconds_);
+        y += line;
+
+        uint64_t passes = windows_.size() * (depthPrePass_ ? 2 : 1);
+        uint64_t draws = passes * draws_.size();
+        uint64_t triangles = draws * options_.overdrawLayers
+            * (mesh_.indexBuffer != VK_NULL_HANDLE ? mesh_.indexCount / 3 : 1);
+        overlay.textf(x,
+                      y,
+                      textColor,
+                      "draws %llu  triangles %llu",
+                      static_cast<unsigned long long>(draws),
+                      static_cast<unsigned long long>(triangles));
+        y += line;
+
+        if (textureStreamer_) {
+            TextureStreamer::Statistics statistics =
+                textureStreamer_->statistics();
+            overlay.textf(x,
+                          y,
+                          textColor,
+                          "textures %llu/%llu mib",
+                          static_cast<unsigned long long>(
+                              statistics.residentBytes >> 20),
+                          static_cast<unsigned long long>(
+                              statistics.budget >> 20));
+        }
+        else {
+            overlay.text(x, y, "textures -", textColor);
+        }
+        y += line;
+        // Against the driver's budget when it reports one
+        MemoryBudget::Heap deviceLocal = memoryBudget_->deviceLocal();
+        if (memoryBudget_->driverReported())
+            overlay.textf(x,
+                          y,
+                          deviceLocal.pressure == MemoryBudget::Pressure::NORMAL
+                              ? textColor
+                              : slowColor,
+                          "device local %llu/%llu mib",
+                          static_cast<unsigned long long>(deviceLocal.usage
+                                                          >> 20),
+                          static_cast<unsigned long long>(deviceLocal.budget
+                                                          >> 20));
+        else
+            overlay.textf(x,
+                          y,
+                          textColor,
+                          "device local %llu mib",
+                          static_cast<unsigned long long>(deviceLocal.size
+                                                          >> 20));
+        y += line;
+        overlay.textf(x,
+                      y,
+                      textColor,
+                      "present %s, %zu window(s)",
+                      presentModeName(windows_.front().presentMode),
+                      windows_.size());
+        y += line;
+
+        // Up to 50 ms, the 60 Hz frame time marked
+        overlay.graph(x,
+                      y,
+                      width,
+                      graphHeight,
+                      frameMilliseconds_.data(),
+                      FRAME_GRAPH_FRAMES,
+                      frameGraphNext_,
+                      50.0f,
+                      1000.0f / 60.0f,
+                      graphColor,
+                      slowColor);
+
+        std::memcpy(overlayBuffers_[currentFrame_].mapped,
+                    overlay.vertices(),
+                    overlay.vertexCount() * sizeof(OverlayVertex));
+        if (callCapture_)
+            callCapture_->bufferData(
+                overlayBuffers_[currentFrame_].buffer,
+                0,
+                overlay.vertices(),
+                overlay.vertexCount() * sizeof(OverlayVertex));
+    }
 
-        VkPipelineColorBlendStateCreateInfo colorBlendCreateInfo{};
-        colorBlendCreateInfo.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlendCreateInfo.logicOpEnable = VK_FALSE;
-        colorBlendCreateInfo.logicOp = VK_LOGIC_OP_COPY;
-        colorBlendCreateInfo.attachmentCount = 1;
-        colorBlendCreateInfo.pAttachments = &colorBlendAttachment;
-        colorBlendCreateInfo.blendConstants[0] = 0.0f; // Optional
-        colorBlendCreateInfo.blendConstants[1] = 0.0f; // Optional
-        colorBlendCreateInfo.blendConstants[2] = 0.0f; // Optional
-        colorBlendCreateInfo.blendConstants[3] = 0.0f; // Optional
+    // Its own render pass over the window's swap chain image, one draw
+    void recordOverlay(VkCommandBuffer commandBuffer, const Window &window)
+    {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = overlayRenderPass_;
+        renderPassInfo.framebuffer =
+            window.overlayFramebuffers[window.imageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = window.extent;
 
-        // Dynamic state: Viewport and scissor will be specified at runtime
+        vkCmdBeginRenderPass(
+            commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        if (callCapture_)
+            callCapture_->beginRenderPass(renderPassInfo);
 
-        std::vector<VkDynamicState> dynamicStates = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR,
-        };
+        VkViewport viewport{};
+        viewport.width = static_cast<float>(window.extent.width);
+        viewport.height = static_cast<float>(window.extent.height);
+        viewport.maxDepth = 1.0f;
+        stateRecorder_->setViewport(viewport);
 
-        VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
-        dynamicStateCreateInfo.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicStateCreateInfo.dynamicStateCount = dynamicStates.size();
-        dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
+        VkRect2D scissor{};
+        scissor.extent = window.extent;
+        stateRecorder_->setScissor(scissor);
+        stateRecorder_->bindPipeline(overlayPipeline_);
+        stateRecorder_->setState(drawState(overlayState_));
+
+        OverlayConstants constants{};
+        constants.atlasIndex = overlayAtlas_.heapIndex;
+        constants.vertexBufferIndex = overlayBuffers_[currentFrame_].heapIndex;
+        constants.scale[0] = 2.0f / viewport.width;
+        constants.scale[1] = 2.0f / viewport.height;
+        vkCmdPushConstants(commandBuffer,
+                           pipelineLayout_,
+                           VK_SHADER_STAGE_VERTEX_BIT
+                               | VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0,
+                           sizeof(constants),
+                           &constants);
+        vkCmdDraw(commandBuffer, overlay_->vertexCount(), 1, 0, 0);
+        if (callCapture_) {
+            callCapture_->pushConstants(VK_SHADER_STAGE_VERTEX_BIT
+                                            | VK_SHADER_STAGE_FRAGMENT_BIT,
+                                        0,
+                                        sizeof(constants),
+                                        &constants);
+            callCapture_->draw(overlay_->vertexCount(), 1, 0, 0);
+        }
 
-        // Pipeline layout
+        vkCmdEndRenderPass(commandBuffer);
+        if (callCapture_)
+            callCapture_->endRenderPass();
+    }
 
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
-        pipelineLayoutCreateInfo.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.setLayoutCount = 0;
-        pipelineLayoutCreateInfo.pSetLayouts = nullptr;
-        pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+    void createTextureStreamer()
+    {
+        TRACE_ZONE("createTextureStreamer");
+        if (options_.texturePaths.empty())
+            return;
+
+        TextureStreamer::Settings settings;
+        settings.physicalDevice = physicalDevice_;
+        settings.device = device_;
+        settings.graphicsFamily = graphicsFamily_;
+        settings.transferFamily = transferFamily_;
+        settings.transferQueue = transferQueue_;
+        settings.budget = VkDeviceSize(options_.textureBudgetMiB) << 20;
+        settings.workerCount =
+            std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+        textureStreamer_ = std::make_unique<TextureStreamer>(
+            settings, *bindlessHeap_, *deletionQueue_);
+        for (const auto &path : options_.texturePaths) {
+            streamedTextures_.push_back(textureStreamer_->request(path));
+        }
 
-        if (vkCreatePipelineLayout(
-                device_, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout_)
-            != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
+        // Only the heap holding the textures: shrinking them does nothing
+        // for the small host-visible device-local heap of discrete GPUs
+        // without resizable BAR, which the uniform ring and other
+        // processes fill
+        memoryBudget_->addWatermarkCallback(
+            [this](uint32_t heapIndex, const MemoryBudget::Heap &heap) {
+                if (heapIndex == textureStreamer_->memoryHeap())
+                    relieveMemoryPressure(heapIndex, heap);
+            });
+
+        std::cout << "streaming " << streamedTextures_.size()
+                  << " texture(s) "
+                  << (transferFamily_ != graphicsFamily_
+                          ? "on a dedicated transfer queue"
+                          : "on the graphics queue")
+                  << ", budget " << options_.textureBudgetMiB << " MiB\n";
+    }
+
+    // Past the high watermark the streamed textures give back what takes
+    // the heap over it, dropping their finest mips; past the critical one
+    // they shrink to their mip tails. The configured budget is restored
+    // once the pressure is back to normal.
+    void relieveMemoryPressure(uint32_t heapIndex,
+                               const MemoryBudget::Heap &heap)
+    {
+        VkDeviceSize budget = VkDeviceSize(options_.textureBudgetMiB) << 20;
+        VkDeviceSize resident = textureStreamer_->statistics().residentBytes;
+        const char *level = "normal";
+        if (heap.pressure == MemoryBudget::Pressure::HIGH) {
+            VkDeviceSize target = VkDeviceSize(
+                double(heap.budget) * options_.memoryHighWatermark);
+            VkDeviceSize excess = heap.usage > target ? heap.usage - target
+                                                      : 0;
+            budget = std::min(budget, resident > excess ? resident - excess
+                                                        : 0);
+            level = "high";
+        }
+        else if (heap.pressure == MemoryBudget::Pressure::CRITICAL) {
+            budget = 0;
+            level = "critical";
         }
+        textureStreamer_->setBudget(budget);
 
-        VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
-        pipelineCreateInfo.sType =
-            VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineCreateInfo.stageCount = 2;
-        pipelineCreateInfo.pStages = shaderStages;
+        std::cout << "memory pressure " << level << " on heap " << heapIndex
+                  << " (" << (heap.usage >> 20) << "/" << (heap.budget >> 20)
+                  << " MiB): texture budget " << (budget >> 20) << " MiB\n";
+    }
 
-        pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;
-        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyCreateInfo;
-        pipelineCreateInfo.pViewportState = &viewportCreateInfo;
-        pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
-        pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
-        pipelineCreateInfo.pDepthStencilState = nullptr; // optional
-        pipelineCreateInfo.pColorBlendState = &colorBlendCreateInfo;
-        pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    // Publishes finished uploads and starts new ones; draws fall back to the
+    // checkerboard until their texture has a resident mip
+    void updateStreamedTextures()
+    {
+        if (!textureStreamer_)
+            return;
+
+        textureStreamer_->update();
+        for (size_t i = 0; i < draws_.size(); i++) {
+            TextureHandle handle =
+                streamedTextures_[i % streamedTextures_.size()];
+            draws_[i].textureIndex =
+                textureStreamer_->heapIndex(handle, texture_.heapIndex);
+        }
+    }
 
-        pipelineCreateInfo.layout = pipelineLayout_;
+    void reportTextureStreaming() const
+    {
+        TextureStreamer::Statistics statistics =
+            textureStreamer_->statistics();
+        std::cout << "textures: " << statistics.decoded << "/"
+                  << statistics.textures << " decoded, "
+                  << statistics.fullyResident << " at full resolution, "
+                  << statistics.uploading << " uploading, "
+                  << (statistics.residentBytes >> 20) << " of "
+                  << (statistics.budget >> 20) << " MiB resident, "
+                  << (statistics.uploadedBytes >> 20) << " MiB uploaded";
+        if (statistics.failed > 0)
+            std::cout << ", " << statistics.failed << " failed";
+        std::cout << "\n";
+    }
 
-        pipelineCreateInfo.renderPass = renderPass_;
-        pipelineCreateInfo.subpass = 0;
+    void createLayerBuffer()
+    {
+        TRACE_ZONE("createLayerBuffer");
+        VkDeviceSize size = sizeof(float) * 4 * options_.overdrawLayers;
+        createBuffer(size,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     layerBuffer_,
+                     layerBufferMemory_);
+
+        void *data;
+        vkMapMemory(device_, layerBufferMemory_, 0, size, 0, &data);
+        auto tints = static_cast<float *>(data);
+        for (uint32_t i = 0; i < options_.overdrawLayers; i++) {
+            tints[i * 4 + 0] = 1.0f;
+            tints[i * 4 + 1] = 1.0f - 0.15f * static_cast<float>(i % 3);
+            tints[i * 4 + 2] = 1.0f - 0.15f * static_cast<float>(i % 5);
+            tints[i * 4 + 3] = 1.0f;
+        }
+        if (callCapture_)
+            callCapture_->bufferData(layerBuffer_, 0, data, size);
+        vkUnmapMemory(device_, layerBufferMemory_);
+
+        drawConstants_.layerBufferIndex =
+            bindlessHeap_->addStorageBuffer(layerBuffer_);
+        if (callCapture_)
+            callCapture_->heapBuffer(layerBuffer_,
+                                     drawConstants_.layerBufferIndex);
+    }
 
-        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
-        pipelineCreateInfo.basePipelineIndex = -1;
+    // Parses the mesh on every core directly into staging memory, then
+    // copies it to device local buffers
+    void createMesh()
+    {
+        TRACE_ZONE("createMesh");
+        if (options_.meshPath.empty())
+            return;
+
+        auto start = std::chrono::steady_clock::now();
+
+        StagingMeshDestination staging;
+        staging.app = this;
+        MeshInfo info = loadMesh(options_.meshPath, staging);
+
+        double loadMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+        VkDeviceSize indexSize = std::max<VkDeviceSize>(staging.sizes[0], 4);
+        VkDeviceSize vertexSize = std::max<VkDeviceSize>(staging.sizes[1], 4);
+        createBuffer(indexSize,
+                     VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                         | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     mesh_.indexBuffer,
+                     mesh_.indexMemory);
+        createBuffer(vertexSize,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                         | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     mesh_.vertexBuffer,
+                     mesh_.vertexMemory);
+        if (callCapture_) {
+            callCapture_->bufferData(
+                mesh_.indexBuffer, 0, staging.mapped[0], staging.sizes[0]);
+            callCapture_->bufferData(
+                mesh_.vertexBuffer, 0, staging.mapped[1], staging.sizes[1]);
+        }
 
-        if (vkCreateGraphicsPipelines(device_,
-                                      nullptr,
-                                      1,
-                                      &pipelineCreateInfo,
-                                      nullptr,
-                                      &graphicsPipeline_)
-            != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        VkBufferCopy indexCopy{ 0, 0, indexSize };
+        vkCmdCopyBuffer(commandBuffer,
+                        staging.buffers[0],
+                        mesh_.indexBuffer,
+                        1,
+                        &indexCopy);
+        VkBufferCopy vertexCopy{ 0, 0, vertexSize };
+        vkCmdCopyBuffer(commandBuffer,
+                        staging.buffers[1],
+                        mesh_.vertexBuffer,
+                        1,
+                        &vertexCopy);
+        endSingleTimeCommands(commandBuffer);
+
+        for (int slot = 0; slot < 2; slot++) {
+            vkUnmapMemory(device_, staging.memories[slot]);
+            vkDestroyBuffer(device_, staging.buffers[slot], nullptr);
+            vkFreeMemory(device_, staging.memories[slot], nullptr);
         }
 
-        // Destroy shader sources
+        mesh_.indexCount = info.indexCount;
+        drawConstants_.vertexBufferIndex =
+            bindlessHeap_->addStorageBuffer(mesh_.vertexBuffer);
+        if (callCapture_)
+            callCapture_->heapBuffer(mesh_.vertexBuffer,
+                                     drawConstants_.vertexBufferIndex);
+
+        float extent = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            drawConstants_.meshCenterScale[i] =
+                0.5f * (info.boundsMin[i] + info.boundsMax[i]);
+            extent = std::max(extent, info.boundsMax[i] - info.boundsMin[i]);
+        }
+        drawConstants_.meshCenterScale[3] = extent > 0.0f ? 1.0f / extent
+                                                          : 1.0f;
+
+        double megabytes =
+            std::filesystem::file_size(options_.meshPath) / double(1 << 20);
+        std::cout << "loaded " << options_.meshPath << ": "
+                  << info.vertexCount << " vertices (from "
+                  << info.sourceVertexCount << "), " << info.indexCount / 3
+                  << " triangles in " << loadMs << " ms ("
+                  << megabytes / (loadMs / 1000.0) << " MB/s)\n";
+    }
 
-        vkDestroyShaderModule(device_, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device_, vertShaderModule, nullptr);
+    void createCaptureResources()
+    {
+        TRACE_ZONE("createCaptureResources");
+        if (options_.capturePath.empty())
+            return;
+
+        captureWriter_ = std::make_unique<FrameCaptureWriter>(
+            options_.capturePath, options_.captureFrameRate);
+
+        // Only the first window is captured
+        const VkExtent2D &extent = windows_.front().extent;
+        VkDeviceSize frameSize =
+            static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+
+        captureSlots_ = std::vector<CaptureSlot>(options_.captureSlots);
+        for (auto &slot : captureSlots_) {
+            // Cached memory makes the CPU reads of the writer fast
+            VkMemoryPropertyFlags memoryProperties =
+                createBuffer(frameSize,
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                             slot.buffer,
+                             slot.memory,
+                             VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            captureCoherent_ = captureCoherent_
+                && (memoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+            if (vkMapMemory(device_, slot.memory, 0, frameSize, 0, &slot.mapped)
+                != VK_SUCCESS)
+                throw std::runtime_error("failed to map capture buffer!");
+        }
     }
 
-    void createFramebuffers()
+    void destroyCaptureResources()
     {
-        swapChainFramebuffers_.resize(swapChainImagesViews_.size());
+        if (!captureWriter_)
+            return;
 
-        for (size_t i = 0; i < swapChainImagesViews_.size(); i++) {
-            VkImageView attachments[] = {
-                swapChainImagesViews_[i],
-            };
+        // The device is idle: hand over the last copies, then let the writer
+        // drain its queue before the buffers go away
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            collectCapturedFrames(i);
+        }
+        captureWriter_.reset();
 
-            VkFramebufferCreateInfo framebufferCreateInfo{};
-            framebufferCreateInfo.sType =
-                VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferCreateInfo.renderPass = renderPass_;
-            framebufferCreateInfo.attachmentCount = 1;
-            framebufferCreateInfo.pAttachments = attachments;
-            framebufferCreateInfo.width = swapChainExtent_.width;
-            framebufferCreateInfo.height = swapChainExtent_.height;
-            framebufferCreateInfo.layers = 1;
+        for (auto &slot : captureSlots_) {
+            vkUnmapMemory(device_, slot.memory);
+            vkDestroyBuffer(device_, slot.buffer, nullptr);
+            vkFreeMemory(device_, slot.memory, nullptr);
+        }
+        captureSlots_.clear();
 
-            if (vkCreateFramebuffer(device_,
-                                    &framebufferCreateInfo,
-                                    nullptr,
-                                    &swapChainFramebuffers_[i])
-                != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
+        std::cout << "capture: " << capturedFrames_ << " frames written to "
+                  << options_.capturePath << ", " << droppedFrames_
+                  << " dropped (no free readback buffer)\n";
+    }
+
+    // Copies the rendered swap chain image into a free readback buffer.
+    // Never waits: without a free buffer the frame is dropped.
+    void recordCapture(VkCommandBuffer commandBuffer, const Window &window)
+    {
+        CaptureSlot *slot = nullptr;
+        for (auto &candidate : captureSlots_) {
+            if (!candidate.busy.load(std::memory_order_acquire)) {
+                slot = &candidate;
+                break;
             }
         }
+        if (slot == nullptr) {
+            droppedFrames_++;
+            return;
+        }
+        slot->busy.store(true, std::memory_order_relaxed);
+        slot->copyPending = true;
+        slot->frame = currentFrame_;
+
+        VkImageSubresourceRange colorRange{};
+        colorRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        colorRange.baseMipLevel = 0;
+        colorRange.levelCount = 1;
+        colorRange.baseArrayLayer = 0;
+        colorRange.layerCount = 1;
+
+        VkImageMemoryBarrier toTransfer{};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = window.images[window.imageIndex];
+        toTransfer.subresourceRange = colorRange;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             1,
+                             &toTransfer);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { window.extent.width, window.extent.height, 1 };
+
+        vkCmdCopyImageToBuffer(commandBuffer,
+                               window.images[window.imageIndex],
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               slot->buffer,
+                               1,
+                               &region);
+
+        VkImageMemoryBarrier toPresent = toTransfer;
+        toPresent.srcAccessMask = 0;
+        toPresent.dstAccessMask = 0;
+        toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkBufferMemoryBarrier toHost{};
+        toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.buffer = slot->buffer;
+        toHost.offset = 0;
+        toHost.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT
+                                 | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             1,
+                             &toHost,
+                             1,
+                             &toPresent);
     }
 
-    void createCommandPool()
+    // Called once the given frame in flight has completed
+    void collectCapturedFrames(uint32_t frame)
     {
-        QueueFamilyIndices queueFamilyIndices =
-            findQueueFamilies(physicalDevice_, surface_);
+        bool bgra = surfaceFormat_.format == VK_FORMAT_B8G8R8A8_SRGB
+            || surfaceFormat_.format == VK_FORMAT_B8G8R8A8_UNORM;
+
+        for (auto &slot : captureSlots_) {
+            if (!slot.copyPending || slot.frame != frame)
+                continue;
+            slot.copyPending = false;
+
+            if (!captureCoherent_) {
+                VkMappedMemoryRange range{};
+                range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+                range.memory = slot.memory;
+                range.offset = 0;
+                range.size = VK_WHOLE_SIZE;
+                vkInvalidateMappedMemoryRanges(device_, 1, &range);
+            }
 
-        VkCommandPoolCreateInfo commandPoolCreateInfo{};
-        commandPoolCreateInfo.sType =
-            VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        commandPoolCreateInfo.flags =
-            VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        commandPoolCreateInfo.queueFamilyIndex =
-            queueFamilyIndices.graphicsFamily.value();
+            CaptureFrame frame{};
+            frame.pixels = static_cast<const uint8_t *>(slot.mapped);
+            frame.width = windows_.front().extent.width;
+            frame.height = windows_.front().extent.height;
+            frame.bgra = bgra;
+            frame.index = capturedFrames_++;
+            frame.busy = &slot.busy;
+            captureWriter_->submit(frame);
+        }
+    }
 
-        if (vkCreateCommandPool(
-                device_, &commandPoolCreateInfo, nullptr, &commandPool_)
+    void createQueryPool()
+    {
+        TRACE_ZONE("createQueryPool");
+        if (!pipelineStatisticsSupported_) {
+            std::cout << "pipeline statistics queries not supported, "
+                         "overdraw and vertex reuse will not be reported\n";
+            return;
+        }
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+        // Results come back in bit order: primitives, vertex and fragment
+        // shader invocations
+        queryPoolInfo.pipelineStatistics =
+            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+            | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+            | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        if (vkCreateQueryPool(
+                device_, &queryPoolInfo, nullptr, &statisticsQueryPool_)
             != VK_SUCCESS) {
-            throw std::runtime_error("failed to create command pool!");
+            throw std::runtime_error("failed to create query pool!");
         }
     }
 
-    void createCommandBuffer()
+    void createTimestampQueryPool()
     {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool_;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = 1;
+        TRACE_ZONE("createTimestampQueryPool");
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(
+            physicalDevice_, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(
+            physicalDevice_, &familyCount, families.data());
 
-        if (vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer_)
+        uint32_t validBits = families[graphicsFamily_].timestampValidBits;
+        if (validBits == 0) {
+            std::cout << "timestamp queries not supported, traces will "
+                         "have no GPU track\n";
+            return;
+        }
+        timestampPeriod_ = properties.limits.timestampPeriod;
+        timestampMask_ = validBits < 64 ? (1ull << validBits) - 1 : ~0ull;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * TIMESTAMPS_PER_FRAME;
+
+        if (vkCreateQueryPool(
+                device_, &queryPoolInfo, nullptr, &timestampQueryPool_)
             != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate command buffers!");
+            throw std::runtime_error("failed to create query pool!");
+        }
+    }
+
+    // Records a timestamp of the current frame, if drawFrame() decided to
+    // time it
+    void writeTimestamp(VkCommandBuffer commandBuffer,
+                        VkPipelineStageFlagBits stage,
+                        uint32_t index)
+    {
+        if (!timestampQueryPending_[currentFrame_])
+            return;
+        vkCmdWriteTimestamp(commandBuffer,
+                            stage,
+                            timestampQueryPool_,
+                            currentFrame_ * TIMESTAMPS_PER_FRAME + index);
+    }
+
+    // Measures gpuClockOffset_. Without calibrated timestamps, the frame
+    // whose start is at startNanoseconds on the GPU is assumed to have
+    // started as it was submitted.
+    void calibrateGpuClock(uint32_t frame, double startNanoseconds)
+    {
+        gpuClockOffset_ = static_cast<int64_t>(submitTimes_[frame])
+            - static_cast<int64_t>(startNanoseconds);
+        gpuClockCalibrated_ = true;
+        if (!getCalibratedTimestamps_)
+            return;
+
+        VkCalibratedTimestampInfoEXT infos[2] = {};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        uint64_t timestamps[2];
+        uint64_t deviation;
+        if (getCalibratedTimestamps_(device_, 2, infos, timestamps, &deviation)
+            == VK_SUCCESS)
+            gpuClockOffset_ = static_cast<int64_t>(timestamps[1])
+                - static_cast<int64_t>(gpuNanoseconds(timestamps[0]));
+    }
+
+    double gpuNanoseconds(uint64_t ticks) const
+    {
+        return (ticks & timestampMask_) * timestampPeriod_;
+    }
+
+    // GPU ticks on the tracer's clock
+    uint64_t gpuTime(uint64_t ticks) const
+    {
+        return static_cast<uint64_t>(
+            static_cast<int64_t>(gpuNanoseconds(ticks)) + gpuClockOffset_);
+    }
+
+    // Called once the frame that wrote the timestamps has completed. The
+    // GPU time of the frame goes to the overlay, its zones to the trace.
+    void collectTimestamps(uint32_t frame)
+    {
+        if (!timestampQueryPending_[frame])
+            return;
+        timestampQueryPending_[frame] = false;
+
+        uint64_t results[TIMESTAMPS_PER_FRAME] = {};
+        if (vkGetQueryPoolResults(device_,
+                                  timestampQueryPool_,
+                                  frame * TIMESTAMPS_PER_FRAME,
+                                  TIMESTAMPS_PER_FRAME,
+                                  sizeof(results),
+                                  results,
+                                  sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT)
+            != VK_SUCCESS)
+            return;
+
+        gpuMilliseconds_ =
+            (gpuNanoseconds(results[2]) - gpuNanoseconds(results[0])) * 1e-6;
+        if (!options_.resultsPath.empty())
+            gpuFrameMilliseconds_.push_back(gpuMilliseconds_);
+        if (resolutionController_)
+            resolutionController_->update(gpuMilliseconds_);
+        if (!Tracer::enabled())
+            return;
+
+        if (!gpuClockCalibrated_)
+            calibrateGpuClock(frame, gpuNanoseconds(results[0]));
+        uint64_t start = gpuTime(results[0]);
+        uint64_t renderPassesEnd = gpuTime(results[1]);
+        uint64_t end = gpuTime(results[2]);
+        Tracer::gpuZone("frame", start, end);
+        Tracer::gpuZone("render passes", start, renderPassesEnd);
+        if (captureWriter_)
+            Tracer::gpuZone("capture copy", renderPassesEnd, end);
+    }
+
+    void resetStatistics()
+    {
+        fragmentInvocations_ = 0;
+        vertexInvocations_ = 0;
+        primitives_ = 0;
+        statisticsFrames_ = 0;
+    }
+
+    // Called once the frame that wrote the query has completed
+    void collectStatistics(uint32_t frame)
+    {
+        if (!statisticsQueryPending_[frame])
+            return;
+        statisticsQueryPending_[frame] = false;
+
+        uint64_t results[3] = {};
+        if (vkGetQueryPoolResults(device_,
+                                  statisticsQueryPool_,
+                                  frame,
+                                  1,
+                                  sizeof(results),
+                                  results,
+                                  sizeof(results),
+                                  VK_QUERY_RESULT_64_BIT)
+            != VK_SUCCESS)
+            return;
+
+        primitives_ += results[0];
+        vertexInvocations_ += results[1];
+        fragmentInvocations_ += results[2];
+        if (++statisticsFrames_ < STATISTICS_REPORT_FRAMES)
+            return;
+
+        double pixels = 0.0;
+        for (const auto &window : windows_) {
+            pixels += static_cast<double>(window.extent.width)
+                * window.extent.height * statisticsFrames_;
         }
+        std::cout << "overdraw: " << fragmentInvocations_ / pixels
+                  << " fragment shader invocations per pixel (depth "
+                     "pre-pass "
+                  << (depthPrePass_ ? "on" : "off") << ", "
+                  << options_.overdrawLayers << " layers)\n";
+        // The hardware ACMR, to compare with meshOptimize's simulation
+        if (primitives_ > 0)
+            std::cout << "vertex reuse: "
+                      << double(vertexInvocations_) / primitives_
+                      << " vertex shader invocations per triangle\n";
+        resetStatistics();
     }
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    // Records the render passes of every window into one command buffer
+    void recordCommandBuffer(VkCommandBuffer commandBuffer)
     {
+        TRACE_ZONE("recordCommandBuffer");
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = 0; // optional
@@ -1062,53 +4798,323 @@ private:
             throw std::runtime_error(
                 "failed to begin recording command buffer!");
         }
+        stateRecorder_->begin(commandBuffer);
+
+        if (timestampQueryPending_[currentFrame_])
+            vkCmdResetQueryPool(commandBuffer,
+                                timestampQueryPool_,
+                                currentFrame_ * TIMESTAMPS_PER_FRAME,
+                                TIMESTAMPS_PER_FRAME);
+        writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+
+        if (statisticsQueryPool_ != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(
+                commandBuffer, statisticsQueryPool_, currentFrame_, 1);
+            vkCmdBeginQuery(
+                commandBuffer, statisticsQueryPool_, currentFrame_, 0);
+        }
+
+        // The heap and the resource indices stay bound for every pipeline
+        // and render pass of the command buffer
+        VkDescriptorSet heapSet = bindlessHeap_->set();
+        vkCmdBindDescriptorSets(commandBuffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelineLayout_,
+                                0,
+                                1,
+                                &heapSet,
+                                0,
+                                nullptr);
+        vkCmdPushConstants(commandBuffer,
+                           pipelineLayout_,
+                           VK_SHADER_STAGE_VERTEX_BIT
+                               | VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0,
+                           offsetof(DrawConstants, draw),
+                           &drawConstants_);
+        if (callCapture_) {
+            callCapture_->bindHeap();
+            callCapture_->pushConstants(VK_SHADER_STAGE_VERTEX_BIT
+                                            | VK_SHADER_STAGE_FRAGMENT_BIT,
+                                        0,
+                                        offsetof(DrawConstants, draw),
+                                        &drawConstants_);
+        }
+
+        // With push constants the draw binding is not read: any valid
+        // offset will do
+        if (options_.pushDrawConstants)
+            bindUniformRing(commandBuffer, frameUniformsOffset_);
+
+        if (mesh_.indexBuffer != VK_NULL_HANDLE) {
+            vkCmdBindIndexBuffer(
+                commandBuffer, mesh_.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            if (callCapture_)
+                callCapture_->bindIndexBuffer(
+                    mesh_.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        }
+
+        for (const auto &window : windows_) {
+            recordRenderPass(commandBuffer, window);
+        }
+        if (overlayVisible_)
+            recordOverlay(commandBuffer, windows_.front());
+        writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
+
+        if (captureWriter_)
+            recordCapture(commandBuffer, windows_.front());
+        writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2);
+
+        if (statisticsQueryPool_ != VK_NULL_HANDLE) {
+            vkCmdEndQuery(commandBuffer, statisticsQueryPool_, currentFrame_);
+            statisticsQueryPending_[currentFrame_] = true;
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffers!");
+        }
+    }
+
+    void bindUniformRing(VkCommandBuffer commandBuffer, uint32_t drawOffset)
+    {
+        VkDescriptorSet ringSet = uniformRing_->set();
+        uint32_t dynamicOffsets[] = { frameUniformsOffset_, drawOffset };
+        vkCmdBindDescriptorSets(commandBuffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelineLayout_,
+                                1,
+                                1,
+                                &ringSet,
+                                2,
+                                dynamicOffsets);
+        if (callCapture_)
+            callCapture_->bindRing(frameUniformsOffset_, drawOffset);
+    }
+
+    // Each draw gets its constants either through a dynamic offset into the
+    // ring or by pushing them, and its state through stateRecorder_, which
+    // only records what changed. With materialPipelines, indexed by
+    // material, each draw also gets the pipeline of its material.
+    void recordDraws(VkCommandBuffer commandBuffer,
+                     const PipelineState &state,
+                     const VkPipeline *materialPipelines = nullptr)
+    {
+        DrawStateRecorder::State recordedState = drawState(state);
+        for (size_t i = 0; i < draws_.size(); i++) {
+            if (materialPipelines)
+                stateRecorder_->bindPipeline(
+                    materialPipelines[draws_[i].material]);
+            stateRecorder_->setState(recordedState);
+
+            if (options_.pushDrawConstants) {
+                vkCmdPushConstants(commandBuffer,
+                                   pipelineLayout_,
+                                   VK_SHADER_STAGE_VERTEX_BIT
+                                       | VK_SHADER_STAGE_FRAGMENT_BIT,
+                                   offsetof(DrawConstants, draw),
+                                   sizeof(DrawData),
+                                   &draws_[i]);
+                if (callCapture_)
+                    callCapture_->pushConstants(
+                        VK_SHADER_STAGE_VERTEX_BIT
+                            | VK_SHADER_STAGE_FRAGMENT_BIT,
+                        offsetof(DrawConstants, draw),
+                        sizeof(DrawData),
+                        &draws_[i]);
+            }
+            else {
+                bindUniformRing(commandBuffer, drawOffsets_[i]);
+            }
+
+            if (mesh_.indexBuffer != VK_NULL_HANDLE) {
+                vkCmdDrawIndexed(commandBuffer,
+                                 mesh_.indexCount,
+                                 options_.overdrawLayers,
+                                 0,
+                                 0,
+                                 0);
+                if (callCapture_)
+                    callCapture_->drawIndexed(
+                        mesh_.indexCount, options_.overdrawLayers, 0, 0, 0);
+            }
+            else {
+                vkCmdDraw(commandBuffer, 3, options_.overdrawLayers, 0, 0);
+                if (callCapture_)
+                    callCapture_->draw(3, options_.overdrawLayers, 0, 0);
+            }
+        }
+    }
+
+    void recordRenderPass(VkCommandBuffer commandBuffer, const Window &window)
+    {
+        // Below full resolution the scene goes to the target of the scale
+        const ScaledTarget *scaledTarget = nullptr;
+        if (resolutionController_
+            && resolutionController_->scaleIndex() + 1 < RENDER_SCALE_COUNT)
+            scaledTarget =
+                &window.scaledTargets[resolutionController_->scaleIndex()];
+        VkExtent2D extent =
+            scaledTarget ? scaledTarget->extent : window.extent;
 
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass_;
-        renderPassInfo.framebuffer = swapChainFramebuffers_[imageIndex];
+        renderPassInfo.renderPass =
+            scaledTarget ? scaledRenderPass_ : renderPass_;
+        renderPassInfo.framebuffer = scaledTarget
+            ? scaledTarget->framebuffer
+            : window.framebuffers[window.imageIndex];
 
         // render area
         renderPassInfo.renderArea.offset = { 0, 0 };
-        renderPassInfo.renderArea.extent = swapChainExtent_;
+        renderPassInfo.renderArea.extent = extent;
 
-        // clear color
-        VkClearValue clearColor = { { { 0.0f, 0.0f, 0.0f } } };
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+        // clear values, indexed by attachment (the resolve one is unused)
+        VkClearValue clearValues[2]{};
+        clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+        renderPassInfo.clearValueCount = 2;
+        renderPassInfo.pClearValues = clearValues;
 
         vkCmdBeginRenderPass(
             commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(
-            commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
+        if (callCapture_)
+            callCapture_->beginRenderPass(renderPassInfo);
 
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent_.width);
-        viewport.height = static_cast<float>(swapChainExtent_.height);
+        viewport.width = static_cast<float>(extent.width);
+        viewport.height = static_cast<float>(extent.height);
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        stateRecorder_->setViewport(viewport);
 
         VkRect2D scissor{};
         scissor.offset = { 0, 0 };
-        scissor.extent = swapChainExtent_;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        scissor.extent = extent;
+        stateRecorder_->setScissor(scissor);
+
+        // Depth pre-pass: lay down the nearest depth without shading
+
+        if (depthPrePass_) {
+            stateRecorder_->bindPipeline(depthPrePassPipeline_);
+            recordDraws(commandBuffer, passStates_[1]);
+        }
+
+        vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        if (callCapture_)
+            callCapture_->nextSubpass();
+
+        // Colour pass, each material with its specialised pipeline once
+        // compiled
+
+        VkPipeline generic =
+            depthPrePass_ ? depthEqualPipeline_ : graphicsPipeline_;
+        const PipelineState &colorState = passStates_[depthPrePass_ ? 2 : 0];
+        VkPipeline materialPipelines[MATERIAL_COUNT];
+        for (uint32_t material = 0; material < MATERIAL_COUNT; material++) {
+            materialPipelines[material] =
+                materialPipeline(colorState, material, generic);
+        }
 
-        // draw call
-        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        // draw calls
+        recordDraws(commandBuffer, colorState, materialPipelines);
 
         vkCmdEndRenderPass(commandBuffer);
+        if (callCapture_)
+            callCapture_->endRenderPass();
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffers!");
+        if (scaledTarget)
+            recordUpscale(commandBuffer, window, *scaledTarget);
+    }
+
+    // Blits the scene rendered at a reduced scale to the swap chain image,
+    // which is left as the main render pass would have left it
+    void recordUpscale(VkCommandBuffer commandBuffer,
+                       const Window &window,
+                       const ScaledTarget &target)
+    {
+        VkImage swapChainImage = window.images[window.imageIndex];
+
+        VkImageMemoryBarrier barriers[2]{};
+        for (VkImageMemoryBarrier &barrier : barriers) {
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
         }
+
+        // The render pass left the scene in TRANSFER_SRC_OPTIMAL
+        barriers[0].image = target.image;
+        barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        // Its previous contents are entirely overwritten
+        barriers[1].image = swapChainImage;
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             2,
+                             barriers);
+
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = { static_cast<int32_t>(target.extent.width),
+                               static_cast<int32_t>(target.extent.height),
+                               1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[1] = { static_cast<int32_t>(window.extent.width),
+                               static_cast<int32_t>(window.extent.height),
+                               1 };
+        vkCmdBlitImage(commandBuffer,
+                       target.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       swapChainImage,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1,
+                       &blit,
+                       VK_FILTER_LINEAR);
+
+        // For the overlay pass, the frame capture copy and presentation
+        VkImageMemoryBarrier present = barriers[1];
+        present.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        present.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_TRANSFER_READ_BIT;
+        present.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        present.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                                 | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             1,
+                             &present);
     }
 
     void createSyncObjects()
     {
+        TRACE_ZONE("createSyncObjects");
         VkSemaphoreCreateInfo semaphoreInfo{};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -1116,76 +5122,242 @@ private:
         fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        if (vkCreateSemaphore(
-                device_, &semaphoreInfo, nullptr, &imageAvailableSemaphore_)
-                != VK_SUCCESS
-            || vkCreateSemaphore(
-                   device_, &semaphoreInfo, nullptr, &renderFinishedSemaphore_)
-                != VK_SUCCESS
-            || vkCreateFence(device_, &fenceInfo, nullptr, &inFlightFence_)
-                != VK_SUCCESS) {
-            throw std::runtime_error("failed to create sync objects!");
+        renderFinishedSemaphores_.resize(MAX_FRAMES_IN_FLIGHT);
+        inFlightFences_.resize(MAX_FRAMES_IN_FLIGHT);
+
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (vkCreateSemaphore(device_,
+                                  &semaphoreInfo,
+                                  nullptr,
+                                  &renderFinishedSemaphores_[i])
+                    != VK_SUCCESS
+                || vkCreateFence(
+                       device_, &fenceInfo, nullptr, &inFlightFences_[i])
+                    != VK_SUCCESS) {
+                throw std::runtime_error("failed to create sync objects!");
+            }
         }
     }
 
+    void resetFrameTiming()
+    {
+        if (stateRecorder_)
+            stateRecorder_->takeStatistics();
+        cpuFrameSeconds_ = 0.0;
+        recordSeconds_ = 0.0;
+        timedFrames_ = 0;
+        timingStart_ = std::chrono::steady_clock::now();
+    }
+
+    // Reports how the cost of a frame grows with the number of windows
+    void recordFrameTiming(double cpuSeconds)
+    {
+        cpuFrameSeconds_ += cpuSeconds;
+        if (++timedFrames_ < STATISTICS_REPORT_FRAMES)
+            return;
+
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - timingStart_)
+                             .count();
+        double frameMs = 1000.0 * elapsed / timedFrames_;
+        double cpuMs = 1000.0 * cpuFrameSeconds_ / timedFrames_;
+        double recordMs = 1000.0 * recordSeconds_ / timedFrames_;
+        std::cout << windows_.size() << " window(s): " << frameMs
+                  << " ms per frame, " << cpuMs
+                  << " ms to acquire, record, submit and present ("
+                  << cpuMs / windows_.size() << " ms per window), "
+                  << recordMs << " ms recording " << draws_.size()
+                  << " draws with per-draw constants in "
+                  << (options_.pushDrawConstants ? "push constants"
+                                                 : "the uniform ring")
+                  << "\n";
+        if (textureStreamer_)
+            reportTextureStreaming();
+        if (pipelineVariants_)
+            reportPipelineVariantStatistics();
+        gpuClockCalibrated_ = false;
+        DrawStateRecorder::Statistics stateStatistics =
+            stateRecorder_->takeStatistics();
+        std::cout << "state commands per frame: "
+                  << stateStatistics.issued / timedFrames_ << " recorded, "
+                  << stateStatistics.skipped / timedFrames_
+                  << " skipped as redundant\n";
+        resetFrameTiming();
+    }
+
     void drawFrame()
     {
-        vkWaitForFences(device_, 1, &inFlightFence_, VK_TRUE, UINT64_MAX);
-        vkResetFences(device_, 1, &inFlightFence_);
+        TRACE_ZONE("drawFrame");
+        auto frameStart = std::chrono::steady_clock::now();
+        if (lastFrameStart_ != std::chrono::steady_clock::time_point{}) {
+            frameMilliseconds_[frameGraphNext_] =
+                std::chrono::duration<float, std::milli>(frameStart
+                                                         - lastFrameStart_)
+                    .count();
+            if (!options_.resultsPath.empty())
+                frameIntervals_.push_back(frameMilliseconds_[frameGraphNext_]);
+            frameGraphNext_ = (frameGraphNext_ + 1) % FRAME_GRAPH_FRAMES;
+        }
+        lastFrameStart_ = frameStart;
+
+        VkFence inFlightFence = inFlightFences_[currentFrame_];
+        VkCommandBuffer commandBuffer = commandBuffers_[currentFrame_];
+        VkSemaphore renderFinishedSemaphore =
+            renderFinishedSemaphores_[currentFrame_];
+
+        {
+            TRACE_ZONE("waitForFrameFence");
+            vkWaitForFences(device_, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+        }
+        vkResetFences(device_, 1, &inFlightFence);
+
+        // Everything written by this frame slot's previous use is complete,
+        // and with it every frame before
+        if (framesDrawn_ >= MAX_FRAMES_IN_FLIGHT)
+            deletionQueue_->collect(framesDrawn_ - MAX_FRAMES_IN_FLIGHT);
+        deletionQueue_->setFrame(framesDrawn_);
+        collectTimestamps(currentFrame_);
+        collectStatistics(currentFrame_);
+        collectCapturedFrames(currentFrame_);
+        memoryBudget_->update();
+        updateStreamedTextures();
+        if (pipelineVariants_)
+            pipelineVariants_->update();
+
+        auto cpuStart = std::chrono::steady_clock::now();
+
+        // The frame's jobs run on the workers while this thread waits for
+        // the swap chain images
+        JobSystem::Counter frameJobs;
+        writeFrameUniforms(frameJobs);
+
+        // Decided before the image waits, which depend on it
+        timestampQueryPending_[currentFrame_] =
+            timestampQueryPool_ != VK_NULL_HANDLE
+            && (Tracer::enabled() || overlayVisible_ || resolutionController_
+                || !options_.resultsPath.empty());
+
+        std::vector<VkSemaphore> waitSemaphores;
+        std::vector<VkPipelineStageFlags> waitStages;
+        std::vector<VkSwapchainKHR> swapChains;
+        std::vector<uint32_t> imageIndices;
+        {
+            TRACE_ZONE("acquireImages");
+            for (auto &window : windows_) {
+                VkSemaphore imageAvailableSemaphore =
+                    window.imageAvailableSemaphores[currentFrame_];
+                vkAcquireNextImageKHR(device_,
+                                      window.swapChain,
+                                      UINT64_MAX,
+                                      imageAvailableSemaphore,
+                                      VK_NULL_HANDLE,
+                                      &window.imageIndex);
+
+                waitSemaphores.push_back(imageAvailableSemaphore);
+                // A timed frame waits with all its commands, so that the
+                // top of pipe start timestamp comes after the acquire and
+                // the GPU time leaves out waiting for the presentation
+                // engine. Otherwise the upscaling blit writes the image
+                // before any pass.
+                VkPipelineStageFlags waitStage =
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+                if (timestampQueryPending_[currentFrame_])
+                    waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+                else if (resolutionController_)
+                    waitStage |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+                waitStages.push_back(waitStage);
+                swapChains.push_back(window.swapChain);
+                imageIndices.push_back(window.imageIndex);
+            }
+        }
+
+        {
+            TRACE_ZONE("waitFrameJobs");
+            jobSystem_->wait(frameJobs);
+        }
+        if (callCapture_)
+            callCapture_->beginFrame(currentFrame_,
+                                     uniformRing_->frameOffset(),
+                                     uniformRing_->frameData(),
+                                     uniformRing_->used());
 
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(device_,
-                              swapChain_,
-                              UINT64_MAX,
-                              imageAvailableSemaphore_,
-                              VK_NULL_HANDLE,
-                              &imageIndex);
+        auto recordStart = std::chrono::steady_clock::now();
 
-        vkResetCommandBuffer(commandBuffer_, 0);
-        recordCommandBuffer(commandBuffer_, imageIndex);
+        if (overlayVisible_)
+            buildOverlay();
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordCommandBuffer(commandBuffer);
 
+        recordSeconds_ += std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - recordStart)
+                              .count();
+
+        // One submission renders every window
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphore_ };
-        VkPipelineStageFlags waitStages[] = {
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-        };
-
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.waitSemaphoreCount =
+            static_cast<uint32_t>(waitSemaphores.size());
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer_;
+        submitInfo.pCommandBuffers = &commandBuffer;
 
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphore_ };
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if (vkQueueSubmit(graphicsQueue_, 1, &submitInfo, inFlightFence_)
-            != VK_SUCCESS) {
-            throw std::runtime_error("failed to submit draw command buffer!");
+        if (callCapture_)
+            callCapture_->endFrame();
+        if (timestampQueryPending_[currentFrame_])
+            submitTimes_[currentFrame_] = Tracer::now();
+        {
+            TRACE_ZONE("vkQueueSubmit");
+            if (vkQueueSubmit(graphicsQueue_, 1, &submitInfo, inFlightFence)
+                != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "failed to submit draw command buffer!");
+            }
         }
 
+        // And a single present call hands all the swap chains over
+        std::vector<VkResult> results(swapChains.size());
+
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         presentInfo.waitSemaphoreCount = 1;
         presentInfo.pWaitSemaphores = signalSemaphores;
 
-        VkSwapchainKHR swapChains[] = { swapChain_ };
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-        presentInfo.pImageIndices = &imageIndex;
-        presentInfo.pResults = nullptr;
+        presentInfo.swapchainCount = static_cast<uint32_t>(swapChains.size());
+        presentInfo.pSwapchains = swapChains.data();
+        presentInfo.pImageIndices = imageIndices.data();
+        presentInfo.pResults = results.data();
 
-        vkQueuePresentKHR(presentQueue_, &presentInfo);
+        {
+            TRACE_ZONE("vkQueuePresentKHR");
+            vkQueuePresentKHR(presentQueue_, &presentInfo);
+        }
+
+        currentFrame_ = (currentFrame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+
+        double cpuSeconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - cpuStart)
+                                .count();
+        cpuMilliseconds_ = 1000.0 * cpuSeconds;
+        recordFrameTiming(cpuSeconds);
+
+        if (framesDrawn_++ == 0)
+            startupMilliseconds_ =
+                std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - runStart_)
+                    .count();
+        if (!options_.resultsPath.empty())
+            cpuFrameMilliseconds_.push_back(cpuMilliseconds_);
     }
 };
 
-int main()
+int main(int argc, char **argv)
 {
-    HelloTriangleApplication app;
-
 #ifdef NDEBUG
     std::cout << "Release binary\n";
 #else
@@ -1193,6 +5365,7 @@ int main()
 #endif
 
     try {
+        HelloTriangleApplication app{ parseOptions(argc, argv) };
         app.run();
     }
     catch (const std::exception &e) {
@@ -0,0 +1,93 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Draws an imported mesh by pulling its vertices from a storage buffer of
+// the bindless heap; the pipeline has no vertex input state. Instances are
+// layers, as in triangle.vert.
+
+layout(constant_id = 0) const bool PUSH_DRAW_DATA = false;
+
+struct DrawData {
+	vec4 offsetScale; // xy offset, z scale, w rotation speed
+	vec4 color;
+	uint textureIndex; // bindless heap index
+	uint material;     // MATERIAL_* flags of triangle.frag
+};
+
+layout(push_constant) uniform DrawConstants {
+	uint layerBufferIndex;
+	uint vertexBufferIndex;
+	vec4 meshCenterScale; // xyz centre, w scale into a unit cube
+	DrawData draw;
+} constants;
+
+layout(set = 1, binding = 0) uniform FrameUniforms {
+	float time;
+} frame;
+
+layout(set = 1, binding = 1) uniform DrawUniforms {
+	DrawData draw;
+} drawUniforms;
+
+layout(set = 0, binding = 2) readonly buffer LayerTints {
+	vec4 tint[];
+} layerTints[];
+
+// MeshVertex: position, normal, uv as 8 tightly packed floats
+layout(set = 0, binding = 2) readonly buffer MeshVertices {
+	float v[];
+} meshVertices[];
+
+layout(location = 0) out vec3 out_color;
+layout(location = 1) out vec2 out_uv;
+layout(location = 2) flat out uint out_textureIndex;
+layout(location = 3) flat out uint out_material;
+
+invariant gl_Position;
+
+void main() {
+	uint heap = constants.vertexBufferIndex;
+	uint base = uint(gl_VertexIndex) * 8u;
+	vec3 position = vec3(meshVertices[heap].v[base],
+		meshVertices[heap].v[base + 1u],
+		meshVertices[heap].v[base + 2u]);
+	vec3 normal = vec3(meshVertices[heap].v[base + 3u],
+		meshVertices[heap].v[base + 4u],
+		meshVertices[heap].v[base + 5u]);
+	vec2 uv = vec2(meshVertices[heap].v[base + 6u],
+		meshVertices[heap].v[base + 7u]);
+
+	DrawData draw;
+	if (PUSH_DRAW_DATA)
+		draw = constants.draw;
+	else
+		draw = drawUniforms.draw;
+
+	// Spin around Y; the unit cube fills clip space at scale 1
+	float angle = frame.time * draw.offsetScale.w;
+	mat3 rotation = mat3(cos(angle), 0.0, -sin(angle),
+		0.0, 1.0, 0.0,
+		sin(angle), 0.0, cos(angle));
+	vec3 p = rotation * (position - constants.meshCenterScale.xyz)
+		* constants.meshCenterScale.w * draw.offsetScale.z * 2.0;
+
+	// Layers move towards the viewer like the triangle's; within a layer
+	// nearer parts of the mesh get smaller depths
+	float layerDepth = 1.0 / float(gl_InstanceIndex + 2);
+	float depth = layerDepth * (0.5 - 0.25 * p.z);
+	vec2 offset = vec2(0.02 * float(gl_InstanceIndex % 8));
+	vec3 tint =
+		layerTints[constants.layerBufferIndex].tint[gl_InstanceIndex].rgb;
+
+	gl_Position = vec4(vec2(p.x, -p.y) + draw.offsetScale.xy + offset,
+		depth, 1.0);
+
+	// Headlight Lambert term; meshes without normals are lit flat
+	float light = 1.0;
+	if (dot(normal, normal) > 0.0)
+		light = 0.3 + 0.7 * abs((rotation * normalize(normal)).z);
+	out_color = vec3(light) * tint * draw.color.rgb;
+	out_uv = uv;
+	out_textureIndex = draw.textureIndex;
+	out_material = draw.material;
+}
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(push_constant) uniform OverlayConstants {
+	uint atlasIndex;
+	uint vertexBufferIndex;
+	vec2 scale;
+} constants;
+
+// Bindless heap: one immutable sampler and every sampled image
+layout(set = 0, binding = 0) uniform sampler linearSampler;
+layout(set = 0, binding = 1) uniform texture2D textures[];
+
+layout(location = 0) in vec2 in_uv;
+layout(location = 1) in vec4 in_color;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	// Texels are fetched unfiltered: glyphs are magnified by whole factors
+	float coverage = texelFetch(
+		sampler2D(textures[constants.atlasIndex], linearSampler),
+		ivec2(in_uv),
+		0).a;
+	outColor = vec4(in_color.rgb, in_color.a * coverage);
+}
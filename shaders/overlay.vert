@@ -0,0 +1,33 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Statistics overlay: batched screen-space quads, pulled from a storage
+// buffer of the bindless heap
+
+struct OverlayVertex {
+	vec2 position; // pixels from the top-left corner
+	vec2 uv;       // atlas texels
+	uint color;    // RGBA8
+	uint padding;
+};
+
+layout(push_constant) uniform OverlayConstants {
+	uint atlasIndex;
+	uint vertexBufferIndex;
+	vec2 scale; // 2 / framebuffer size
+} constants;
+
+layout(set = 0, binding = 2) readonly buffer OverlayVertices {
+	OverlayVertex vertices[];
+} vertexBuffers[];
+
+layout(location = 0) out vec2 out_uv;
+layout(location = 1) out vec4 out_color;
+
+void main() {
+	OverlayVertex vertex =
+		vertexBuffers[constants.vertexBufferIndex].vertices[gl_VertexIndex];
+	gl_Position = vec4(vertex.position * constants.scale - 1.0, 0.0, 1.0);
+	out_uv = vertex.uv;
+	out_color = unpackUnorm4x8(vertex.color);
+}
@@ -1,9 +1,39 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+const uint MATERIAL_TEXTURE = 1u;
+const uint MATERIAL_VERTEX_COLOR = 2u;
+const uint MATERIAL_GRAYSCALE = 4u;
+const uint MATERIAL_GENERIC = 0xFFFFFFFFu;
+
+// Features of the material. Specialised pipelines fold the tests below;
+// the generic pipeline reads the material of each draw instead.
+layout(constant_id = 1) const uint MATERIAL = MATERIAL_GENERIC;
+
+// Bindless heap: one immutable sampler and every sampled image
+layout(set = 0, binding = 0) uniform sampler linearSampler;
+layout(set = 0, binding = 1) uniform texture2D textures[];
 
 layout(location = 0) in vec3 in_color;
+layout(location = 1) in vec2 in_uv;
+// Per draw, so uniform within a draw; the qualifier keeps it correct
+// should draws ever be merged
+layout(location = 2) flat in uint in_textureIndex;
+layout(location = 3) flat in uint in_material;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-	outColor = vec4(in_color, 1.0);
+	uint material = MATERIAL == MATERIAL_GENERIC ? in_material : MATERIAL;
+
+	vec3 color = vec3(1.0);
+	if ((material & MATERIAL_TEXTURE) != 0u)
+		color = texture(
+			sampler2D(textures[nonuniformEXT(in_textureIndex)], linearSampler),
+			in_uv).rgb;
+	if ((material & MATERIAL_VERTEX_COLOR) != 0u)
+		color *= in_color;
+	if ((material & MATERIAL_GRAYSCALE) != 0u)
+		color = vec3(dot(color, vec3(0.2126, 0.7152, 0.0722)));
+	outColor = vec4(color, 1.0);
 }
@@ -1,6 +1,45 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Where per-draw data is read from: push constants or the uniform ring
+layout(constant_id = 0) const bool PUSH_DRAW_DATA = false;
+
+struct DrawData {
+	vec4 offsetScale; // xy offset, z scale, w rotation speed
+	vec4 color;
+	uint textureIndex; // bindless heap index
+	uint material;     // MATERIAL_* flags of triangle.frag
+};
+
+layout(push_constant) uniform DrawConstants {
+	uint layerBufferIndex;
+	uint vertexBufferIndex; // mesh.vert only
+	vec4 meshCenterScale;   // mesh.vert only
+	DrawData draw;
+} constants;
+
+// Uniform ring, bound with dynamic offsets
+layout(set = 1, binding = 0) uniform FrameUniforms {
+	float time;
+} frame;
+
+layout(set = 1, binding = 1) uniform DrawUniforms {
+	DrawData draw;
+} drawUniforms;
+
+// Every storage buffer of the bindless heap
+layout(set = 0, binding = 2) readonly buffer LayerTints {
+	vec4 tint[];
+} layerTints[];
 
 layout(location = 0) out vec3 out_color;
+layout(location = 1) out vec2 out_uv;
+layout(location = 2) flat out uint out_textureIndex;
+layout(location = 3) flat out uint out_material;
+
+// The depth pre-pass and the EQUAL-tested colour pass must produce
+// bit-identical depth values
+invariant gl_Position;
 
 vec2 positions[3] = vec2[](
 	vec2(0.0, -0.5),
@@ -16,6 +55,28 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	out_color = colors[gl_VertexIndex];
+	// Each instance is a layer drawn in front of the previous ones (back to
+	// front), which is the worst case for overdraw without a pre-pass
+	float depth = 1.0 / float(gl_InstanceIndex + 2);
+	vec2 offset = vec2(0.02 * float(gl_InstanceIndex % 8));
+	vec3 tint =
+		layerTints[constants.layerBufferIndex].tint[gl_InstanceIndex].rgb;
+
+	DrawData draw;
+	if (PUSH_DRAW_DATA)
+		draw = constants.draw;
+	else
+		draw = drawUniforms.draw;
+
+	float angle = frame.time * draw.offsetScale.w;
+	mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+	vec2 position = rotation * positions[gl_VertexIndex] * draw.offsetScale.z
+		+ draw.offsetScale.xy;
+
+	gl_Position = vec4(position + offset, depth, 1.0);
+	out_color =
+		colors[gl_VertexIndex] * tint * draw.color.rgb * (0.5 + 0.5 * depth);
+	out_uv = positions[gl_VertexIndex] + vec2(0.5);
+	out_textureIndex = draw.textureIndex;
+	out_material = draw.material;
 }
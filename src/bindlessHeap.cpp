@@ -0,0 +1,222 @@
+#include "bindlessHeap.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+BindlessHeap::BindlessHeap(VkPhysicalDevice physicalDevice,
+                           VkDevice device,
+                           uint32_t sampledImageCapacity,
+                           uint32_t storageBufferCapacity)
+    : device_(device)
+{
+    VkPhysicalDeviceVulkan12Properties properties12{};
+    properties12.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    sampledImageCapacity = std::min(
+        { sampledImageCapacity,
+          properties12.maxDescriptorSetUpdateAfterBindSampledImages,
+          properties12.maxPerStageDescriptorUpdateAfterBindSampledImages });
+    storageBufferCapacity = std::min(
+        { storageBufferCapacity,
+          properties12.maxDescriptorSetUpdateAfterBindStorageBuffers,
+          properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+    sampledImages_ = IndexAllocator(sampledImageCapacity);
+    storageBuffers_ = IndexAllocator(storageBufferCapacity);
+
+    // Sampler
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device_, &samplerInfo, nullptr, &sampler_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create sampler!");
+
+    // Set layout
+
+    VkDescriptorSetLayoutBinding bindings[3]{};
+    bindings[SAMPLER_BINDING].binding = SAMPLER_BINDING;
+    bindings[SAMPLER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[SAMPLER_BINDING].descriptorCount = 1;
+    bindings[SAMPLER_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[SAMPLER_BINDING].pImmutableSamplers = &sampler_;
+
+    bindings[SAMPLED_IMAGE_BINDING].binding = SAMPLED_IMAGE_BINDING;
+    bindings[SAMPLED_IMAGE_BINDING].descriptorType =
+        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[SAMPLED_IMAGE_BINDING].descriptorCount = sampledImageCapacity;
+    bindings[SAMPLED_IMAGE_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+
+    bindings[STORAGE_BUFFER_BINDING].binding = STORAGE_BUFFER_BINDING;
+    bindings[STORAGE_BUFFER_BINDING].descriptorType =
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[STORAGE_BUFFER_BINDING].descriptorCount = storageBufferCapacity;
+    bindings[STORAGE_BUFFER_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+
+    // Unused slots may hold no descriptor at all, and slots not read by the
+    // frames in flight can be rewritten while the set is bound
+    VkDescriptorBindingFlags arrayFlags =
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+        | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+        | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    VkDescriptorBindingFlags bindingFlags[3] = { 0, arrayFlags, arrayFlags };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 3;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &layout_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create descriptor set layout!");
+
+    // Pool and the single set
+
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, sampledImageCapacity },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBufferCapacity },
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 3;
+    poolInfo.pPoolSizes = poolSizes;
+
+    if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create descriptor pool!");
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool_;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout_;
+
+    if (vkAllocateDescriptorSets(device_, &allocInfo, &set_) != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate descriptor set!");
+}
+
+BindlessHeap::~BindlessHeap()
+{
+    vkDestroyDescriptorPool(device_, pool_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, layout_, nullptr);
+    vkDestroySampler(device_, sampler_, nullptr);
+}
+
+bool BindlessHeap::isSupported(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_2)
+        return false;
+
+    VkPhysicalDeviceVulkan12Features supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &supported;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return supported.descriptorIndexing
+        && supported.runtimeDescriptorArray
+        && supported.descriptorBindingPartiallyBound
+        && supported.descriptorBindingUpdateUnusedWhilePending
+        && supported.descriptorBindingSampledImageUpdateAfterBind
+        && supported.descriptorBindingStorageBufferUpdateAfterBind
+        && supported.shaderSampledImageArrayNonUniformIndexing
+        && supported.shaderStorageBufferArrayNonUniformIndexing;
+}
+
+void BindlessHeap::requiredFeatures(VkPhysicalDeviceVulkan12Features &features)
+{
+    features.descriptorIndexing = VK_TRUE;
+    features.runtimeDescriptorArray = VK_TRUE;
+    features.descriptorBindingPartiallyBound = VK_TRUE;
+    features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+}
+
+uint32_t BindlessHeap::addSampledImage(VkImageView view, VkImageLayout layout)
+{
+    uint32_t index = sampledImages_.allocate();
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = layout;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set_;
+    write.dstBinding = SAMPLED_IMAGE_BINDING;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+    return index;
+}
+
+uint32_t BindlessHeap::addStorageBuffer(VkBuffer buffer,
+                                        VkDeviceSize offset,
+                                        VkDeviceSize range)
+{
+    uint32_t index = storageBuffers_.allocate();
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = offset;
+    bufferInfo.range = range;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set_;
+    write.dstBinding = STORAGE_BUFFER_BINDING;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+    return index;
+}
+
+void BindlessHeap::releaseSampledImage(uint32_t index)
+{
+    sampledImages_.release(index);
+}
+
+void BindlessHeap::releaseStorageBuffer(uint32_t index)
+{
+    storageBuffers_.release(index);
+}
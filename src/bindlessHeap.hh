@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "indexAllocator.hh"
+
+// Global descriptor set holding every sampled image and storage buffer in
+// large, partially bound arrays. Shaders select resources by index, so the
+// set is bound once per command buffer and draws never update descriptors.
+//
+//   binding 0: immutable linear sampler
+//   binding 1: sampled images  (partially bound, update after bind)
+//   binding 2: storage buffers (partially bound, update after bind)
+//
+// Requires the Vulkan 1.2 descriptor indexing features listed in
+// requiredFeatures().
+class BindlessHeap {
+public:
+    static constexpr uint32_t SAMPLER_BINDING = 0;
+    static constexpr uint32_t SAMPLED_IMAGE_BINDING = 1;
+    static constexpr uint32_t STORAGE_BUFFER_BINDING = 2;
+
+    // Capacities are clamped to the update-after-bind limits of the device
+    BindlessHeap(VkPhysicalDevice physicalDevice,
+                 VkDevice device,
+                 uint32_t sampledImageCapacity,
+                 uint32_t storageBufferCapacity);
+    ~BindlessHeap();
+
+    BindlessHeap(const BindlessHeap &) = delete;
+    BindlessHeap &operator=(const BindlessHeap &) = delete;
+
+    // Checks that the device supports the features requested below
+    static bool isSupported(VkPhysicalDevice physicalDevice);
+    // Enables the features the heap relies on
+    static void requiredFeatures(VkPhysicalDeviceVulkan12Features &features);
+
+    // Returns the index shaders use to reach the resource. The descriptor
+    // is written immediately, even while the set is in use by frames in
+    // flight.
+    uint32_t addSampledImage(VkImageView view, VkImageLayout layout);
+    uint32_t addStorageBuffer(VkBuffer buffer,
+                              VkDeviceSize offset = 0,
+                              VkDeviceSize range = VK_WHOLE_SIZE);
+
+    // The index can be handed out again straight away: callers must make
+    // sure no frame in flight still reads it.
+    void releaseSampledImage(uint32_t index);
+    void releaseStorageBuffer(uint32_t index);
+
+    VkDescriptorSetLayout layout() const
+    {
+        return layout_;
+    }
+
+    VkDescriptorSet set() const
+    {
+        return set_;
+    }
+
+    uint32_t sampledImageCount() const
+    {
+        return sampledImages_.size();
+    }
+
+    uint32_t storageBufferCount() const
+    {
+        return storageBuffers_.size();
+    }
+
+private:
+    VkDevice device_;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+    VkDescriptorPool pool_ = VK_NULL_HANDLE;
+    VkDescriptorSet set_ = VK_NULL_HANDLE;
+    IndexAllocator sampledImages_;
+    IndexAllocator storageBuffers_;
+};
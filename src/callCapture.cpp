@@ -0,0 +1,571 @@
+#include "callCapture.hh"
+
+namespace {
+
+// Appends to a record payload
+class Bytes {
+public:
+    explicit Bytes(std::vector<uint8_t> &out)
+        : out_(out)
+    {
+    }
+
+    void append(const void *data, size_t size)
+    {
+        auto bytes = static_cast<const uint8_t *>(data);
+        out_.insert(out_.end(), bytes, bytes + size);
+    }
+
+    template <typename T> void put(const T &value)
+    {
+        append(&value, sizeof(T));
+    }
+
+    template <typename T> void putArray(const T *values, uint32_t count)
+    {
+        put(count);
+        if (count > 0)
+            append(values, sizeof(T) * count);
+    }
+
+    void putString(const char *text)
+    {
+        putArray(text, static_cast<uint32_t>(std::strlen(text)));
+    }
+
+    // Whether state is present, then a copy with its pNext cleared, for
+    // create-info structures with no other pointer
+    template <typename T> void putState(const T *state)
+    {
+        put(uint32_t(state != nullptr));
+        if (state) {
+            T copy = *state;
+            copy.pNext = nullptr;
+            put(copy);
+        }
+    }
+
+private:
+    std::vector<uint8_t> &out_;
+};
+
+void putRenderPass(Bytes &bytes, const VkRenderPassCreateInfo &info)
+{
+    bytes.put(info.flags);
+    bytes.putArray(info.pAttachments, info.attachmentCount);
+    bytes.put(info.subpassCount);
+    for (uint32_t i = 0; i < info.subpassCount; i++) {
+        const VkSubpassDescription &subpass = info.pSubpasses[i];
+        bytes.put(subpass.flags);
+        bytes.put(subpass.pipelineBindPoint);
+        bytes.putArray(subpass.pInputAttachments,
+                       subpass.inputAttachmentCount);
+        bytes.putArray(subpass.pColorAttachments,
+                       subpass.colorAttachmentCount);
+        bytes.putArray(subpass.pResolveAttachments,
+                       subpass.pResolveAttachments
+                           ? subpass.colorAttachmentCount
+                           : 0);
+        bytes.putArray(subpass.pDepthStencilAttachment,
+                       subpass.pDepthStencilAttachment ? 1 : 0);
+        bytes.putArray(subpass.pPreserveAttachments,
+                       subpass.preserveAttachmentCount);
+    }
+    bytes.putArray(info.pDependencies, info.dependencyCount);
+}
+
+void putPipeline(Bytes &bytes, const VkGraphicsPipelineCreateInfo &info)
+{
+    bytes.put(info.flags);
+    bytes.put(info.subpass);
+
+    bytes.put(info.stageCount);
+    for (uint32_t i = 0; i < info.stageCount; i++) {
+        const VkPipelineShaderStageCreateInfo &stage = info.pStages[i];
+        bytes.put(stage.flags);
+        bytes.put(stage.stage);
+        bytes.putString(stage.pName);
+        const VkSpecializationInfo *specialization =
+            stage.pSpecializationInfo;
+        bytes.putArray(specialization ? specialization->pMapEntries : nullptr,
+                       specialization ? specialization->mapEntryCount : 0);
+        bytes.putArray(
+            specialization
+                ? static_cast<const uint8_t *>(specialization->pData)
+                : nullptr,
+            specialization ? uint32_t(specialization->dataSize) : 0);
+    }
+
+    const VkPipelineVertexInputStateCreateInfo *vertexInput =
+        info.pVertexInputState;
+    bytes.put(uint32_t(vertexInput != nullptr));
+    if (vertexInput) {
+        bytes.putArray(vertexInput->pVertexBindingDescriptions,
+                       vertexInput->vertexBindingDescriptionCount);
+        bytes.putArray(vertexInput->pVertexAttributeDescriptions,
+                       vertexInput->vertexAttributeDescriptionCount);
+    }
+
+    bytes.putState(info.pInputAssemblyState);
+    bytes.putState(info.pTessellationState);
+
+    const VkPipelineViewportStateCreateInfo *viewport = info.pViewportState;
+    bytes.put(uint32_t(viewport != nullptr));
+    if (viewport) {
+        bytes.put(viewport->flags);
+        bytes.put(viewport->viewportCount);
+        bytes.put(viewport->scissorCount);
+        // Absent when dynamic
+        bytes.putArray(viewport->pViewports,
+                       viewport->pViewports ? viewport->viewportCount : 0);
+        bytes.putArray(viewport->pScissors,
+                       viewport->pScissors ? viewport->scissorCount : 0);
+    }
+
+    bytes.putState(info.pRasterizationState);
+
+    const VkPipelineMultisampleStateCreateInfo *multisample =
+        info.pMultisampleState;
+    bytes.put(uint32_t(multisample != nullptr));
+    if (multisample) {
+        VkPipelineMultisampleStateCreateInfo copy = *multisample;
+        copy.pNext = nullptr;
+        copy.pSampleMask = nullptr;
+        bytes.put(copy);
+        uint32_t maskWords = (copy.rasterizationSamples + 31) / 32;
+        bytes.putArray(multisample->pSampleMask,
+                       multisample->pSampleMask ? maskWords : 0);
+    }
+
+    bytes.putState(info.pDepthStencilState);
+
+    const VkPipelineColorBlendStateCreateInfo *colorBlend =
+        info.pColorBlendState;
+    bytes.put(uint32_t(colorBlend != nullptr));
+    if (colorBlend) {
+        VkPipelineColorBlendStateCreateInfo copy = *colorBlend;
+        copy.pNext = nullptr;
+        copy.pAttachments = nullptr;
+        bytes.put(copy);
+        bytes.putArray(colorBlend->pAttachments, colorBlend->attachmentCount);
+    }
+
+    const VkPipelineDynamicStateCreateInfo *dynamic = info.pDynamicState;
+    bytes.put(uint32_t(dynamic != nullptr));
+    if (dynamic)
+        bytes.putArray(dynamic->pDynamicStates, dynamic->dynamicStateCount);
+}
+
+} // namespace
+
+CallCapture::CallCapture(const std::filesystem::path &path,
+                         const DrawStateRecorder::Support &support)
+    : out_(path, std::ios::binary)
+    , path_(path)
+{
+    if (!out_)
+        throw std::runtime_error("failed to open call trace "
+                                 + path.string() + "!");
+
+    CallTraceHeader header;
+    header.extendedDynamicState = support.extendedDynamicState;
+    header.extendedDynamicState2 = support.extendedDynamicState2;
+    header.extendedDynamicState3Blend = support.extendedDynamicState3Blend;
+    out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+CallCapture::~CallCapture() = default;
+
+void CallCapture::heap(uint32_t sampledImageCapacity,
+                       uint32_t storageBufferCapacity)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(sampledImageCapacity);
+    bytes.put(storageBufferCapacity);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    nextIds_[static_cast<size_t>(CallRecord::HEAP)]++;
+    writeRecord(CallRecord::HEAP, objectRecord({}, payload));
+}
+
+void CallCapture::ring(VkDeviceSize bytesPerFrame,
+                       uint32_t framesInFlight,
+                       VkDeviceSize frameRange,
+                       VkDeviceSize drawRange,
+                       VkDeviceSize alignment)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(bytesPerFrame);
+    bytes.put(framesInFlight);
+    bytes.put(frameRange);
+    bytes.put(drawRange);
+    bytes.put(alignment);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    nextIds_[static_cast<size_t>(CallRecord::RING)]++;
+    writeRecord(CallRecord::RING, objectRecord({}, payload));
+}
+
+void CallCapture::pipelineLayout(VkShaderStageFlags pushConstantStages,
+                                 uint32_t pushConstantSize)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(pushConstantStages);
+    bytes.put(pushConstantSize);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    nextIds_[static_cast<size_t>(CallRecord::PIPELINE_LAYOUT)]++;
+    writeRecord(CallRecord::PIPELINE_LAYOUT, objectRecord({}, payload));
+}
+
+void CallCapture::shaderModule(VkShaderModule module,
+                               const void *code,
+                               size_t size)
+{
+    std::vector<uint8_t> payload;
+    Bytes(payload).putArray(static_cast<const uint8_t *>(code),
+                            static_cast<uint32_t>(size));
+    note(key(CallRecord::SHADER_MODULE, module), {}, std::move(payload));
+}
+
+void CallCapture::renderPass(VkRenderPass renderPass,
+                             const VkRenderPassCreateInfo &info)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    putRenderPass(bytes, info);
+    note(key(CallRecord::RENDER_PASS, renderPass), {}, std::move(payload));
+}
+
+void CallCapture::pipeline(VkPipeline pipeline,
+                           const VkGraphicsPipelineCreateInfo &info)
+{
+    if (info.flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR)
+        throw std::runtime_error("pipeline libraries cannot be captured!");
+
+    std::vector<Key> uses = { key(CallRecord::RENDER_PASS, info.renderPass) };
+    for (uint32_t i = 0; i < info.stageCount; i++) {
+        uses.push_back(
+            key(CallRecord::SHADER_MODULE, info.pStages[i].module));
+    }
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    putPipeline(bytes, info);
+
+    Key pipelineKey = key(CallRecord::PIPELINE, pipeline);
+    note(pipelineKey, std::move(uses), std::move(payload));
+    std::lock_guard<std::mutex> lock(mutex_);
+    written(pipelineKey);
+}
+
+void CallCapture::buffer(VkBuffer buffer,
+                         VkDeviceSize size,
+                         VkBufferUsageFlags usage,
+                         VkMemoryPropertyFlags properties)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(size);
+    bytes.put(usage);
+    bytes.put(properties);
+    note(key(CallRecord::BUFFER, buffer), {}, std::move(payload));
+}
+
+void CallCapture::image(VkImage image, const VkImageCreateInfo &info)
+{
+    VkImageCreateInfo copy = info;
+    copy.pNext = nullptr;
+    copy.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    copy.queueFamilyIndexCount = 0;
+    copy.pQueueFamilyIndices = nullptr;
+
+    std::vector<uint8_t> payload;
+    Bytes(payload).put(copy);
+    note(key(CallRecord::IMAGE, image), {}, std::move(payload));
+}
+
+void CallCapture::imageView(VkImageView view, const VkImageViewCreateInfo &info)
+{
+    VkImageViewCreateInfo copy = info;
+    copy.pNext = nullptr;
+    copy.image = VK_NULL_HANDLE;
+
+    std::vector<uint8_t> payload;
+    Bytes(payload).put(copy);
+    note(key(CallRecord::IMAGE_VIEW, view),
+         { key(CallRecord::IMAGE, info.image) },
+         std::move(payload));
+}
+
+void CallCapture::framebuffer(VkFramebuffer framebuffer,
+                              const VkFramebufferCreateInfo &info)
+{
+    std::vector<Key> uses = { key(CallRecord::RENDER_PASS, info.renderPass) };
+    for (uint32_t i = 0; i < info.attachmentCount; i++) {
+        uses.push_back(key(CallRecord::IMAGE_VIEW, info.pAttachments[i]));
+    }
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(info.flags);
+    bytes.put(info.width);
+    bytes.put(info.height);
+    bytes.put(info.layers);
+    note(key(CallRecord::FRAMEBUFFER, framebuffer),
+         std::move(uses),
+         std::move(payload));
+}
+
+void CallCapture::bufferData(VkBuffer buffer,
+                             VkDeviceSize offset,
+                             const void *data,
+                             size_t size)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(offset);
+    bytes.putArray(static_cast<const uint8_t *>(data),
+                   static_cast<uint32_t>(size));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<uint8_t> record =
+        objectRecord({ key(CallRecord::BUFFER, buffer) }, payload);
+    if (inFrame_)
+        command(CallRecord::BUFFER_DATA, record.data(), record.size());
+    else
+        writeRecord(CallRecord::BUFFER_DATA, record);
+}
+
+void CallCapture::imageData(VkImage image, const void *texels, size_t size)
+{
+    std::vector<uint8_t> payload;
+    Bytes(payload).putArray(static_cast<const uint8_t *>(texels),
+                            static_cast<uint32_t>(size));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeRecord(CallRecord::IMAGE_DATA,
+                objectRecord({ key(CallRecord::IMAGE, image) }, payload));
+}
+
+void CallCapture::heapImage(VkImageView view, uint32_t index)
+{
+    std::vector<uint8_t> payload;
+    Bytes(payload).put(index);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeRecord(CallRecord::HEAP_IMAGE,
+                objectRecord({ key(CallRecord::IMAGE_VIEW, view) }, payload));
+}
+
+void CallCapture::heapBuffer(VkBuffer buffer, uint32_t index)
+{
+    std::vector<uint8_t> payload;
+    Bytes(payload).put(index);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeRecord(CallRecord::HEAP_BUFFER,
+                objectRecord({ key(CallRecord::BUFFER, buffer) }, payload));
+}
+
+void CallCapture::beginFrame(uint32_t frameIndex,
+                             VkDeviceSize ringOffset,
+                             const void *ringData,
+                             size_t ringSize)
+{
+    frame_.clear();
+    Bytes bytes(frame_);
+    bytes.put(frameIndex);
+    bytes.put(ringOffset);
+    bytes.putArray(static_cast<const uint8_t *>(ringData),
+                   static_cast<uint32_t>(ringSize));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    inFrame_ = true;
+}
+
+void CallCapture::endFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeRecord(CallRecord::FRAME, frame_);
+    inFrame_ = false;
+    frames_++;
+}
+
+void CallCapture::beginRenderPass(const VkRenderPassBeginInfo &info)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes.put(written(key(CallRecord::FRAMEBUFFER, info.framebuffer)));
+    }
+    bytes.put(info.renderArea);
+    bytes.putArray(info.pClearValues, info.clearValueCount);
+    command(CallRecord::BEGIN_RENDER_PASS, payload.data(), payload.size());
+}
+
+void CallCapture::nextSubpass()
+{
+    command(CallRecord::NEXT_SUBPASS, nullptr, 0);
+}
+
+void CallCapture::endRenderPass()
+{
+    command(CallRecord::END_RENDER_PASS, nullptr, 0);
+}
+
+void CallCapture::bindPipeline(VkPipeline pipeline)
+{
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = written(key(CallRecord::PIPELINE, pipeline));
+    }
+    command(CallRecord::BIND_PIPELINE, &id, sizeof(id));
+}
+
+void CallCapture::setViewport(const VkViewport &viewport)
+{
+    command(CallRecord::SET_VIEWPORT, &viewport, sizeof(viewport));
+}
+
+void CallCapture::setScissor(const VkRect2D &scissor)
+{
+    command(CallRecord::SET_SCISSOR, &scissor, sizeof(scissor));
+}
+
+void CallCapture::setState(const DrawStateRecorder::State &state)
+{
+    command(CallRecord::SET_STATE, &state, sizeof(state));
+}
+
+void CallCapture::bindHeap()
+{
+    command(CallRecord::BIND_HEAP, nullptr, 0);
+}
+
+void CallCapture::bindRing(uint32_t frameOffset, uint32_t drawOffset)
+{
+    uint32_t offsets[] = { frameOffset, drawOffset };
+    command(CallRecord::BIND_RING, offsets, sizeof(offsets));
+}
+
+void CallCapture::pushConstants(VkShaderStageFlags stages,
+                                uint32_t offset,
+                                uint32_t size,
+                                const void *data)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    bytes.put(stages);
+    bytes.put(offset);
+    bytes.putArray(static_cast<const uint8_t *>(data), size);
+    command(CallRecord::PUSH_CONSTANTS, payload.data(), payload.size());
+}
+
+void CallCapture::bindIndexBuffer(VkBuffer buffer,
+                                  VkDeviceSize offset,
+                                  VkIndexType indexType)
+{
+    std::vector<uint8_t> payload;
+    Bytes bytes(payload);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes.put(written(key(CallRecord::BUFFER, buffer)));
+    }
+    bytes.put(offset);
+    bytes.put(indexType);
+    command(CallRecord::BIND_INDEX_BUFFER, payload.data(), payload.size());
+}
+
+void CallCapture::draw(uint32_t vertexCount,
+                       uint32_t instanceCount,
+                       uint32_t firstVertex,
+                       uint32_t firstInstance)
+{
+    uint32_t parameters[] = {
+        vertexCount, instanceCount, firstVertex, firstInstance
+    };
+    command(CallRecord::DRAW, parameters, sizeof(parameters));
+}
+
+void CallCapture::drawIndexed(uint32_t indexCount,
+                              uint32_t instanceCount,
+                              uint32_t firstIndex,
+                              int32_t vertexOffset,
+                              uint32_t firstInstance)
+{
+    uint32_t parameters[] = { indexCount,
+                              instanceCount,
+                              firstIndex,
+                              static_cast<uint32_t>(vertexOffset),
+                              firstInstance };
+    command(CallRecord::DRAW_INDEXED, parameters, sizeof(parameters));
+}
+
+void CallCapture::note(const Key &key,
+                       std::vector<Key> uses,
+                       std::vector<uint8_t> payload)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A handle can be reused once its object is destroyed
+    Object &object = objects_[key];
+    object.uses = std::move(uses);
+    object.payload = std::move(payload);
+    object.id = NOT_WRITTEN;
+}
+
+uint32_t CallCapture::written(const Key &key)
+{
+    auto found = objects_.find(key);
+    if (found == objects_.end())
+        throw std::runtime_error(
+            "call capture: object used but its creation was not captured!");
+
+    Object &object = found->second;
+    if (object.id == NOT_WRITTEN) {
+        std::vector<uint8_t> record = objectRecord(object.uses, object.payload);
+        object.id = nextIds_[static_cast<size_t>(key.first)]++;
+        writeRecord(key.first, record);
+    }
+    return object.id;
+}
+
+void CallCapture::writeRecord(CallRecord type,
+                              const std::vector<uint8_t> &payload)
+{
+    uint32_t header[] = { static_cast<uint32_t>(type),
+                          static_cast<uint32_t>(payload.size()) };
+    out_.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out_.write(reinterpret_cast<const char *>(payload.data()),
+               static_cast<std::streamsize>(payload.size()));
+    if (!out_)
+        throw std::runtime_error("failed to write call trace "
+                                 + path_.string() + "!");
+}
+
+std::vector<uint8_t>
+CallCapture::objectRecord(const std::vector<Key> &uses,
+                          const std::vector<uint8_t> &payload)
+{
+    std::vector<uint32_t> ids;
+    for (const Key &use : uses) {
+        ids.push_back(written(use));
+    }
+    std::vector<uint8_t> record;
+    Bytes bytes(record);
+    bytes.putArray(ids.data(), static_cast<uint32_t>(ids.size()));
+    bytes.append(payload.data(), payload.size());
+    return record;
+}
+
+void CallCapture::command(CallRecord type, const void *payload, size_t size)
+{
+    Bytes bytes(frame_);
+    bytes.put(static_cast<uint32_t>(type));
+    bytes.put(static_cast<uint32_t>(size));
+    if (size > 0)
+        bytes.append(payload, size);
+}
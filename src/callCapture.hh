@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "drawStateRecorder.hh"
+
+// Binary trace of the Vulkan objects a renderer creates and of the commands
+// of each frame it records, replayed headless by vulkanReplay.
+//
+// A CallTraceHeader is followed by records: a CallRecord type, a payload
+// size and the payload, all uint32_t. Objects are numbered per record type
+// in the order they appear, and object records start with the numbers of
+// the objects they use (a uint32_t count, then the numbers). A FRAME
+// record holds the commands of one frame as nested records.
+//
+// Vulkan structures without pointers are stored as laid out in memory, and
+// pNext chains are not stored: a trace replays on the platform that wrote
+// it, with the extensions the header lists.
+
+constexpr uint32_t CALL_TRACE_MAGIC = 0x5443'4B56; // "VKCT"
+constexpr uint32_t CALL_TRACE_VERSION = 1;
+
+struct CallTraceHeader {
+    uint32_t magic = CALL_TRACE_MAGIC;
+    uint32_t version = CALL_TRACE_VERSION;
+    // DrawStateRecorder::Support of the capturing device
+    uint32_t extendedDynamicState = 0;
+    uint32_t extendedDynamicState2 = 0;
+    uint32_t extendedDynamicState3Blend = 0;
+};
+
+enum class CallRecord : uint32_t
+{
+    // Objects
+    HEAP,
+    RING,
+    PIPELINE_LAYOUT,
+    SHADER_MODULE,
+    RENDER_PASS,
+    PIPELINE,
+    BUFFER,
+    IMAGE,
+    IMAGE_VIEW,
+    FRAMEBUFFER,
+    // Contents, and slots of the bindless heap
+    BUFFER_DATA,
+    IMAGE_DATA,
+    HEAP_IMAGE,
+    HEAP_BUFFER,
+    FRAME,
+    // Commands, inside a FRAME
+    BEGIN_RENDER_PASS,
+    NEXT_SUBPASS,
+    END_RENDER_PASS,
+    BIND_PIPELINE,
+    SET_VIEWPORT,
+    SET_SCISSOR,
+    SET_STATE,
+    BIND_HEAP,
+    BIND_RING,
+    PUSH_CONSTANTS,
+    BIND_INDEX_BUFFER,
+    DRAW,
+    DRAW_INDEXED,
+    COUNT
+};
+
+// Writes a trace. Objects may be created from any thread; frames are
+// recorded by one thread at a time.
+//
+// Buffers, images, views and framebuffers are only noted when created, and
+// written once a record refers to them: staging resources never reach the
+// trace. Pipelines are written as they are created, with the shader modules
+// and render pass they use, as modules may be destroyed before the
+// pipeline is first bound. Only whole pipelines can be captured, not
+// pipeline libraries.
+class CallCapture {
+public:
+    CallCapture(const std::filesystem::path &path,
+                const DrawStateRecorder::Support &support);
+    ~CallCapture();
+
+    CallCapture(const CallCapture &) = delete;
+    CallCapture &operator=(const CallCapture &) = delete;
+
+    // The BindlessHeap, UniformRing and pipeline layout the commands use
+
+    void heap(uint32_t sampledImageCapacity, uint32_t storageBufferCapacity);
+    void ring(VkDeviceSize bytesPerFrame,
+              uint32_t framesInFlight,
+              VkDeviceSize frameRange,
+              VkDeviceSize drawRange,
+              VkDeviceSize alignment);
+    void pipelineLayout(VkShaderStageFlags pushConstantStages,
+                        uint32_t pushConstantSize);
+
+    // Objects, noted after their creation
+
+    void shaderModule(VkShaderModule module, const void *code, size_t size);
+    void renderPass(VkRenderPass renderPass,
+                    const VkRenderPassCreateInfo &info);
+    void pipeline(VkPipeline pipeline,
+                  const VkGraphicsPipelineCreateInfo &info);
+    void buffer(VkBuffer buffer,
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                VkMemoryPropertyFlags properties);
+    void image(VkImage image, const VkImageCreateInfo &info);
+    void imageView(VkImageView view, const VkImageViewCreateInfo &info);
+    void framebuffer(VkFramebuffer framebuffer,
+                     const VkFramebufferCreateInfo &info);
+
+    // Contents and heap slots. Inside a frame, buffer data is part of the
+    // frame, written before its commands execute.
+
+    void bufferData(VkBuffer buffer,
+                    VkDeviceSize offset,
+                    const void *data,
+                    size_t size);
+    // Tightly packed texels of the first mip level, left in
+    // SHADER_READ_ONLY_OPTIMAL layout
+    void imageData(VkImage image, const void *texels, size_t size);
+    void heapImage(VkImageView view, uint32_t index);
+    void heapBuffer(VkBuffer buffer, uint32_t index);
+
+    // Frames. ringData is the frame's region of the uniform ring, which
+    // starts at ringOffset in the ring buffer.
+
+    void beginFrame(uint32_t frameIndex,
+                    VkDeviceSize ringOffset,
+                    const void *ringData,
+                    size_t ringSize);
+    void endFrame();
+
+    void beginRenderPass(const VkRenderPassBeginInfo &info);
+    void nextSubpass();
+    void endRenderPass();
+    void bindPipeline(VkPipeline pipeline);
+    void setViewport(const VkViewport &viewport);
+    void setScissor(const VkRect2D &scissor);
+    void setState(const DrawStateRecorder::State &state);
+    void bindHeap();
+    void bindRing(uint32_t frameOffset, uint32_t drawOffset);
+    void pushConstants(VkShaderStageFlags stages,
+                       uint32_t offset,
+                       uint32_t size,
+                       const void *data);
+    void bindIndexBuffer(VkBuffer buffer,
+                         VkDeviceSize offset,
+                         VkIndexType indexType);
+    void draw(uint32_t vertexCount,
+              uint32_t instanceCount,
+              uint32_t firstVertex,
+              uint32_t firstInstance);
+    void drawIndexed(uint32_t indexCount,
+                     uint32_t instanceCount,
+                     uint32_t firstIndex,
+                     int32_t vertexOffset,
+                     uint32_t firstInstance);
+
+    uint64_t frames() const
+    {
+        return frames_;
+    }
+
+private:
+    using Key = std::pair<CallRecord, uint64_t>;
+
+    static constexpr uint32_t NOT_WRITTEN = ~0u;
+
+    struct Object {
+        std::vector<Key> uses;
+        std::vector<uint8_t> payload;
+        // Number in the trace, once written
+        uint32_t id = NOT_WRITTEN;
+    };
+
+    template <typename Handle> static Key key(CallRecord type, Handle handle)
+    {
+        uint64_t value = 0;
+        std::memcpy(&value, &handle, sizeof(handle));
+        return { type, value };
+    }
+
+    void note(const Key &key,
+              std::vector<Key> uses,
+              std::vector<uint8_t> payload);
+    // Writes the object and those it uses if not done yet, with mutex_ held
+    uint32_t written(const Key &key);
+    void writeRecord(CallRecord type, const std::vector<uint8_t> &payload);
+    // A record of the objects used, then the payload
+    std::vector<uint8_t> objectRecord(const std::vector<Key> &uses,
+                                      const std::vector<uint8_t> &payload);
+    void command(CallRecord type, const void *payload, size_t size);
+
+    std::mutex mutex_;
+    std::ofstream out_;
+    std::filesystem::path path_;
+    std::map<Key, Object> objects_;
+    uint32_t nextIds_[static_cast<size_t>(CallRecord::COUNT)] = {};
+    // Commands of the frame being recorded, written whole by endFrame
+    std::vector<uint8_t> frame_;
+    bool inFrame_ = false;
+    uint64_t frames_ = 0;
+};
+
+// Cursor over a trace or over the payload of one of its records. Throws
+// std::runtime_error past the end.
+class CallTraceReader {
+public:
+    CallTraceReader(const uint8_t *data, size_t size)
+        : data_(data)
+        , end_(data + size)
+    {
+    }
+
+    bool atEnd() const
+    {
+        return data_ == end_;
+    }
+
+    const uint8_t *bytes(size_t size)
+    {
+        if (size > static_cast<size_t>(end_ - data_))
+            throw std::runtime_error("truncated call trace!");
+        const uint8_t *bytes = data_;
+        data_ += size;
+        return bytes;
+    }
+
+    template <typename T> T read()
+    {
+        T value;
+        std::memcpy(&value, bytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // A uint32_t count, then the elements
+    template <typename T> std::vector<T> readArray()
+    {
+        uint32_t count = read<uint32_t>();
+        std::vector<T> values(count);
+        if (count > 0)
+            std::memcpy(
+                values.data(), bytes(sizeof(T) * count), sizeof(T) * count);
+        return values;
+    }
+
+    // The next record, its payload as a reader of its own
+    CallTraceReader record(CallRecord &type)
+    {
+        type = static_cast<CallRecord>(read<uint32_t>());
+        uint32_t size = read<uint32_t>();
+        return CallTraceReader(bytes(size), size);
+    }
+
+private:
+    const uint8_t *data_;
+    const uint8_t *end_;
+};
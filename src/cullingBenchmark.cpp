@@ -0,0 +1,167 @@
+// Frustum culling throughput of each kernel the CPU runs:
+//
+//   cullingBenchmark [--objects N] [--threads N] [--runs N] [--grain N]
+//
+// --objects random objects (sphere and box) fill a cube around a camera
+// with a 90 degree field of view, so that about a sixth are visible.
+// Measures, best of --runs, the cull on the calling thread alone and spread
+// over the job system, in millions of objects per second per core. Every
+// kernel's visible list is checked against the scalar one.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "frustumCuller.hh"
+#include "jobSystem.hh"
+
+namespace {
+
+const FrustumCuller::Kernel KERNELS[] = { FrustumCuller::Kernel::SCALAR,
+                                          FrustumCuller::Kernel::SSE,
+                                          FrustumCuller::Kernel::AVX2 };
+
+// Column-major perspective projection of a camera at the origin looking
+// down -z, Vulkan clip space
+void perspective(float fovY, float aspect, float near, float far, float *m)
+{
+    float f = 1.0f / std::tan(fovY / 2.0f);
+    std::fill(m, m + 16, 0.0f);
+    m[0] = f / aspect;
+    m[5] = -f;
+    m[10] = far / (near - far);
+    m[11] = -1.0f;
+    m[14] = near * far / (near - far);
+}
+
+void fill(FrustumCuller &culler, size_t count)
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> extent(0.5f, 20.0f);
+
+    culler.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        float center[3] = { position(random),
+                            position(random),
+                            position(random) };
+        float half[3] = { extent(random), extent(random), extent(random) };
+        float boxMin[3];
+        float boxMax[3];
+        for (int axis = 0; axis < 3; axis++) {
+            boxMin[axis] = center[axis] - half[axis];
+            boxMax[axis] = center[axis] + half[axis];
+        }
+        float radius = std::sqrt(half[0] * half[0] + half[1] * half[1]
+                                 + half[2] * half[2]);
+        culler.add(center, radius, boxMin, boxMax);
+    }
+}
+
+template <typename Function>
+double bestMilliseconds(uint32_t runs, Function function)
+{
+    double best = 1e30;
+    for (uint32_t run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best,
+                        std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+    return best;
+}
+
+void report(const char *name, size_t objects, double ms, uint32_t cores)
+{
+    double rate = objects / (ms / 1000.0) / 1e6;
+    std::cout << "  " << name << ": " << ms << " ms, " << rate
+              << " M objects/s, " << rate / cores << " M objects/s/core\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try {
+        size_t objectCount = 1 << 20;
+        uint32_t threads = 0;
+        uint32_t runs = 10;
+        size_t grain = 16384;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--objects" && i + 1 < argc)
+                objectCount = std::max<size_t>(1, std::stoull(argv[++i]));
+            else if (arg == "--threads" && i + 1 < argc)
+                threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--runs" && i + 1 < argc)
+                runs = std::max(
+                    1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+            else if (arg == "--grain" && i + 1 < argc)
+                grain = std::max<size_t>(1, std::stoull(argv[++i]));
+            else
+                throw std::runtime_error(
+                    "usage: cullingBenchmark [--objects N] [--threads N] "
+                    "[--runs N] [--grain N]");
+        }
+
+        float viewProjection[16];
+        perspective(1.5707963f, 1.0f, 0.1f, 2000.0f, viewProjection);
+        FrustumCuller::Frustum frustum =
+            FrustumCuller::extractFrustum(viewProjection);
+
+        JobSystem jobs(threads);
+        // The waiting thread culls too
+        uint32_t cores = jobs.threadCount() + 1;
+        std::cout << objectCount << " objects, " << cores
+                  << " thread(s) with the job system\n";
+
+        std::vector<uint32_t> reference;
+        for (FrustumCuller::Kernel kernel : KERNELS) {
+            if (!FrustumCuller::isSupported(kernel)) {
+                std::cout << FrustumCuller::kernelName(kernel)
+                          << ": not supported\n";
+                continue;
+            }
+
+            FrustumCuller culler(kernel);
+            fill(culler, objectCount);
+            std::vector<uint32_t> visible;
+
+            double serialMs =
+                bestMilliseconds(runs, [&] { culler.cull(frustum, visible); });
+            if (kernel == FrustumCuller::Kernel::SCALAR)
+                reference = visible;
+            else if (visible != reference)
+                throw std::runtime_error(
+                    std::string(FrustumCuller::kernelName(kernel))
+                    + " kernel disagrees with the scalar one!");
+
+            double parallelMs = bestMilliseconds(
+                runs, [&] { culler.cull(frustum, visible, jobs, grain); });
+            if (visible != reference)
+                throw std::runtime_error(
+                    std::string(FrustumCuller::kernelName(kernel))
+                    + " kernel disagrees with itself across threads!");
+
+            std::cout << FrustumCuller::kernelName(kernel) << ": "
+                      << visible.size() << " visible\n";
+            report("1 thread", objectCount, serialMs, 1);
+            report("job system", objectCount, parallelMs, cores);
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+#include "deletionQueue.hh"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+
+template <typename Handle> Handle handleOf(uint64_t value)
+{
+    Handle handle;
+    std::memcpy(&handle, &value, sizeof(handle));
+    return handle;
+}
+
+} // namespace
+
+DeletionQueue::DeletionQueue(VkDevice device)
+    : device_(device)
+{
+}
+
+DeletionQueue::~DeletionQueue()
+{
+    flush();
+}
+
+void DeletionQueue::setFrame(uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_ = frame;
+}
+
+template <typename Handle> void DeletionQueue::push(Kind kind, Handle handle)
+{
+    if (handle == VK_NULL_HANDLE)
+        return;
+
+    Entry entry;
+    entry.kind = kind;
+    std::memcpy(&entry.handle, &handle, sizeof(handle));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry.frame = frame_;
+    entries_.push_back(std::move(entry));
+}
+
+void DeletionQueue::destroy(VkBuffer buffer)
+{
+    push(Kind::BUFFER, buffer);
+}
+
+void DeletionQueue::destroy(VkImage image)
+{
+    push(Kind::IMAGE, image);
+}
+
+void DeletionQueue::destroy(VkImageView view)
+{
+    push(Kind::IMAGE_VIEW, view);
+}
+
+void DeletionQueue::destroy(VkFramebuffer framebuffer)
+{
+    push(Kind::FRAMEBUFFER, framebuffer);
+}
+
+void DeletionQueue::destroy(VkPipeline pipeline)
+{
+    push(Kind::PIPELINE, pipeline);
+}
+
+void DeletionQueue::destroy(VkDeviceMemory memory)
+{
+    push(Kind::MEMORY, memory);
+}
+
+void DeletionQueue::destroy(VkSwapchainKHR swapChain)
+{
+    push(Kind::SWAPCHAIN, swapChain);
+}
+
+void DeletionQueue::defer(std::function<void()> release)
+{
+    Entry entry;
+    entry.release = std::move(release);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry.frame = frame_;
+    entries_.push_back(std::move(entry));
+}
+
+void DeletionQueue::collect(uint64_t completedFrame)
+{
+    // Destroyed outside the lock, so that releases may queue more
+    std::vector<Entry> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!entries_.empty() && entries_.front().frame <= completedFrame) {
+            expired.push_back(std::move(entries_.front()));
+            entries_.pop_front();
+        }
+    }
+    for (Entry &entry : expired) {
+        destroy(entry);
+    }
+}
+
+void DeletionQueue::flush()
+{
+    std::deque<Entry> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expired.swap(entries_);
+    }
+    for (Entry &entry : expired) {
+        destroy(entry);
+    }
+}
+
+size_t DeletionQueue::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void DeletionQueue::destroy(Entry &entry)
+{
+    switch (entry.kind) {
+    case Kind::BUFFER:
+        vkDestroyBuffer(device_, handleOf<VkBuffer>(entry.handle), nullptr);
+        break;
+    case Kind::IMAGE:
+        vkDestroyImage(device_, handleOf<VkImage>(entry.handle), nullptr);
+        break;
+    case Kind::IMAGE_VIEW:
+        vkDestroyImageView(
+            device_, handleOf<VkImageView>(entry.handle), nullptr);
+        break;
+    case Kind::FRAMEBUFFER:
+        vkDestroyFramebuffer(
+            device_, handleOf<VkFramebuffer>(entry.handle), nullptr);
+        break;
+    case Kind::PIPELINE:
+        vkDestroyPipeline(device_, handleOf<VkPipeline>(entry.handle), nullptr);
+        break;
+    case Kind::MEMORY:
+        vkFreeMemory(device_, handleOf<VkDeviceMemory>(entry.handle), nullptr);
+        break;
+    case Kind::SWAPCHAIN:
+        vkDestroySwapchainKHR(
+            device_, handleOf<VkSwapchainKHR>(entry.handle), nullptr);
+        break;
+    case Kind::RELEASE:
+        entry.release();
+        break;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vulkan/vulkan.h>
+
+// Vulkan objects destroyed once the GPU is done with them, so that freeing
+// a resource mid-run never idles the device.
+//
+// The owner numbers its frames and tells the queue which frame is being
+// recorded (setFrame) and which have completed on the GPU (collect), e.g.
+// after waiting for a frame slot's fence. Objects handed over are tagged
+// with the frame being recorded, which covers every frame that may still
+// use them, and destroyed once it completes. Any thread may hand objects
+// over; collect() and flush() run the destruction on the calling thread.
+class DeletionQueue {
+public:
+    explicit DeletionQueue(VkDevice device);
+    // Flushes: the device must be idle
+    ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue &) = delete;
+    DeletionQueue &operator=(const DeletionQueue &) = delete;
+
+    void setFrame(uint64_t frame);
+
+    // Null handles are ignored
+    void destroy(VkBuffer buffer);
+    void destroy(VkImage image);
+    void destroy(VkImageView view);
+    void destroy(VkFramebuffer framebuffer);
+    void destroy(VkPipeline pipeline);
+    void destroy(VkDeviceMemory memory);
+    void destroy(VkSwapchainKHR swapChain);
+
+    // Any other release, such as a bindless heap index, fenced the same way
+    void defer(std::function<void()> release);
+
+    // Destroys what frames up to completedFrame could use
+    void collect(uint64_t completedFrame);
+    // Destroys everything: the device must be idle
+    void flush();
+
+    size_t pending() const;
+
+private:
+    enum class Kind
+    {
+        BUFFER,
+        IMAGE,
+        IMAGE_VIEW,
+        FRAMEBUFFER,
+        PIPELINE,
+        MEMORY,
+        SWAPCHAIN,
+        RELEASE,
+    };
+
+    struct Entry {
+        uint64_t frame = 0;
+        Kind kind = Kind::RELEASE;
+        uint64_t handle = 0;
+        std::function<void()> release;
+    };
+
+    template <typename Handle> void push(Kind kind, Handle handle);
+    void destroy(Entry &entry);
+
+    VkDevice device_;
+    mutable std::mutex mutex_;
+    uint64_t frame_ = 0;
+    // In frame order
+    std::deque<Entry> entries_;
+};
@@ -0,0 +1,159 @@
+#include "drawStateRecorder.hh"
+
+#include <stdexcept>
+#include <string>
+
+#include "callCapture.hh"
+
+namespace {
+
+template <typename Function>
+Function loadDeviceFunction(VkDevice device, const char *name)
+{
+    auto function =
+        reinterpret_cast<Function>(vkGetDeviceProcAddr(device, name));
+    if (!function)
+        throw std::runtime_error(std::string("failed to load ") + name + "!");
+    return function;
+}
+
+} // namespace
+
+DrawStateRecorder::DrawStateRecorder(VkDevice device, const Support &support)
+    : support_(support)
+{
+    if (support_.extendedDynamicState) {
+        setCullMode_ = loadDeviceFunction<PFN_vkCmdSetCullModeEXT>(
+            device, "vkCmdSetCullModeEXT");
+        setFrontFace_ = loadDeviceFunction<PFN_vkCmdSetFrontFaceEXT>(
+            device, "vkCmdSetFrontFaceEXT");
+        setPrimitiveTopology_ =
+            loadDeviceFunction<PFN_vkCmdSetPrimitiveTopologyEXT>(
+                device, "vkCmdSetPrimitiveTopologyEXT");
+        setDepthTestEnable_ =
+            loadDeviceFunction<PFN_vkCmdSetDepthTestEnableEXT>(
+                device, "vkCmdSetDepthTestEnableEXT");
+        setDepthWriteEnable_ =
+            loadDeviceFunction<PFN_vkCmdSetDepthWriteEnableEXT>(
+                device, "vkCmdSetDepthWriteEnableEXT");
+        setDepthCompareOp_ = loadDeviceFunction<PFN_vkCmdSetDepthCompareOpEXT>(
+            device, "vkCmdSetDepthCompareOpEXT");
+    }
+    if (support_.extendedDynamicState2) {
+        setDepthBiasEnable_ =
+            loadDeviceFunction<PFN_vkCmdSetDepthBiasEnableEXT>(
+                device, "vkCmdSetDepthBiasEnableEXT");
+        setPrimitiveRestartEnable_ =
+            loadDeviceFunction<PFN_vkCmdSetPrimitiveRestartEnableEXT>(
+                device, "vkCmdSetPrimitiveRestartEnableEXT");
+    }
+    if (support_.extendedDynamicState3Blend) {
+        setColorBlendEnable_ =
+            loadDeviceFunction<PFN_vkCmdSetColorBlendEnableEXT>(
+                device, "vkCmdSetColorBlendEnableEXT");
+        setColorBlendEquation_ =
+            loadDeviceFunction<PFN_vkCmdSetColorBlendEquationEXT>(
+                device, "vkCmdSetColorBlendEquationEXT");
+    }
+}
+
+std::vector<VkDynamicState> DrawStateRecorder::dynamicStates() const
+{
+    std::vector<VkDynamicState> states = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+    if (support_.extendedDynamicState)
+        states.insert(states.end(),
+                      { VK_DYNAMIC_STATE_CULL_MODE_EXT,
+                        VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+                        VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT,
+                        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+                        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+                        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT });
+    if (support_.extendedDynamicState2)
+        states.insert(states.end(),
+                      { VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT,
+                        VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT });
+    if (support_.extendedDynamicState3Blend)
+        states.insert(states.end(),
+                      { VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
+                        VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT });
+    return states;
+}
+
+void DrawStateRecorder::begin(VkCommandBuffer commandBuffer)
+{
+    commandBuffer_ = commandBuffer;
+    valid_ = 0;
+}
+
+void DrawStateRecorder::bindPipeline(VkPipeline pipeline)
+{
+    if (capture_)
+        capture_->bindPipeline(pipeline);
+    if (update(PIPELINE, pipeline_, pipeline))
+        vkCmdBindPipeline(
+            commandBuffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+}
+
+void DrawStateRecorder::setViewport(const VkViewport &viewport)
+{
+    if (capture_)
+        capture_->setViewport(viewport);
+    if (update(VIEWPORT, viewport_, viewport))
+        vkCmdSetViewport(commandBuffer_, 0, 1, &viewport);
+}
+
+void DrawStateRecorder::setScissor(const VkRect2D &scissor)
+{
+    if (capture_)
+        capture_->setScissor(scissor);
+    if (update(SCISSOR, scissor_, scissor))
+        vkCmdSetScissor(commandBuffer_, 0, 1, &scissor);
+}
+
+void DrawStateRecorder::setState(const State &state)
+{
+    if (capture_)
+        capture_->setState(state);
+    if (support_.extendedDynamicState) {
+        if (update(CULL_MODE, state_.cullMode, state.cullMode))
+            setCullMode_(commandBuffer_, state.cullMode);
+        if (update(FRONT_FACE, state_.frontFace, state.frontFace))
+            setFrontFace_(commandBuffer_, state.frontFace);
+        if (update(TOPOLOGY, state_.topology, state.topology))
+            setPrimitiveTopology_(commandBuffer_, state.topology);
+        if (update(DEPTH_TEST, state_.depthTestEnable, state.depthTestEnable))
+            setDepthTestEnable_(commandBuffer_, state.depthTestEnable);
+        if (update(
+                DEPTH_WRITE, state_.depthWriteEnable, state.depthWriteEnable))
+            setDepthWriteEnable_(commandBuffer_, state.depthWriteEnable);
+        if (update(DEPTH_COMPARE_OP,
+                   state_.depthCompareOp,
+                   state.depthCompareOp))
+            setDepthCompareOp_(commandBuffer_, state.depthCompareOp);
+    }
+    if (support_.extendedDynamicState2) {
+        if (update(DEPTH_BIAS, state_.depthBiasEnable, state.depthBiasEnable))
+            setDepthBiasEnable_(commandBuffer_, state.depthBiasEnable);
+        if (update(PRIMITIVE_RESTART,
+                   state_.primitiveRestartEnable,
+                   state.primitiveRestartEnable))
+            setPrimitiveRestartEnable_(commandBuffer_,
+                                       state.primitiveRestartEnable);
+    }
+    if (support_.extendedDynamicState3Blend) {
+        if (update(BLEND_ENABLE, state_.blendEnable, state.blendEnable))
+            setColorBlendEnable_(commandBuffer_, 0, 1, &state.blendEnable);
+        if (update(BLEND_EQUATION, state_.blendEquation, state.blendEquation))
+            setColorBlendEquation_(commandBuffer_, 0, 1, &state.blendEquation);
+    }
+}
+
+DrawStateRecorder::Statistics DrawStateRecorder::takeStatistics()
+{
+    Statistics statistics = statistics_;
+    statistics_ = Statistics{};
+    return statistics;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class CallCapture;
+
+// Records pipeline binds and draw state into a command buffer, skipping
+// every call that would set what is already set.
+//
+// The states an extended dynamic state extension of the device covers are
+// set with vkCmdSet*; the others stay baked into the pipelines and setting
+// them here does nothing. Every pipeline bound through the recorder must
+// therefore be created with dynamicStates(): binding one where a state is
+// static would leave the recorded value stale.
+class DrawStateRecorder {
+public:
+    struct Support {
+        // VK_EXT_extended_dynamic_state: cull mode, front face, topology,
+        // depth test, depth write and depth compare op
+        bool extendedDynamicState = false;
+        // VK_EXT_extended_dynamic_state2: depth bias and primitive restart
+        // enables
+        bool extendedDynamicState2 = false;
+        // VK_EXT_extended_dynamic_state3: colour blend enable and equation
+        bool extendedDynamicState3Blend = false;
+    };
+
+    struct State {
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkBool32 depthTestEnable = VK_TRUE;
+        VkBool32 depthWriteEnable = VK_TRUE;
+        VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+        VkBool32 depthBiasEnable = VK_FALSE;
+        VkBool32 primitiveRestartEnable = VK_FALSE;
+        // Of the colour attachment
+        VkBool32 blendEnable = VK_FALSE;
+        VkColorBlendEquationEXT blendEquation{ VK_BLEND_FACTOR_ONE,
+                                               VK_BLEND_FACTOR_ZERO,
+                                               VK_BLEND_OP_ADD,
+                                               VK_BLEND_FACTOR_ONE,
+                                               VK_BLEND_FACTOR_ZERO,
+                                               VK_BLEND_OP_ADD };
+    };
+
+    struct Statistics {
+        uint64_t issued = 0;
+        uint64_t skipped = 0;
+    };
+
+    // Loads the entry points of the supported extensions, which must be
+    // enabled on device
+    DrawStateRecorder(VkDevice device, const Support &support);
+
+    const Support &support() const
+    {
+        return support_;
+    }
+
+    // Viewport and scissor, plus every state the extensions cover
+    std::vector<VkDynamicState> dynamicStates() const;
+
+    // Starts recording into commandBuffer, where no state is set yet
+    void begin(VkCommandBuffer commandBuffer);
+
+    // Every call below is also captured, skipped or not, when set
+    void setCapture(CallCapture *capture)
+    {
+        capture_ = capture;
+    }
+
+    void bindPipeline(VkPipeline pipeline);
+    void setViewport(const VkViewport &viewport);
+    void setScissor(const VkRect2D &scissor);
+    void setState(const State &state);
+
+    // Calls made and skipped since the last call
+    Statistics takeStatistics();
+
+private:
+    enum : uint32_t
+    {
+        PIPELINE = 1 << 0,
+        VIEWPORT = 1 << 1,
+        SCISSOR = 1 << 2,
+        CULL_MODE = 1 << 3,
+        FRONT_FACE = 1 << 4,
+        TOPOLOGY = 1 << 5,
+        DEPTH_TEST = 1 << 6,
+        DEPTH_WRITE = 1 << 7,
+        DEPTH_COMPARE_OP = 1 << 8,
+        DEPTH_BIAS = 1 << 9,
+        PRIMITIVE_RESTART = 1 << 10,
+        BLEND_ENABLE = 1 << 11,
+        BLEND_EQUATION = 1 << 12,
+    };
+
+    // Whether value must be recorded: true, and remembered, unless it is
+    // already the current value of the field
+    template <typename T>
+    bool update(uint32_t field, T &current, const T &value)
+    {
+        if ((valid_ & field) && std::memcmp(&current, &value, sizeof(T)) == 0) {
+            statistics_.skipped++;
+            return false;
+        }
+        current = value;
+        valid_ |= field;
+        statistics_.issued++;
+        return true;
+    }
+
+    Support support_;
+    PFN_vkCmdSetCullModeEXT setCullMode_ = nullptr;
+    PFN_vkCmdSetFrontFaceEXT setFrontFace_ = nullptr;
+    PFN_vkCmdSetPrimitiveTopologyEXT setPrimitiveTopology_ = nullptr;
+    PFN_vkCmdSetDepthTestEnableEXT setDepthTestEnable_ = nullptr;
+    PFN_vkCmdSetDepthWriteEnableEXT setDepthWriteEnable_ = nullptr;
+    PFN_vkCmdSetDepthCompareOpEXT setDepthCompareOp_ = nullptr;
+    PFN_vkCmdSetDepthBiasEnableEXT setDepthBiasEnable_ = nullptr;
+    PFN_vkCmdSetPrimitiveRestartEnableEXT setPrimitiveRestartEnable_ =
+        nullptr;
+    PFN_vkCmdSetColorBlendEnableEXT setColorBlendEnable_ = nullptr;
+    PFN_vkCmdSetColorBlendEquationEXT setColorBlendEquation_ = nullptr;
+
+    CallCapture *capture_ = nullptr;
+    VkCommandBuffer commandBuffer_ = VK_NULL_HANDLE;
+    // Fields whose current value is known
+    uint32_t valid_ = 0;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkViewport viewport_{};
+    VkRect2D scissor_{};
+    State state_;
+    Statistics statistics_;
+};
@@ -0,0 +1,278 @@
+#include "frameCapture.hh"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "tracer.hh"
+
+namespace {
+
+const std::array<uint32_t, 256> &crcTable()
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+uint32_t updateCrc(uint32_t crc, const uint8_t *data, size_t size)
+{
+    const auto &table = crcTable();
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+void putBigEndian(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void writeChunk(std::ofstream &file,
+                const char type[4],
+                const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> header;
+    putBigEndian(header, static_cast<uint32_t>(data.size()));
+    header.insert(header.end(), type, type + 4);
+
+    uint32_t crc = updateCrc(0xFFFFFFFFu, header.data() + 4, 4);
+    crc = updateCrc(crc, data.data(), data.size()) ^ 0xFFFFFFFFu;
+
+    std::vector<uint8_t> trailer;
+    putBigEndian(trailer, crc);
+
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    file.write(reinterpret_cast<const char *>(trailer.data()), trailer.size());
+}
+
+// Swap chain pixels are either B8G8R8A8 or R8G8B8A8
+void toRgba(const CaptureFrame &frame, size_t pixel, uint8_t rgba[4])
+{
+    const uint8_t *src = frame.pixels + pixel * 4;
+    rgba[0] = frame.bgra ? src[2] : src[0];
+    rgba[1] = src[1];
+    rgba[2] = frame.bgra ? src[0] : src[2];
+    rgba[3] = src[3];
+}
+
+} // namespace
+
+FrameCaptureWriter::FrameCaptureWriter(const std::filesystem::path &path,
+                                       uint32_t frameRate)
+    : path_(path)
+    , format_(formatFromPath(path))
+    , frameRate_(frameRate)
+{
+    unsigned int workerCount = 1;
+
+    if (format_ == CaptureFormat::PNG) {
+        // Frames are independent files, so encoding can be spread out
+        workerCount = std::max(2u, std::thread::hardware_concurrency() / 2);
+    }
+    else {
+        stream_.open(path_, std::ios::binary | std::ios::trunc);
+        if (!stream_.is_open())
+            throw std::runtime_error("failed to open capture file: "
+                                     + path_.string());
+    }
+
+    for (unsigned int i = 0; i < workerCount; i++)
+        workers_.emplace_back(&FrameCaptureWriter::workerLoop, this);
+}
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+
+    for (auto &worker : workers_)
+        worker.join();
+}
+
+CaptureFormat
+FrameCaptureWriter::formatFromPath(const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(
+        extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == ".y4m")
+        return CaptureFormat::Y4M;
+    if (extension == ".png")
+        return CaptureFormat::PNG;
+    return CaptureFormat::RAW;
+}
+
+void FrameCaptureWriter::submit(const CaptureFrame &frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(frame);
+    }
+    condition_.notify_one();
+}
+
+void FrameCaptureWriter::workerLoop()
+{
+    Tracer::nameThread("capture writer");
+    for (;;) {
+        CaptureFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock,
+                            [this] { return stopping_ || !queue_.empty(); });
+            // Drain the queue before exiting so no readback is lost
+            if (queue_.empty())
+                return;
+            frame = queue_.front();
+            queue_.pop_front();
+        }
+
+        TRACE_ZONE("writeCaptureFrame");
+        if (format_ == CaptureFormat::PNG)
+            writePng(frame);
+        else
+            writeStreamFrame(frame);
+
+        framesWritten_++;
+        frame.busy->store(false, std::memory_order_release);
+    }
+}
+
+void FrameCaptureWriter::writeStreamFrame(const CaptureFrame &frame)
+{
+    size_t pixelCount = static_cast<size_t>(frame.width) * frame.height;
+
+    if (format_ == CaptureFormat::RAW) {
+        planes_.resize(pixelCount * 4);
+        for (size_t i = 0; i < pixelCount; i++)
+            toRgba(frame, i, &planes_[i * 4]);
+
+        stream_.write(reinterpret_cast<const char *>(planes_.data()),
+                      planes_.size());
+        return;
+    }
+
+    if (!headerWritten_) {
+        stream_ << "YUV4MPEG2 W" << frame.width << " H" << frame.height
+                << " F" << frameRate_ << ":1 Ip A1:1 C444\n";
+        headerWritten_ = true;
+    }
+
+    // BT.601 limited range, one plane per component
+    planes_.resize(pixelCount * 3);
+    uint8_t *y = planes_.data();
+    uint8_t *u = y + pixelCount;
+    uint8_t *v = u + pixelCount;
+
+    for (size_t i = 0; i < pixelCount; i++) {
+        uint8_t rgba[4];
+        toRgba(frame, i, rgba);
+        int r = rgba[0], g = rgba[1], b = rgba[2];
+
+        y[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8)
+                                    + 16);
+        u[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8)
+                                    + 128);
+        v[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8)
+                                    + 128);
+    }
+
+    stream_ << "FRAME\n";
+    stream_.write(reinterpret_cast<const char *>(planes_.data()),
+                  planes_.size());
+}
+
+void FrameCaptureWriter::writePng(const CaptureFrame &frame) const
+{
+    std::ostringstream name;
+    name << path_.stem().string() << '_';
+    name.width(6);
+    name.fill('0');
+    name << frame.index << ".png";
+
+    std::filesystem::path filePath = path_.parent_path() / name.str();
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "failed to open capture file: " << filePath << std::endl;
+        return;
+    }
+
+    static const uint8_t signature[8] = { 0x89, 'P',  'N',  'G',
+                                          '\r', '\n', 0x1A, '\n' };
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    putBigEndian(header, frame.width);
+    putBigEndian(header, frame.height);
+    header.push_back(8); // bit depth
+    header.push_back(6); // colour type: RGBA
+    header.push_back(0); // compression
+    header.push_back(0); // filter
+    header.push_back(0); // interlace
+    writeChunk(file, "IHDR", header);
+
+    // Scanlines with filter type 0, stored in uncompressed deflate blocks:
+    // encoding stays a copy plus two checksums, which keeps up with the
+    // frame rate at the cost of file size.
+    size_t rowSize = static_cast<size_t>(frame.width) * 4 + 1;
+    std::vector<uint8_t> scanlines(rowSize * frame.height);
+    for (uint32_t row = 0; row < frame.height; row++) {
+        uint8_t *dst = &scanlines[row * rowSize];
+        dst[0] = 0;
+        for (uint32_t x = 0; x < frame.width; x++)
+            toRgba(frame,
+                   static_cast<size_t>(row) * frame.width + x,
+                   dst + 1 + x * 4);
+    }
+
+    constexpr size_t maxBlockSize = 65535;
+    std::vector<uint8_t> zlib;
+    zlib.reserve(scanlines.size() + scanlines.size() / maxBlockSize * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < scanlines.size();
+         offset += maxBlockSize) {
+        size_t blockSize = std::min(maxBlockSize, scanlines.size() - offset);
+        bool last = offset + blockSize == scanlines.size();
+
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(blockSize));
+        zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+        zlib.push_back(static_cast<uint8_t>(~blockSize));
+        zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        zlib.insert(zlib.end(),
+                    scanlines.begin() + offset,
+                    scanlines.begin() + offset + blockSize);
+
+        for (size_t i = offset; i < offset + blockSize; i++) {
+            adlerA = (adlerA + scanlines[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+    }
+    putBigEndian(zlib, (adlerB << 16) | adlerA);
+
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat
+{
+    Y4M, // YUV4MPEG2 stream, 4:4:4
+    RAW, // headerless RGBA8 frames, back to back
+    PNG, // one PNG file per frame
+};
+
+// A frame read back from the GPU. The pixels stay owned by the caller, who
+// must not reuse them before the writer clears *busy.
+struct CaptureFrame {
+    const uint8_t *pixels = nullptr; // 4 bytes per pixel, tightly packed
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool bgra = false;
+    uint64_t index = 0;
+    std::atomic<bool> *busy = nullptr;
+};
+
+// Encodes and writes captured frames on worker threads so that the render
+// loop only has to hand over a pointer to a mapped readback buffer.
+class FrameCaptureWriter {
+public:
+    FrameCaptureWriter(const std::filesystem::path &path, uint32_t frameRate);
+    ~FrameCaptureWriter();
+
+    FrameCaptureWriter(const FrameCaptureWriter &) = delete;
+    FrameCaptureWriter &operator=(const FrameCaptureWriter &) = delete;
+
+    void submit(const CaptureFrame &frame);
+
+    uint64_t framesWritten() const
+    {
+        return framesWritten_.load();
+    }
+
+    static CaptureFormat formatFromPath(const std::filesystem::path &path);
+
+private:
+    void workerLoop();
+    void writeStreamFrame(const CaptureFrame &frame);
+    void writePng(const CaptureFrame &frame) const;
+
+    std::filesystem::path path_;
+    CaptureFormat format_;
+    uint32_t frameRate_;
+
+    std::ofstream stream_;
+    bool headerWritten_ = false;
+    std::vector<uint8_t> planes_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<CaptureFrame> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+    std::atomic<uint64_t> framesWritten_{ 0 };
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+// Paces a loop to a fixed rate. Sleeping is only as precise as the
+// scheduler (a millisecond or worse), and spinning to the deadline keeps a
+// core busy: wait() sleeps until spinMargin before the deadline and spins
+// the rest, so intervals stay even at a fraction of the CPU time.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FramePacer(double framesPerSecond,
+                        Clock::duration spinMargin =
+                            std::chrono::microseconds(1500))
+        : period_(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(1.0 / framesPerSecond)))
+        , spinMargin_(spinMargin)
+        , next_(Clock::now())
+    {
+    }
+
+    // Returns when the next frame is due. A late frame restarts the
+    // schedule rather than letting the following ones catch up in a burst.
+    void wait()
+    {
+        next_ += period_;
+        Clock::time_point now = Clock::now();
+        if (next_ <= now) {
+            next_ = now;
+            return;
+        }
+
+        if (next_ - now > spinMargin_)
+            std::this_thread::sleep_until(next_ - spinMargin_);
+        while (Clock::now() < next_)
+            std::this_thread::yield();
+    }
+
+    Clock::duration period() const
+    {
+        return period_;
+    }
+
+private:
+    Clock::duration period_;
+    Clock::duration spinMargin_;
+    // Deadline of the last frame
+    Clock::time_point next_;
+};
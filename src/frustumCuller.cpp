@@ -0,0 +1,385 @@
+#include "frustumCuller.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "jobSystem.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRUSTUM_CULLER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using Plane = FrustumCuller::Plane;
+
+// What a kernel reads: the planes, the spheres and for each plane the box
+// corner furthest along its normal, picked once for every object
+struct CullInput {
+    const Plane *planes;
+    const float *center[3];
+    const float *radius;
+    const float *corner[6][3];
+};
+
+size_t roundUp(size_t count, size_t multiple)
+{
+    return (count + multiple - 1) / multiple * multiple;
+}
+
+// Writes the branchless way: every index is stored, the count only moves
+// past the visible ones
+size_t cullScalar(const CullInput &in, size_t begin, size_t end, uint32_t *out)
+{
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6; p++) {
+            const Plane &plane = in.planes[p];
+            float sphere = plane.x * in.center[0][i]
+                + plane.y * in.center[1][i] + plane.z * in.center[2][i]
+                + plane.w;
+            float box = plane.x * in.corner[p][0][i]
+                + plane.y * in.corner[p][1][i] + plane.z * in.corner[p][2][i]
+                + plane.w;
+            inside = inside && sphere >= -in.radius[i] && box >= 0.0f;
+        }
+        out[count] = static_cast<uint32_t>(i);
+        count += inside ? 1 : 0;
+    }
+    return count;
+}
+
+#ifdef FRUSTUM_CULLER_X86
+
+// The vector kernels compute the plane distances in the scalar kernel's
+// order, without fused multiply-adds, so that every kernel culls the same
+// objects to the last bit
+
+// Appends the indices of the set bits of mask, lanes from first
+inline size_t
+compact(unsigned mask, size_t first, uint32_t *out, size_t count)
+{
+    while (mask != 0) {
+        out[count++] = static_cast<uint32_t>(first + __builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+__attribute__((target("sse2"))) size_t
+cullSse(const CullInput &in, size_t begin, size_t end, uint32_t *out)
+{
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        planes[p][0] = _mm_set1_ps(in.planes[p].x);
+        planes[p][1] = _mm_set1_ps(in.planes[p].y);
+        planes[p][2] = _mm_set1_ps(in.planes[p].z);
+        planes[p][3] = _mm_set1_ps(in.planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t count = 0;
+    for (size_t i = begin; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(in.center[0] + i);
+        __m128 y = _mm_loadu_ps(in.center[1] + i);
+        __m128 z = _mm_loadu_ps(in.center[2] + i);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(in.radius + i));
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++) {
+            const __m128 *plane = planes[p];
+            __m128 sphere = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(plane[0], x),
+                               _mm_mul_ps(plane[1], y)),
+                    _mm_mul_ps(plane[2], z)),
+                plane[3]);
+            __m128 box = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_mul_ps(plane[0], _mm_loadu_ps(in.corner[p][0] + i)),
+                        _mm_mul_ps(plane[1],
+                                   _mm_loadu_ps(in.corner[p][1] + i))),
+                    _mm_mul_ps(plane[2], _mm_loadu_ps(in.corner[p][2] + i))),
+                plane[3]);
+            inside = _mm_and_ps(inside,
+                                _mm_and_ps(_mm_cmpge_ps(sphere, negativeRadius),
+                                           _mm_cmpge_ps(box, zero)));
+        }
+
+        unsigned mask = static_cast<unsigned>(_mm_movemask_ps(inside));
+        if (end - i < 4)
+            mask &= (1u << (end - i)) - 1;
+        count = compact(mask, i, out, count);
+    }
+    return count;
+}
+
+__attribute__((target("avx2"))) size_t
+cullAvx2(const CullInput &in, size_t begin, size_t end, uint32_t *out)
+{
+    __m256 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        planes[p][0] = _mm256_set1_ps(in.planes[p].x);
+        planes[p][1] = _mm256_set1_ps(in.planes[p].y);
+        planes[p][2] = _mm256_set1_ps(in.planes[p].z);
+        planes[p][3] = _mm256_set1_ps(in.planes[p].w);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t count = 0;
+    for (size_t i = begin; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(in.center[0] + i);
+        __m256 y = _mm256_loadu_ps(in.center[1] + i);
+        __m256 z = _mm256_loadu_ps(in.center[2] + i);
+        __m256 negativeRadius =
+            _mm256_sub_ps(zero, _mm256_loadu_ps(in.radius + i));
+
+        __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        for (int p = 0; p < 6; p++) {
+            const __m256 *plane = planes[p];
+            __m256 sphere = _mm256_add_ps(
+                _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane[0], x),
+                                            _mm256_mul_ps(plane[1], y)),
+                              _mm256_mul_ps(plane[2], z)),
+                plane[3]);
+            __m256 box = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_add_ps(
+                        _mm256_mul_ps(plane[0],
+                                      _mm256_loadu_ps(in.corner[p][0] + i)),
+                        _mm256_mul_ps(plane[1],
+                                      _mm256_loadu_ps(in.corner[p][1] + i))),
+                    _mm256_mul_ps(plane[2],
+                                  _mm256_loadu_ps(in.corner[p][2] + i))),
+                plane[3]);
+            inside = _mm256_and_ps(
+                inside,
+                _mm256_and_ps(
+                    _mm256_cmp_ps(sphere, negativeRadius, _CMP_GE_OQ),
+                    _mm256_cmp_ps(box, zero, _CMP_GE_OQ)));
+        }
+
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(inside));
+        if (end - i < 8)
+            mask &= (1u << (end - i)) - 1;
+        count = compact(mask, i, out, count);
+    }
+    return count;
+}
+
+#endif // FRUSTUM_CULLER_X86
+
+} // namespace
+
+FrustumCuller::Kernel FrustumCuller::bestKernel()
+{
+    if (isSupported(Kernel::AVX2))
+        return Kernel::AVX2;
+    if (isSupported(Kernel::SSE))
+        return Kernel::SSE;
+    return Kernel::SCALAR;
+}
+
+bool FrustumCuller::isSupported(Kernel kernel)
+{
+    switch (kernel) {
+    case Kernel::SCALAR:
+        return true;
+#ifdef FRUSTUM_CULLER_X86
+    case Kernel::SSE:
+        return __builtin_cpu_supports("sse2");
+    case Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+
+    default:
+        return false;
+    }
+}
+
+const char *FrustumCuller::kernelName(Kernel kernel)
+{
+    switch (kernel) {
+    case Kernel::SCALAR:
+        return "scalar";
+    case Kernel::SSE:
+        return "sse";
+    case Kernel::AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+FrustumCuller::Frustum
+FrustumCuller::extractFrustum(const float viewProjection[16])
+{
+    // Row r of the column-major matrix
+    auto row = [viewProjection](int r) {
+        return Plane{ viewProjection[r],
+                      viewProjection[4 + r],
+                      viewProjection[8 + r],
+                      viewProjection[12 + r] };
+    };
+    auto add = [](const Plane &a, const Plane &b, float sign) {
+        return Plane{ a.x + sign * b.x,
+                      a.y + sign * b.y,
+                      a.z + sign * b.z,
+                      a.w + sign * b.w };
+    };
+
+    Plane w = row(3);
+    Frustum frustum = {
+        add(w, row(0), 1.0f), // left
+        add(w, row(0), -1.0f), // right
+        add(w, row(1), 1.0f), // top, y pointing down in Vulkan
+        add(w, row(1), -1.0f), // bottom
+        row(2), // near, at depth 0
+        add(w, row(2), -1.0f), // far
+    };
+    for (Plane &plane : frustum) {
+        float length = std::sqrt(plane.x * plane.x + plane.y * plane.y
+                                 + plane.z * plane.z);
+        if (length > 0.0f) {
+            plane.x /= length;
+            plane.y /= length;
+            plane.z /= length;
+            plane.w /= length;
+        }
+    }
+    return frustum;
+}
+
+FrustumCuller::FrustumCuller(Kernel kernel)
+    : kernel_(kernel)
+{
+    if (!isSupported(kernel_))
+        throw std::runtime_error(std::string("the CPU cannot run the ")
+                                 + kernelName(kernel_)
+                                 + " culling kernel!");
+}
+
+uint32_t FrustumCuller::add(const float center[3],
+                            float radius,
+                            const float boxMin[3],
+                            const float boxMax[3])
+{
+    size_t padded = roundUp(count_ + 1, LANES);
+    for (std::vector<float> &component : components_) {
+        component.resize(padded);
+    }
+    uint32_t index = static_cast<uint32_t>(count_++);
+    set(index, center, radius, boxMin, boxMax);
+    return index;
+}
+
+void FrustumCuller::set(uint32_t index,
+                        const float center[3],
+                        float radius,
+                        const float boxMin[3],
+                        const float boxMax[3])
+{
+    for (int axis = 0; axis < 3; axis++) {
+        components_[CENTER_X + axis][index] = center[axis];
+        components_[MIN_X + axis][index] = boxMin[axis];
+        components_[MAX_X + axis][index] = boxMax[axis];
+    }
+    components_[RADIUS][index] = radius;
+}
+
+void FrustumCuller::reserve(size_t count)
+{
+    for (std::vector<float> &component : components_) {
+        component.reserve(roundUp(count, LANES));
+    }
+}
+
+void FrustumCuller::clear()
+{
+    for (std::vector<float> &component : components_) {
+        component.clear();
+    }
+    count_ = 0;
+}
+
+void FrustumCuller::cull(const Frustum &frustum,
+                         std::vector<uint32_t> &visible)
+{
+    visible.resize(count_);
+    visible.resize(cullRange(frustum, 0, count_, visible.data()));
+}
+
+void FrustumCuller::cull(const Frustum &frustum,
+                         std::vector<uint32_t> &visible,
+                         JobSystem &jobs,
+                         size_t grain)
+{
+    // Ranges start on a vector boundary: the kernels read whole vectors
+    grain = roundUp(std::max<size_t>(grain, 1), LANES);
+    size_t ranges = (count_ + grain - 1) / grain;
+    if (ranges <= 1) {
+        cull(frustum, visible);
+        return;
+    }
+
+    scratch_.resize(count_);
+    rangeCounts_.assign(ranges, 0);
+    JobSystem::Counter counter;
+    jobs.parallelFor(
+        count_,
+        grain,
+        [this, &frustum, grain](size_t begin, size_t end) {
+            rangeCounts_[begin / grain] =
+                cullRange(frustum, begin, end, scratch_.data() + begin);
+        },
+        counter);
+    jobs.wait(counter);
+
+    size_t total = 0;
+    for (size_t count : rangeCounts_) {
+        total += count;
+    }
+    visible.resize(total);
+    uint32_t *out = visible.data();
+    for (size_t range = 0; range < ranges; range++) {
+        const uint32_t *first = scratch_.data() + range * grain;
+        out = std::copy(first, first + rangeCounts_[range], out);
+    }
+}
+
+size_t FrustumCuller::cullRange(const Frustum &frustum,
+                                size_t begin,
+                                size_t end,
+                                uint32_t *out) const
+{
+    CullInput in{};
+    in.planes = frustum.data();
+    in.radius = components_[RADIUS].data();
+    for (int axis = 0; axis < 3; axis++) {
+        in.center[axis] = components_[CENTER_X + axis].data();
+    }
+    for (int p = 0; p < 6; p++) {
+        const float normal[3] = { frustum[p].x, frustum[p].y, frustum[p].z };
+        for (int axis = 0; axis < 3; axis++) {
+            in.corner[p][axis] =
+                components_[(normal[axis] >= 0.0f ? MAX_X : MIN_X) + axis]
+                    .data();
+        }
+    }
+
+    switch (kernel_) {
+#ifdef FRUSTUM_CULLER_X86
+    case Kernel::SSE:
+        return cullSse(in, begin, end, out);
+    case Kernel::AVX2:
+        return cullAvx2(in, begin, end, out);
+#endif
+
+    default:
+        return cullScalar(in, begin, end, out);
+    }
+}
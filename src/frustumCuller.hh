@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Frustum culling of many objects on the CPU, for devices that cannot cull
+// in a compute shader.
+//
+// Each object has a bounding sphere and an axis-aligned box, stored as
+// structure of arrays so that a kernel tests 4 (SSE) or 8 (AVX2) objects
+// per instruction against each of the six planes. An object is culled when
+// its sphere or its box lies entirely outside one plane: the sphere test is
+// the cheaper one, the box is tighter for elongated objects. The kernel is
+// picked at runtime from what the CPU supports, with a scalar fallback.
+//
+// cull() writes the indices of the objects left, in increasing order, to a
+// compact list meant to index the instance data of instanced draws.
+class FrustumCuller {
+public:
+    enum class Kernel
+    {
+        SCALAR,
+        SSE,
+        AVX2,
+    };
+
+    // Points p inside satisfy x * p.x + y * p.y + z * p.z + w >= 0
+    struct Plane {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+        float w = 0.0f;
+    };
+
+    using Frustum = std::array<Plane, 6>;
+
+    // Best kernel the CPU runs
+    static Kernel bestKernel();
+    static bool isSupported(Kernel kernel);
+    static const char *kernelName(Kernel kernel);
+
+    // Planes of a column-major view-projection matrix with Vulkan's 0 to 1
+    // depth range (Gribb and Hartmann), normalised so that sphere radii
+    // compare with plane distances
+    static Frustum extractFrustum(const float viewProjection[16]);
+
+    // Throws std::runtime_error if the CPU does not support kernel
+    explicit FrustumCuller(Kernel kernel = bestKernel());
+
+    // Returns the index of the new object
+    uint32_t add(const float center[3],
+                 float radius,
+                 const float boxMin[3],
+                 const float boxMax[3]);
+    void set(uint32_t index,
+             const float center[3],
+             float radius,
+             const float boxMin[3],
+             const float boxMax[3]);
+    void reserve(size_t count);
+    void clear();
+
+    size_t size() const
+    {
+        return count_;
+    }
+
+    Kernel kernel() const
+    {
+        return kernel_;
+    }
+
+    // Replaces visible with the indices of the objects intersecting the
+    // frustum
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible);
+    // Same, in ranges of grain objects culled by the jobs' workers
+    void cull(const Frustum &frustum,
+              std::vector<uint32_t> &visible,
+              JobSystem &jobs,
+              size_t grain = 16384);
+
+    // Padding of the arrays: the widest kernel reads 8 objects at a time
+    static constexpr size_t LANES = 8;
+
+private:
+    enum Component
+    {
+        CENTER_X,
+        CENTER_Y,
+        CENTER_Z,
+        RADIUS,
+        MIN_X,
+        MIN_Y,
+        MIN_Z,
+        MAX_X,
+        MAX_Y,
+        MAX_Z,
+        COMPONENT_COUNT,
+    };
+
+    // Writes the visible indices in [begin, end) to out, returns how many
+    size_t cullRange(const Frustum &frustum,
+                     size_t begin,
+                     size_t end,
+                     uint32_t *out) const;
+
+    Kernel kernel_;
+    size_t count_ = 0;
+    // One array per component, sized to a multiple of LANES
+    std::array<std::vector<float>, COMPONENT_COUNT> components_;
+    // Per-range results of the threaded cull
+    std::vector<uint32_t> scratch_;
+    std::vector<size_t> rangeCounts_;
+};
@@ -0,0 +1,253 @@
+#include "imageDecoder.hh"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+Image decodeImage(const uint8_t *data,
+                  size_t size,
+                  const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(),
+                   extension.end(),
+                   extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    if (extension == ".tga")
+        return decodeTga(data, size);
+    if (extension == ".ppm")
+        return decodePpm(data, size);
+    throw std::runtime_error("unsupported image format: " + path.string());
+}
+
+// TGA
+
+Image decodeTga(const uint8_t *data, size_t size)
+{
+    const size_t HEADER_SIZE = 18;
+    if (size < HEADER_SIZE)
+        throw std::runtime_error("truncated TGA header!");
+
+    uint8_t idLength = data[0];
+    uint8_t colorMapType = data[1];
+    uint8_t imageType = data[2];
+    uint32_t width = data[12] | data[13] << 8;
+    uint32_t height = data[14] | data[15] << 8;
+    uint32_t bytesPerPixel = data[16] / 8;
+    bool topLeftOrigin = data[17] & 0x20;
+
+    // 2, 3: raw true colour and greyscale; 10, 11: their RLE variants
+    bool rle = imageType == 10 || imageType == 11;
+    bool greyscale = imageType == 3 || imageType == 11;
+    if (colorMapType != 0 || (imageType & ~8) < 2 || (imageType & ~8) > 3)
+        throw std::runtime_error("unsupported TGA image type!");
+    if (greyscale ? bytesPerPixel != 1
+                  : bytesPerPixel != 3 && bytesPerPixel != 4)
+        throw std::runtime_error("unsupported TGA pixel depth!");
+    if (width == 0 || height == 0)
+        throw std::runtime_error("empty TGA image!");
+
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(size_t(width) * height * 4);
+
+    const uint8_t *src = data + HEADER_SIZE + idLength;
+    const uint8_t *end = data + size;
+    size_t pixelCount = size_t(width) * height;
+
+    auto store = [&](size_t index, const uint8_t *pixel) {
+        // Rows are stored bottom-up unless the descriptor says otherwise
+        size_t x = index % width;
+        size_t y = index / width;
+        if (!topLeftOrigin)
+            y = height - 1 - y;
+        uint8_t *dst = &image.pixels[(y * width + x) * 4];
+        if (greyscale) {
+            dst[0] = dst[1] = dst[2] = pixel[0];
+            dst[3] = 255;
+        }
+        else {
+            dst[0] = pixel[2];
+            dst[1] = pixel[1];
+            dst[2] = pixel[0];
+            dst[3] = bytesPerPixel == 4 ? pixel[3] : 255;
+        }
+    };
+
+    size_t index = 0;
+    while (index < pixelCount) {
+        // Raw images are one long raw packet
+        size_t count = pixelCount - index;
+        bool repeat = false;
+        if (rle) {
+            if (src >= end)
+                throw std::runtime_error("truncated TGA data!");
+            repeat = *src & 0x80;
+            count = std::min<size_t>((*src & 0x7f) + 1, pixelCount - index);
+            src++;
+        }
+
+        size_t packetBytes = repeat ? bytesPerPixel : count * bytesPerPixel;
+        if (size_t(end - src) < packetBytes)
+            throw std::runtime_error("truncated TGA data!");
+
+        for (size_t i = 0; i < count; i++)
+            store(index + i, repeat ? src : src + i * bytesPerPixel);
+        src += packetBytes;
+        index += count;
+    }
+    return image;
+}
+
+// PPM
+
+Image decodePpm(const uint8_t *data, size_t size)
+{
+    const uint8_t *src = data;
+    const uint8_t *end = data + size;
+
+    auto skipWhitespace = [&]() {
+        while (src < end) {
+            if (*src == '#') {
+                while (src < end && *src != '\n')
+                    src++;
+            }
+            else if (std::isspace(*src)) {
+                src++;
+            }
+            else {
+                break;
+            }
+        }
+    };
+    auto readNumber = [&]() {
+        skipWhitespace();
+        if (src == end || !std::isdigit(*src))
+            throw std::runtime_error("malformed PPM header!");
+        uint32_t value = 0;
+        while (src < end && std::isdigit(*src) && value < 1u << 24)
+            value = value * 10 + (*src++ - '0');
+        return value;
+    };
+
+    if (size < 2 || src[0] != 'P' || src[1] != '6')
+        throw std::runtime_error("unsupported PPM variant!");
+    src += 2;
+
+    uint32_t width = readNumber();
+    uint32_t height = readNumber();
+    uint32_t maxValue = readNumber();
+    if (width == 0 || height == 0)
+        throw std::runtime_error("empty PPM image!");
+    if (maxValue == 0 || maxValue > 255)
+        throw std::runtime_error("unsupported PPM sample depth!");
+
+    // Exactly one whitespace character separates the header from the data
+    src++;
+    size_t pixelCount = size_t(width) * height;
+    if (src > end || size_t(end - src) < pixelCount * 3)
+        throw std::runtime_error("truncated PPM data!");
+
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(pixelCount * 4);
+    for (size_t i = 0; i < pixelCount; i++) {
+        for (size_t c = 0; c < 3; c++)
+            image.pixels[i * 4 + c] =
+                static_cast<uint8_t>(src[i * 3 + c] * 255u / maxValue);
+        image.pixels[i * 4 + 3] = 255;
+    }
+    return image;
+}
+
+// Mip generation
+
+namespace {
+
+const size_t ENCODE_TABLE_SIZE = 4096;
+
+struct SrgbTables {
+    std::array<float, 256> toLinear;
+    std::array<uint8_t, ENCODE_TABLE_SIZE> toSrgb;
+
+    SrgbTables()
+    {
+        for (size_t i = 0; i < toLinear.size(); i++) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f
+                                        : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (size_t i = 0; i < toSrgb.size(); i++) {
+            float c = i / float(ENCODE_TABLE_SIZE - 1);
+            float s = c <= 0.0031308f
+                ? c * 12.92f
+                : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = static_cast<uint8_t>(s * 255.0f + 0.5f);
+        }
+    }
+};
+
+const SrgbTables &srgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+Image downsample(const Image &src)
+{
+    const SrgbTables &tables = srgbTables();
+
+    Image dst;
+    dst.width = std::max(src.width / 2, 1u);
+    dst.height = std::max(src.height / 2, 1u);
+    dst.pixels.resize(size_t(dst.width) * dst.height * 4);
+
+    // 2x2 box filter: an odd last row or column is skipped, a single one
+    // is repeated
+    for (uint32_t y = 0; y < dst.height; y++) {
+        uint32_t y0 = std::min(y * 2, src.height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+        for (uint32_t x = 0; x < dst.width; x++) {
+            uint32_t x0 = std::min(x * 2, src.width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+            const uint8_t *texels[4] = {
+                &src.pixels[(size_t(y0) * src.width + x0) * 4],
+                &src.pixels[(size_t(y0) * src.width + x1) * 4],
+                &src.pixels[(size_t(y1) * src.width + x0) * 4],
+                &src.pixels[(size_t(y1) * src.width + x1) * 4],
+            };
+            uint8_t *out = &dst.pixels[(size_t(y) * dst.width + x) * 4];
+            for (int c = 0; c < 3; c++) {
+                float sum = 0.0f;
+                for (const uint8_t *texel : texels)
+                    sum += tables.toLinear[texel[c]];
+                size_t index = static_cast<size_t>(
+                    sum * 0.25f * (ENCODE_TABLE_SIZE - 1) + 0.5f);
+                out[c] = tables.toSrgb[index];
+            }
+            // Alpha is linear
+            uint32_t alpha = 2;
+            for (const uint8_t *texel : texels)
+                alpha += texel[3];
+            out[3] = static_cast<uint8_t>(alpha / 4);
+        }
+    }
+    return dst;
+}
+
+} // namespace
+
+std::vector<Image> generateMipChain(Image image)
+{
+    std::vector<Image> levels;
+    levels.push_back(std::move(image));
+    while (levels.back().width > 1 || levels.back().height > 1)
+        levels.push_back(downsample(levels.back()));
+    return levels;
+}
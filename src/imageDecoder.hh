@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Tightly packed RGBA8 pixels, top row first
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Decodes an in-memory image, picking the format from the file extension:
+// TGA (true colour or greyscale, raw or RLE) and binary PPM (P6).
+// Throws std::runtime_error on unsupported or malformed data.
+Image decodeImage(const uint8_t *data,
+                  size_t size,
+                  const std::filesystem::path &path);
+
+Image decodeTga(const uint8_t *data, size_t size);
+Image decodePpm(const uint8_t *data, size_t size);
+
+// Full mip chain down to 1x1, level 0 being the image itself. Pixels are
+// treated as sRGB and averaged in linear space.
+std::vector<Image> generateMipChain(Image image);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Hands out indices in [0, capacity). Released indices are reused first
+// (LIFO), so the range in use stays compact.
+class IndexAllocator {
+public:
+    explicit IndexAllocator(uint32_t capacity = 0)
+        : capacity_(capacity)
+    {
+    }
+
+    uint32_t allocate()
+    {
+        if (!freeList_.empty()) {
+            uint32_t index = freeList_.back();
+            freeList_.pop_back();
+            return index;
+        }
+        if (next_ == capacity_)
+            throw std::runtime_error("index allocator is full!");
+        return next_++;
+    }
+
+    void release(uint32_t index)
+    {
+        freeList_.push_back(index);
+    }
+
+    uint32_t capacity() const
+    {
+        return capacity_;
+    }
+
+    uint32_t size() const
+    {
+        return next_ - static_cast<uint32_t>(freeList_.size());
+    }
+
+private:
+    uint32_t capacity_;
+    uint32_t next_ = 0;
+    std::vector<uint32_t> freeList_;
+};
@@ -0,0 +1,318 @@
+#include "jobSystem.hh"
+
+#include <algorithm>
+
+#include "tracer.hh"
+
+struct JobSystem::Job {
+    std::function<void()> function;
+    Counter *counter = nullptr;
+};
+
+// Chase-Lev deque of fixed capacity (Lê, Pop, Cohen and Zappa Nardelli,
+// "Correct and efficient work-stealing for weak memory models"). push()
+// and pop() are for the owner only, steal() for any thread; only the last
+// element is contended.
+class JobSystem::Deque {
+public:
+    static constexpr int64_t CAPACITY = 4096;
+
+    // False when full: the caller queues the job elsewhere
+    bool push(Job *job)
+    {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        if (bottom - top >= CAPACITY)
+            return false;
+        slots_[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Job *pop()
+    {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job *job = slots_[bottom & (CAPACITY - 1)].load(
+            std::memory_order_relaxed);
+        if (top == bottom) {
+            // Last element: race the thieves for it
+            if (!top_.compare_exchange_strong(top,
+                                              top + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+                job = nullptr;
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job *steal()
+    {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return nullptr;
+
+        Job *job = slots_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(top,
+                                          top + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top_{ 0 };
+    alignas(64) std::atomic<int64_t> bottom_{ 0 };
+    alignas(64) std::atomic<Job *> slots_[CAPACITY] = {};
+};
+
+struct JobSystem::Worker {
+    JobSystem *system = nullptr;
+    Deque deque;
+    std::thread thread;
+    // Written by the worker only
+    std::atomic<uint64_t> executed{ 0 };
+    std::atomic<uint64_t> stolen{ 0 };
+    uint32_t random = 0;
+};
+
+namespace {
+
+thread_local void *currentWorkerSlot = nullptr;
+
+} // namespace
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->system = this;
+        worker->random = 0x9E3779B9u * (i + 1);
+        workers_.push_back(std::move(worker));
+    }
+    // Started once every deque exists, as workers steal from all of them
+    for (auto &worker : workers_) {
+        Worker *self = worker.get();
+        worker->thread = std::thread([this, self] { workerLoop(*self); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wakeCondition_.notify_all();
+    for (auto &worker : workers_)
+        worker->thread.join();
+}
+
+void JobSystem::run(std::function<void()> function, Counter *counter)
+{
+    if (counter)
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+    schedule(new Job{ std::move(function), counter });
+}
+
+void JobSystem::runAfter(Counter &dependency,
+                         std::function<void()> function,
+                         Counter *counter)
+{
+    if (counter)
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+    Job *job = new Job{ std::move(function), counter };
+
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex_);
+        if (dependency.pending_.load(std::memory_order_acquire) != 0) {
+            dependency.continuations_.push_back(job);
+            return;
+        }
+    }
+    schedule(job);
+}
+
+void JobSystem::wait(Counter &counter)
+{
+    Worker *worker = currentWorker();
+    while (!counter.done()) {
+        Job *job = findJob(worker);
+        if (job)
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+
+    // The thread that finished the last job may still hold the mutex
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex_);
+        std::swap(error, counter.error_);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+JobSystem::Statistics JobSystem::statistics() const
+{
+    Statistics statistics;
+    statistics.executed = externalExecuted_.load(std::memory_order_relaxed);
+    for (const auto &worker : workers_) {
+        statistics.executed += worker->executed.load(std::memory_order_relaxed);
+        statistics.stolen += worker->stolen.load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
+
+void JobSystem::workerLoop(Worker &worker)
+{
+    currentWorkerSlot = &worker;
+    Tracer::nameThread("job worker");
+
+    for (;;) {
+        Job *job = findJob(&worker);
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepers_.fetch_add(1);
+        wakeCondition_.wait(
+            lock, [this] { return queued_.load() > 0 || stopping_; });
+        sleepers_.fetch_sub(1);
+        if (stopping_ && queued_.load() <= 0)
+            return;
+    }
+}
+
+JobSystem::Worker *JobSystem::currentWorker() const
+{
+    auto worker = static_cast<Worker *>(currentWorkerSlot);
+    return worker && worker->system == this ? worker : nullptr;
+}
+
+void JobSystem::schedule(Job *job)
+{
+    Worker *worker = currentWorker();
+    if (!worker || !worker->deque.push(job)) {
+        std::lock_guard<std::mutex> lock(sharedMutex_);
+        shared_.push_back(job);
+        sharedCount_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Sequentially consistent with the sleepers' check of queued_: either
+    // they see the job or this sees them asleep
+    queued_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        wakeCondition_.notify_one();
+    }
+}
+
+JobSystem::Job *JobSystem::findJob(Worker *worker)
+{
+    Job *job = worker ? worker->deque.pop() : nullptr;
+
+    if (!job && sharedCount_.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(sharedMutex_);
+        if (!shared_.empty()) {
+            job = shared_.front();
+            shared_.pop_front();
+            sharedCount_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!job) {
+        // Victims in a random order, so that thieves spread out
+        uint32_t start = 0;
+        if (worker) {
+            worker->random ^= worker->random << 13;
+            worker->random ^= worker->random >> 17;
+            worker->random ^= worker->random << 5;
+            start = worker->random;
+        }
+        size_t count = workers_.size();
+        for (size_t i = 0; i < count && !job; i++) {
+            Worker &victim = *workers_[(start + i) % count];
+            if (&victim != worker)
+                job = victim.deque.steal();
+        }
+        if (job && worker)
+            worker->stolen.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (job)
+        queued_.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::execute(Job *job)
+{
+    TRACE_ZONE("job");
+    if (job->counter) {
+        try {
+            job->function();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(job->counter->mutex_);
+            if (!job->counter->error_)
+                job->counter->error_ = std::current_exception();
+        }
+    }
+    else {
+        job->function();
+    }
+
+    Worker *worker = currentWorker();
+    if (worker)
+        worker->executed.fetch_add(1, std::memory_order_relaxed);
+    else
+        externalExecuted_.fetch_add(1, std::memory_order_relaxed);
+
+    Counter *counter = job->counter;
+    delete job;
+    finish(counter);
+}
+
+void JobSystem::finish(Counter *counter)
+{
+    if (!counter)
+        return;
+
+    // Lock-free unless this is the last job: then the counter is only
+    // released, and may be destroyed by its waiter, once the mutex is
+    uint32_t pending = counter->pending_.load(std::memory_order_relaxed);
+    while (pending > 1) {
+        if (counter->pending_.compare_exchange_weak(
+                pending, pending - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    std::vector<Job *> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex_);
+        if (counter->pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        ready.swap(counter->continuations_);
+    }
+    for (Job *job : ready)
+        schedule(job);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job scheduler. Each worker thread owns a deque: it pushes
+// and pops jobs at the bottom (LIFO, cache-warm), while idle workers steal
+// from the top of the others' (FIFO, the largest pieces of work). Jobs
+// added from threads that are not workers go through a shared queue.
+//
+// Dependencies are expressed with counters: a job added with a counter
+// increments it and decrements it when done, and runAfter() holds a job
+// back until a counter reaches zero. wait() runs other jobs while the
+// counter it waits on is not zero, so waiting never idles a thread that
+// could help.
+//
+// Every job must have completed (been waited on) before destruction.
+class JobSystem {
+    struct Job;
+
+public:
+    class Counter {
+    public:
+        Counter() = default;
+        Counter(const Counter &) = delete;
+        Counter &operator=(const Counter &) = delete;
+
+        bool done() const
+        {
+            return pending_.load(std::memory_order_acquire) == 0;
+        }
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<uint32_t> pending_{ 0 };
+        // Guards the hand-over when pending_ reaches zero
+        std::mutex mutex_;
+        std::vector<Job *> continuations_;
+        // First exception thrown by a job, rethrown by wait()
+        std::exception_ptr error_;
+    };
+
+    struct Statistics {
+        uint64_t executed = 0;
+        // Jobs a worker took from another worker's deque
+        uint64_t stolen = 0;
+    };
+
+    // threadCount 0: one worker per core but one, the thread that waits
+    // being the last one
+    explicit JobSystem(uint32_t threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // Jobs without a counter must not throw: nothing could report it
+    void run(std::function<void()> function, Counter *counter = nullptr);
+    void runAfter(Counter &dependency,
+                  std::function<void()> function,
+                  Counter *counter = nullptr);
+
+    // Runs function(begin, end) over [0, count) in ranges of grain items
+    template <typename Function>
+    void parallelFor(size_t count,
+                     size_t grain,
+                     Function function,
+                     Counter &counter)
+    {
+        grain = grain > 0 ? grain : 1;
+        for (size_t begin = 0; begin < count; begin += grain) {
+            size_t end = begin + grain < count ? begin + grain : count;
+            run([function, begin, end]() { function(begin, end); },
+                &counter);
+        }
+    }
+
+    // Runs jobs until counter reaches zero, then rethrows the first
+    // exception its jobs threw
+    void wait(Counter &counter);
+
+    uint32_t threadCount() const
+    {
+        return static_cast<uint32_t>(workers_.size());
+    }
+
+    Statistics statistics() const;
+
+private:
+    class Deque;
+    struct Worker;
+
+    void workerLoop(Worker &worker);
+    Worker *currentWorker() const;
+    void schedule(Job *job);
+    Job *findJob(Worker *worker);
+    void execute(Job *job);
+    void finish(Counter *counter);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Jobs added from outside the workers
+    std::mutex sharedMutex_;
+    std::deque<Job *> shared_;
+    std::atomic<size_t> sharedCount_{ 0 };
+    // Jobs waiting in any queue; idle workers sleep while it is zero
+    std::atomic<int64_t> queued_{ 0 };
+    std::mutex sleepMutex_;
+    std::condition_variable wakeCondition_;
+    std::atomic<uint32_t> sleepers_{ 0 };
+    bool stopping_ = false;
+    std::atomic<uint64_t> externalExecuted_{ 0 };
+};
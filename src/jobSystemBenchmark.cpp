@@ -0,0 +1,164 @@
+// Job scheduler micro-benchmark:
+//
+//   jobSystemBenchmark [--threads N] [--jobs N] [--runs N]
+//
+// Measures, best of --runs:
+// - spawn: one worker adds --jobs empty jobs to its own deque, in batches
+//   it waits for, the others stealing
+// - tree: jobs recursively spawn two children down to --jobs leaves, so
+//   work starts on one deque and spreads by stealing
+// - chain: --jobs / 64 jobs each started by the previous one's counter,
+//   the latency of a dependency hand-over
+// - parallelFor: a --jobs element loop in ranges of 256, from outside the
+//   workers like the frame loop does it
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "jobSystem.hh"
+
+namespace {
+
+// Fits in a worker's deque, which overflows into the shared queue
+const uint32_t SPAWN_BATCH = 2048;
+
+struct Result {
+    double ms = 1e30;
+    uint64_t jobs = 0;
+    uint64_t stolen = 0;
+};
+
+template <typename Function>
+Result measure(JobSystem &jobs, uint32_t runs, Function function)
+{
+    Result result;
+    for (uint32_t run = 0; run < runs; run++) {
+        JobSystem::Statistics before = jobs.statistics();
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        JobSystem::Statistics after = jobs.statistics();
+        if (ms < result.ms) {
+            result.ms = ms;
+            result.jobs = after.executed - before.executed;
+            result.stolen = after.stolen - before.stolen;
+        }
+    }
+    return result;
+}
+
+void report(const char *name, const Result &result)
+{
+    std::cout << "  " << name << ": " << result.jobs << " jobs in "
+              << result.ms << " ms, "
+              << result.jobs / (result.ms / 1000.0) / 1e6 << " M jobs/s, "
+              << result.stolen << " stolen\n";
+}
+
+void spawnTree(JobSystem &jobs,
+               JobSystem::Counter &counter,
+               uint32_t leaves)
+{
+    if (leaves <= 1)
+        return;
+    jobs.run([&jobs, &counter, leaves] {
+        spawnTree(jobs, counter, leaves / 2);
+    }, &counter);
+    jobs.run([&jobs, &counter, leaves] {
+        spawnTree(jobs, counter, leaves - leaves / 2);
+    }, &counter);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try {
+        uint32_t threads = 0;
+        uint32_t jobCount = 1 << 20;
+        uint32_t runs = 5;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--threads" && i + 1 < argc)
+                threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--jobs" && i + 1 < argc)
+                jobCount = std::max(
+                    64u, static_cast<uint32_t>(std::stoul(argv[++i])));
+            else if (arg == "--runs" && i + 1 < argc)
+                runs = std::max(
+                    1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+            else
+                throw std::runtime_error(
+                    "usage: jobSystemBenchmark [--threads N] [--jobs N] "
+                    "[--runs N]");
+        }
+
+        JobSystem jobs(threads);
+        std::cout << jobs.threadCount() << " worker thread(s)\n";
+
+        report("spawn", measure(jobs, runs, [&] {
+                   JobSystem::Counter done;
+                   jobs.run(
+                       [&] {
+                           for (uint32_t i = 0; i < jobCount;
+                                i += SPAWN_BATCH) {
+                               JobSystem::Counter children;
+                               for (uint32_t j = 0; j < SPAWN_BATCH; j++)
+                                   jobs.run([] {}, &children);
+                               jobs.wait(children);
+                           }
+                       },
+                       &done);
+                   jobs.wait(done);
+               }));
+
+        report("tree", measure(jobs, runs, [&] {
+                   JobSystem::Counter counter;
+                   jobs.run([&] { spawnTree(jobs, counter, jobCount); },
+                            &counter);
+                   jobs.wait(counter);
+               }));
+
+        report("chain", measure(jobs, runs, [&] {
+                   uint32_t length = jobCount / 64;
+                   std::vector<std::unique_ptr<JobSystem::Counter>> counters;
+                   for (uint32_t i = 0; i < length; i++)
+                       counters.push_back(
+                           std::make_unique<JobSystem::Counter>());
+                   jobs.run([] {}, counters[0].get());
+                   for (uint32_t i = 1; i < length; i++)
+                       jobs.runAfter(
+                           *counters[i - 1], [] {}, counters[i].get());
+                   jobs.wait(*counters.back());
+               }));
+
+        std::vector<float> values(jobCount, 1.0f);
+        report("parallelFor", measure(jobs, runs, [&] {
+                   JobSystem::Counter counter;
+                   jobs.parallelFor(
+                       values.size(),
+                       256,
+                       [&values](size_t begin, size_t end) {
+                           for (size_t i = begin; i < end; i++)
+                               values[i] = values[i] * 0.5f + 1.0f;
+                       },
+                       counter);
+                   jobs.wait(counter);
+               }));
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
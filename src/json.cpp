@@ -0,0 +1,308 @@
+#include "json.hh"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+class JsonValue::Parser {
+public:
+    explicit Parser(std::string_view text)
+        : text_(text)
+    {
+    }
+
+    JsonValue parseDocument()
+    {
+        JsonValue value = parseValue(0);
+        skipWhitespace();
+        if (position_ != text_.size())
+            fail("trailing characters");
+        return value;
+    }
+
+private:
+    // Deep enough for any asset header, shallow enough for the stack
+    static constexpr int MAX_DEPTH = 256;
+
+    [[noreturn]] void fail(const char *what) const
+    {
+        throw std::runtime_error("malformed JSON at offset "
+                                 + std::to_string(position_) + ": " + what);
+    }
+
+    void skipWhitespace()
+    {
+        while (position_ < text_.size()
+               && (text_[position_] == ' ' || text_[position_] == '\t'
+                   || text_[position_] == '\n' || text_[position_] == '\r'))
+            position_++;
+    }
+
+    char peek()
+    {
+        skipWhitespace();
+        if (position_ == text_.size())
+            fail("unexpected end");
+        return text_[position_];
+    }
+
+    void expect(char c)
+    {
+        if (peek() != c)
+            fail("unexpected character");
+        position_++;
+    }
+
+    bool consumeLiteral(std::string_view literal)
+    {
+        if (text_.substr(position_, literal.size()) != literal)
+            return false;
+        position_ += literal.size();
+        return true;
+    }
+
+    JsonValue parseValue(int depth)
+    {
+        if (depth > MAX_DEPTH)
+            fail("nesting too deep");
+
+        JsonValue value;
+        char c = peek();
+        if (c == '{') {
+            value.type_ = Type::OBJECT;
+            position_++;
+            if (peek() == '}') {
+                position_++;
+                return value;
+            }
+            do {
+                std::string key = parseString();
+                expect(':');
+                value.members_.emplace_back(std::move(key),
+                                            parseValue(depth + 1));
+            } while (consumeSeparator('}'));
+        }
+        else if (c == '[') {
+            value.type_ = Type::ARRAY;
+            position_++;
+            if (peek() == ']') {
+                position_++;
+                return value;
+            }
+            do {
+                value.elements_.push_back(parseValue(depth + 1));
+            } while (consumeSeparator(']'));
+        }
+        else if (c == '"') {
+            value.type_ = Type::STRING;
+            value.string_ = parseString();
+        }
+        else if (consumeLiteral("true") || consumeLiteral("false")) {
+            value.type_ = Type::BOOLEAN;
+            value.boolean_ = c == 't';
+        }
+        else if (consumeLiteral("null")) {
+            value.type_ = Type::NUL;
+        }
+        else {
+            value.type_ = Type::NUMBER;
+            value.number_ = parseNumber();
+        }
+        return value;
+    }
+
+    // After an element: true on ',', false on the closing character
+    bool consumeSeparator(char close)
+    {
+        char c = peek();
+        position_++;
+        if (c == ',')
+            return true;
+        if (c != close)
+            fail("expected ',' or closing bracket");
+        return false;
+    }
+
+    double parseNumber()
+    {
+        size_t start = position_;
+        while (position_ < text_.size()
+               && (std::isdigit(static_cast<unsigned char>(text_[position_]))
+                   || text_[position_] == '-' || text_[position_] == '+'
+                   || text_[position_] == '.' || text_[position_] == 'e'
+                   || text_[position_] == 'E'))
+            position_++;
+        if (start == position_)
+            fail("unexpected character");
+
+        std::string number(text_.substr(start, position_ - start));
+        char *end;
+        double value = std::strtod(number.c_str(), &end);
+        if (end != number.c_str() + number.size())
+            fail("invalid number");
+        return value;
+    }
+
+    std::string parseString()
+    {
+        expect('"');
+        std::string result;
+        for (;;) {
+            if (position_ >= text_.size())
+                fail("unterminated string");
+            char c = text_[position_++];
+            if (c == '"')
+                return result;
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+
+            if (position_ >= text_.size())
+                fail("unterminated string");
+            char escape = text_[position_++];
+            switch (escape) {
+            case '"':
+            case '\\':
+            case '/':
+                result += escape;
+                break;
+            case 'b':
+                result += '\b';
+                break;
+            case 'f':
+                result += '\f';
+                break;
+            case 'n':
+                result += '\n';
+                break;
+            case 'r':
+                result += '\r';
+                break;
+            case 't':
+                result += '\t';
+                break;
+            case 'u':
+                appendUtf8(result, parseHex4());
+                break;
+            default:
+                fail("invalid escape");
+            }
+        }
+    }
+
+    uint32_t parseHex4()
+    {
+        if (text_.size() - position_ < 4)
+            fail("truncated escape");
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text_[position_++];
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                fail("invalid escape");
+        }
+        return value;
+    }
+
+    // Surrogate pairs are kept as two separate code points: names and URIs
+    // in asset headers do not need them
+    static void appendUtf8(std::string &out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800) {
+            out += static_cast<char>(0xC0 | codePoint >> 6);
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else {
+            out += static_cast<char>(0xE0 | codePoint >> 12);
+            out += static_cast<char>(0x80 | (codePoint >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    std::string_view text_;
+    size_t position_ = 0;
+};
+
+JsonValue JsonValue::parse(std::string_view text)
+{
+    return Parser(text).parseDocument();
+}
+
+bool JsonValue::asBool() const
+{
+    if (type_ != Type::BOOLEAN)
+        throw std::runtime_error("JSON value is not a boolean!");
+    return boolean_;
+}
+
+double JsonValue::asNumber() const
+{
+    if (type_ != Type::NUMBER)
+        throw std::runtime_error("JSON value is not a number!");
+    return number_;
+}
+
+uint64_t JsonValue::asUint() const
+{
+    double number = asNumber();
+    if (number < 0.0 || number != std::floor(number))
+        throw std::runtime_error("JSON value is not an unsigned integer!");
+    return static_cast<uint64_t>(number);
+}
+
+const std::string &JsonValue::asString() const
+{
+    if (type_ != Type::STRING)
+        throw std::runtime_error("JSON value is not a string!");
+    return string_;
+}
+
+size_t JsonValue::size() const
+{
+    if (type_ == Type::ARRAY)
+        return elements_.size();
+    if (type_ == Type::OBJECT)
+        return members_.size();
+    return 0;
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const
+{
+    if (type_ != Type::ARRAY || index >= elements_.size())
+        throw std::runtime_error("JSON array index out of range!");
+    return elements_[index];
+}
+
+const JsonValue *JsonValue::find(std::string_view key) const
+{
+    for (const auto &member : members_) {
+        if (member.first == key)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+const JsonValue &JsonValue::operator[](std::string_view key) const
+{
+    const JsonValue *value = find(key);
+    if (value == nullptr)
+        throw std::runtime_error("missing JSON member: " + std::string(key));
+    return *value;
+}
+
+uint64_t JsonValue::uintOr(std::string_view key, uint64_t fallback) const
+{
+    const JsonValue *value = find(key);
+    return value ? value->asUint() : fallback;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Small JSON document model for asset headers and configuration files.
+// Bulk data never goes through it (glTF keeps vertices in binary buffers).
+class JsonValue {
+public:
+    enum class Type
+    {
+        NUL,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT,
+    };
+
+    // Throws std::runtime_error on malformed text
+    static JsonValue parse(std::string_view text);
+
+    Type type() const
+    {
+        return type_;
+    }
+
+    bool isNull() const
+    {
+        return type_ == Type::NUL;
+    }
+
+    // Typed accessors throw std::runtime_error on a type mismatch
+    bool asBool() const;
+    double asNumber() const;
+    uint64_t asUint() const;
+    const std::string &asString() const;
+
+    // Elements of an array, members of an object, 0 otherwise
+    size_t size() const;
+    const JsonValue &operator[](size_t index) const;
+
+    // nullptr when the object has no such member
+    const JsonValue *find(std::string_view key) const;
+    // Throws when the member is missing
+    const JsonValue &operator[](std::string_view key) const;
+
+    // Member value, or fallback when missing
+    uint64_t uintOr(std::string_view key, uint64_t fallback) const;
+
+private:
+    class Parser;
+
+    Type type_ = Type::NUL;
+    bool boolean_ = false;
+    double number_ = 0.0;
+    std::string string_;
+    std::vector<JsonValue> elements_;
+    std::vector<std::pair<std::string, JsonValue>> members_;
+};
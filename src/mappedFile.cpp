@@ -0,0 +1,66 @@
+#include "mappedFile.hh"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("failed to open " + path.string() + "!");
+
+    struct stat status {};
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat " + path.string() + "!");
+    }
+    size_ = static_cast<size_t>(status.st_size);
+
+    // mmap rejects empty mappings: an empty file is an empty span
+    if (size_ > 0) {
+        void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("failed to map " + path.string() + "!");
+        }
+        // Parsers read front to back
+        madvise(mapping, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const uint8_t *>(mapping);
+    }
+
+    // The mapping stays valid once the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void MappedFile::unmap()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<uint8_t *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
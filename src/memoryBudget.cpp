@@ -0,0 +1,102 @@
+#include "memoryBudget.hh"
+
+#include <algorithm>
+#include <cstring>
+
+bool MemoryBudget::isSupported(VkPhysicalDevice physicalDevice)
+{
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice, nullptr, &count, extensions.data());
+    return std::any_of(extensions.begin(),
+                       extensions.end(),
+                       [](const VkExtensionProperties &extension) {
+                           return std::strcmp(
+                                      extension.extensionName,
+                                      VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+                               == 0;
+                       });
+}
+
+MemoryBudget::MemoryBudget(VkPhysicalDevice physicalDevice,
+                           bool extensionEnabled,
+                           const Watermarks &watermarks)
+    : physicalDevice_(physicalDevice)
+    , extensionEnabled_(extensionEnabled)
+    , watermarks_(watermarks)
+{
+    VkPhysicalDeviceMemoryProperties properties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &properties);
+    heaps_.resize(properties.memoryHeapCount);
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        heaps_[i].size = properties.memoryHeaps[i].size;
+        heaps_[i].budget = heaps_[i].size;
+        heaps_[i].deviceLocal =
+            properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    }
+    update();
+}
+
+void MemoryBudget::update()
+{
+    if (!extensionEnabled_)
+        return;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice_, &properties);
+
+    for (uint32_t i = 0; i < heaps_.size(); i++) {
+        Heap &heap = heaps_[i];
+        heap.usage = budget.heapUsage[i];
+        // 0 from drivers that cannot tell
+        heap.budget = budget.heapBudget[i] > 0 ? budget.heapBudget[i]
+                                               : heap.size;
+
+        Pressure pressure = pressureOf(heap);
+        if (pressure == heap.pressure)
+            continue;
+        heap.pressure = pressure;
+        for (const Callback &callback : callbacks_) {
+            callback(i, heap);
+        }
+    }
+}
+
+MemoryBudget::Heap MemoryBudget::deviceLocal() const
+{
+    Heap total;
+    total.deviceLocal = true;
+    for (const Heap &heap : heaps_) {
+        if (!heap.deviceLocal)
+            continue;
+        total.usage += heap.usage;
+        total.budget += heap.budget;
+        total.size += heap.size;
+        total.pressure = std::max(total.pressure, heap.pressure);
+    }
+    return total;
+}
+
+MemoryBudget::Pressure MemoryBudget::pressureOf(const Heap &heap) const
+{
+    double used =
+        double(heap.usage) / double(std::max<VkDeviceSize>(heap.budget, 1));
+    // Watermarks to leave the current level by are lowered by hysteresis
+    auto above = [&](float watermark, Pressure level) {
+        return used >= watermark
+            - (heap.pressure >= level ? watermarks_.hysteresis : 0.0f);
+    };
+    if (above(watermarks_.critical, Pressure::CRITICAL))
+        return Pressure::CRITICAL;
+    if (above(watermarks_.high, Pressure::HIGH))
+        return Pressure::HIGH;
+    return Pressure::NORMAL;
+}
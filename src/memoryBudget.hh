@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Device memory usage against the budget of each memory heap, refreshed
+// once per frame. With VK_EXT_memory_budget the usage and budget are the
+// driver's, covering every process and allocation on the device; without
+// it usage is unknown (0) and the budget is the heap size.
+//
+// Usage is compared with two watermarks, fractions of the budget. When a
+// heap crosses one, in either direction, the watermark callbacks are told
+// its new pressure level, so that streaming can drop detail before the
+// driver starts paging or allocations fail. A level is only left once
+// usage falls a hysteresis fraction below its watermark, so that usage
+// hovering around it does not make the callbacks oscillate.
+class MemoryBudget {
+public:
+    enum class Pressure
+    {
+        NORMAL,
+        HIGH,
+        CRITICAL,
+    };
+
+    struct Heap {
+        VkDeviceSize usage = 0;
+        VkDeviceSize budget = 0;
+        VkDeviceSize size = 0;
+        bool deviceLocal = false;
+        Pressure pressure = Pressure::NORMAL;
+    };
+
+    struct Watermarks {
+        float high = 0.80f;
+        float critical = 0.95f;
+        float hysteresis = 0.05f;
+    };
+
+    // Called from update() with the index of the heap whose level changed
+    using Callback = std::function<void(uint32_t heapIndex, const Heap &heap)>;
+
+    // Whether the device can report budgets; VK_EXT_memory_budget must then
+    // be enabled on the device before passing extensionEnabled
+    static bool isSupported(VkPhysicalDevice physicalDevice);
+
+    MemoryBudget(VkPhysicalDevice physicalDevice,
+                 bool extensionEnabled,
+                 const Watermarks &watermarks);
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    bool driverReported() const
+    {
+        return extensionEnabled_;
+    }
+
+    void addWatermarkCallback(Callback callback)
+    {
+        callbacks_.push_back(std::move(callback));
+    }
+
+    // Once per frame, on the thread that owns the callbacks' consumers
+    void update();
+
+    const std::vector<Heap> &heaps() const
+    {
+        return heaps_;
+    }
+
+    // Sum over the device-local heaps, at the highest of their levels
+    Heap deviceLocal() const;
+
+private:
+    Pressure pressureOf(const Heap &heap) const;
+
+    VkPhysicalDevice physicalDevice_;
+    bool extensionEnabled_;
+    Watermarks watermarks_;
+    std::vector<Heap> heaps_;
+    std::vector<Callback> callbacks_;
+};
@@ -0,0 +1,72 @@
+#include "meshFile.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+MeshFile::MeshFile(const std::filesystem::path &path)
+    : file_(path)
+{
+    if (file_.size() < sizeof(MeshFileHeader))
+        throw std::runtime_error("truncated mesh file: " + path.string());
+
+    const MeshFileHeader &fileHeader = header();
+    if (fileHeader.magic != MeshFileHeader::MAGIC
+        || fileHeader.version != MeshFileHeader::VERSION)
+        throw std::runtime_error("not a mesh file: " + path.string());
+    if (fileHeader.indexSize != 2 && fileHeader.indexSize != 4)
+        throw std::runtime_error("invalid index size in " + path.string());
+
+    uint64_t size = sizeof(MeshFileHeader)
+        + uint64_t(fileHeader.vertexCount) * sizeof(MeshVertex)
+        + uint64_t(fileHeader.indexCount) * fileHeader.indexSize;
+    if (file_.size() < size)
+        throw std::runtime_error("truncated mesh file: " + path.string());
+}
+
+void writeMeshFile(const std::filesystem::path &path,
+                   const MeshVertex *vertices,
+                   uint32_t vertexCount,
+                   const uint32_t *indices,
+                   uint32_t indexCount)
+{
+    MeshFileHeader header;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.indexSize =
+        vertexCount <= std::numeric_limits<uint16_t>::max() + 1u ? 2 : 4;
+    for (int i = 0; i < 3; i++) {
+        header.boundsMin[i] = vertexCount > 0 ? vertices[0].position[i] : 0;
+        header.boundsMax[i] = header.boundsMin[i];
+    }
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+        for (int i = 0; i < 3; i++) {
+            header.boundsMin[i] =
+                std::min(header.boundsMin[i], vertices[vertex].position[i]);
+            header.boundsMax[i] =
+                std::max(header.boundsMax[i], vertices[vertex].position[i]);
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("failed to create " + path.string() + "!");
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(vertices),
+               std::streamsize(vertexCount) * sizeof(MeshVertex));
+    if (header.indexSize == 2) {
+        std::vector<uint16_t> narrow(indices, indices + indexCount);
+        file.write(reinterpret_cast<const char *>(narrow.data()),
+                   std::streamsize(indexCount) * sizeof(uint16_t));
+    }
+    else {
+        file.write(reinterpret_cast<const char *>(indices),
+                   std::streamsize(indexCount) * sizeof(uint32_t));
+    }
+
+    if (!file)
+        throw std::runtime_error("failed to write " + path.string() + "!");
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include "mappedFile.hh"
+#include "meshLoader.hh"
+
+// Compact binary mesh, the output of meshOptimize: a header followed by
+// the vertices (MeshVertex, already in GPU layout) and the indices, 16-bit
+// when every vertex can be addressed with them. Little endian.
+struct MeshFileHeader {
+    static constexpr uint32_t MAGIC = 0x4853454D; // "MESH"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    uint32_t indexSize = 4; // bytes per index, 2 or 4
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+};
+
+static_assert(sizeof(MeshFileHeader) == 44, "MeshFileHeader is packed");
+
+// A .mesh file mapped once and validated; vertices and indices point into
+// the mapping, ready to be copied to staging memory as they are
+class MeshFile {
+public:
+    // Throws std::runtime_error when the file is truncated or not a mesh
+    explicit MeshFile(const std::filesystem::path &path);
+
+    const MeshFileHeader &header() const
+    {
+        return *reinterpret_cast<const MeshFileHeader *>(file_.data());
+    }
+
+    const MeshVertex *vertices() const
+    {
+        return reinterpret_cast<const MeshVertex *>(file_.data()
+                                                    + sizeof(MeshFileHeader));
+    }
+
+    // uint16_t or uint32_t elements, depending on header().indexSize
+    const void *indices() const
+    {
+        return file_.data() + sizeof(MeshFileHeader)
+            + header().vertexCount * sizeof(MeshVertex);
+    }
+
+private:
+    MappedFile file_;
+};
+
+void writeMeshFile(const std::filesystem::path &path,
+                   const MeshVertex *vertices,
+                   uint32_t vertexCount,
+                   const uint32_t *indices,
+                   uint32_t indexCount);
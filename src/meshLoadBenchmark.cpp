@@ -0,0 +1,189 @@
+// Measures mesh load time against thread count:
+//
+//   meshLoadBenchmark [--runs N] [--threads N]... FILE...
+//   meshLoadBenchmark --generate MB FILE.obj
+//
+// --generate writes a synthetic OBJ of about MB megabytes (a
+// tessellated, displaced grid with positions, uvs and normals) to load
+// afterwards. Without --threads, every power of two up to the core count is
+// measured. Output goes to write-only memory, as staging memory would be.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "meshLoader.hh"
+
+namespace {
+
+// Reuses its allocations across runs so that page faults of fresh memory
+// are not measured as load time
+class BenchmarkDestination : public MeshDestination {
+public:
+    uint32_t *indices(uint32_t count) override
+    {
+        indices_.resize(std::max<size_t>(indices_.size(), count));
+        return indices_.data();
+    }
+
+    MeshVertex *vertices(uint32_t count) override
+    {
+        vertices_.resize(std::max<size_t>(vertices_.size(), count));
+        return vertices_.data();
+    }
+
+private:
+    std::vector<uint32_t> indices_;
+    std::vector<MeshVertex> vertices_;
+};
+
+void generateObj(const std::filesystem::path &path, uint64_t megabytes)
+{
+    // About 170 bytes of text per grid vertex (v, vt, vn and one quad)
+    uint64_t side = static_cast<uint64_t>(
+        std::sqrt(double(megabytes << 20) / 170.0)) + 2;
+
+    std::unique_ptr<FILE, int (*)(FILE *)> file(
+        std::fopen(path.c_str(), "w"), std::fclose);
+    if (!file)
+        throw std::runtime_error("failed to create " + path.string() + "!");
+
+    for (uint64_t y = 0; y < side; y++) {
+        for (uint64_t x = 0; x < side; x++) {
+            double u = double(x) / (side - 1);
+            double v = double(y) / (side - 1);
+            double height = 0.05 * std::sin(u * 40.0) * std::cos(v * 40.0);
+            std::fprintf(file.get(),
+                         "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.4f %.4f %.4f\n",
+                         u - 0.5,
+                         height,
+                         v - 0.5,
+                         u,
+                         v,
+                         0.0,
+                         1.0,
+                         0.0);
+        }
+    }
+    for (uint64_t y = 0; y + 1 < side; y++) {
+        for (uint64_t x = 0; x + 1 < side; x++) {
+            uint64_t a = y * side + x + 1;
+            uint64_t b = a + 1;
+            uint64_t c = a + side + 1;
+            uint64_t d = a + side;
+            std::fprintf(file.get(),
+                         "f %llu/%llu/%llu %llu/%llu/%llu %llu/%llu/%llu "
+                         "%llu/%llu/%llu\n",
+                         (unsigned long long)a,
+                         (unsigned long long)a,
+                         (unsigned long long)a,
+                         (unsigned long long)d,
+                         (unsigned long long)d,
+                         (unsigned long long)d,
+                         (unsigned long long)c,
+                         (unsigned long long)c,
+                         (unsigned long long)c,
+                         (unsigned long long)b,
+                         (unsigned long long)b,
+                         (unsigned long long)b);
+        }
+    }
+}
+
+void benchmark(const std::filesystem::path &path,
+               const std::vector<uint32_t> &threadCounts,
+               uint32_t runs)
+{
+    double megabytes = std::filesystem::file_size(path) / double(1 << 20);
+    std::cout << path.string() << ": " << megabytes << " MB\n";
+
+    BenchmarkDestination destination;
+    // Untimed run: maps the file into the page cache and sizes the output
+    MeshInfo info = loadMesh(path, destination);
+    std::cout << "  " << info.vertexCount << " vertices (from "
+              << info.sourceVertexCount << "), " << info.indexCount / 3
+              << " triangles\n";
+
+    double serialMs = 0.0;
+    for (uint32_t threads : threadCounts) {
+        double bestMs = 1e30;
+        for (uint32_t run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            loadMesh(path, destination, threads);
+            double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+            bestMs = std::min(bestMs, ms);
+        }
+        if (threads == threadCounts.front())
+            serialMs = bestMs;
+        std::cout << "  " << threads << " thread(s): " << bestMs << " ms, "
+                  << megabytes / (bestMs / 1000.0) << " MB/s, "
+                  << serialMs / bestMs << "x\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try {
+        std::vector<uint32_t> threadCounts;
+        std::vector<std::filesystem::path> paths;
+        uint32_t runs = 3;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--generate" && i + 2 < argc) {
+                uint64_t megabytes = std::stoull(argv[++i]);
+                std::filesystem::path path = argv[++i];
+                generateObj(path, megabytes);
+                paths.push_back(path);
+            }
+            else if (arg == "--threads" && i + 1 < argc) {
+                threadCounts.push_back(std::max(
+                    1u, static_cast<uint32_t>(std::stoul(argv[++i]))));
+            }
+            else if (arg == "--runs" && i + 1 < argc) {
+                runs = std::max(1u, static_cast<uint32_t>(
+                                        std::stoul(argv[++i])));
+            }
+            else if (!arg.empty() && arg[0] != '-') {
+                paths.emplace_back(arg);
+            }
+            else {
+                throw std::runtime_error("unknown option: " + arg);
+            }
+        }
+        if (paths.empty())
+            throw std::runtime_error(
+                "usage: meshLoadBenchmark [--runs N] [--threads N]... "
+                "[--generate MB FILE.obj] FILE...");
+
+        if (threadCounts.empty()) {
+            uint32_t cores =
+                std::max(std::thread::hardware_concurrency(), 1u);
+            for (uint32_t threads = 1; threads < cores; threads *= 2)
+                threadCounts.push_back(threads);
+            threadCounts.push_back(cores);
+        }
+
+        for (const auto &path : paths)
+            benchmark(path, threadCounts, runs);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,970 @@
+#include "meshLoader.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "json.hh"
+#include "mappedFile.hh"
+#include "meshFile.hh"
+
+namespace {
+
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+// Threads
+
+uint32_t resolveThreadCount(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    return std::max(threadCount, 1u);
+}
+
+// Calls function(range, begin, end) on up to threadCount contiguous
+// ranges of [0, count), the first one on the calling thread. The first
+// exception thrown by any range is rethrown once every thread has joined.
+template <typename Function>
+void parallelFor(uint32_t threadCount, size_t count, Function function)
+{
+    size_t rangeCount =
+        std::min<size_t>(threadCount, std::max<size_t>(count, 1));
+    std::vector<std::exception_ptr> errors(rangeCount);
+    auto run = [&](size_t range) {
+        try {
+            function(range,
+                     count * range / rangeCount,
+                     count * (range + 1) / rangeCount);
+        }
+        catch (...) {
+            errors[range] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t range = 1; range < rangeCount; range++)
+        threads.emplace_back(run, range);
+    run(0);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+struct Bounds {
+    float min[3] = { std::numeric_limits<float>::max(),
+                     std::numeric_limits<float>::max(),
+                     std::numeric_limits<float>::max() };
+    float max[3] = { std::numeric_limits<float>::lowest(),
+                     std::numeric_limits<float>::lowest(),
+                     std::numeric_limits<float>::lowest() };
+
+    void add(const float position[3])
+    {
+        for (int i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], position[i]);
+            max[i] = std::max(max[i], position[i]);
+        }
+    }
+
+    // Empty bounds leave this unchanged
+    void add(const Bounds &other)
+    {
+        for (int i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], other.min[i]);
+            max[i] = std::max(max[i], other.max[i]);
+        }
+    }
+};
+
+// Deduplication
+
+uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Open addressing map from plain-old-data keys to vertex indices. Keys are
+// compared bytewise. The table doubles when half full, so the number of
+// allocations is logarithmic in the vertex count.
+template <typename Key> class VertexMap {
+public:
+    explicit VertexMap(size_t expectedEntries)
+    {
+        size_t capacity = 1024;
+        while (capacity < expectedEntries * 2)
+            capacity *= 2;
+        slots_.resize(capacity);
+    }
+
+    // Index of key, or newIndex after inserting it
+    uint32_t insert(const Key &key, uint64_t hash, uint32_t newIndex)
+    {
+        if ((size_ + 1) * 2 > slots_.size())
+            grow();
+
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot &slot = slots_[i];
+            if (slot.index == NONE) {
+                slot.key = key;
+                slot.hash = hash;
+                slot.index = newIndex;
+                size_++;
+                return newIndex;
+            }
+            if (slot.hash == hash
+                && std::memcmp(&slot.key, &key, sizeof(Key)) == 0)
+                return slot.index;
+        }
+    }
+
+private:
+    struct Slot {
+        Key key;
+        uint64_t hash = 0;
+        uint32_t index = NONE;
+    };
+
+    void grow()
+    {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (const Slot &slot : old) {
+            if (slot.index == NONE)
+                continue;
+            size_t i = slot.hash & mask;
+            while (slots_[i].index != NONE)
+                i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+};
+
+uint32_t checkedCount(uint64_t count, const char *what)
+{
+    if (count > std::numeric_limits<uint32_t>::max() - 1)
+        throw std::runtime_error(std::string("too many ") + what
+                                 + " for 32-bit indices!");
+    return static_cast<uint32_t>(count);
+}
+
+void finishInfo(MeshInfo &info, const Bounds &bounds)
+{
+    for (int i = 0; i < 3; i++) {
+        info.boundsMin[i] = info.vertexCount > 0 ? bounds.min[i] : 0.0f;
+        info.boundsMax[i] = info.vertexCount > 0 ? bounds.max[i] : 0.0f;
+    }
+}
+
+// OBJ
+
+// Index triplet of a face corner, 0-based, NONE when absent
+struct ObjCorner {
+    uint32_t position;
+    uint32_t uv;
+    uint32_t normal;
+};
+
+// A slice of the file starting and ending on line boundaries
+struct ObjChunk {
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    // Counted by the first pass, turned into offsets by a prefix sum
+    uint64_t positions = 0;
+    uint64_t uvs = 0;
+    uint64_t normals = 0;
+    uint64_t corners = 0;
+};
+
+bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char *skipBlanks(const char *p, const char *end)
+{
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+const char *nextLine(const char *p, const char *end)
+{
+    const void *newline = std::memchr(p, '\n', end - p);
+    return newline ? static_cast<const char *>(newline) + 1 : end;
+}
+
+// Locale-free float parsing, without the copy strtof needs for its
+// terminating null
+float parseFloat(const char *&p, const char *end)
+{
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    double value = 0.0;
+    bool digits = false;
+    while (p < end && std::isdigit(static_cast<unsigned char>(*p))) {
+        value = value * 10.0 + (*p++ - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < end && std::isdigit(static_cast<unsigned char>(*p))) {
+            value += (*p++ - '0') * scale;
+            scale *= 0.1;
+            digits = true;
+        }
+    }
+    if (!digits)
+        throw std::runtime_error("malformed OBJ number!");
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        int exponent = 0;
+        while (p < end && std::isdigit(static_cast<unsigned char>(*p))
+               && exponent < 1000)
+            exponent = exponent * 10 + (*p++ - '0');
+        value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+    }
+    return static_cast<float>(negative ? -value : value);
+}
+
+// Resolves a 1-based or negative (relative) OBJ index against the number
+// of elements defined so far; an empty index (as in v//vn) gives NONE
+uint32_t parseIndex(const char *&p, const char *end, uint64_t defined)
+{
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    int64_t value = 0;
+    bool digits = false;
+    while (p < end && std::isdigit(static_cast<unsigned char>(*p))) {
+        value = std::min<int64_t>(value * 10 + (*p++ - '0'), INT64_MAX / 16);
+        digits = true;
+    }
+    if (!digits)
+        return NONE;
+
+    int64_t index = negative ? int64_t(defined) - value : value - 1;
+    if (index < 0 || index >= int64_t(NONE))
+        throw std::runtime_error("OBJ index out of range!");
+    return static_cast<uint32_t>(index);
+}
+
+// The line kinds the loader cares about; everything else is skipped
+enum class ObjLine
+{
+    OTHER,
+    POSITION,
+    UV,
+    NORMAL,
+    FACE,
+};
+
+// Leaves p after the keyword and its separator
+ObjLine classify(const char *&p, const char *end)
+{
+    p = skipBlanks(p, end);
+    auto keyword = [&](std::string_view word) {
+        if (size_t(end - p) <= word.size()
+            || std::memcmp(p, word.data(), word.size()) != 0
+            || !isBlank(p[word.size()]))
+            return false;
+        p += word.size() + 1;
+        return true;
+    };
+
+    if (keyword("v"))
+        return ObjLine::POSITION;
+    if (keyword("vt"))
+        return ObjLine::UV;
+    if (keyword("vn"))
+        return ObjLine::NORMAL;
+    if (keyword("f"))
+        return ObjLine::FACE;
+    return ObjLine::OTHER;
+}
+
+bool endOfTokens(const char *p, const char *lineEnd)
+{
+    return p >= lineEnd || *p == '\n' || *p == '#';
+}
+
+const char *skipToken(const char *p, const char *lineEnd)
+{
+    while (p < lineEnd && !isBlank(*p) && *p != '\n')
+        p++;
+    return p;
+}
+
+// Polygons are triangulated as fans
+uint64_t countFaceCorners(const char *p, const char *lineEnd)
+{
+    uint64_t vertices = 0;
+    for (p = skipBlanks(p, lineEnd); !endOfTokens(p, lineEnd);
+         p = skipBlanks(p, lineEnd)) {
+        vertices++;
+        p = skipToken(p, lineEnd);
+    }
+    return vertices >= 3 ? (vertices - 2) * 3 : 0;
+}
+
+void countObjChunk(ObjChunk &chunk)
+{
+    for (const char *line = chunk.begin; line < chunk.end;) {
+        const char *lineEnd = nextLine(line, chunk.end);
+        const char *p = line;
+        switch (classify(p, lineEnd)) {
+        case ObjLine::POSITION:
+            chunk.positions++;
+            break;
+        case ObjLine::UV:
+            chunk.uvs++;
+            break;
+        case ObjLine::NORMAL:
+            chunk.normals++;
+            break;
+        case ObjLine::FACE:
+            chunk.corners += countFaceCorners(p, lineEnd);
+            break;
+        case ObjLine::OTHER:
+            break;
+        }
+        line = lineEnd;
+    }
+}
+
+struct ObjData {
+    std::vector<float> positions; // xyz
+    std::vector<float> uvs;       // uv, v pointing down
+    std::vector<float> normals;   // xyz
+    std::vector<ObjCorner> corners;
+};
+
+// Writes the chunk's elements at the offsets left in it by the prefix sum
+void parseObjChunk(const ObjChunk &chunk, ObjData &data)
+{
+    uint64_t position = chunk.positions;
+    uint64_t uv = chunk.uvs;
+    uint64_t normal = chunk.normals;
+    uint64_t corner = chunk.corners;
+
+    for (const char *line = chunk.begin; line < chunk.end;) {
+        const char *lineEnd = nextLine(line, chunk.end);
+        const char *p = line;
+        switch (classify(p, lineEnd)) {
+        case ObjLine::POSITION: {
+            float *out = &data.positions[position++ * 3];
+            for (int i = 0; i < 3; i++)
+                out[i] = parseFloat(p, lineEnd);
+            break;
+        }
+        case ObjLine::UV: {
+            // OBJ puts v = 0 at the bottom, Vulkan at the top
+            float *out = &data.uvs[uv++ * 2];
+            out[0] = parseFloat(p, lineEnd);
+            out[1] = 1.0f - parseFloat(p, lineEnd);
+            break;
+        }
+        case ObjLine::NORMAL: {
+            float *out = &data.normals[normal++ * 3];
+            for (int i = 0; i < 3; i++)
+                out[i] = parseFloat(p, lineEnd);
+            break;
+        }
+        case ObjLine::FACE: {
+            ObjCorner first{};
+            ObjCorner previous{};
+            uint32_t vertices = 0;
+            for (p = skipBlanks(p, lineEnd); !endOfTokens(p, lineEnd);
+                 p = skipBlanks(p, lineEnd)) {
+                // v, v/vt, v//vn or v/vt/vn
+                ObjCorner current{ parseIndex(p, lineEnd, position),
+                                   NONE,
+                                   NONE };
+                if (current.position == NONE)
+                    throw std::runtime_error("OBJ face without position!");
+                if (p < lineEnd && *p == '/') {
+                    p++;
+                    current.uv = parseIndex(p, lineEnd, uv);
+                    if (p < lineEnd && *p == '/') {
+                        p++;
+                        current.normal = parseIndex(p, lineEnd, normal);
+                    }
+                }
+                p = skipToken(p, lineEnd);
+
+                if (vertices == 0) {
+                    first = current;
+                }
+                else if (vertices >= 2) {
+                    data.corners[corner++] = first;
+                    data.corners[corner++] = previous;
+                    data.corners[corner++] = current;
+                }
+                previous = current;
+                vertices++;
+            }
+            break;
+        }
+        case ObjLine::OTHER:
+            break;
+        }
+        line = lineEnd;
+    }
+}
+
+MeshInfo loadObj(const std::filesystem::path &path,
+                 MeshDestination &destination,
+                 uint32_t threadCount)
+{
+    MappedFile file(path);
+    const char *begin = reinterpret_cast<const char *>(file.data());
+    const char *end = begin + file.size();
+
+    // One chunk per thread, split at line boundaries
+    std::vector<ObjChunk> chunks(threadCount);
+    chunks.front().begin = begin;
+    for (uint32_t i = 1; i < threadCount; i++) {
+        const char *split = begin + file.size() * i / threadCount;
+        chunks[i].begin = nextLine(split, end);
+        chunks[i - 1].end = chunks[i].begin;
+    }
+    chunks.back().end = end;
+
+    parallelFor(threadCount, chunks.size(), [&](size_t, size_t b, size_t e) {
+        for (size_t i = b; i < e; i++)
+            countObjChunk(chunks[i]);
+    });
+
+    // Counts become offsets: every chunk knows where its elements go and
+    // how many of each were defined before it (for relative indices)
+    ObjChunk totals;
+    for (ObjChunk &chunk : chunks) {
+        std::swap(totals.positions, chunk.positions);
+        std::swap(totals.uvs, chunk.uvs);
+        std::swap(totals.normals, chunk.normals);
+        std::swap(totals.corners, chunk.corners);
+        totals.positions += chunk.positions;
+        totals.uvs += chunk.uvs;
+        totals.normals += chunk.normals;
+        totals.corners += chunk.corners;
+    }
+
+    ObjData data;
+    data.positions.resize(totals.positions * 3);
+    data.uvs.resize(totals.uvs * 2);
+    data.normals.resize(totals.normals * 3);
+    data.corners.resize(totals.corners);
+
+    parallelFor(threadCount, chunks.size(), [&](size_t, size_t b, size_t e) {
+        for (size_t i = b; i < e; i++)
+            parseObjChunk(chunks[i], data);
+    });
+
+    MeshInfo info;
+    info.sourceVertexCount = totals.corners;
+    info.indexCount = checkedCount(totals.corners, "indices");
+    uint32_t *indices = destination.indices(info.indexCount);
+
+    // Corners sharing a triplet become one vertex
+    VertexMap<ObjCorner> map(data.corners.size() / 4);
+    std::vector<ObjCorner> unique;
+    unique.reserve(data.corners.size() / 4);
+    for (size_t i = 0; i < data.corners.size(); i++) {
+        const ObjCorner &corner = data.corners[i];
+        if (corner.position >= totals.positions
+            || (corner.uv != NONE && corner.uv >= totals.uvs)
+            || (corner.normal != NONE && corner.normal >= totals.normals))
+            throw std::runtime_error("OBJ index out of range!");
+
+        uint64_t hash = mix(corner.position * 0x9e3779b97f4a7c15ull
+                            ^ mix(uint64_t(corner.uv) << 32 | corner.normal));
+        uint32_t index = map.insert(
+            corner, hash, static_cast<uint32_t>(unique.size()));
+        if (index == unique.size())
+            unique.push_back(corner);
+        indices[i] = index;
+    }
+
+    info.vertexCount = checkedCount(unique.size(), "vertices");
+    MeshVertex *vertices = destination.vertices(info.vertexCount);
+
+    std::vector<Bounds> bounds(threadCount);
+    parallelFor(
+        threadCount, unique.size(), [&](size_t range, size_t b, size_t e) {
+            for (size_t i = b; i < e; i++) {
+                const ObjCorner &corner = unique[i];
+                MeshVertex vertex{};
+                std::memcpy(vertex.position,
+                            &data.positions[corner.position * 3ull],
+                            sizeof(vertex.position));
+                if (corner.normal != NONE)
+                    std::memcpy(vertex.normal,
+                                &data.normals[corner.normal * 3ull],
+                                sizeof(vertex.normal));
+                if (corner.uv != NONE)
+                    std::memcpy(vertex.uv,
+                                &data.uvs[corner.uv * 2ull],
+                                sizeof(vertex.uv));
+                vertices[i] = vertex;
+                bounds[range].add(vertex.position);
+            }
+        });
+
+    Bounds total;
+    for (const Bounds &range : bounds)
+        total.add(range);
+    finishInfo(info, total);
+    return info;
+}
+
+// glTF
+
+const uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+const uint32_t GLB_JSON_CHUNK = 0x4E4F534A;  // "JSON"
+const uint32_t GLB_BINARY_CHUNK = 0x004E4942; // "BIN\0"
+
+const uint32_t COMPONENT_UNSIGNED_BYTE = 5121;
+const uint32_t COMPONENT_UNSIGNED_SHORT = 5123;
+const uint32_t COMPONENT_UNSIGNED_INT = 5125;
+const uint32_t COMPONENT_FLOAT = 5126;
+
+const uint64_t MODE_TRIANGLES = 4;
+
+struct BufferSpan {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
+
+// Strided view of an accessor's elements inside a buffer
+struct Accessor {
+    const uint8_t *data = nullptr;
+    size_t stride = 0;
+    size_t count = 0;
+    uint32_t componentType = 0;
+    uint32_t components = 0;
+};
+
+struct Primitive {
+    Accessor position;
+    Accessor normal; // count 0 when absent
+    Accessor uv;     // count 0 when absent
+    Accessor indices;
+    bool indexed = false;
+    uint64_t vertexBase = 0;
+    uint64_t cornerBase = 0;
+    uint64_t cornerCount = 0;
+};
+
+uint32_t readU32(const uint8_t *data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t componentCount(const std::string &type)
+{
+    if (type == "SCALAR")
+        return 1;
+    if (type == "VEC2")
+        return 2;
+    if (type == "VEC3")
+        return 3;
+    if (type == "VEC4")
+        return 4;
+    throw std::runtime_error("unsupported glTF accessor type: " + type);
+}
+
+uint32_t componentSize(uint32_t componentType)
+{
+    switch (componentType) {
+    case 5120: // BYTE
+    case COMPONENT_UNSIGNED_BYTE:
+        return 1;
+    case 5122: // SHORT
+    case COMPONENT_UNSIGNED_SHORT:
+        return 2;
+    case COMPONENT_UNSIGNED_INT:
+    case COMPONENT_FLOAT:
+        return 4;
+    default:
+        throw std::runtime_error("unsupported glTF component type!");
+    }
+}
+
+Accessor readAccessor(const JsonValue &document,
+                      const std::vector<BufferSpan> &buffers,
+                      uint64_t index)
+{
+    const JsonValue &accessor = document["accessors"][index];
+    if (accessor.find("sparse"))
+        throw std::runtime_error("sparse glTF accessors are not supported!");
+    const JsonValue *viewIndex = accessor.find("bufferView");
+    if (!viewIndex)
+        throw std::runtime_error("glTF accessor without buffer view!");
+
+    Accessor result;
+    result.count = accessor["count"].asUint();
+    result.componentType =
+        static_cast<uint32_t>(accessor["componentType"].asUint());
+    result.components = componentCount(accessor["type"].asString());
+
+    const JsonValue &view = document["bufferViews"][viewIndex->asUint()];
+    const BufferSpan &buffer = buffers.at(view["buffer"].asUint());
+    uint64_t viewOffset = view.uintOr("byteOffset", 0);
+    uint64_t viewLength = view["byteLength"].asUint();
+    uint64_t elementSize =
+        uint64_t(result.components) * componentSize(result.componentType);
+    uint64_t offset = accessor.uintOr("byteOffset", 0);
+    result.stride = view.uintOr("byteStride", elementSize);
+
+    if (viewOffset + viewLength > buffer.size
+        || (result.count > 0
+            && offset + result.stride * (result.count - 1) + elementSize
+                > viewLength))
+        throw std::runtime_error("glTF accessor out of buffer bounds!");
+
+    result.data = buffer.data + viewOffset + offset;
+    return result;
+}
+
+void requireFloat(const Accessor &accessor, uint32_t components)
+{
+    if (accessor.componentType != COMPONENT_FLOAT
+        || accessor.components != components)
+        throw std::runtime_error(
+            "unsupported glTF vertex attribute format!");
+}
+
+uint32_t readIndex(const Accessor &accessor, size_t i)
+{
+    const uint8_t *element = accessor.data + accessor.stride * i;
+    switch (accessor.componentType) {
+    case COMPONENT_UNSIGNED_BYTE:
+        return element[0];
+    case COMPONENT_UNSIGNED_SHORT: {
+        uint16_t value;
+        std::memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    default:
+        return readU32(element);
+    }
+}
+
+MeshVertex readVertex(const Primitive &primitive, size_t i)
+{
+    MeshVertex vertex{};
+    std::memcpy(vertex.position,
+                primitive.position.data + primitive.position.stride * i,
+                sizeof(vertex.position));
+    if (primitive.normal.count > 0)
+        std::memcpy(vertex.normal,
+                    primitive.normal.data + primitive.normal.stride * i,
+                    sizeof(vertex.normal));
+    if (primitive.uv.count > 0)
+        std::memcpy(vertex.uv,
+                    primitive.uv.data + primitive.uv.stride * i,
+                    sizeof(vertex.uv));
+    return vertex;
+}
+
+uint64_t hashVertex(const MeshVertex &vertex)
+{
+    uint64_t words[sizeof(MeshVertex) / sizeof(uint64_t)];
+    std::memcpy(words, &vertex, sizeof(words));
+    uint64_t hash = 0;
+    for (uint64_t word : words)
+        hash = mix(hash ^ word) * 0x9e3779b97f4a7c15ull;
+    return hash;
+}
+
+MeshInfo loadGltf(const std::filesystem::path &path,
+                  MeshDestination &destination,
+                  uint32_t threadCount)
+{
+    MappedFile file(path);
+    std::string_view json(reinterpret_cast<const char *>(file.data()),
+                          file.size());
+    BufferSpan binaryChunk;
+
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(),
+                   extension.end(),
+                   extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (extension == ".glb") {
+        // 12-byte header, then chunks: JSON first, optional BIN second
+        const uint8_t *data = file.data();
+        if (file.size() < 20 || readU32(data) != GLB_MAGIC
+            || readU32(data + 4) != 2)
+            throw std::runtime_error("not a glTF 2.0 binary file!");
+        size_t length = std::min<size_t>(readU32(data + 8), file.size());
+
+        json = {};
+        for (size_t offset = 12; offset + 8 <= length;) {
+            uint32_t chunkLength = readU32(data + offset);
+            uint32_t chunkType = readU32(data + offset + 4);
+            const uint8_t *chunk = data + offset + 8;
+            if (chunkLength > length - offset - 8)
+                throw std::runtime_error("truncated glTF binary chunk!");
+            if (chunkType == GLB_JSON_CHUNK && json.empty())
+                json = { reinterpret_cast<const char *>(chunk), chunkLength };
+            else if (chunkType == GLB_BINARY_CHUNK && !binaryChunk.data)
+                binaryChunk = { chunk, chunkLength };
+            offset += 8 + ((chunkLength + 3) & ~3u);
+        }
+        if (json.empty())
+            throw std::runtime_error("glTF binary file without JSON chunk!");
+    }
+
+    JsonValue document = JsonValue::parse(json);
+
+    // Buffers: the GLB binary chunk or external files, mapped as well
+    std::vector<MappedFile> bufferFiles;
+    std::vector<BufferSpan> buffers;
+    if (const JsonValue *bufferList = document.find("buffers")) {
+        bufferFiles.reserve(bufferList->size());
+        for (size_t i = 0; i < bufferList->size(); i++) {
+            const JsonValue &buffer = (*bufferList)[i];
+            BufferSpan span;
+            if (const JsonValue *uri = buffer.find("uri")) {
+                if (uri->asString().compare(0, 5, "data:") == 0)
+                    throw std::runtime_error(
+                        "embedded glTF buffers are not supported!");
+                bufferFiles.emplace_back(path.parent_path()
+                                         / uri->asString());
+                span = { bufferFiles.back().data(),
+                         bufferFiles.back().size() };
+            }
+            else if (i == 0 && binaryChunk.data) {
+                span = binaryChunk;
+            }
+            else {
+                throw std::runtime_error("glTF buffer without data!");
+            }
+            if (buffer["byteLength"].asUint() > span.size)
+                throw std::runtime_error("glTF buffer is truncated!");
+            buffers.push_back(span);
+        }
+    }
+
+    // Every triangle primitive of every mesh, in mesh space
+    std::vector<Primitive> primitives;
+    uint64_t vertexTotal = 0;
+    uint64_t cornerTotal = 0;
+    if (const JsonValue *meshes = document.find("meshes")) {
+        for (size_t m = 0; m < meshes->size(); m++) {
+            const JsonValue &meshPrimitives = (*meshes)[m]["primitives"];
+            for (size_t p = 0; p < meshPrimitives.size(); p++) {
+                const JsonValue &source = meshPrimitives[p];
+                if (source.uintOr("mode", MODE_TRIANGLES) != MODE_TRIANGLES)
+                    continue;
+                const JsonValue &attributes = source["attributes"];
+
+                Primitive primitive;
+                primitive.position = readAccessor(
+                    document, buffers, attributes["POSITION"].asUint());
+                requireFloat(primitive.position, 3);
+                if (const JsonValue *normal = attributes.find("NORMAL")) {
+                    primitive.normal =
+                        readAccessor(document, buffers, normal->asUint());
+                    requireFloat(primitive.normal, 3);
+                }
+                if (const JsonValue *uv = attributes.find("TEXCOORD_0")) {
+                    primitive.uv =
+                        readAccessor(document, buffers, uv->asUint());
+                    requireFloat(primitive.uv, 2);
+                }
+                size_t vertexCount = primitive.position.count;
+                if ((primitive.normal.count > 0
+                     && primitive.normal.count != vertexCount)
+                    || (primitive.uv.count > 0
+                        && primitive.uv.count != vertexCount))
+                    throw std::runtime_error(
+                        "glTF attributes differ in length!");
+
+                if (const JsonValue *indices = source.find("indices")) {
+                    primitive.indices =
+                        readAccessor(document, buffers, indices->asUint());
+                    if (primitive.indices.components != 1
+                        || (primitive.indices.componentType
+                                != COMPONENT_UNSIGNED_BYTE
+                            && primitive.indices.componentType
+                                != COMPONENT_UNSIGNED_SHORT
+                            && primitive.indices.componentType
+                                != COMPONENT_UNSIGNED_INT))
+                        throw std::runtime_error(
+                            "unsupported glTF index format!");
+                    primitive.indexed = true;
+                }
+
+                primitive.cornerCount = primitive.indexed
+                    ? primitive.indices.count
+                    : vertexCount;
+                primitive.cornerCount -= primitive.cornerCount % 3;
+                primitive.vertexBase = vertexTotal;
+                primitive.cornerBase = cornerTotal;
+                vertexTotal += vertexCount;
+                cornerTotal += primitive.cornerCount;
+                primitives.push_back(primitive);
+            }
+        }
+    }
+
+    MeshInfo info;
+    info.sourceVertexCount = vertexTotal;
+    info.indexCount = checkedCount(cornerTotal, "indices");
+    checkedCount(vertexTotal, "vertices");
+
+    // Identical vertices, within and across primitives, become one
+    std::vector<uint32_t> remap(vertexTotal);
+    std::vector<std::pair<uint32_t, uint32_t>> unique; // primitive, vertex
+    unique.reserve(vertexTotal / 2);
+    VertexMap<MeshVertex> map(vertexTotal / 2);
+    for (size_t p = 0; p < primitives.size(); p++) {
+        const Primitive &primitive = primitives[p];
+        for (size_t i = 0; i < primitive.position.count; i++) {
+            MeshVertex vertex = readVertex(primitive, i);
+            uint32_t index = map.insert(vertex,
+                                        hashVertex(vertex),
+                                        static_cast<uint32_t>(unique.size()));
+            if (index == unique.size())
+                unique.emplace_back(static_cast<uint32_t>(p),
+                                    static_cast<uint32_t>(i));
+            remap[primitive.vertexBase + i] = index;
+        }
+    }
+
+    uint32_t *indices = destination.indices(info.indexCount);
+    parallelFor(threadCount, cornerTotal, [&](size_t, size_t b, size_t e) {
+        // First primitive whose corners reach past b
+        auto primitive = std::upper_bound(
+            primitives.begin(),
+            primitives.end(),
+            b,
+            [](uint64_t corner, const Primitive &candidate) {
+                return corner < candidate.cornerBase + candidate.cornerCount;
+            });
+        for (size_t corner = b; corner < e; corner++) {
+            while (corner >= primitive->cornerBase + primitive->cornerCount)
+                ++primitive;
+            size_t local = corner - primitive->cornerBase;
+            uint32_t source = primitive->indexed
+                ? readIndex(primitive->indices, local)
+                : static_cast<uint32_t>(local);
+            if (source >= primitive->position.count)
+                throw std::runtime_error("glTF index out of range!");
+            indices[corner] = remap[primitive->vertexBase + source];
+        }
+    });
+
+    info.vertexCount = checkedCount(unique.size(), "vertices");
+    MeshVertex *vertices = destination.vertices(info.vertexCount);
+
+    std::vector<Bounds> bounds(threadCount);
+    parallelFor(
+        threadCount, unique.size(), [&](size_t range, size_t b, size_t e) {
+            for (size_t i = b; i < e; i++) {
+                MeshVertex vertex =
+                    readVertex(primitives[unique[i].first], unique[i].second);
+                vertices[i] = vertex;
+                bounds[range].add(vertex.position);
+            }
+        });
+
+    Bounds total;
+    for (const Bounds &range : bounds)
+        total.add(range);
+    finishInfo(info, total);
+    return info;
+}
+
+// Binary
+
+// Already optimised and deduplicated: a copy, widening 16-bit indices
+MeshInfo loadMeshFile(const std::filesystem::path &path,
+                      MeshDestination &destination,
+                      uint32_t threadCount)
+{
+    MeshFile file(path);
+    const MeshFileHeader &header = file.header();
+
+    MeshInfo info;
+    info.vertexCount = header.vertexCount;
+    info.indexCount = header.indexCount;
+    info.sourceVertexCount = header.vertexCount;
+    std::copy(header.boundsMin, header.boundsMin + 3, info.boundsMin);
+    std::copy(header.boundsMax, header.boundsMax + 3, info.boundsMax);
+
+    uint32_t *indices = destination.indices(header.indexCount);
+    const auto *narrow = static_cast<const uint16_t *>(file.indices());
+    const auto *wide = static_cast<const uint32_t *>(file.indices());
+    parallelFor(threadCount, info.indexCount, [&](size_t, size_t b, size_t e) {
+        for (size_t i = b; i < e; i++) {
+            indices[i] = header.indexSize == 2 ? narrow[i] : wide[i];
+            if (indices[i] >= info.vertexCount)
+                throw std::runtime_error("mesh index out of range in "
+                                         + path.string());
+        }
+    });
+
+    MeshVertex *vertices = destination.vertices(info.vertexCount);
+    parallelFor(threadCount, info.vertexCount, [&](size_t, size_t b, size_t e) {
+        std::memcpy(
+            vertices + b, file.vertices() + b, (e - b) * sizeof(MeshVertex));
+    });
+    return info;
+}
+
+} // namespace
+
+MeshInfo loadMesh(const std::filesystem::path &path,
+                  MeshDestination &destination,
+                  uint32_t threadCount)
+{
+    threadCount = resolveThreadCount(threadCount);
+
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(),
+                   extension.end(),
+                   extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    if (extension == ".obj")
+        return loadObj(path, destination, threadCount);
+    if (extension == ".gltf" || extension == ".glb")
+        return loadGltf(path, destination, threadCount);
+    if (extension == ".mesh")
+        return loadMeshFile(path, destination, threadCount);
+    throw std::runtime_error("unsupported mesh format: " + path.string());
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Vertex layout of imported meshes, read by mesh.vert from a storage
+// buffer (vertex pulling)
+struct MeshVertex {
+    float position[3];
+    float normal[3]; // zero when the source has no normals
+    float uv[2];
+};
+
+struct MeshInfo {
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+    // Corners before deduplication, for the load reports
+    uint64_t sourceVertexCount = 0;
+};
+
+// Where the loader writes its output, typically mapped staging memory.
+// indices() is called first, once the index count is known, then
+// vertices() once deduplication has settled the vertex count. The memory
+// is only written to, never read back, so write-combined mappings are fine.
+class MeshDestination {
+public:
+    virtual ~MeshDestination() = default;
+    virtual uint32_t *indices(uint32_t count) = 0;
+    virtual MeshVertex *vertices(uint32_t count) = 0;
+};
+
+// Loads every triangle of an OBJ, glTF 2.0 (.gltf with external buffers),
+// GLB or .mesh (see meshFile.hh) file into one indexed triangle list.
+//
+// The file is memory-mapped and parsed by threadCount threads (0: one per
+// core), each working on its own chunk. Storage is sized by counting
+// passes up front, so nothing is allocated per vertex. Identical vertices
+// are merged through an open-addressing hash map.
+//
+// glTF node transforms, sparse accessors and quantized attributes are not
+// supported. Throws std::runtime_error on malformed input.
+MeshInfo loadMesh(const std::filesystem::path &path,
+                  MeshDestination &destination,
+                  uint32_t threadCount = 0);
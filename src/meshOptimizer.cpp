@@ -0,0 +1,439 @@
+#include "meshOptimizer.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+void checkIndices(const uint32_t *indices,
+                  size_t indexCount,
+                  uint32_t vertexCount)
+{
+    if (indexCount % 3 != 0)
+        throw std::runtime_error("index count is not a multiple of 3!");
+    for (size_t i = 0; i < indexCount; i++) {
+        if (indices[i] >= vertexCount)
+            throw std::runtime_error("mesh index out of range!");
+    }
+}
+
+// FIFO post-transform cache. A vertex is cached while fewer than cacheSize
+// misses happened since it was transformed, so lookups are O(1) and the
+// whole cache is flushed by skipping cacheSize misses ahead.
+class FifoCache {
+public:
+    FifoCache(uint32_t vertexCount, uint32_t cacheSize)
+        : stamps_(vertexCount, 0)
+        , cacheSize_(cacheSize)
+        , time_(cacheSize + 1)
+    {
+    }
+
+    // Number of the triangle's vertices that had to be transformed
+    uint32_t add(const uint32_t *triangle)
+    {
+        uint32_t misses = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = triangle[corner];
+            if (time_ - stamps_[vertex] > cacheSize_) {
+                stamps_[vertex] = time_++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void flush()
+    {
+        time_ += cacheSize_;
+    }
+
+private:
+    std::vector<uint64_t> stamps_;
+    uint64_t cacheSize_;
+    uint64_t time_;
+};
+
+// Vertex cache optimisation
+
+// LRU size assumed by the scoring; larger than real FIFOs on purpose, the
+// score only has to prefer recently used vertices
+const int SCORE_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+const uint32_t VALENCE_TABLE_SIZE = 64;
+
+struct ScoreTables {
+    float cache[SCORE_CACHE_SIZE];
+    float valence[VALENCE_TABLE_SIZE];
+
+    ScoreTables()
+    {
+        for (int position = 0; position < SCORE_CACHE_SIZE; position++) {
+            // The last triangle's vertices get a fixed score so that the
+            // next triangle does not always reuse the same edge
+            if (position < 3)
+                cache[position] = LAST_TRIANGLE_SCORE;
+            else
+                cache[position] = std::pow(
+                    1.0f
+                        - float(position - 3) / float(SCORE_CACHE_SIZE - 3),
+                    CACHE_DECAY_POWER);
+        }
+        valence[0] = 0.0f;
+        for (uint32_t count = 1; count < VALENCE_TABLE_SIZE; count++)
+            valence[count] = VALENCE_BOOST_SCALE
+                * std::pow(float(count), -VALENCE_BOOST_POWER);
+    }
+
+    // Vertices with few triangles left are boosted so that none is left
+    // stranded, to be transformed again much later
+    float score(int cachePosition, uint32_t remaining) const
+    {
+        if (remaining == 0)
+            return -1.0f;
+        float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+        if (remaining < VALENCE_TABLE_SIZE)
+            return score + valence[remaining];
+        return score
+            + VALENCE_BOOST_SCALE
+            * std::pow(float(remaining), -VALENCE_BOOST_POWER);
+    }
+};
+
+// Overdraw optimisation
+
+struct Vector3 {
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+};
+
+Vector3 position(const MeshVertex &vertex)
+{
+    return { vertex.position[0], vertex.position[1], vertex.position[2] };
+}
+
+// Area-weighted centroid and normal of a cluster, the normal's length being
+// twice the area
+struct ClusterShape {
+    Vector3 centroid;
+    Vector3 normal;
+    double area = 0.0;
+
+    void add(const Vector3 &a, const Vector3 &b, const Vector3 &c)
+    {
+        Vector3 ab{ b.x - a.x, b.y - a.y, b.z - a.z };
+        Vector3 ac{ c.x - a.x, c.y - a.y, c.z - a.z };
+        Vector3 cross{ ab.y * ac.z - ab.z * ac.y,
+                       ab.z * ac.x - ab.x * ac.z,
+                       ab.x * ac.y - ab.y * ac.x };
+        double triangleArea = 0.5
+            * std::sqrt(cross.x * cross.x + cross.y * cross.y
+                        + cross.z * cross.z);
+
+        centroid.x += triangleArea * (a.x + b.x + c.x) / 3.0;
+        centroid.y += triangleArea * (a.y + b.y + c.y) / 3.0;
+        centroid.z += triangleArea * (a.z + b.z + c.z) / 3.0;
+        normal.x += cross.x;
+        normal.y += cross.y;
+        normal.z += cross.z;
+        area += triangleArea;
+    }
+
+    Vector3 center() const
+    {
+        if (area == 0.0)
+            return {};
+        return { centroid.x / area, centroid.y / area, centroid.z / area };
+    }
+};
+
+// Splits the triangles where the cache-optimised order starts over (every
+// vertex missing), then each such run where its miss ratio so far is
+// within threshold of the whole run's: the order of those clusters can
+// then change at little cost in cache misses.
+std::vector<size_t> findClusters(const uint32_t *indices,
+                                 size_t triangleCount,
+                                 uint32_t vertexCount,
+                                 float threshold,
+                                 uint32_t cacheSize)
+{
+    std::vector<size_t> hard;
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        if (cache.add(&indices[triangle * 3]) == 3)
+            hard.push_back(triangle);
+    }
+    hard.push_back(triangleCount);
+
+    std::vector<size_t> clusters;
+    for (size_t run = 0; run + 1 < hard.size(); run++) {
+        size_t begin = hard[run];
+        size_t end = hard[run + 1];
+
+        cache.flush();
+        uint32_t runMisses = 0;
+        for (size_t triangle = begin; triangle < end; triangle++)
+            runMisses += cache.add(&indices[triangle * 3]);
+        double limit = threshold * double(runMisses) / double(end - begin);
+
+        cache.flush();
+        clusters.push_back(begin);
+        uint32_t misses = 0;
+        size_t clusterBegin = begin;
+        for (size_t triangle = begin; triangle + 1 < end; triangle++) {
+            misses += cache.add(&indices[triangle * 3]);
+            if (misses <= limit * double(triangle + 1 - clusterBegin)) {
+                clusterBegin = triangle + 1;
+                clusters.push_back(clusterBegin);
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+    return clusters;
+}
+
+} // namespace
+
+VertexCacheStatistics analyzeVertexCache(const uint32_t *indices,
+                                         size_t indexCount,
+                                         uint32_t vertexCount,
+                                         uint32_t cacheSize)
+{
+    checkIndices(indices, indexCount, vertexCount);
+
+    VertexCacheStatistics statistics;
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> used(vertexCount, false);
+    uint32_t usedCount = 0;
+    for (size_t i = 0; i < indexCount; i += 3) {
+        statistics.transformedVertices += cache.add(&indices[i]);
+        for (size_t corner = i; corner < i + 3; corner++) {
+            if (!used[indices[corner]]) {
+                used[indices[corner]] = true;
+                usedCount++;
+            }
+        }
+    }
+
+    if (indexCount > 0)
+        statistics.acmr =
+            statistics.transformedVertices / (double(indexCount) / 3.0);
+    if (usedCount > 0)
+        statistics.atvr = statistics.transformedVertices / double(usedCount);
+    return statistics;
+}
+
+void optimizeVertexCache(uint32_t *indices,
+                         size_t indexCount,
+                         uint32_t vertexCount)
+{
+    checkIndices(indices, indexCount, vertexCount);
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    static const ScoreTables tables;
+
+    // Triangles of each vertex, the live ones first in each range
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++)
+        liveCount[indices[i]]++;
+    std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+        adjacencyOffsets[vertex + 1] =
+            adjacencyOffsets[vertex] + liveCount[vertex];
+    std::vector<uint32_t> adjacency(indexCount);
+    {
+        std::vector<size_t> fill(adjacencyOffsets.begin(),
+                                 adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indexCount; i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+        vertexScore[vertex] = tables.score(-1, liveCount[vertex]);
+
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        const uint32_t *corners = &indices[triangle * 3];
+        triangleScore[triangle] = vertexScore[corners[0]]
+            + vertexScore[corners[1]] + vertexScore[corners[2]];
+    }
+
+    std::vector<uint32_t> output(indexCount);
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t cache[SCORE_CACHE_SIZE + 3];
+    uint32_t newCache[SCORE_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    size_t cursor = 0;
+    size_t best = triangleCount;
+
+    for (size_t written = 0; written < triangleCount; written++) {
+        // Dead end: nothing in the cache has triangles left, continue with
+        // the first triangle not emitted yet in input order
+        if (best == triangleCount) {
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        const uint32_t *corners = &indices[best * 3];
+        std::copy(corners, corners + 3, &output[written * 3]);
+        emitted[best] = true;
+
+        int newCount = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = corners[corner];
+            uint32_t *begin = &adjacency[adjacencyOffsets[vertex]];
+            uint32_t *end = begin + liveCount[vertex];
+            std::iter_swap(std::find(begin, end, uint32_t(best)), end - 1);
+            liveCount[vertex]--;
+
+            if (std::find(newCache, newCache + newCount, vertex)
+                == newCache + newCount)
+                newCache[newCount++] = vertex;
+        }
+        for (int i = 0; i < cacheCount; i++) {
+            if (std::find(corners, corners + 3, cache[i]) == corners + 3)
+                newCache[newCount++] = cache[i];
+        }
+
+        // Rescore every vertex whose position changed, evicted ones
+        // included, and move their live triangles' scores by the difference
+        for (int i = 0; i < newCount; i++) {
+            uint32_t vertex = newCache[i];
+            cachePosition[vertex] = i < SCORE_CACHE_SIZE ? i : -1;
+            float score =
+                tables.score(cachePosition[vertex], liveCount[vertex]);
+            float delta = score - vertexScore[vertex];
+            vertexScore[vertex] = score;
+            const uint32_t *begin = &adjacency[adjacencyOffsets[vertex]];
+            for (const uint32_t *t = begin; t < begin + liveCount[vertex];
+                 t++)
+                triangleScore[*t] += delta;
+        }
+
+        cacheCount = std::min(newCount, SCORE_CACHE_SIZE);
+        for (int i = 0; i < cacheCount; i++)
+            cache[i] = newCache[i];
+
+        best = triangleCount;
+        float bestScore = -std::numeric_limits<float>::max();
+        for (int i = 0; i < cacheCount; i++) {
+            uint32_t vertex = cache[i];
+            const uint32_t *begin = &adjacency[adjacencyOffsets[vertex]];
+            for (const uint32_t *t = begin; t < begin + liveCount[vertex];
+                 t++) {
+                if (triangleScore[*t] > bestScore) {
+                    bestScore = triangleScore[*t];
+                    best = *t;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices,
+                      size_t indexCount,
+                      const MeshVertex *vertices,
+                      uint32_t vertexCount,
+                      float threshold,
+                      uint32_t cacheSize)
+{
+    checkIndices(indices, indexCount, vertexCount);
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<size_t> clusters = findClusters(
+        indices, triangleCount, vertexCount, threshold, cacheSize);
+    size_t clusterCount = clusters.size() - 1;
+
+    std::vector<ClusterShape> shapes(clusterCount);
+    ClusterShape mesh;
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        for (size_t triangle = clusters[cluster];
+             triangle < clusters[cluster + 1];
+             triangle++) {
+            const uint32_t *corners = &indices[triangle * 3];
+            Vector3 a = position(vertices[corners[0]]);
+            Vector3 b = position(vertices[corners[1]]);
+            Vector3 c = position(vertices[corners[2]]);
+            shapes[cluster].add(a, b, c);
+            mesh.add(a, b, c);
+        }
+    }
+
+    // Clusters far out along their normal are likely to be in front of the
+    // rest from any viewpoint that sees them
+    Vector3 meshCenter = mesh.center();
+    std::vector<double> keys(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        const ClusterShape &shape = shapes[cluster];
+        Vector3 center = shape.center();
+        double length = std::sqrt(shape.normal.x * shape.normal.x
+                                  + shape.normal.y * shape.normal.y
+                                  + shape.normal.z * shape.normal.z);
+        keys[cluster] = length == 0.0
+            ? 0.0
+            : ((center.x - meshCenter.x) * shape.normal.x
+               + (center.y - meshCenter.y) * shape.normal.y
+               + (center.z - meshCenter.z) * shape.normal.z)
+                / length;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return keys[a] > keys[b];
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+    for (size_t cluster : order)
+        output.insert(output.end(),
+                      indices + clusters[cluster] * 3,
+                      indices + clusters[cluster + 1] * 3);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+uint32_t optimizeVertexFetch(MeshVertex *vertices,
+                             uint32_t vertexCount,
+                             uint32_t *indices,
+                             size_t indexCount)
+{
+    checkIndices(indices, indexCount, vertexCount);
+
+    std::vector<uint32_t> remap(vertexCount, NONE);
+    uint32_t used = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t &target = remap[indices[i]];
+        if (target == NONE)
+            target = used++;
+        indices[i] = target;
+    }
+
+    std::vector<MeshVertex> reordered(used);
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+        if (remap[vertex] != NONE)
+            reordered[remap[vertex]] = vertices[vertex];
+    }
+    std::copy(reordered.begin(), reordered.end(), vertices);
+    return used;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "meshLoader.hh"
+
+// Offline reordering of indexed triangle lists. The passes are meant to run
+// in this order: vertex cache, overdraw (which keeps most of the cache
+// locality), then vertex fetch (which renumbers vertices, not triangles).
+
+// Post-transform cache behaviour of an index buffer, simulated with a FIFO
+// of cacheSize entries like most hardware
+struct VertexCacheStatistics {
+    uint32_t transformedVertices = 0;
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 at
+    // best on large regular meshes, 3 at worst
+    double acmr = 0.0;
+    // Average transform to vertex ratio: 1 when every vertex is shaded once
+    double atvr = 0.0;
+};
+
+VertexCacheStatistics analyzeVertexCache(const uint32_t *indices,
+                                         size_t indexCount,
+                                         uint32_t vertexCount,
+                                         uint32_t cacheSize = 16);
+
+// Reorders triangles for post-transform cache hits (Forsyth's linear-speed
+// algorithm: greedy, scored by LRU cache position and remaining valence)
+void optimizeVertexCache(uint32_t *indices,
+                         size_t indexCount,
+                         uint32_t vertexCount);
+
+// Reorders clusters of cache-optimised triangles so that outward-facing
+// ones on the outside of the mesh come first and occlude the rest (Sander,
+// Nehab and Barczak, "Fast triangle reordering for vertex locality and
+// reduced overdraw"). threshold bounds the ACMR increase: 1.05 allows 5%.
+void optimizeOverdraw(uint32_t *indices,
+                      size_t indexCount,
+                      const MeshVertex *vertices,
+                      uint32_t vertexCount,
+                      float threshold = 1.05f,
+                      uint32_t cacheSize = 16);
+
+// Renumbers vertices in the order the indices first reference them, so that
+// vertex fetches walk memory forwards, and drops unreferenced vertices.
+// Returns the new vertex count.
+uint32_t optimizeVertexFetch(MeshVertex *vertices,
+                             uint32_t vertexCount,
+                             uint32_t *indices,
+                             size_t indexCount);
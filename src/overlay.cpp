@@ -0,0 +1,221 @@
+#include "overlay.hh"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace {
+
+// 5x7 glyphs, one byte per row from the top, bit 4 the leftmost pixel
+struct Glyph {
+    char character;
+    uint8_t rows[7];
+};
+
+const Glyph GLYPHS[] = {
+    { '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+    { '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+    { '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+    { '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+    { '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+    { '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+    { '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+    { '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+    { '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+    { '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+    { 'A', { 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 } },
+    { 'B', { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E } },
+    { 'C', { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E } },
+    { 'D', { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C } },
+    { 'E', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F } },
+    { 'F', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 } },
+    { 'G', { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F } },
+    { 'H', { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 } },
+    { 'I', { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+    { 'J', { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C } },
+    { 'K', { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 } },
+    { 'L', { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F } },
+    { 'M', { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 } },
+    { 'N', { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 } },
+    { 'O', { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E } },
+    { 'P', { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 } },
+    { 'Q', { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D } },
+    { 'R', { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 } },
+    { 'S', { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E } },
+    { 'T', { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 } },
+    { 'U', { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E } },
+    { 'V', { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 } },
+    { 'W', { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A } },
+    { 'X', { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 } },
+    { 'Y', { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 } },
+    { 'Z', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F } },
+    { '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+    { ',', { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 } },
+    { ':', { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 } },
+    { '/', { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 } },
+    { '%', { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 } },
+    { '(', { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 } },
+    { ')', { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 } },
+    { '-', { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 } },
+    { '+', { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 } },
+    { '=', { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 } },
+    { '_', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F } },
+    { '?', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 } },
+};
+
+constexpr char FIRST_CHARACTER = ' ';
+// Fully covered cell, the texel source of rectangles
+constexpr char SOLID_CHARACTER = 0x7F;
+
+// Atlas cell of c, lower case mapped to upper case and characters without
+// a glyph to '?'
+uint32_t cellOf(char c)
+{
+    if (c >= 'a' && c <= 'z')
+        c = static_cast<char>(c - 'a' + 'A');
+    if (c == ' ' || c == SOLID_CHARACTER)
+        return static_cast<uint32_t>(c - FIRST_CHARACTER);
+    for (const Glyph &glyph : GLYPHS) {
+        if (glyph.character == c)
+            return static_cast<uint32_t>(c - FIRST_CHARACTER);
+    }
+    return static_cast<uint32_t>('?' - FIRST_CHARACTER);
+}
+
+} // namespace
+
+Overlay::Overlay(size_t maxQuads)
+    : vertices_(maxQuads * VERTICES_PER_QUAD)
+{
+}
+
+std::vector<uint8_t> Overlay::atlasPixels()
+{
+    std::vector<uint8_t> pixels(ATLAS_WIDTH * ATLAS_HEIGHT * 4, 255);
+    for (size_t i = 3; i < pixels.size(); i += 4) {
+        pixels[i] = 0;
+    }
+
+    auto cellOrigin = [](uint32_t cell, uint32_t &x, uint32_t &y) {
+        x = cell % ATLAS_COLUMNS * GLYPH_WIDTH;
+        y = cell / ATLAS_COLUMNS * GLYPH_HEIGHT;
+    };
+
+    for (const Glyph &glyph : GLYPHS) {
+        uint32_t x0, y0;
+        cellOrigin(
+            static_cast<uint32_t>(glyph.character - FIRST_CHARACTER), x0, y0);
+        for (uint32_t row = 0; row < 7; row++) {
+            for (uint32_t column = 0; column < 5; column++) {
+                if (glyph.rows[row] & (0x10 >> column))
+                    pixels[((y0 + row) * ATLAS_WIDTH + x0 + column) * 4 + 3] =
+                        255;
+            }
+        }
+    }
+
+    uint32_t x0, y0;
+    cellOrigin(cellOf(SOLID_CHARACTER), x0, y0);
+    for (uint32_t y = y0; y < y0 + GLYPH_HEIGHT; y++) {
+        for (uint32_t x = x0; x < x0 + GLYPH_WIDTH; x++) {
+            pixels[(y * ATLAS_WIDTH + x) * 4 + 3] = 255;
+        }
+    }
+    return pixels;
+}
+
+void Overlay::quad(float x0,
+                   float y0,
+                   float x1,
+                   float y1,
+                   float u0,
+                   float v0,
+                   float u1,
+                   float v1,
+                   uint32_t color)
+{
+    // Dropped once full: the overlay loses its tail, the frame goes on
+    if (vertexCount_ + VERTICES_PER_QUAD > vertices_.size())
+        return;
+
+    OverlayVertex *vertex = &vertices_[vertexCount_];
+    vertex[0] = { x0, y0, u0, v0, color, 0 };
+    vertex[1] = { x1, y0, u1, v0, color, 0 };
+    vertex[2] = { x0, y1, u0, v1, color, 0 };
+    vertex[3] = { x1, y0, u1, v0, color, 0 };
+    vertex[4] = { x1, y1, u1, v1, color, 0 };
+    vertex[5] = { x0, y1, u0, v1, color, 0 };
+    vertexCount_ += VERTICES_PER_QUAD;
+}
+
+void Overlay::rect(float x, float y, float width, float height, uint32_t color)
+{
+    uint32_t cell = cellOf(SOLID_CHARACTER);
+    float u = float(cell % ATLAS_COLUMNS * GLYPH_WIDTH) + 0.5f;
+    float v = float(cell / ATLAS_COLUMNS * GLYPH_HEIGHT) + 0.5f;
+    quad(x, y, x + width, y + height, u, v, u, v, color);
+}
+
+float Overlay::text(float x, float y, const char *text, uint32_t color)
+{
+    float width = float(GLYPH_WIDTH * textScale_);
+    float height = float(GLYPH_HEIGHT * textScale_);
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c != ' ') {
+            uint32_t cell = cellOf(*c);
+            float u = float(cell % ATLAS_COLUMNS * GLYPH_WIDTH);
+            float v = float(cell / ATLAS_COLUMNS * GLYPH_HEIGHT);
+            quad(x,
+                 y,
+                 x + width,
+                 y + height,
+                 u,
+                 v,
+                 u + GLYPH_WIDTH,
+                 v + GLYPH_HEIGHT,
+                 color);
+        }
+        x += width;
+    }
+    return x;
+}
+
+float Overlay::textf(float x, float y, uint32_t color, const char *format, ...)
+{
+    char buffer[256];
+    va_list arguments;
+    va_start(arguments, format);
+    std::vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    return text(x, y, buffer, color);
+}
+
+void Overlay::graph(float x,
+                    float y,
+                    float width,
+                    float height,
+                    const float *values,
+                    size_t count,
+                    size_t first,
+                    float maxValue,
+                    float limit,
+                    uint32_t color,
+                    uint32_t overColor)
+{
+    if (count == 0 || maxValue <= 0.0f)
+        return;
+
+    float barWidth = width / float(count);
+    for (size_t i = 0; i < count; i++) {
+        float value = values[(first + i) % count];
+        float barHeight = std::min(value / maxValue, 1.0f) * height;
+        rect(x + barWidth * float(i),
+             y + height - barHeight,
+             std::max(barWidth - 1.0f, 1.0f),
+             barHeight,
+             value > limit ? overColor : color);
+    }
+    // The limit itself
+    if (limit < maxValue)
+        rect(x, y + height - limit / maxValue * height, width, 1.0f, overColor);
+}
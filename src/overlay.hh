@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Vertex of the overlay, read by overlay.vert from a storage buffer
+struct OverlayVertex {
+    float x, y; // pixels from the top-left corner
+    float u, v; // atlas texels
+    uint32_t color; // RGBA8, red in the low byte
+    uint32_t padding;
+};
+
+// Screen-space text, rectangles and graphs for the statistics overlay,
+// batched as triangles into one vertex array allocated up front: building
+// a frame's overlay never allocates. Text uses a 5x7 bitmap font of digits,
+// capitals (lower case is drawn as upper case) and common punctuation,
+// rasterised once into a glyph atlas.
+class Overlay {
+public:
+    // Atlas cell of a glyph, spacing included
+    static constexpr uint32_t GLYPH_WIDTH = 6;
+    static constexpr uint32_t GLYPH_HEIGHT = 8;
+    // Cells for the 96 characters from ' ' up
+    static constexpr uint32_t ATLAS_COLUMNS = 16;
+    static constexpr uint32_t ATLAS_WIDTH = ATLAS_COLUMNS * GLYPH_WIDTH;
+    static constexpr uint32_t ATLAS_HEIGHT = 6 * GLYPH_HEIGHT;
+
+    static constexpr uint32_t VERTICES_PER_QUAD = 6;
+
+    explicit Overlay(size_t maxQuads);
+
+    // RGBA8 atlas of ATLAS_WIDTH x ATLAS_HEIGHT texels: white, with the
+    // glyph coverage in alpha
+    static std::vector<uint8_t> atlasPixels();
+
+    static constexpr uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+    {
+        return uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16
+            | uint32_t(a) << 24;
+    }
+
+    void clear()
+    {
+        vertexCount_ = 0;
+    }
+
+    // Integer magnification of the glyphs, so that they stay crisp
+    void setTextScale(uint32_t scale)
+    {
+        textScale_ = scale > 0 ? scale : 1;
+    }
+
+    float lineHeight() const
+    {
+        return float(GLYPH_HEIGHT * textScale_);
+    }
+
+    void rect(float x, float y, float width, float height, uint32_t color);
+
+    // Returns the x following the text
+    float text(float x, float y, const char *text, uint32_t color);
+
+    // printf-style, formatted into a fixed buffer
+    float textf(float x, float y, uint32_t color, const char *format, ...);
+
+    // Bars of values[(first + i) % count] for i in [0, count), oldest on
+    // the left, scaled so that maxValue fills height. Bars above limit are
+    // drawn in overColor.
+    void graph(float x,
+               float y,
+               float width,
+               float height,
+               const float *values,
+               size_t count,
+               size_t first,
+               float maxValue,
+               float limit,
+               uint32_t color,
+               uint32_t overColor);
+
+    const OverlayVertex *vertices() const
+    {
+        return vertices_.data();
+    }
+
+    uint32_t vertexCount() const
+    {
+        return vertexCount_;
+    }
+
+    size_t maxVertices() const
+    {
+        return vertices_.size();
+    }
+
+private:
+    void quad(float x0,
+              float y0,
+              float x1,
+              float y1,
+              float u0,
+              float v0,
+              float u1,
+              float v1,
+              uint32_t color);
+
+    std::vector<OverlayVertex> vertices_;
+    uint32_t vertexCount_ = 0;
+    uint32_t textScale_ = 2;
+};
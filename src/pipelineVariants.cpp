@@ -0,0 +1,100 @@
+#include "pipelineVariants.hh"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "tracer.hh"
+
+PipelineVariants::PipelineVariants(VkDevice device)
+    : device_(device)
+{
+    thread_ = std::thread([this] { compileLoop(); });
+}
+
+PipelineVariants::~PipelineVariants()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        requests_.clear();
+    }
+    requestCondition_.notify_one();
+    thread_.join();
+
+    update();
+    for (const auto &entry : pipelines_) {
+        if (entry.second != VK_NULL_HANDLE)
+            vkDestroyPipeline(device_, entry.second, nullptr);
+    }
+}
+
+void PipelineVariants::update()
+{
+    std::vector<Result> results;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (results_.empty())
+            return;
+        results.swap(results_);
+    }
+
+    for (const Result &result : results) {
+        pipelines_[result.key] = result.pipeline;
+        statistics_.compileSeconds += result.seconds;
+        if (result.pipeline != VK_NULL_HANDLE)
+            statistics_.ready++;
+        else
+            statistics_.failed++;
+    }
+}
+
+PipelineVariants::Statistics PipelineVariants::statistics() const
+{
+    Statistics statistics = statistics_;
+    statistics.requested = static_cast<uint32_t>(pipelines_.size());
+    return statistics;
+}
+
+void PipelineVariants::queue(uint64_t key, std::function<VkPipeline()> create)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_.push_back(Request{ key, std::move(create) });
+    }
+    requestCondition_.notify_one();
+}
+
+void PipelineVariants::compileLoop()
+{
+    Tracer::nameThread("pipeline variants");
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            requestCondition_.wait(
+                lock, [this] { return stopping_ || !requests_.empty(); });
+            if (stopping_)
+                return;
+            request = std::move(requests_.front());
+            requests_.pop_front();
+        }
+
+        // A failed variant stays on the generic pipeline
+        TRACE_ZONE("compilePipelineVariant");
+        Result result;
+        result.key = request.key;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            result.pipeline = request.create();
+        }
+        catch (const std::exception &) {
+            result.pipeline = VK_NULL_HANDLE;
+        }
+        result.seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back(result);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Pipelines compiled on demand on a background thread, so that a new
+// variant never stalls the frame that first needs it.
+//
+// Variants are identified by a 64-bit hash of everything their creation
+// depends on. The render thread asks for a variant with find(): the first
+// request queues its creation and, like every request until the pipeline is
+// ready, returns VK_NULL_HANDLE, for the caller to draw with a generic
+// pipeline meanwhile. Finished pipelines are handed over by update(), so
+// that find() never takes a lock.
+//
+// Every pipeline is destroyed with the PipelineVariants, which must outlive
+// the command buffers using them.
+class PipelineVariants {
+public:
+    struct Statistics {
+        uint32_t requested = 0;
+        uint32_t ready = 0;
+        uint32_t failed = 0;
+        // Time spent in the creation functions
+        double compileSeconds = 0.0;
+    };
+
+    explicit PipelineVariants(VkDevice device);
+    ~PipelineVariants();
+
+    PipelineVariants(const PipelineVariants &) = delete;
+    PipelineVariants &operator=(const PipelineVariants &) = delete;
+
+    // Render thread. The pipeline of the variant, or VK_NULL_HANDLE while it
+    // is being created or if its creation failed. The first call for a key
+    // queues create, which runs on the background thread and must be
+    // thread-safe.
+    template <typename Create>
+    VkPipeline find(uint64_t key, Create &&create)
+    {
+        auto it = pipelines_.find(key);
+        if (it != pipelines_.end())
+            return it->second;
+
+        pipelines_.emplace(key, VK_NULL_HANDLE);
+        queue(key, std::forward<Create>(create));
+        return VK_NULL_HANDLE;
+    }
+
+    // Render thread. The pipeline of a variant find() was called for, or
+    // VK_NULL_HANDLE while it is not ready; never queues a creation.
+    VkPipeline find(uint64_t key) const
+    {
+        auto it = pipelines_.find(key);
+        return it != pipelines_.end() ? it->second : VK_NULL_HANDLE;
+    }
+
+    // Render thread, once per frame: makes the variants created since the
+    // last call available to find()
+    void update();
+
+    // Render thread
+    Statistics statistics() const;
+
+private:
+    struct Request {
+        uint64_t key = 0;
+        std::function<VkPipeline()> create;
+    };
+
+    struct Result {
+        uint64_t key = 0;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        double seconds = 0.0;
+    };
+
+    void queue(uint64_t key, std::function<VkPipeline()> create);
+    void compileLoop();
+
+    VkDevice device_;
+    // Render thread only: VK_NULL_HANDLE while pending or failed
+    std::unordered_map<uint64_t, VkPipeline> pipelines_;
+    Statistics statistics_;
+
+    std::mutex mutex_;
+    std::condition_variable requestCondition_;
+    std::deque<Request> requests_;
+    std::vector<Result> results_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,51 @@
+#include "resolutionController.hh"
+
+#include <stdexcept>
+
+ResolutionController::ResolutionController(const Settings &settings)
+    : settings_(settings)
+{
+    if (settings_.scales.empty())
+        throw std::runtime_error("resolution controller without scales!");
+    if (!(settings_.targetMilliseconds > 0.0))
+        throw std::runtime_error("resolution controller without a target!");
+
+    // Full resolution until measured otherwise
+    scaleIndex_ = settings_.scales.size() - 1;
+}
+
+bool ResolutionController::update(double gpuMilliseconds)
+{
+    if (framesSinceChange_ < settings_.settleFrames) {
+        framesSinceChange_++;
+        return false;
+    }
+    average_ = average_ == 0.0
+        ? gpuMilliseconds
+        : average_ + settings_.smoothing * (gpuMilliseconds - average_);
+
+    size_t next = scaleIndex_;
+    if (average_ > settings_.targetMilliseconds) {
+        while (next > 0 && predict(next) > settings_.targetMilliseconds) {
+            next--;
+        }
+    }
+    else if (next + 1 < settings_.scales.size()
+             && predict(next + 1)
+                 < settings_.targetMilliseconds * (1.0 - settings_.headroom)) {
+        next++;
+    }
+    if (next == scaleIndex_)
+        return false;
+
+    scaleIndex_ = next;
+    average_ = 0.0;
+    framesSinceChange_ = 0;
+    return true;
+}
+
+double ResolutionController::predict(size_t scaleIndex) const
+{
+    double ratio = settings_.scales[scaleIndex] / scale();
+    return average_ * ratio * ratio;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Picks the render resolution that holds the GPU frame time at a target.
+//
+// The scene is rendered at one of a few fixed scales of the output size,
+// so that a render target can be allocated once per scale. update() is fed
+// the GPU time of each measured frame; its average, assumed proportional
+// to the pixel count, predicts the time at the other scales. Over the
+// target the scale drops to the largest one predicted to fit; the next
+// scale up is only taken once predicted to stay under the target by the
+// headroom fraction, so the scale does not oscillate around it.
+//
+// Frames already in flight when the scale changed were rendered at the old
+// one: their times are ignored for settleFrames.
+class ResolutionController {
+public:
+    struct Settings {
+        // GPU milliseconds per frame to hold
+        double targetMilliseconds = 16.0;
+        // Ascending scales of the width and height, the last usually 1
+        std::vector<float> scales;
+        // Fraction of the target a scale up must be predicted to leave
+        // unused
+        double headroom = 0.1;
+        // Weight of each new time in the average
+        double smoothing = 0.2;
+        uint32_t settleFrames = 4;
+    };
+
+    explicit ResolutionController(const Settings &settings);
+
+    // Returns whether the scale changed
+    bool update(double gpuMilliseconds);
+
+    // Index into Settings::scales
+    size_t scaleIndex() const
+    {
+        return scaleIndex_;
+    }
+
+    float scale() const
+    {
+        return settings_.scales[scaleIndex_];
+    }
+
+    // Average GPU time at the current scale, 0 until measured
+    double averageMilliseconds() const
+    {
+        return average_;
+    }
+
+private:
+    double predict(size_t scaleIndex) const;
+
+    Settings settings_;
+    size_t scaleIndex_ = 0;
+    double average_ = 0.0;
+    uint32_t framesSinceChange_ = 0;
+};
@@ -0,0 +1,296 @@
+#include "sceneGraph.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "jobSystem.hh"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define SCENE_GRAPH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+using Matrix = SceneGraph::Matrix;
+
+// out = a * b, column-major: each column of out is a combination of the
+// columns of a weighted by a column of b
+void multiply(const Matrix &a, const Matrix &b, Matrix &out)
+{
+#ifdef SCENE_GRAPH_SSE
+    __m128 columns[4] = { _mm_load_ps(a.m),
+                          _mm_load_ps(a.m + 4),
+                          _mm_load_ps(a.m + 8),
+                          _mm_load_ps(a.m + 12) };
+    for (int j = 0; j < 4; j++) {
+        const float *weights = b.m + 4 * j;
+        __m128 column = _mm_mul_ps(columns[0], _mm_set1_ps(weights[0]));
+        column = _mm_add_ps(column,
+                            _mm_mul_ps(columns[1], _mm_set1_ps(weights[1])));
+        column = _mm_add_ps(column,
+                            _mm_mul_ps(columns[2], _mm_set1_ps(weights[2])));
+        column = _mm_add_ps(column,
+                            _mm_mul_ps(columns[3], _mm_set1_ps(weights[3])));
+        _mm_store_ps(out.m + 4 * j, column);
+    }
+#else
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            out.m[4 * j + i] = a.m[i] * b.m[4 * j]
+                + a.m[4 + i] * b.m[4 * j + 1] + a.m[8 + i] * b.m[4 * j + 2]
+                + a.m[12 + i] * b.m[4 * j + 3];
+        }
+    }
+#endif
+}
+
+// Instance buffers are usually mapped device memory: written once, in
+// whole vectors, never read back
+void store(const Matrix &matrix, Matrix &destination)
+{
+#ifdef SCENE_GRAPH_SSE
+    for (int j = 0; j < 16; j += 4) {
+        _mm_storeu_ps(destination.m + j, _mm_load_ps(matrix.m + j));
+    }
+#else
+    destination = matrix;
+#endif
+}
+
+} // namespace
+
+uint32_t SceneGraph::add(uint32_t parent, const Transform &local)
+{
+    if (parent != NO_PARENT && parent >= nodes_.size())
+        throw std::runtime_error("scene graph parent does not exist!");
+
+    uint32_t handle = static_cast<uint32_t>(nodes_.size());
+    uint32_t node = static_cast<uint32_t>(parent_.size());
+    uint32_t parentNode = parent == NO_PARENT ? NO_PARENT : nodes_[parent];
+    parent_.push_back(parentNode);
+    depth_.push_back(parentNode == NO_PARENT ? 0 : depth_[parentNode] + 1);
+    for (std::vector<float> &component : local_) {
+        component.push_back(0.0f);
+    }
+    world_.emplace_back();
+    dirty_.push_back(1);
+    handles_.push_back(handle);
+    nodes_.push_back(node);
+
+    // Still sorted if appended at the deepest depth
+    sorted_ = sorted_ && (node == 0 || depth_[node] >= depth_[node - 1]);
+    setLocal(handle, local);
+    return handle;
+}
+
+void SceneGraph::reserve(size_t count)
+{
+    parent_.reserve(count);
+    depth_.reserve(count);
+    for (std::vector<float> &component : local_) {
+        component.reserve(count);
+    }
+    world_.reserve(count);
+    dirty_.reserve(count);
+    handles_.reserve(count);
+    nodes_.reserve(count);
+}
+
+void SceneGraph::setLocal(uint32_t node, const Transform &local)
+{
+    uint32_t index = nodes_[node];
+    for (int axis = 0; axis < 3; axis++) {
+        local_[TRANSLATION_X + axis][index] = local.translation[axis];
+        local_[SCALE_X + axis][index] = local.scale[axis];
+    }
+    for (int axis = 0; axis < 4; axis++) {
+        local_[ROTATION_X + axis][index] = local.rotation[axis];
+    }
+    dirty_[index] = 1;
+}
+
+SceneGraph::Transform SceneGraph::local(uint32_t node) const
+{
+    uint32_t index = nodes_[node];
+    Transform local;
+    for (int axis = 0; axis < 3; axis++) {
+        local.translation[axis] = local_[TRANSLATION_X + axis][index];
+        local.scale[axis] = local_[SCALE_X + axis][index];
+    }
+    for (int axis = 0; axis < 4; axis++) {
+        local.rotation[axis] = local_[ROTATION_X + axis][index];
+    }
+    return local;
+}
+
+const SceneGraph::Matrix &SceneGraph::world(uint32_t node) const
+{
+    return world_[nodes_[node]];
+}
+
+size_t SceneGraph::update(Matrix *instances, JobSystem *jobs, size_t grain)
+{
+    if (!sorted_ || depthStarts_.empty() || depthStarts_.back() != size())
+        sort();
+
+    grain = std::max<size_t>(grain, 1);
+    size_t recomputed = 0;
+    for (size_t depth = 0; depth + 1 < depthStarts_.size(); depth++) {
+        size_t begin = depthStarts_[depth];
+        size_t end = depthStarts_[depth + 1];
+        if (jobs == nullptr || end - begin <= grain) {
+            recomputed += updateRange(begin, end, instances);
+            continue;
+        }
+
+        // A depth only reads the previous ones: its ranges are independent
+        rangeCounts_.assign((end - begin + grain - 1) / grain, 0);
+        JobSystem::Counter counter;
+        jobs->parallelFor(
+            end - begin,
+            grain,
+            [this, begin, grain, instances](size_t first, size_t last) {
+                rangeCounts_[first / grain] =
+                    updateRange(begin + first, begin + last, instances);
+            },
+            counter);
+        jobs->wait(counter);
+        for (size_t count : rangeCounts_) {
+            recomputed += count;
+        }
+    }
+
+    // Kept until now for the descendants to inherit
+    std::fill(dirty_.begin(), dirty_.end(), 0);
+    return recomputed;
+}
+
+void SceneGraph::sort()
+{
+    // Breadth-first order: the depths are contiguous, and within one the
+    // children of a parent are together, in the order of the parents, so
+    // that update() reads the parent world matrices sequentially
+    std::vector<uint32_t> childStarts(size() + 1, 0);
+    for (uint32_t parent : parent_) {
+        if (parent != NO_PARENT)
+            childStarts[parent + 1]++;
+    }
+    for (size_t node = 0; node < size(); node++) {
+        childStarts[node + 1] += childStarts[node];
+    }
+    std::vector<uint32_t> children(childStarts.back());
+    std::vector<uint32_t> next(childStarts.begin(), childStarts.end() - 1);
+    std::vector<uint32_t> breadthFirst;
+    breadthFirst.reserve(size());
+    for (size_t node = 0; node < size(); node++) {
+        if (parent_[node] == NO_PARENT)
+            breadthFirst.push_back(static_cast<uint32_t>(node));
+        else
+            children[next[parent_[node]]++] = static_cast<uint32_t>(node);
+    }
+    for (size_t i = 0; i < breadthFirst.size(); i++) {
+        uint32_t node = breadthFirst[i];
+        breadthFirst.insert(breadthFirst.end(),
+                            children.begin() + childStarts[node],
+                            children.begin() + childStarts[node + 1]);
+    }
+
+    std::vector<uint32_t> order(size());
+    for (size_t i = 0; i < size(); i++) {
+        order[breadthFirst[i]] = static_cast<uint32_t>(i);
+    }
+
+    auto permute = [&order](auto &values) {
+        auto sorted = values;
+        for (size_t node = 0; node < order.size(); node++) {
+            sorted[order[node]] = values[node];
+        }
+        values.swap(sorted);
+    };
+    for (uint32_t &parent : parent_) {
+        if (parent != NO_PARENT)
+            parent = order[parent];
+    }
+    permute(parent_);
+    permute(depth_);
+    for (std::vector<float> &component : local_) {
+        permute(component);
+    }
+    permute(world_);
+    permute(dirty_);
+    permute(handles_);
+    for (size_t node = 0; node < size(); node++) {
+        nodes_[handles_[node]] = static_cast<uint32_t>(node);
+    }
+
+    depthStarts_.clear();
+    for (size_t node = 0; node < size(); node++) {
+        while (depthStarts_.size() <= depth_[node]) {
+            depthStarts_.push_back(node);
+        }
+    }
+    depthStarts_.push_back(size());
+    sorted_ = true;
+}
+
+size_t SceneGraph::updateRange(size_t begin, size_t end, Matrix *instances)
+{
+    const float *tx = local_[TRANSLATION_X].data();
+    const float *ty = local_[TRANSLATION_Y].data();
+    const float *tz = local_[TRANSLATION_Z].data();
+    const float *qx = local_[ROTATION_X].data();
+    const float *qy = local_[ROTATION_Y].data();
+    const float *qz = local_[ROTATION_Z].data();
+    const float *qw = local_[ROTATION_W].data();
+    const float *sx = local_[SCALE_X].data();
+    const float *sy = local_[SCALE_Y].data();
+    const float *sz = local_[SCALE_Z].data();
+
+    size_t recomputed = 0;
+    for (size_t node = begin; node < end; node++) {
+        uint32_t parent = parent_[node];
+        if (parent != NO_PARENT)
+            dirty_[node] |= dirty_[parent];
+        if (!dirty_[node])
+            continue;
+
+        // Rotation columns scaled, then the translation
+        float xx = qx[node] * qx[node];
+        float yy = qy[node] * qy[node];
+        float zz = qz[node] * qz[node];
+        float xy = qx[node] * qy[node];
+        float xz = qx[node] * qz[node];
+        float yz = qy[node] * qz[node];
+        float wx = qw[node] * qx[node];
+        float wy = qw[node] * qy[node];
+        float wz = qw[node] * qz[node];
+
+        Matrix local;
+        local.m[0] = (1.0f - 2.0f * (yy + zz)) * sx[node];
+        local.m[1] = 2.0f * (xy + wz) * sx[node];
+        local.m[2] = 2.0f * (xz - wy) * sx[node];
+        local.m[3] = 0.0f;
+        local.m[4] = 2.0f * (xy - wz) * sy[node];
+        local.m[5] = (1.0f - 2.0f * (xx + zz)) * sy[node];
+        local.m[6] = 2.0f * (yz + wx) * sy[node];
+        local.m[7] = 0.0f;
+        local.m[8] = 2.0f * (xz + wy) * sz[node];
+        local.m[9] = 2.0f * (yz - wx) * sz[node];
+        local.m[10] = (1.0f - 2.0f * (xx + yy)) * sz[node];
+        local.m[11] = 0.0f;
+        local.m[12] = tx[node];
+        local.m[13] = ty[node];
+        local.m[14] = tz[node];
+        local.m[15] = 1.0f;
+
+        if (parent == NO_PARENT)
+            world_[node] = local;
+        else
+            multiply(world_[parent], local, world_[node]);
+        if (instances)
+            store(world_[node], instances[handles_[node]]);
+        recomputed++;
+    }
+    return recomputed;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Transform hierarchy stored flat, as structure of arrays sorted by depth:
+// every parent comes before its children, and the nodes of one depth are
+// contiguous. update() walks the depths in order, so a node's parent world
+// matrix is always final when the node is reached, and the nodes of one
+// depth are independent of each other: they are updated in parallel
+// ranges on the job system.
+//
+// Changing a node's local transform marks it dirty; update() recomputes
+// the world matrices of the dirty nodes and of their descendants only,
+// a dirty flag being inherited from the parent on the way down. Matrices
+// are column-major 4x4 floats, multiplied with SSE where available.
+//
+// Nodes are named by the handle add() returns, which is also where update()
+// writes their world matrix in the instance buffer it is given. Adding a
+// node defers re-sorting to the next update().
+class SceneGraph {
+public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    struct Transform {
+        float translation[3] = { 0.0f, 0.0f, 0.0f };
+        // Unit quaternion, x y z w
+        float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        float scale[3] = { 1.0f, 1.0f, 1.0f };
+    };
+
+    struct alignas(16) Matrix {
+        float m[16];
+    };
+
+    // parent is NO_PARENT or a handle returned before
+    uint32_t add(uint32_t parent, const Transform &local);
+    void reserve(size_t count);
+
+    void setLocal(uint32_t node, const Transform &local);
+    Transform local(uint32_t node) const;
+    // As of the last update()
+    const Matrix &world(uint32_t node) const;
+
+    // Recomputes the world matrices of the dirty nodes and their
+    // descendants. With instances, each recomputed matrix is also written
+    // to instances[node], such as the mapped per-instance buffer of the
+    // draws. With jobs, depths of more than grain nodes are split into
+    // parallel ranges. Returns how many matrices were recomputed.
+    size_t update(Matrix *instances = nullptr,
+                  JobSystem *jobs = nullptr,
+                  size_t grain = 8192);
+
+    size_t size() const
+    {
+        return parent_.size();
+    }
+
+    size_t depthCount() const
+    {
+        return depthStarts_.empty() ? 0 : depthStarts_.size() - 1;
+    }
+
+private:
+    enum Component
+    {
+        TRANSLATION_X,
+        TRANSLATION_Y,
+        TRANSLATION_Z,
+        ROTATION_X,
+        ROTATION_Y,
+        ROTATION_Z,
+        ROTATION_W,
+        SCALE_X,
+        SCALE_Y,
+        SCALE_Z,
+        COMPONENT_COUNT,
+    };
+
+    // Re-sorts the nodes by depth after additions
+    void sort();
+    // Updates the nodes in [begin, end) of one depth, returns how many
+    // were dirty
+    size_t updateRange(size_t begin, size_t end, Matrix *instances);
+
+    // Per node, in depth order
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> depth_;
+    std::array<std::vector<float>, COMPONENT_COUNT> local_;
+    std::vector<Matrix> world_;
+    std::vector<uint8_t> dirty_;
+    // Handle of each node, and node of each handle
+    std::vector<uint32_t> handles_;
+    std::vector<uint32_t> nodes_;
+    // First node of each depth, then the node count
+    std::vector<size_t> depthStarts_;
+    bool sorted_ = true;
+    // Per range recomputed counts of the parallel update
+    std::vector<size_t> rangeCounts_;
+};
@@ -0,0 +1,224 @@
+// World transform propagation throughput of the scene graph:
+//
+//   sceneGraphBenchmark [--nodes N] [--threads N] [--runs N] [--dirty F]
+//
+// --nodes nodes form random trees added depth first, as a scene file
+// loads, so that the first update() sorts them breadth first. Measures,
+// best of --runs, an update after moving the roots (every node recomputed)
+// and after moving a random fraction --dirty of the nodes (those and their
+// descendants), on the calling thread alone and spread over the job
+// system. World matrices are written to an instance buffer in host memory;
+// the threaded one is checked against the single-threaded one.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "jobSystem.hh"
+#include "sceneGraph.hh"
+
+namespace {
+
+const uint32_t FAN_OUT = 4;
+const uint32_t MAX_DEPTH = 8;
+
+SceneGraph::Transform randomTransform(std::mt19937 &random)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    SceneGraph::Transform transform;
+    float length = 0.0f;
+    for (int axis = 0; axis < 4; axis++) {
+        transform.rotation[axis] = unit(random);
+        length += transform.rotation[axis] * transform.rotation[axis];
+    }
+    length = std::sqrt(std::max(length, 1e-6f));
+    for (int axis = 0; axis < 4; axis++) {
+        transform.rotation[axis] /= length;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        transform.translation[axis] = 10.0f * unit(random);
+        transform.scale[axis] = scale(random);
+    }
+    return transform;
+}
+
+// Depth first, like a scene file loads: trees of MAX_DEPTH levels whose
+// nodes have 0 to 2 * FAN_OUT children, until count nodes. Returns the
+// roots.
+std::vector<uint32_t> build(SceneGraph &graph, size_t count)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<uint32_t> childCount(0, 2 * FAN_OUT);
+    graph.reserve(count);
+
+    std::vector<uint32_t> roots;
+    // Nodes whose children are still to add, with their depth
+    std::vector<std::pair<uint32_t, uint32_t>> pending;
+    while (graph.size() < count) {
+        if (pending.empty()) {
+            roots.push_back(
+                graph.add(SceneGraph::NO_PARENT, randomTransform(random)));
+            pending.emplace_back(roots.back(), 0);
+            continue;
+        }
+
+        auto [parent, depth] = pending.back();
+        pending.pop_back();
+        if (depth + 1 == MAX_DEPTH)
+            continue;
+        uint32_t children = childCount(random);
+        for (uint32_t child = 0; child < children && graph.size() < count;
+             child++) {
+            pending.emplace_back(
+                graph.add(parent, randomTransform(random)), depth + 1);
+        }
+    }
+    return roots;
+}
+
+// Best of runs, prepare() not timed; recomputed is that of the last run
+template <typename Prepare, typename Function>
+double bestMilliseconds(uint32_t runs,
+                        Prepare prepare,
+                        Function function,
+                        size_t &recomputed)
+{
+    double best = 1e30;
+    for (uint32_t run = 0; run < runs; run++) {
+        prepare();
+        auto start = std::chrono::steady_clock::now();
+        recomputed = function();
+        best = std::min(best,
+                        std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+    return best;
+}
+
+void report(const char *name, size_t nodes, double ms, uint32_t cores)
+{
+    double rate = nodes / (ms / 1000.0) / 1e6;
+    std::cout << "  " << name << ": " << ms << " ms, " << rate
+              << " M nodes/s, " << rate / cores << " M nodes/s/core\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try {
+        size_t nodeCount = 1 << 20;
+        uint32_t threads = 0;
+        uint32_t runs = 10;
+        double dirtyFraction = 0.01;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--nodes" && i + 1 < argc)
+                nodeCount = std::max<size_t>(1, std::stoull(argv[++i]));
+            else if (arg == "--threads" && i + 1 < argc)
+                threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--runs" && i + 1 < argc)
+                runs = std::max(
+                    1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+            else if (arg == "--dirty" && i + 1 < argc)
+                dirtyFraction =
+                    std::min(1.0, std::max(0.0, std::stod(argv[++i])));
+            else
+                throw std::runtime_error(
+                    "usage: sceneGraphBenchmark [--nodes N] [--threads N] "
+                    "[--runs N] [--dirty F]");
+        }
+
+        SceneGraph graph;
+        std::vector<uint32_t> roots = build(graph, nodeCount);
+        std::vector<SceneGraph::Matrix> serial(nodeCount);
+        std::vector<SceneGraph::Matrix> parallel(nodeCount);
+
+        auto sortStart = std::chrono::steady_clock::now();
+        graph.update(serial.data());
+        double sortMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - sortStart)
+                            .count();
+
+        JobSystem jobs(threads);
+        // The waiting thread updates too
+        uint32_t cores = jobs.threadCount() + 1;
+        std::cout << nodeCount << " nodes in " << roots.size()
+                  << " trees of " << graph.depthCount() << " depths, " << cores
+                  << " thread(s) with the job system\n"
+                  << "first update, sorting included: " << sortMs << " ms\n";
+
+        std::mt19937 random(7);
+        auto moveRoots = [&] {
+            for (uint32_t root : roots) {
+                graph.setLocal(root, randomTransform(random));
+            }
+        };
+        size_t moved = static_cast<size_t>(nodeCount * dirtyFraction);
+        auto moveSome = [&] {
+            std::uniform_int_distribution<uint32_t> node(
+                0, static_cast<uint32_t>(nodeCount - 1));
+            for (size_t i = 0; i < moved; i++) {
+                graph.setLocal(node(random), randomTransform(random));
+            }
+        };
+
+        size_t recomputed = 0;
+        std::cout << "all nodes moved\n";
+        double ms = bestMilliseconds(
+            runs, moveRoots, [&] { return graph.update(serial.data()); },
+            recomputed);
+        report("1 thread", recomputed, ms, 1);
+        ms = bestMilliseconds(
+            runs,
+            moveRoots,
+            [&] { return graph.update(parallel.data(), &jobs); },
+            recomputed);
+        report("job system", recomputed, ms, cores);
+
+        // Same local transforms, every node recomputed on both sides
+        moveRoots();
+        graph.update(serial.data());
+        for (uint32_t root : roots) {
+            graph.setLocal(root, graph.local(root));
+        }
+        graph.update(parallel.data(), &jobs);
+        if (std::memcmp(serial.data(),
+                        parallel.data(),
+                        nodeCount * sizeof(SceneGraph::Matrix))
+            != 0)
+            throw std::runtime_error(
+                "threaded update disagrees with the single-threaded one!");
+
+        std::cout << moved << " nodes moved\n";
+        ms = bestMilliseconds(
+            runs, moveSome, [&] { return graph.update(serial.data()); },
+            recomputed);
+        report("1 thread", recomputed, ms, 1);
+        ms = bestMilliseconds(
+            runs,
+            moveSome,
+            [&] { return graph.update(parallel.data(), &jobs); },
+            recomputed);
+        report("job system", recomputed, ms, cores);
+        std::cout << "  " << recomputed << " matrices recomputed\n";
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. Neither side ever blocks: push() fails when the queue is
+// full and pop() when it is empty. Each side caches the other's index and
+// only reloads it (one shared cache line) when the cached value says full
+// or empty.
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    // Producer thread only
+    bool push(const T &value)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ == CAPACITY) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ == CAPACITY)
+                return false;
+        }
+        slots_[tail & (CAPACITY - 1)] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool pop(T &value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_)
+                return false;
+        }
+        value = slots_[head & (CAPACITY - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Consumer side
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{ 0 };
+    size_t cachedTail_ = 0;
+    // Producer side
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{ 0 };
+    size_t cachedHead_ = 0;
+    alignas(CACHE_LINE_SIZE) std::array<T, CAPACITY> slots_{};
+};
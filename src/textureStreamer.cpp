@@ -0,0 +1,656 @@
+#include "textureStreamer.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "bindlessHeap.hh"
+#include "deletionQueue.hh"
+#include "mappedFile.hh"
+#include "tracer.hh"
+
+namespace {
+
+const uint32_t BATCH_COUNT = 4;
+// Buffer offsets of buffer to image copies must be texel aligned; 16 also
+// suits the optimal copy alignment of common devices
+const VkDeviceSize STAGING_ALIGNMENT = 16;
+const VkFormat TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties &properties,
+                        uint32_t typeFilter,
+                        VkMemoryPropertyFlags flags)
+{
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i))
+            && (properties.memoryTypes[i].propertyFlags & flags) == flags)
+            return i;
+    }
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(const Settings &settings,
+                                 BindlessHeap &heap,
+                                 DeletionQueue &deletionQueue)
+    : settings_(settings)
+    , heap_(heap)
+    , deletionQueue_(deletionQueue)
+    , budget_(settings.budget)
+{
+    VkDevice device = settings_.device;
+    vkGetPhysicalDeviceMemoryProperties(settings_.physicalDevice,
+                                        &memoryProperties_);
+
+    // Images of one format, tiling and usage share their memory types
+    VkImage probe = createImageHandle(1, 1, 1);
+    VkMemoryRequirements probeRequirements;
+    vkGetImageMemoryRequirements(device, probe, &probeRequirements);
+    vkDestroyImage(device, probe, nullptr);
+    uint32_t probeType = findMemoryType(memoryProperties_,
+                                        probeRequirements.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    memoryHeap_ = memoryProperties_.memoryTypes[probeType].heapIndex;
+
+    // Staging ring
+
+    settings_.stagingSize = alignUp(settings_.stagingSize, STAGING_ALIGNMENT);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = settings_.stagingSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &staging_) != VK_SUCCESS)
+        throw std::runtime_error("failed to create texture staging buffer!");
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, staging_, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex =
+        findMemoryType(memoryProperties_,
+                       memRequirements.memoryTypeBits,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                           | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &stagingMemory_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate texture staging memory!");
+
+    vkBindBufferMemory(device, staging_, stagingMemory_, 0);
+
+    void *mapped;
+    if (vkMapMemory(device, stagingMemory_, 0, VK_WHOLE_SIZE, 0, &mapped)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to map texture staging memory!");
+    stagingMapped_ = static_cast<uint8_t *>(mapped);
+
+    // Transfer command buffers, one per batch in flight
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = settings_.transferFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create transfer command pool!");
+
+    batches_.resize(BATCH_COUNT);
+    for (Batch &batch : batches_) {
+        VkCommandBufferAllocateInfo commandBufferInfo{};
+        commandBufferInfo.sType =
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool = commandPool_;
+        commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(
+                device, &commandBufferInfo, &batch.commandBuffer)
+            != VK_SUCCESS)
+            throw std::runtime_error(
+                "failed to allocate transfer command buffer!");
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create transfer fence!");
+
+        freeBatches_.push_back(&batch);
+    }
+
+    // Decoding workers
+
+    uint32_t workerCount = std::max(settings_.workerCount, 1u);
+    for (uint32_t i = 0; i < workerCount; i++)
+        workers_.emplace_back(&TextureStreamer::workerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (std::thread &worker : workers_)
+        worker.join();
+
+    VkDevice device = settings_.device;
+    for (Batch *batch : submitted_)
+        vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+
+    for (auto &texture : textures_) {
+        destroyImage(texture->resident);
+        if (texture->upload)
+            destroyImage(texture->upload->target);
+    }
+
+    for (Batch &batch : batches_)
+        vkDestroyFence(device, batch.fence, nullptr);
+    vkDestroyCommandPool(device, commandPool_, nullptr);
+
+    vkUnmapMemory(device, stagingMemory_);
+    vkDestroyBuffer(device, staging_, nullptr);
+    vkFreeMemory(device, stagingMemory_, nullptr);
+}
+
+TextureHandle TextureStreamer::request(const std::filesystem::path &path)
+{
+    auto texture = std::make_unique<Texture>();
+    texture->path = path;
+    Texture *pointer = texture.get();
+    textures_.push_back(std::move(texture));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(pointer);
+    }
+    condition_.notify_one();
+    return static_cast<TextureHandle>(textures_.size() - 1);
+}
+
+uint32_t TextureStreamer::heapIndex(TextureHandle handle,
+                                    uint32_t fallback) const
+{
+    const Texture &texture = *textures_.at(handle);
+    return texture.resident.image != VK_NULL_HANDLE
+        ? texture.resident.heapIndex
+        : fallback;
+}
+
+TextureStreamer::Statistics TextureStreamer::statistics() const
+{
+    Statistics statistics;
+    statistics.textures = static_cast<uint32_t>(textures_.size());
+    statistics.budget = budget_;
+    statistics.uploadedBytes = uploadedBytes_;
+    for (const auto &texture : textures_) {
+        DecodeState state = texture->state.load(std::memory_order_acquire);
+        statistics.decoded += state == DecodeState::DECODED;
+        statistics.failed += state == DecodeState::FAILED;
+        statistics.fullyResident += texture->residentMip == 0;
+        statistics.uploading += texture->upload != nullptr;
+        statistics.residentBytes += texture->resident.size;
+    }
+    return statistics;
+}
+
+// Workers
+
+void TextureStreamer::workerLoop()
+{
+    Tracer::nameThread("texture decoder");
+    for (;;) {
+        Texture *texture;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock,
+                            [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+                return;
+            texture = queue_.front();
+            queue_.pop_front();
+        }
+        decode(*texture);
+    }
+}
+
+void TextureStreamer::decode(Texture &texture)
+{
+    TRACE_ZONE("decodeTexture");
+    try {
+        MappedFile file(texture.path);
+        texture.mips = generateMipChain(
+            decodeImage(file.data(), file.size(), texture.path));
+
+        // A level is copied in one piece. The ring rewinds to offset 0
+        // whenever it drains, so any level up to its size is placed in the
+        // end; larger ones never would be.
+        for (const Image &level : texture.mips) {
+            if (level.pixels.size() > settings_.stagingSize)
+                throw std::runtime_error(
+                    "texture is larger than the staging ring");
+        }
+
+        texture.tailMip = static_cast<uint32_t>(texture.mips.size() - 1);
+        while (texture.tailMip > 0) {
+            const Image &level = texture.mips[texture.tailMip - 1];
+            if (std::max(level.width, level.height) > TAIL_SIZE)
+                break;
+            texture.tailMip--;
+        }
+        texture.state.store(DecodeState::DECODED, std::memory_order_release);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "failed to load texture " << texture.path.string() << ": "
+                  << e.what() << std::endl;
+        texture.mips.clear();
+        texture.state.store(DecodeState::FAILED, std::memory_order_release);
+    }
+}
+
+// Render thread
+
+void TextureStreamer::update()
+{
+    TRACE_ZONE("TextureStreamer::update");
+    pollBatches();
+    planResidency();
+    recordUploads();
+}
+
+void TextureStreamer::pollBatches()
+{
+    // Batches complete in submission order on the single transfer queue
+    while (!submitted_.empty()) {
+        Batch *batch = submitted_.front();
+        if (vkGetFenceStatus(settings_.device, batch->fence) != VK_SUCCESS)
+            break;
+
+        // Never behind a rewind of the drained ring
+        stagingTail_ = std::max(stagingTail_, batch->stagingEnd);
+        for (Texture *texture : batch->completed) {
+            GpuImage image = texture->upload->target;
+            image.heapIndex = heap_.addSampledImage(
+                image.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            // Frames in flight may still sample the previous image
+            if (texture->resident.image != VK_NULL_HANDLE)
+                retireImage(texture->resident);
+            texture->resident = image;
+            texture->residentMip = texture->upload->mip;
+            texture->upload.reset();
+        }
+        batch->completed.clear();
+
+        vkResetFences(settings_.device, 1, &batch->fence);
+        submitted_.pop_front();
+        freeBatches_.push_back(batch);
+    }
+}
+
+void TextureStreamer::planResidency()
+{
+    // Bytes the textures will occupy once the uploads in flight land
+    VkDeviceSize committed = 0;
+    for (const auto &texture : textures_) {
+        committed += texture->upload ? texture->upload->target.size
+                                     : texture->resident.size;
+    }
+
+    auto decoded = [](const Texture &texture) {
+        return texture.state.load(std::memory_order_acquire)
+            == DecodeState::DECODED;
+    };
+    auto residentTexels = [](const Texture &texture) {
+        if (texture.residentMip == UINT32_MAX)
+            return uint64_t(0);
+        const Image &top = texture.mips[texture.residentMip];
+        return uint64_t(top.width) * top.height;
+    };
+
+    // Over budget: the finest textures drop their top level, never going
+    // below the mip tail
+    while (committed > budget_) {
+        Texture *finest = nullptr;
+        for (auto &texture : textures_) {
+            if (!decoded(*texture) || texture->upload
+                || texture->residentMip >= texture->tailMip)
+                continue;
+            if (!finest || residentTexels(*texture) > residentTexels(*finest))
+                finest = texture.get();
+        }
+        if (!finest)
+            break;
+
+        VkDeviceSize previous = finest->resident.size;
+        startUpload(*finest, finest->residentMip + 1);
+        committed -= previous - finest->upload->target.size;
+    }
+
+    // Under budget: refine the coarsest textures, textures with nothing
+    // resident first. Mip tails are small and always allowed, so that
+    // every texture shows up.
+    const uint32_t MAX_STARTS_PER_UPDATE = 4;
+    for (uint32_t starts = 0; starts < MAX_STARTS_PER_UPDATE; starts++) {
+        Texture *coarsest = nullptr;
+        for (auto &texture : textures_) {
+            if (!decoded(*texture) || texture->upload
+                || texture->residentMip == 0)
+                continue;
+            if (!coarsest
+                || residentTexels(*texture) < residentTexels(*coarsest))
+                coarsest = texture.get();
+        }
+        if (!coarsest)
+            break;
+
+        bool tail = coarsest->residentMip == UINT32_MAX;
+        uint32_t mip = tail ? coarsest->tailMip : coarsest->residentMip - 1;
+        VkDeviceSize cost = imageSize(*coarsest, mip)
+            - coarsest->resident.size;
+        if (!tail && committed + cost > budget_)
+            break;
+
+        VkDeviceSize previous = coarsest->resident.size;
+        startUpload(*coarsest, mip);
+        committed += coarsest->upload->target.size - previous;
+    }
+}
+
+void TextureStreamer::startUpload(Texture &texture, uint32_t mip)
+{
+    // Image creation is the only Vulkan work done here; copies are
+    // recorded as staging space frees up
+    auto upload = std::make_unique<Upload>();
+    upload->target = createImage(texture, mip);
+    upload->mip = mip;
+    upload->nextLevel = mip;
+    texture.upload = std::move(upload);
+}
+
+void TextureStreamer::recordUploads()
+{
+    if (freeBatches_.empty())
+        return;
+    Batch *batch = freeBatches_.back();
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkCommandBuffer commandBuffer = batch->commandBuffer;
+    bool recording = false;
+
+    for (auto &texture : textures_) {
+        if (!texture->upload || texture->upload->recorded)
+            continue;
+        Upload &upload = *texture->upload;
+        uint32_t levelCount =
+            static_cast<uint32_t>(texture->mips.size()) - upload.mip;
+
+        if (!recording) {
+            vkResetCommandBuffer(commandBuffer, 0);
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+                throw std::runtime_error(
+                    "failed to begin recording transfer command buffer!");
+            recording = true;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = upload.target.image;
+        barrier.subresourceRange = {
+            VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1
+        };
+
+        if (!upload.started) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            vkCmdPipelineBarrier(commandBuffer,
+                                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0,
+                                 0,
+                                 nullptr,
+                                 0,
+                                 nullptr,
+                                 1,
+                                 &barrier);
+            upload.started = true;
+        }
+
+        // A texture may span several batches when the ring fills up
+        while (upload.nextLevel < texture->mips.size()) {
+            const Image &level = texture->mips[upload.nextLevel];
+            VkDeviceSize offset;
+            if (!allocateStaging(level.pixels.size(), &offset))
+                break;
+            std::memcpy(stagingMapped_ + offset,
+                        level.pixels.data(),
+                        level.pixels.size());
+            uploadedBytes_ += level.pixels.size();
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = upload.nextLevel - upload.mip;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { level.width, level.height, 1 };
+
+            vkCmdCopyBufferToImage(commandBuffer,
+                                   staging_,
+                                   upload.target.image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   1,
+                                   &region);
+            upload.nextLevel++;
+        }
+        // The rest waits for staging space, smaller textures after this
+        // one may still fit
+        if (upload.nextLevel < texture->mips.size())
+            continue;
+
+        // The fence is waited on by the render thread before the image is
+        // published, so the transition only has to finish the writes
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             1,
+                             &barrier);
+        upload.recorded = true;
+        batch->completed.push_back(texture.get());
+    }
+
+    if (!recording)
+        return;
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        throw std::runtime_error("failed to record transfer command buffer!");
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    if (vkQueueSubmit(settings_.transferQueue, 1, &submitInfo, batch->fence)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to submit texture uploads!");
+
+    batch->stagingEnd = stagingHead_;
+    freeBatches_.pop_back();
+    submitted_.push_back(batch);
+}
+
+bool TextureStreamer::allocateStaging(VkDeviceSize size, VkDeviceSize *offset)
+{
+    VkDeviceSize capacity = settings_.stagingSize;
+
+    // Drained: restart at offset 0 of the next wrap, so that a level as
+    // large as the ring fits whatever the previous uploads left behind
+    if (stagingHead_ == stagingTail_) {
+        stagingHead_ = alignUp(stagingHead_, capacity);
+        stagingTail_ = stagingHead_;
+    }
+
+    uint64_t head = alignUp(stagingHead_, STAGING_ALIGNMENT);
+
+    // Allocations never straddle the end of the ring
+    uint64_t position = head % capacity;
+    if (position + size > capacity)
+        head += capacity - position;
+    if (head + size - stagingTail_ > capacity)
+        return false;
+
+    *offset = head % capacity;
+    stagingHead_ = head + size;
+    return true;
+}
+
+VkDeviceSize TextureStreamer::imageSize(Texture &texture, uint32_t mip)
+{
+    if (texture.imageSizes.empty())
+        texture.imageSizes.resize(texture.mips.size(), 0);
+    if (texture.imageSizes[mip] == 0) {
+        const Image &top = texture.mips[mip];
+        VkImage image = createImageHandle(
+            top.width,
+            top.height,
+            static_cast<uint32_t>(texture.mips.size()) - mip);
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(
+            settings_.device, image, &memRequirements);
+        vkDestroyImage(settings_.device, image, nullptr);
+        texture.imageSizes[mip] = memRequirements.size;
+    }
+    return texture.imageSizes[mip];
+}
+
+VkImage TextureStreamer::createImageHandle(uint32_t width,
+                                           uint32_t height,
+                                           uint32_t levelCount) const
+{
+    // Concurrent sharing lets the graphics queue sample what the transfer
+    // queue wrote without queue family ownership transfers
+    uint32_t families[] = { settings_.graphicsFamily,
+                            settings_.transferFamily };
+    bool shared = settings_.graphicsFamily != settings_.transferFamily;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = TEXTURE_FORMAT;
+    imageInfo.extent = { width, height, 1 };
+    imageInfo.mipLevels = levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage =
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode =
+        shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.queueFamilyIndexCount = shared ? 2 : 0;
+    imageInfo.pQueueFamilyIndices = shared ? families : nullptr;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage image;
+    if (vkCreateImage(settings_.device, &imageInfo, nullptr, &image)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create streamed image!");
+    return image;
+}
+
+TextureStreamer::GpuImage TextureStreamer::createImage(const Texture &texture,
+                                                       uint32_t mip)
+{
+    VkDevice device = settings_.device;
+    const Image &top = texture.mips[mip];
+    uint32_t levelCount = static_cast<uint32_t>(texture.mips.size()) - mip;
+    GpuImage image;
+    image.image = createImageHandle(top.width, top.height, levelCount);
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image.image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex =
+        findMemoryType(memoryProperties_,
+                       memRequirements.memoryTypeBits,
+                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &image.memory)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate streamed image memory!");
+
+    vkBindImageMemory(device, image.image, image.memory, 0);
+    image.size = memRequirements.size;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = TEXTURE_FORMAT;
+    viewInfo.subresourceRange = {
+        VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1
+    };
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &image.view)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create streamed image view!");
+
+    return image;
+}
+
+void TextureStreamer::destroyImage(GpuImage &image)
+{
+    if (image.heapIndex != UINT32_MAX)
+        heap_.releaseSampledImage(image.heapIndex);
+    vkDestroyImageView(settings_.device, image.view, nullptr);
+    vkDestroyImage(settings_.device, image.image, nullptr);
+    vkFreeMemory(settings_.device, image.memory, nullptr);
+    image = GpuImage{};
+}
+
+void TextureStreamer::retireImage(const GpuImage &image)
+{
+    if (image.heapIndex != UINT32_MAX) {
+        BindlessHeap *heap = &heap_;
+        uint32_t heapIndex = image.heapIndex;
+        deletionQueue_.defer(
+            [heap, heapIndex] { heap->releaseSampledImage(heapIndex); });
+    }
+    deletionQueue_.destroy(image.view);
+    deletionQueue_.destroy(image.image);
+    deletionQueue_.destroy(image.memory);
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "imageDecoder.hh"
+
+class BindlessHeap;
+class DeletionQueue;
+
+using TextureHandle = uint32_t;
+
+// Streams textures from disk into the bindless heap without ever blocking
+// the render loop.
+//
+// Worker threads map the files, decode them and build the full mip chain
+// in system memory. The render thread calls update() once per frame: it
+// polls the transfer submissions, publishes finished images and starts new
+// uploads through a persistently mapped staging ring on the transfer queue.
+//
+// Residency is tracked per texture as the finest resident mip. Each
+// texture first gets its mip tail (levels of at most TAIL_SIZE texels), so
+// every texture is visible at low resolution before any is refined; then
+// the coarsest textures are refined one level at a time while the budget
+// allows. When over budget the finest textures drop their top level. A
+// residency change uploads a new image holding the resident levels and
+// swaps it in; the old image and its heap index go to the DeletionQueue,
+// which destroys them once no frame in flight can still reference them.
+class TextureStreamer {
+public:
+    static constexpr uint32_t TAIL_SIZE = 64;
+
+    struct Settings {
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        uint32_t graphicsFamily = 0;
+        // May equal graphicsFamily, in which case transferQueue is the
+        // graphics queue and must only be used from the render thread
+        uint32_t transferFamily = 0;
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        VkDeviceSize budget = 256ull << 20;
+        VkDeviceSize stagingSize = 64ull << 20;
+        uint32_t workerCount = 2;
+    };
+
+    struct Statistics {
+        uint32_t textures = 0;
+        uint32_t decoded = 0;
+        uint32_t failed = 0;
+        uint32_t fullyResident = 0;
+        uint32_t uploading = 0;
+        VkDeviceSize residentBytes = 0;
+        VkDeviceSize budget = 0;
+        VkDeviceSize uploadedBytes = 0;
+    };
+
+    TextureStreamer(const Settings &settings,
+                    BindlessHeap &heap,
+                    DeletionQueue &deletionQueue);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    // Queues the file for decoding; the texture becomes visible once its
+    // mip tail is uploaded
+    TextureHandle request(const std::filesystem::path &path);
+
+    // Render thread, once per frame after waiting for the frame's fence.
+    // Never waits on the GPU or on the workers.
+    void update();
+
+    // Heap index of the resident image, or fallback while none is
+    uint32_t heapIndex(TextureHandle handle, uint32_t fallback) const;
+
+    void setBudget(VkDeviceSize budget)
+    {
+        budget_ = budget;
+    }
+
+    // Memory heap the streamed images are allocated from
+    uint32_t memoryHeap() const
+    {
+        return memoryHeap_;
+    }
+
+    Statistics statistics() const;
+
+private:
+    enum class DecodeState
+    {
+        QUEUED,
+        DECODED,
+        FAILED,
+    };
+
+    struct GpuImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t heapIndex = UINT32_MAX;
+    };
+
+    struct Upload {
+        GpuImage target;
+        uint32_t mip = 0;       // finest level of the new image
+        uint32_t nextLevel = 0; // next source level to copy
+        bool started = false;
+        bool recorded = false; // every level copied, waiting for the batch
+    };
+
+    struct Texture {
+        std::filesystem::path path;
+        std::atomic<DecodeState> state{ DecodeState::QUEUED };
+        // Written by a worker before state becomes DECODED
+        std::vector<Image> mips;
+        uint32_t tailMip = 0;
+
+        // Render thread only
+        uint32_t residentMip = UINT32_MAX; // UINT32_MAX: nothing resident
+        GpuImage resident;
+        std::unique_ptr<Upload> upload;
+        // Memory an image from each mip would take, 0 until queried
+        std::vector<VkDeviceSize> imageSizes;
+    };
+
+    struct Batch {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t stagingEnd = 0;
+        std::vector<Texture *> completed;
+    };
+
+    void workerLoop();
+    void decode(Texture &texture);
+
+    void pollBatches();
+    void planResidency();
+    void recordUploads();
+
+    void startUpload(Texture &texture, uint32_t mip);
+    GpuImage createImage(const Texture &texture, uint32_t mip);
+    // Image without memory
+    VkImage createImageHandle(uint32_t width,
+                              uint32_t height,
+                              uint32_t levelCount) const;
+    void destroyImage(GpuImage &image);
+    // Destroyed once the frames in flight are done with it
+    void retireImage(const GpuImage &image);
+    // What createImage() would allocate, with the driver's alignment and
+    // padding, so that planning compares like with the committed sizes
+    VkDeviceSize imageSize(Texture &texture, uint32_t mip);
+    bool allocateStaging(VkDeviceSize size, VkDeviceSize *offset);
+
+    Settings settings_;
+    BindlessHeap &heap_;
+    DeletionQueue &deletionQueue_;
+    VkPhysicalDeviceMemoryProperties memoryProperties_{};
+    VkDeviceSize budget_;
+    uint32_t memoryHeap_ = 0;
+
+    std::vector<std::unique_ptr<Texture>> textures_;
+
+    // Staging ring: monotonic byte counters, wrapped by stagingSize
+    VkBuffer staging_ = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory_ = VK_NULL_HANDLE;
+    uint8_t *stagingMapped_ = nullptr;
+    uint64_t stagingHead_ = 0;
+    uint64_t stagingTail_ = 0;
+    VkDeviceSize uploadedBytes_ = 0;
+
+    VkCommandPool commandPool_ = VK_NULL_HANDLE;
+    std::vector<Batch> batches_;
+    std::deque<Batch *> submitted_; // in submission order
+    std::vector<Batch *> freeBatches_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Texture *> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
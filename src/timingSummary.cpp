@@ -0,0 +1,30 @@
+#include "timingSummary.hh"
+
+#include <algorithm>
+#include <ostream>
+
+TimingSummary summarizeTimings(std::vector<double> timings)
+{
+    TimingSummary summary;
+    if (timings.empty())
+        return summary;
+
+    std::sort(timings.begin(), timings.end());
+    double sum = 0.0;
+    for (double timing : timings) {
+        sum += timing;
+    }
+    summary.mean = sum / double(timings.size());
+    summary.median = timings[timings.size() / 2];
+    summary.p95 =
+        timings[std::min(timings.size() - 1, timings.size() * 95 / 100)];
+    summary.max = timings.back();
+    return summary;
+}
+
+void writeJson(std::ostream &out, const TimingSummary &summary)
+{
+    out << "{ \"mean\": " << summary.mean
+        << ", \"median\": " << summary.median << ", \"p95\": " << summary.p95
+        << ", \"max\": " << summary.max << " }";
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <iosfwd>
+#include <vector>
+
+// Distribution of a series of timings, in the unit of the timings
+struct TimingSummary {
+    double mean = 0.0;
+    double median = 0.0;
+    double p95 = 0.0;
+    double max = 0.0;
+};
+
+// All zero for an empty series
+TimingSummary summarizeTimings(std::vector<double> timings);
+
+// { "mean": ..., "median": ..., "p95": ..., "max": ... }
+void writeJson(std::ostream &out, const TimingSummary &summary);
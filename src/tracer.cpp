@@ -0,0 +1,259 @@
+#include "tracer.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled_{ false };
+
+namespace {
+
+struct Event {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Single-writer ring read by the thread that writes the trace. The writer
+// claims a slot before overwriting it and publishes it after; the reader
+// copies published slots, then drops those claimed again meanwhile.
+class Ring {
+public:
+    static constexpr uint64_t MASK = Tracer::RING_CAPACITY - 1;
+    static_assert((Tracer::RING_CAPACITY & MASK) == 0,
+                  "Tracer ring capacity must be a power of two");
+
+    // Writer thread only
+    void push(const char *name, uint64_t begin, uint64_t end)
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        claimed_.store(head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Slot &slot = slots_[head & MASK];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.begin.store(begin, std::memory_order_relaxed);
+        slot.end.store(end, std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Reader only. Appends the events published since the previous read
+    // and returns how many were overwritten before they could be read.
+    uint64_t read(std::vector<Event> &events)
+    {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t first = head > Tracer::RING_CAPACITY
+            ? std::max(read_, head - Tracer::RING_CAPACITY)
+            : read_;
+        size_t start = events.size();
+        for (uint64_t i = first; i < head; i++) {
+            const Slot &slot = slots_[i & MASK];
+            events.push_back({ slot.name.load(std::memory_order_relaxed),
+                               slot.begin.load(std::memory_order_relaxed),
+                               slot.end.load(std::memory_order_relaxed) });
+        }
+
+        // Slots claimed after the copy may have been torn by the writer
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimed = claimed_.load(std::memory_order_relaxed);
+        uint64_t valid = claimed > Tracer::RING_CAPACITY
+            ? std::max(first, claimed - Tracer::RING_CAPACITY)
+            : first;
+        events.erase(events.begin() + start,
+                     events.begin() + start + (valid - first));
+
+        uint64_t lost = valid - read_;
+        read_ = head;
+        return lost;
+    }
+
+private:
+    struct Slot {
+        std::atomic<const char *> name{ nullptr };
+        std::atomic<uint64_t> begin{ 0 };
+        std::atomic<uint64_t> end{ 0 };
+    };
+
+    std::atomic<uint64_t> claimed_{ 0 };
+    std::atomic<uint64_t> head_{ 0 };
+    uint64_t read_ = 0;
+    std::unique_ptr<Slot[]> slots_ =
+        std::make_unique<Slot[]>(Tracer::RING_CAPACITY);
+};
+
+struct Track {
+    uint32_t id = 0;
+    std::string name;
+    Ring ring;
+};
+
+// Tracks live as long as the process: a thread may exit with events that
+// were not written yet
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Track>> threads;
+    Track gpu;
+};
+
+Registry &registry()
+{
+    static Registry *registry = new Registry;
+    return *registry;
+}
+
+thread_local Track *currentTrack = nullptr;
+thread_local const char *currentThreadName = nullptr;
+
+// Created on the thread's first event, so that threads never traced cost
+// no ring
+Track &threadTrack()
+{
+    if (!currentTrack) {
+        Registry &tracks = registry();
+        std::lock_guard<std::mutex> lock(tracks.mutex);
+        auto track = std::make_unique<Track>();
+        track->id = static_cast<uint32_t>(tracks.threads.size()) + 1;
+        track->name = currentThreadName
+            ? currentThreadName
+            : "thread " + std::to_string(track->id);
+        currentTrack = track.get();
+        tracks.threads.push_back(std::move(track));
+    }
+    return *currentTrack;
+}
+
+void writeString(std::ostream &out, const std::string &text)
+{
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+// Microseconds with the nanoseconds kept as decimals
+void writeMicroseconds(std::ostream &out, uint64_t nanoseconds)
+{
+    out << nanoseconds / 1000 << '.' << std::setw(3) << std::setfill('0')
+        << nanoseconds % 1000;
+}
+
+constexpr uint32_t CPU_PROCESS = 1;
+constexpr uint32_t GPU_PROCESS = 2;
+
+void writeMetadata(std::ostream &out,
+                   const char *kind,
+                   uint32_t process,
+                   uint32_t thread,
+                   const std::string &name)
+{
+    out << "{\"ph\":\"M\",\"name\":\"" << kind << "\",\"pid\":" << process
+        << ",\"tid\":" << thread << ",\"args\":{\"name\":";
+    writeString(out, name);
+    out << "}},\n";
+}
+
+void writeEvents(std::ostream &out,
+                 uint32_t process,
+                 uint32_t thread,
+                 const std::vector<Event> &events)
+{
+    for (const Event &event : events) {
+        out << "{\"ph\":\"X\",\"name\":";
+        writeString(out, event.name ? event.name : "");
+        out << ",\"pid\":" << process << ",\"tid\":" << thread << ",\"ts\":";
+        writeMicroseconds(out, event.begin);
+        out << ",\"dur\":";
+        writeMicroseconds(out, event.end > event.begin
+                                   ? event.end - event.begin
+                                   : 0);
+        out << "},\n";
+    }
+}
+
+} // namespace
+
+void Tracer::setEnabled(bool enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Tracer::nameThread(const char *name)
+{
+    currentThreadName = name;
+    if (currentTrack) {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        currentTrack->name = name;
+    }
+}
+
+void Tracer::zone(const char *name, uint64_t begin, uint64_t end)
+{
+    threadTrack().ring.push(name, begin, end);
+}
+
+void Tracer::gpuZone(const char *name, uint64_t begin, uint64_t end)
+{
+    registry().gpu.ring.push(name, begin, end);
+}
+
+size_t Tracer::write(const std::filesystem::path &path)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("failed to open trace file "
+                                 + path.string() + "!");
+
+    Registry &tracks = registry();
+    std::lock_guard<std::mutex> lock(tracks.mutex);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    writeMetadata(out, "process_name", CPU_PROCESS, 0, "CPU");
+    writeMetadata(out, "process_name", GPU_PROCESS, 0, "GPU");
+
+    size_t count = 0;
+    uint64_t lost = 0;
+    std::vector<Event> events;
+    for (const auto &track : tracks.threads) {
+        events.clear();
+        lost += track->ring.read(events);
+        writeMetadata(
+            out, "thread_name", CPU_PROCESS, track->id, track->name);
+        writeEvents(out, CPU_PROCESS, track->id, events);
+        count += events.size();
+    }
+    events.clear();
+    lost += tracks.gpu.ring.read(events);
+    writeMetadata(out, "thread_name", GPU_PROCESS, 1, "queue");
+    writeEvents(out, GPU_PROCESS, 1, events);
+    count += events.size();
+
+    // Overwritten events, as a counter at the end of the trace
+    out << "{\"ph\":\"C\",\"name\":\"lost events\",\"pid\":" << CPU_PROCESS
+        << ",\"ts\":";
+    writeMicroseconds(out, now());
+    out << ",\"args\":{\"lost\":" << lost << "}}\n]}\n";
+
+    if (!out)
+        throw std::runtime_error("failed to write trace file "
+                                 + path.string() + "!");
+    return count;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Scoped CPU zones and GPU intervals, written out as Chrome trace-event
+// JSON that chrome://tracing and Perfetto open. Each thread records into a
+// lock-free ring of its own, created on its first event; a full ring
+// overwrites its oldest events, so a trace holds the latest RING_CAPACITY
+// zones of each thread. While tracing is disabled a zone costs one relaxed
+// load and a branch.
+//
+// Zone and thread names are kept by pointer: they must be string literals.
+class Tracer {
+public:
+    static constexpr size_t RING_CAPACITY = size_t(1) << 15;
+
+    static bool enabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled);
+
+    // Nanoseconds on the steady clock, the time base of every event
+    static uint64_t now();
+
+    // Names the calling thread's track. Cheap enough to call whether
+    // tracing is enabled or not.
+    static void nameThread(const char *name);
+
+    static void zone(const char *name, uint64_t begin, uint64_t end);
+
+    // Intervals of the GPU track, already in now()'s time base. From one
+    // thread at a time.
+    static void gpuZone(const char *name, uint64_t begin, uint64_t end);
+
+    // Writes the events of every thread recorded since the previous write
+    // and returns how many. Throws std::runtime_error when the file cannot
+    // be written.
+    static size_t write(const std::filesystem::path &path);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records a zone from its construction to its destruction
+class TraceZone {
+public:
+    explicit TraceZone(const char *name)
+        : name_(name)
+        , begin_(Tracer::enabled() ? Tracer::now() : 0)
+    {
+    }
+
+    ~TraceZone()
+    {
+        if (begin_ != 0)
+            Tracer::zone(name_, begin_, Tracer::now());
+    }
+
+    TraceZone(const TraceZone &) = delete;
+    TraceZone &operator=(const TraceZone &) = delete;
+
+private:
+    const char *name_;
+    // 0 when tracing was disabled at construction
+    uint64_t begin_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// A zone for the rest of the enclosing scope
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
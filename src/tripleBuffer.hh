@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Latest-value exchange between one writer thread and one reader thread.
+// The writer fills back() and publishes it; the reader always gets the
+// most recent published value. With three buffers neither side waits: the
+// writer owns one, the reader another, and the third holds the latest
+// publication, swapped in by a single atomic exchange on either side.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer thread only: the buffer to fill before publish()
+    T &back()
+    {
+        return buffers_[back_];
+    }
+
+    // Writer thread only
+    void publish()
+    {
+        uint32_t previous =
+            middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+        back_ = previous & INDEX_MASK;
+    }
+
+    // Reader thread only. Returns the last published value, or the previous
+    // one again until the writer publishes a new one. The reference stays
+    // valid until the next call.
+    const T &latest()
+    {
+        if (middle_.load(std::memory_order_relaxed) & FRESH) {
+            uint32_t previous =
+                middle_.exchange(front_, std::memory_order_acq_rel);
+            front_ = previous & INDEX_MASK;
+        }
+        return buffers_[front_];
+    }
+
+private:
+    static constexpr uint32_t INDEX_MASK = 3;
+    // Set when the middle buffer has not been read yet
+    static constexpr uint32_t FRESH = 4;
+
+    T buffers_[3]{};
+    std::atomic<uint32_t> middle_{ 1 };
+    uint32_t back_ = 0;
+    uint32_t front_ = 2;
+};
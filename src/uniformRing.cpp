@@ -0,0 +1,172 @@
+#include "uniformRing.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+UniformRing::UniformRing(VkPhysicalDevice physicalDevice,
+                         VkDevice device,
+                         VkDeviceSize bytesPerFrame,
+                         uint32_t framesInFlight,
+                         VkDeviceSize frameRange,
+                         VkDeviceSize drawRange)
+    : device_(device)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // Offsets are valid for both uniform and storage buffer bindings
+    alignment_ = std::max(properties.limits.minUniformBufferOffsetAlignment,
+                          properties.limits.minStorageBufferOffsetAlignment);
+    regionSize_ = alignUp(bytesPerFrame, alignment_);
+
+    // Buffer
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = regionSize_ * framesInFlight;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+        | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer_) != VK_SUCCESS)
+        throw std::runtime_error("failed to create uniform ring buffer!");
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device_, buffer_, &memRequirements);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    // Coherent so that writes need no flush; device local when the device
+    // exposes such host visible memory (integrated GPUs, resizable BAR)
+    VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    uint32_t memoryType = memoryProperties.memoryTypeCount;
+    for (VkMemoryPropertyFlags properties :
+         { required | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, required }) {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((memRequirements.memoryTypeBits & (1 << i))
+                && (memoryProperties.memoryTypes[i].propertyFlags & properties)
+                    == properties) {
+                memoryType = i;
+                break;
+            }
+        }
+        if (memoryType != memoryProperties.memoryTypeCount)
+            break;
+    }
+    if (memoryType == memoryProperties.memoryTypeCount)
+        throw std::runtime_error("failed to find suitable memory type!");
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    if (vkAllocateMemory(device_, &allocInfo, nullptr, &memory_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate uniform ring memory!");
+
+    vkBindBufferMemory(device_, buffer_, memory_, 0);
+
+    void *mapped;
+    if (vkMapMemory(device_, memory_, 0, VK_WHOLE_SIZE, 0, &mapped)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to map uniform ring memory!");
+    mapped_ = static_cast<uint8_t *>(mapped);
+
+    // Set layout
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[FRAME_BINDING].binding = FRAME_BINDING;
+    bindings[FRAME_BINDING].descriptorType =
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[FRAME_BINDING].descriptorCount = 1;
+    bindings[FRAME_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+
+    bindings[DRAW_BINDING].binding = DRAW_BINDING;
+    bindings[DRAW_BINDING].descriptorType =
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[DRAW_BINDING].descriptorCount = 1;
+    bindings[DRAW_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &layout_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create descriptor set layout!");
+
+    // Pool and the single set, written once
+
+    VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                   2 };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+
+    if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool_)
+        != VK_SUCCESS)
+        throw std::runtime_error("failed to create descriptor pool!");
+
+    VkDescriptorSetAllocateInfo setInfo{};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool = pool_;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts = &layout_;
+
+    if (vkAllocateDescriptorSets(device_, &setInfo, &set_) != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate descriptor set!");
+
+    VkDescriptorBufferInfo bufferInfos[2]{};
+    bufferInfos[FRAME_BINDING] = { buffer_, 0, frameRange };
+    bufferInfos[DRAW_BINDING] = { buffer_, 0, drawRange };
+
+    VkWriteDescriptorSet writes[2]{};
+    for (uint32_t i = 0; i < 2; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set_;
+        writes[i].dstBinding = i;
+        writes[i].dstArrayElement = 0;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(device_, 2, writes, 0, nullptr);
+}
+
+UniformRing::~UniformRing()
+{
+    vkDestroyDescriptorPool(device_, pool_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, layout_, nullptr);
+    vkUnmapMemory(device_, memory_);
+    vkDestroyBuffer(device_, buffer_, nullptr);
+    vkFreeMemory(device_, memory_, nullptr);
+}
+
+void UniformRing::beginFrame(uint32_t frameIndex)
+{
+    regionStart_ = regionSize_ * frameIndex;
+    head_ = regionStart_;
+}
+
+uint32_t UniformRing::allocate(VkDeviceSize size, void **data)
+{
+    VkDeviceSize offset = alignUp(head_, alignment_);
+    if (offset + size > regionStart_ + regionSize_)
+        throw std::runtime_error("uniform ring overflow!");
+
+    head_ = offset + size;
+    *data = mapped_ + offset;
+    return static_cast<uint32_t>(offset);
+}
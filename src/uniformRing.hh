@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vulkan/vulkan.h>
+
+// Persistently mapped buffer split into one region per frame in flight.
+// Per-frame and per-draw data is bump-allocated from the region of the
+// current frame and reached through dynamic uniform buffer offsets, so
+// each allocation costs one memcpy: no buffer creation and no descriptor
+// update. A region is reused once the fence of its frame has signalled.
+//
+// The descriptor set (binding 0: frame data, binding 1: draw data, both
+// UNIFORM_BUFFER_DYNAMIC) is owned by the ring and never updated after
+// creation.
+class UniformRing {
+public:
+    static constexpr uint32_t FRAME_BINDING = 0;
+    static constexpr uint32_t DRAW_BINDING = 1;
+
+    // frameRange and drawRange are the sizes of the blocks the shaders
+    // read through each binding
+    UniformRing(VkPhysicalDevice physicalDevice,
+                VkDevice device,
+                VkDeviceSize bytesPerFrame,
+                uint32_t framesInFlight,
+                VkDeviceSize frameRange,
+                VkDeviceSize drawRange);
+    ~UniformRing();
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    // Rewinds to the region of the given frame; its previous contents must
+    // no longer be in use by the GPU
+    void beginFrame(uint32_t frameIndex);
+
+    // Returns the dynamic offset of size bytes, aligned for uniform and
+    // storage buffer bindings, and where to write them
+    uint32_t allocate(VkDeviceSize size, void **data);
+
+    template <typename T> uint32_t push(const T &value)
+    {
+        void *data;
+        uint32_t offset = allocate(sizeof(T), &data);
+        std::memcpy(data, &value, sizeof(T));
+        return offset;
+    }
+
+    VkDescriptorSetLayout layout() const
+    {
+        return layout_;
+    }
+
+    VkDescriptorSet set() const
+    {
+        return set_;
+    }
+
+    VkDeviceSize alignment() const
+    {
+        return alignment_;
+    }
+
+    // Bytes allocated in the current frame, alignment padding included
+    VkDeviceSize used() const
+    {
+        return head_ - regionStart_;
+    }
+
+    // Dynamic offset and contents of the current frame's region
+    VkDeviceSize frameOffset() const
+    {
+        return regionStart_;
+    }
+
+    const uint8_t *frameData() const
+    {
+        return mapped_ + regionStart_;
+    }
+
+private:
+    VkDevice device_;
+    VkBuffer buffer_ = VK_NULL_HANDLE;
+    VkDeviceMemory memory_ = VK_NULL_HANDLE;
+    uint8_t *mapped_ = nullptr;
+    VkDeviceSize alignment_ = 0;
+    VkDeviceSize regionSize_ = 0;
+    VkDeviceSize regionStart_ = 0;
+    VkDeviceSize head_ = 0;
+    VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+    VkDescriptorPool pool_ = VK_NULL_HANDLE;
+    VkDescriptorSet set_ = VK_NULL_HANDLE;
+};
@@ -0,0 +1,1390 @@
+// Headless replay of a call trace written by drawTriangle --capture-calls:
+//
+//   vulkanReplay [--loops N] [--frames] [--json PATH] TRACE
+//
+// Recreates the captured objects on the first device able to (lavapipe
+// included, no window system needed), then records and submits the
+// captured frames back to back, as fast as the device goes, --loops times.
+// Swap chain images become plain colour attachments and nothing is
+// presented.
+//
+// Reports the CPU time to record and submit each frame and its GPU time
+// from timestamps: for every frame with --frames, and their mean, median,
+// 95th percentile and maximum. --json writes the summary for scripts.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "bindlessHeap.hh"
+#include "callCapture.hh"
+#include "drawStateRecorder.hh"
+#include "mappedFile.hh"
+#include "timingSummary.hh"
+#include "uniformRing.hh"
+
+namespace {
+
+// Top and bottom of each frame's command buffer
+const uint32_t TIMESTAMPS_PER_FRAME = 2;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct Buffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    // Host-visible buffers stay mapped, the others are uploaded to
+    uint8_t *mapped = nullptr;
+};
+
+struct Image {
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageCreateInfo info{};
+};
+
+struct Framebuffer {
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+};
+
+// Milliseconds
+struct FrameTiming {
+    double cpu = 0.0;
+    double gpu = 0.0;
+};
+
+// Objects of a trace are numbered in the order their records appear, so
+// that each kind lives in a vector indexed by number
+template <typename T> T &at(std::vector<T> &objects, uint32_t id)
+{
+    if (id >= objects.size())
+        throw std::runtime_error("call trace uses an object it never created!");
+    return objects[id];
+}
+
+// Whether the state follows, then the state
+template <typename T> T *readState(CallTraceReader &reader, T &state)
+{
+    if (!reader.read<uint32_t>())
+        return nullptr;
+    state = reader.read<T>();
+    return &state;
+}
+
+// Nothing is presented: what was left for the presentation engine stays a
+// colour attachment
+void unpresentable(VkImageLayout &layout)
+{
+    if (layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+        layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+}
+
+class Replayer {
+public:
+    explicit Replayer(const CallTraceHeader &header)
+    {
+        support_.extendedDynamicState = header.extendedDynamicState != 0;
+        support_.extendedDynamicState2 = header.extendedDynamicState2 != 0;
+        support_.extendedDynamicState3Blend =
+            header.extendedDynamicState3Blend != 0;
+
+        createInstance();
+        pickPhysicalDevice();
+        createLogicalDevice();
+        recorder_ = std::make_unique<DrawStateRecorder>(device_, support_);
+    }
+
+    ~Replayer()
+    {
+        vkDeviceWaitIdle(device_);
+        if (queryPool_ != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device_, queryPool_, nullptr);
+        for (VkFence fence : fences_) {
+            vkDestroyFence(device_, fence, nullptr);
+        }
+        vkDestroyCommandPool(device_, commandPool_, nullptr);
+        for (const Framebuffer &framebuffer : framebuffers_) {
+            vkDestroyFramebuffer(device_, framebuffer.framebuffer, nullptr);
+        }
+        for (VkImageView view : imageViews_) {
+            vkDestroyImageView(device_, view, nullptr);
+        }
+        for (const Image &image : images_) {
+            vkDestroyImage(device_, image.image, nullptr);
+            vkFreeMemory(device_, image.memory, nullptr);
+        }
+        for (const Buffer &buffer : buffers_) {
+            destroyBuffer(buffer);
+        }
+        for (VkPipeline pipeline : pipelines_) {
+            vkDestroyPipeline(device_, pipeline, nullptr);
+        }
+        for (VkRenderPass renderPass : renderPasses_) {
+            vkDestroyRenderPass(device_, renderPass, nullptr);
+        }
+        for (VkShaderModule module : shaderModules_) {
+            vkDestroyShaderModule(device_, module, nullptr);
+        }
+        if (pipelineLayout_ != VK_NULL_HANDLE)
+            vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+        ring_.reset();
+        heap_.reset();
+        recorder_.reset();
+        vkDestroyDevice(device_, nullptr);
+        vkDestroyInstance(instance_, nullptr);
+    }
+
+    Replayer(const Replayer &) = delete;
+    Replayer &operator=(const Replayer &) = delete;
+
+    const char *deviceName() const
+    {
+        return deviceName_.c_str();
+    }
+
+    bool gpuTimed() const
+    {
+        return queryPool_ != VK_NULL_HANDLE;
+    }
+
+    // Creates an object, or fills one, from a record outside the frames
+    void object(CallRecord type, CallTraceReader record)
+    {
+        std::vector<uint32_t> uses = record.readArray<uint32_t>();
+
+        switch (type) {
+        case CallRecord::HEAP:
+            createHeap(record);
+            break;
+        case CallRecord::RING:
+            createRing(record);
+            break;
+        case CallRecord::PIPELINE_LAYOUT:
+            createPipelineLayout(record);
+            break;
+        case CallRecord::SHADER_MODULE:
+            createShaderModule(record);
+            break;
+        case CallRecord::RENDER_PASS:
+            createRenderPass(record);
+            break;
+        case CallRecord::PIPELINE:
+            createPipeline(uses, record);
+            break;
+        case CallRecord::BUFFER:
+            createBuffer(record);
+            break;
+        case CallRecord::IMAGE:
+            createImage(record);
+            break;
+        case CallRecord::IMAGE_VIEW:
+            createImageView(uses, record);
+            break;
+        case CallRecord::FRAMEBUFFER:
+            createFramebuffer(uses, record);
+            break;
+        case CallRecord::BUFFER_DATA:
+            writeBuffer(uses, record);
+            break;
+        case CallRecord::IMAGE_DATA:
+            writeImage(uses, record);
+            break;
+        case CallRecord::HEAP_IMAGE:
+            addHeapImage(uses, record);
+            break;
+        case CallRecord::HEAP_BUFFER:
+            addHeapBuffer(uses, record);
+            break;
+
+        default:
+            throw std::runtime_error("unexpected record in call trace!");
+        }
+    }
+
+    // Records and submits one frame once the previous use of its frame
+    // slot has completed
+    void frame(CallTraceReader record)
+    {
+        if (!ring_ || !heap_ || pipelineLayout_ == VK_NULL_HANDLE)
+            throw std::runtime_error(
+                "call trace frame before its heap, ring and layout!");
+
+        uint32_t slot = record.read<uint32_t>()
+            % static_cast<uint32_t>(commandBuffers_.size());
+        VkDeviceSize ringOffset = record.read<VkDeviceSize>();
+        uint32_t ringSize = record.read<uint32_t>();
+        const uint8_t *ringData = record.bytes(ringSize);
+
+        vkWaitForFences(device_, 1, &fences_[slot], VK_TRUE, UINT64_MAX);
+        vkResetFences(device_, 1, &fences_[slot]);
+        collectTimestamps(slot);
+
+        auto start = std::chrono::steady_clock::now();
+
+        // The captured offsets, moved to this ring's region of the slot
+        ring_->beginFrame(slot);
+        void *region;
+        uint32_t regionStart = ring_->allocate(ringSize, &region);
+        std::memcpy(region, ringData, ringSize);
+        int64_t ringDelta =
+            int64_t(regionStart) - static_cast<int64_t>(ringOffset);
+
+        VkCommandBuffer commandBuffer = commandBuffers_[slot];
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error(
+                "failed to begin recording command buffer!");
+        recorder_->begin(commandBuffer);
+
+        if (queryPool_ != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer,
+                                queryPool_,
+                                slot * TIMESTAMPS_PER_FRAME,
+                                TIMESTAMPS_PER_FRAME);
+            vkCmdWriteTimestamp(commandBuffer,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                queryPool_,
+                                slot * TIMESTAMPS_PER_FRAME);
+        }
+
+        while (!record.atEnd()) {
+            CallRecord type;
+            CallTraceReader command = record.record(type);
+            recordCommand(commandBuffer, type, command, ringDelta);
+        }
+
+        if (queryPool_ != VK_NULL_HANDLE)
+            vkCmdWriteTimestamp(commandBuffer,
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                queryPool_,
+                                slot * TIMESTAMPS_PER_FRAME + 1);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("failed to record command buffer!");
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(queue_, 1, &submitInfo, fences_[slot])
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to submit command buffer!");
+
+        FrameTiming timing;
+        timing.cpu = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+        slotFrames_[slot] = timings_.size();
+        timings_.push_back(timing);
+    }
+
+    // Waits for the frames in flight and collects their timestamps
+    const std::vector<FrameTiming> &finish()
+    {
+        vkDeviceWaitIdle(device_);
+        for (uint32_t slot = 0; slot < slotFrames_.size(); slot++) {
+            collectTimestamps(slot);
+        }
+        return timings_;
+    }
+
+private:
+    static constexpr size_t NO_FRAME = ~size_t(0);
+
+    void createInstance()
+    {
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "vulkanReplay";
+        appInfo.applicationVersion = VK_MAKE_API_VERSION(0, 1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_API_VERSION(0, 1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_2;
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance_) != VK_SUCCESS)
+            throw std::runtime_error("failed to create instance!");
+    }
+
+    std::vector<const char *> requiredExtensions() const
+    {
+        std::vector<const char *> extensions;
+        if (support_.extendedDynamicState)
+            extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        if (support_.extendedDynamicState2)
+            extensions.push_back(
+                VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+        if (support_.extendedDynamicState3Blend)
+            extensions.push_back(
+                VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        return extensions;
+    }
+
+    // First device with a graphics queue, the bindless heap and the
+    // extensions the capturing device used
+    void pickPhysicalDevice()
+    {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
+
+        for (VkPhysicalDevice device : devices) {
+            uint32_t familyCount = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(
+                device, &familyCount, nullptr);
+            std::vector<VkQueueFamilyProperties> families(familyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(
+                device, &familyCount, families.data());
+            std::optional<uint32_t> graphics;
+            for (uint32_t i = 0; i < familyCount && !graphics; i++) {
+                if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+                    graphics = i;
+            }
+
+            uint32_t extensionCount = 0;
+            vkEnumerateDeviceExtensionProperties(
+                device, nullptr, &extensionCount, nullptr);
+            std::vector<VkExtensionProperties> extensions(extensionCount);
+            vkEnumerateDeviceExtensionProperties(
+                device, nullptr, &extensionCount, extensions.data());
+            std::set<std::string> available;
+            for (const auto &extension : extensions) {
+                available.insert(extension.extensionName);
+            }
+            bool complete = true;
+            for (const char *extension : requiredExtensions()) {
+                complete = complete && available.count(extension) > 0;
+            }
+
+            if (graphics && complete && BindlessHeap::isSupported(device)) {
+                physicalDevice_ = device;
+                queueFamily_ = graphics.value();
+                timestampValidBits_ = families[queueFamily_].timestampValidBits;
+                break;
+            }
+        }
+        if (physicalDevice_ == VK_NULL_HANDLE)
+            throw std::runtime_error(
+                "failed to find a GPU able to replay the call trace!");
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+        deviceName_ = properties.deviceName;
+        timestampPeriod_ = properties.limits.timestampPeriod;
+        if (!properties.limits.timestampComputeAndGraphics)
+            timestampValidBits_ = 0;
+    }
+
+    void createLogicalDevice()
+    {
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = queueFamily_;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        BindlessHeap::requiredFeatures(features12);
+
+        // Only the dynamic states the trace's pipelines were created with;
+        // device creation fails if one is missing
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicFeatures{};
+        dynamicFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        dynamicFeatures.extendedDynamicState = VK_TRUE;
+        VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicFeatures2{};
+        dynamicFeatures2.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+        dynamicFeatures2.extendedDynamicState2 = VK_TRUE;
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicFeatures3{};
+        dynamicFeatures3.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        dynamicFeatures3.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+        dynamicFeatures3.extendedDynamicState3ColorBlendEquation = VK_TRUE;
+
+        void **next = &features12.pNext;
+        auto chain = [&next](auto &features) {
+            *next = &features;
+            next = &features.pNext;
+        };
+        if (support_.extendedDynamicState)
+            chain(dynamicFeatures);
+        if (support_.extendedDynamicState2)
+            chain(dynamicFeatures2);
+        if (support_.extendedDynamicState3Blend)
+            chain(dynamicFeatures3);
+        *next = nullptr;
+
+        std::vector<const char *> extensions = requiredExtensions();
+        VkDeviceCreateInfo deviceCreateInfo{};
+        deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceCreateInfo.pNext = &features12;
+        deviceCreateInfo.queueCreateInfoCount = 1;
+        deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+        deviceCreateInfo.enabledExtensionCount =
+            static_cast<uint32_t>(extensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
+
+        if (vkCreateDevice(
+                physicalDevice_, &deviceCreateInfo, nullptr, &device_)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create logical device!");
+        vkGetDeviceQueue(device_, queueFamily_, 0, &queue_);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily_;
+        if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool_)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create command pool!");
+    }
+
+    // Allocates from a memory type with the preferred properties when
+    // possible, else with the required ones
+    VkDeviceMemory allocate(const VkMemoryRequirements &requirements,
+                            VkMemoryPropertyFlags required,
+                            VkMemoryPropertyFlags preferred)
+    {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memoryProperties);
+
+        std::optional<uint32_t> memoryType;
+        for (VkMemoryPropertyFlags properties :
+             { required | preferred, required }) {
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+                if ((requirements.memoryTypeBits & (1u << i))
+                    && (memoryProperties.memoryTypes[i].propertyFlags
+                        & properties)
+                        == properties) {
+                    memoryType = i;
+                    break;
+                }
+            }
+            if (memoryType)
+                break;
+        }
+        if (!memoryType)
+            throw std::runtime_error("failed to find suitable memory type!");
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = memoryType.value();
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device_, &allocInfo, nullptr, &memory)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate memory!");
+        return memory;
+    }
+
+    Buffer makeBuffer(VkDeviceSize size,
+                      VkBufferUsageFlags usage,
+                      bool hostVisible)
+    {
+        Buffer buffer;
+        buffer.size = size;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer.buffer)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create buffer!");
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device_, buffer.buffer, &requirements);
+        buffer.memory = hostVisible
+            ? allocate(requirements,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                           | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       0)
+            : allocate(requirements, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        vkBindBufferMemory(device_, buffer.buffer, buffer.memory, 0);
+
+        if (hostVisible) {
+            void *mapped;
+            vkMapMemory(device_, buffer.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+            buffer.mapped = static_cast<uint8_t *>(mapped);
+        }
+        return buffer;
+    }
+
+    void destroyBuffer(const Buffer &buffer)
+    {
+        if (buffer.mapped)
+            vkUnmapMemory(device_, buffer.memory);
+        vkDestroyBuffer(device_, buffer.buffer, nullptr);
+        vkFreeMemory(device_, buffer.memory, nullptr);
+    }
+
+    // Copies data into a staging buffer, then runs the copy out of it
+    // recorded by record and waits for it
+    void upload(const uint8_t *data,
+                size_t size,
+                const std::function<void(VkCommandBuffer, VkBuffer)> &record)
+    {
+        Buffer staging = makeBuffer(std::max<VkDeviceSize>(size, 4),
+                                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    true);
+        std::memcpy(staging.mapped, data, size);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool_;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        record(commandBuffer, staging.buffer);
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(queue_);
+
+        vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+        destroyBuffer(staging);
+    }
+
+    // Objects
+
+    void createHeap(CallTraceReader &record)
+    {
+        uint32_t sampledImageCapacity = record.read<uint32_t>();
+        uint32_t storageBufferCapacity = record.read<uint32_t>();
+        heap_ = std::make_unique<BindlessHeap>(physicalDevice_,
+                                               device_,
+                                               sampledImageCapacity,
+                                               storageBufferCapacity);
+    }
+
+    // Regions at least as large, and as aligned, as the captured ones: the
+    // captured dynamic offsets stay valid relative to their region
+    void createRing(CallTraceReader &record)
+    {
+        VkDeviceSize bytesPerFrame = record.read<VkDeviceSize>();
+        uint32_t framesInFlight = record.read<uint32_t>();
+        VkDeviceSize frameRange = record.read<VkDeviceSize>();
+        VkDeviceSize drawRange = record.read<VkDeviceSize>();
+        VkDeviceSize alignment = record.read<VkDeviceSize>();
+
+        ring_ = std::make_unique<UniformRing>(physicalDevice_,
+                                              device_,
+                                              alignUp(bytesPerFrame, alignment),
+                                              framesInFlight,
+                                              frameRange,
+                                              drawRange);
+        if (alignment % ring_->alignment() != 0)
+            throw std::runtime_error(
+                "uniform ring offsets of the call trace are misaligned on "
+                "this device!");
+
+        createFrameSlots(framesInFlight);
+    }
+
+    void createFrameSlots(uint32_t count)
+    {
+        commandBuffers_.resize(count);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool_;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = count;
+        if (vkAllocateCommandBuffers(
+                device_, &allocInfo, commandBuffers_.data())
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate command buffers!");
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        fences_.resize(count);
+        for (VkFence &fence : fences_) {
+            if (vkCreateFence(device_, &fenceInfo, nullptr, &fence)
+                != VK_SUCCESS)
+                throw std::runtime_error("failed to create fence!");
+        }
+        slotFrames_.assign(count, NO_FRAME);
+
+        if (timestampValidBits_ == 0)
+            return;
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = count * TIMESTAMPS_PER_FRAME;
+        if (vkCreateQueryPool(device_, &queryPoolInfo, nullptr, &queryPool_)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create query pool!");
+    }
+
+    void createPipelineLayout(CallTraceReader &record)
+    {
+        if (!heap_ || !ring_)
+            throw std::runtime_error(
+                "call trace pipeline layout before its heap and ring!");
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = record.read<VkShaderStageFlags>();
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = record.read<uint32_t>();
+
+        VkDescriptorSetLayout setLayouts[] = { heap_->layout(),
+                                               ring_->layout() };
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 2;
+        layoutInfo.pSetLayouts = setLayouts;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(
+                device_, &layoutInfo, nullptr, &pipelineLayout_)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    void createShaderModule(CallTraceReader &record)
+    {
+        uint32_t size = record.read<uint32_t>();
+        // SPIR-V words, aligned
+        std::vector<uint32_t> code((size + 3) / 4);
+        std::memcpy(code.data(), record.bytes(size), size);
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = size;
+        createInfo.pCode = code.data();
+
+        VkShaderModule module;
+        if (vkCreateShaderModule(device_, &createInfo, nullptr, &module)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create shader module!");
+        shaderModules_.push_back(module);
+    }
+
+    void createRenderPass(CallTraceReader &record)
+    {
+        struct SubpassAttachments {
+            std::vector<VkAttachmentReference> inputs;
+            std::vector<VkAttachmentReference> colors;
+            std::vector<VkAttachmentReference> resolves;
+            std::vector<VkAttachmentReference> depthStencil;
+            std::vector<uint32_t> preserves;
+        };
+
+        VkRenderPassCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        createInfo.flags = record.read<VkRenderPassCreateFlags>();
+
+        std::vector<VkAttachmentDescription> attachments =
+            record.readArray<VkAttachmentDescription>();
+        for (auto &attachment : attachments) {
+            unpresentable(attachment.initialLayout);
+            unpresentable(attachment.finalLayout);
+        }
+
+        uint32_t subpassCount = record.read<uint32_t>();
+        std::vector<SubpassAttachments> references(subpassCount);
+        std::vector<VkSubpassDescription> subpasses(subpassCount);
+        for (uint32_t i = 0; i < subpassCount; i++) {
+            SubpassAttachments &used = references[i];
+            VkSubpassDescription &subpass = subpasses[i];
+            subpass.flags = record.read<VkSubpassDescriptionFlags>();
+            subpass.pipelineBindPoint = record.read<VkPipelineBindPoint>();
+            used.inputs = record.readArray<VkAttachmentReference>();
+            used.colors = record.readArray<VkAttachmentReference>();
+            used.resolves = record.readArray<VkAttachmentReference>();
+            used.depthStencil = record.readArray<VkAttachmentReference>();
+            used.preserves = record.readArray<uint32_t>();
+
+            subpass.inputAttachmentCount =
+                static_cast<uint32_t>(used.inputs.size());
+            subpass.pInputAttachments = used.inputs.data();
+            subpass.colorAttachmentCount =
+                static_cast<uint32_t>(used.colors.size());
+            subpass.pColorAttachments = used.colors.data();
+            subpass.pResolveAttachments =
+                used.resolves.empty() ? nullptr : used.resolves.data();
+            subpass.pDepthStencilAttachment =
+                used.depthStencil.empty() ? nullptr : used.depthStencil.data();
+            subpass.preserveAttachmentCount =
+                static_cast<uint32_t>(used.preserves.size());
+            subpass.pPreserveAttachments = used.preserves.data();
+        }
+        std::vector<VkSubpassDependency> dependencies =
+            record.readArray<VkSubpassDependency>();
+
+        createInfo.attachmentCount =
+            static_cast<uint32_t>(attachments.size());
+        createInfo.pAttachments = attachments.data();
+        createInfo.subpassCount = subpassCount;
+        createInfo.pSubpasses = subpasses.data();
+        createInfo.dependencyCount =
+            static_cast<uint32_t>(dependencies.size());
+        createInfo.pDependencies = dependencies.data();
+
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(device_, &createInfo, nullptr, &renderPass)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create render pass!");
+        renderPasses_.push_back(renderPass);
+    }
+
+    // Uses its render pass, then the module of each stage
+    void createPipeline(const std::vector<uint32_t> &uses,
+                        CallTraceReader &record)
+    {
+        VkGraphicsPipelineCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        createInfo.flags = record.read<VkPipelineCreateFlags>();
+        createInfo.subpass = record.read<uint32_t>();
+
+        uint32_t stageCount = record.read<uint32_t>();
+        if (uses.size() != 1 + size_t(stageCount))
+            throw std::runtime_error("malformed pipeline in call trace!");
+
+        std::vector<VkPipelineShaderStageCreateInfo> stages(stageCount);
+        std::vector<std::string> names(stageCount);
+        std::vector<std::vector<VkSpecializationMapEntry>> mapEntries(
+            stageCount);
+        std::vector<std::vector<uint8_t>> constants(stageCount);
+        std::vector<VkSpecializationInfo> specializations(stageCount);
+        for (uint32_t i = 0; i < stageCount; i++) {
+            VkPipelineShaderStageCreateInfo &stage = stages[i];
+            stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stage.flags = record.read<VkPipelineShaderStageCreateFlags>();
+            stage.stage = record.read<VkShaderStageFlagBits>();
+            stage.module = at(shaderModules_, uses[1 + i]);
+            std::vector<char> name = record.readArray<char>();
+            names[i].assign(name.begin(), name.end());
+            stage.pName = names[i].c_str();
+
+            mapEntries[i] = record.readArray<VkSpecializationMapEntry>();
+            constants[i] = record.readArray<uint8_t>();
+            if (!mapEntries[i].empty() || !constants[i].empty()) {
+                specializations[i].mapEntryCount =
+                    static_cast<uint32_t>(mapEntries[i].size());
+                specializations[i].pMapEntries = mapEntries[i].data();
+                specializations[i].dataSize = constants[i].size();
+                specializations[i].pData = constants[i].data();
+                stage.pSpecializationInfo = &specializations[i];
+            }
+        }
+        createInfo.stageCount = stageCount;
+        createInfo.pStages = stages.data();
+
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+        if (record.read<uint32_t>()) {
+            bindings = record.readArray<VkVertexInputBindingDescription>();
+            attributes =
+                record.readArray<VkVertexInputAttributeDescription>();
+            vertexInput.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+            vertexInput.vertexBindingDescriptionCount =
+                static_cast<uint32_t>(bindings.size());
+            vertexInput.pVertexBindingDescriptions = bindings.data();
+            vertexInput.vertexAttributeDescriptionCount =
+                static_cast<uint32_t>(attributes.size());
+            vertexInput.pVertexAttributeDescriptions = attributes.data();
+            createInfo.pVertexInputState = &vertexInput;
+        }
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+        createInfo.pInputAssemblyState = readState(record, inputAssembly);
+        VkPipelineTessellationStateCreateInfo tessellation;
+        createInfo.pTessellationState = readState(record, tessellation);
+
+        VkPipelineViewportStateCreateInfo viewport{};
+        std::vector<VkViewport> viewports;
+        std::vector<VkRect2D> scissors;
+        if (record.read<uint32_t>()) {
+            viewport.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+            viewport.flags = record.read<VkPipelineViewportStateCreateFlags>();
+            viewport.viewportCount = record.read<uint32_t>();
+            viewport.scissorCount = record.read<uint32_t>();
+            viewports = record.readArray<VkViewport>();
+            scissors = record.readArray<VkRect2D>();
+            viewport.pViewports =
+                viewports.empty() ? nullptr : viewports.data();
+            viewport.pScissors = scissors.empty() ? nullptr : scissors.data();
+            createInfo.pViewportState = &viewport;
+        }
+
+        VkPipelineRasterizationStateCreateInfo rasterization;
+        createInfo.pRasterizationState = readState(record, rasterization);
+
+        VkPipelineMultisampleStateCreateInfo multisample;
+        std::vector<VkSampleMask> sampleMask;
+        if (readState(record, multisample)) {
+            sampleMask = record.readArray<VkSampleMask>();
+            multisample.pSampleMask =
+                sampleMask.empty() ? nullptr : sampleMask.data();
+            createInfo.pMultisampleState = &multisample;
+        }
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil;
+        createInfo.pDepthStencilState = readState(record, depthStencil);
+
+        VkPipelineColorBlendStateCreateInfo colorBlend;
+        std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+        if (readState(record, colorBlend)) {
+            blendAttachments =
+                record.readArray<VkPipelineColorBlendAttachmentState>();
+            colorBlend.pAttachments = blendAttachments.data();
+            createInfo.pColorBlendState = &colorBlend;
+        }
+
+        VkPipelineDynamicStateCreateInfo dynamic{};
+        std::vector<VkDynamicState> dynamicStates;
+        if (record.read<uint32_t>()) {
+            dynamicStates = record.readArray<VkDynamicState>();
+            dynamic.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+            dynamic.dynamicStateCount =
+                static_cast<uint32_t>(dynamicStates.size());
+            dynamic.pDynamicStates = dynamicStates.data();
+            createInfo.pDynamicState = &dynamic;
+        }
+
+        createInfo.layout = pipelineLayout_;
+        createInfo.renderPass = at(renderPasses_, uses[0]);
+        createInfo.basePipelineHandle = VK_NULL_HANDLE;
+        createInfo.basePipelineIndex = -1;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(
+                device_, VK_NULL_HANDLE, 1, &createInfo, nullptr, &pipeline)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create graphics pipeline!");
+        pipelines_.push_back(pipeline);
+    }
+
+    // Device-local unless the renderer wrote it from the host
+    void createBuffer(CallTraceReader &record)
+    {
+        VkDeviceSize size = record.read<VkDeviceSize>();
+        VkBufferUsageFlags usage = record.read<VkBufferUsageFlags>();
+        VkMemoryPropertyFlags properties =
+            record.read<VkMemoryPropertyFlags>();
+
+        bool hostVisible = properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        if (!hostVisible)
+            usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        buffers_.push_back(makeBuffer(size, usage, hostVisible));
+    }
+
+    void createImage(CallTraceReader &record)
+    {
+        Image image;
+        image.info = record.read<VkImageCreateInfo>();
+        if (vkCreateImage(device_, &image.info, nullptr, &image.image)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create image!");
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device_, image.image, &requirements);
+        VkMemoryPropertyFlags preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (image.info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+            preferred |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        image.memory = allocate(requirements, 0, preferred);
+        vkBindImageMemory(device_, image.image, image.memory, 0);
+        images_.push_back(image);
+    }
+
+    void createImageView(const std::vector<uint32_t> &uses,
+                         CallTraceReader &record)
+    {
+        VkImageViewCreateInfo createInfo =
+            record.read<VkImageViewCreateInfo>();
+        createInfo.image = at(images_, uses.at(0)).image;
+
+        VkImageView view;
+        if (vkCreateImageView(device_, &createInfo, nullptr, &view)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create image view!");
+        imageViews_.push_back(view);
+    }
+
+    // Uses its render pass, then its attachments
+    void createFramebuffer(const std::vector<uint32_t> &uses,
+                           CallTraceReader &record)
+    {
+        if (uses.empty())
+            throw std::runtime_error("malformed framebuffer in call trace!");
+
+        std::vector<VkImageView> attachments;
+        for (size_t i = 1; i < uses.size(); i++) {
+            attachments.push_back(at(imageViews_, uses[i]));
+        }
+
+        Framebuffer framebuffer;
+        framebuffer.renderPass = at(renderPasses_, uses[0]);
+
+        VkFramebufferCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        createInfo.flags = record.read<VkFramebufferCreateFlags>();
+        createInfo.renderPass = framebuffer.renderPass;
+        createInfo.attachmentCount =
+            static_cast<uint32_t>(attachments.size());
+        createInfo.pAttachments = attachments.data();
+        createInfo.width = record.read<uint32_t>();
+        createInfo.height = record.read<uint32_t>();
+        createInfo.layers = record.read<uint32_t>();
+
+        if (vkCreateFramebuffer(
+                device_, &createInfo, nullptr, &framebuffer.framebuffer)
+            != VK_SUCCESS)
+            throw std::runtime_error("failed to create framebuffer!");
+        framebuffers_.push_back(framebuffer);
+    }
+
+    // Contents and heap slots
+
+    void writeBuffer(const std::vector<uint32_t> &uses,
+                     CallTraceReader &record)
+    {
+        Buffer &buffer = at(buffers_, uses.at(0));
+        VkDeviceSize offset = record.read<VkDeviceSize>();
+        uint32_t size = record.read<uint32_t>();
+        const uint8_t *data = record.bytes(size);
+        if (offset + size > buffer.size)
+            throw std::runtime_error("call trace writes past a buffer!");
+
+        if (buffer.mapped) {
+            std::memcpy(buffer.mapped + offset, data, size);
+            return;
+        }
+        if (size == 0)
+            return;
+        upload(data, size, [&](VkCommandBuffer commandBuffer, VkBuffer from) {
+            VkBufferCopy region{ 0, offset, size };
+            vkCmdCopyBuffer(commandBuffer, from, buffer.buffer, 1, &region);
+        });
+    }
+
+    // First mip level and layer; the whole image is left ready for sampling
+    void writeImage(const std::vector<uint32_t> &uses, CallTraceReader &record)
+    {
+        const Image &image = at(images_, uses.at(0));
+        uint32_t size = record.read<uint32_t>();
+        const uint8_t *texels = record.bytes(size);
+
+        upload(texels, size, [&](VkCommandBuffer commandBuffer, VkBuffer from) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image.image;
+            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT,
+                                         0,
+                                         VK_REMAINING_MIP_LEVELS,
+                                         0,
+                                         VK_REMAINING_ARRAY_LAYERS };
+            vkCmdPipelineBarrier(commandBuffer,
+                                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0,
+                                 0,
+                                 nullptr,
+                                 0,
+                                 nullptr,
+                                 1,
+                                 &barrier);
+
+            VkBufferImageCopy region{};
+            region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            region.imageExtent = { image.info.extent.width,
+                                   image.info.extent.height,
+                                   1 };
+            vkCmdCopyBufferToImage(commandBuffer,
+                                   from,
+                                   image.image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   1,
+                                   &region);
+
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            vkCmdPipelineBarrier(commandBuffer,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 0,
+                                 0,
+                                 nullptr,
+                                 0,
+                                 nullptr,
+                                 1,
+                                 &barrier);
+        });
+    }
+
+    // The heap hands out the same indices when filled in the same order;
+    // the shaders read the captured ones
+    void addHeapImage(const std::vector<uint32_t> &uses,
+                      CallTraceReader &record)
+    {
+        VkImageView view = at(imageViews_, uses.at(0));
+        uint32_t index = record.read<uint32_t>();
+        if (!heap_
+            || heap_->addSampledImage(
+                   view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+                != index)
+            throw std::runtime_error(
+                "bindless heap index differs from the call trace!");
+    }
+
+    void addHeapBuffer(const std::vector<uint32_t> &uses,
+                       CallTraceReader &record)
+    {
+        VkBuffer buffer = at(buffers_, uses.at(0)).buffer;
+        uint32_t index = record.read<uint32_t>();
+        if (!heap_ || heap_->addStorageBuffer(buffer) != index)
+            throw std::runtime_error(
+                "bindless heap index differs from the call trace!");
+    }
+
+    // Commands
+
+    void recordCommand(VkCommandBuffer commandBuffer,
+                       CallRecord type,
+                       CallTraceReader &command,
+                       int64_t ringDelta)
+    {
+        switch (type) {
+        case CallRecord::BUFFER_DATA:
+            writeBuffer(command.readArray<uint32_t>(), command);
+            break;
+        case CallRecord::BEGIN_RENDER_PASS: {
+            const Framebuffer &framebuffer =
+                at(framebuffers_, command.read<uint32_t>());
+            VkRect2D renderArea = command.read<VkRect2D>();
+            std::vector<VkClearValue> clearValues =
+                command.readArray<VkClearValue>();
+
+            VkRenderPassBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            beginInfo.renderPass = framebuffer.renderPass;
+            beginInfo.framebuffer = framebuffer.framebuffer;
+            beginInfo.renderArea = renderArea;
+            beginInfo.clearValueCount =
+                static_cast<uint32_t>(clearValues.size());
+            beginInfo.pClearValues = clearValues.data();
+            vkCmdBeginRenderPass(
+                commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            break;
+        }
+        case CallRecord::NEXT_SUBPASS:
+            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+            break;
+        case CallRecord::END_RENDER_PASS:
+            vkCmdEndRenderPass(commandBuffer);
+            break;
+        case CallRecord::BIND_PIPELINE:
+            recorder_->bindPipeline(at(pipelines_, command.read<uint32_t>()));
+            break;
+        case CallRecord::SET_VIEWPORT:
+            recorder_->setViewport(command.read<VkViewport>());
+            break;
+        case CallRecord::SET_SCISSOR:
+            recorder_->setScissor(command.read<VkRect2D>());
+            break;
+        case CallRecord::SET_STATE:
+            recorder_->setState(command.read<DrawStateRecorder::State>());
+            break;
+        case CallRecord::BIND_HEAP: {
+            VkDescriptorSet heapSet = heap_->set();
+            vkCmdBindDescriptorSets(commandBuffer,
+                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    pipelineLayout_,
+                                    0,
+                                    1,
+                                    &heapSet,
+                                    0,
+                                    nullptr);
+            break;
+        }
+        case CallRecord::BIND_RING: {
+            VkDescriptorSet ringSet = ring_->set();
+            uint32_t dynamicOffsets[2];
+            for (uint32_t &offset : dynamicOffsets) {
+                offset = static_cast<uint32_t>(
+                    int64_t(command.read<uint32_t>()) + ringDelta);
+            }
+            vkCmdBindDescriptorSets(commandBuffer,
+                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    pipelineLayout_,
+                                    1,
+                                    1,
+                                    &ringSet,
+                                    2,
+                                    dynamicOffsets);
+            break;
+        }
+        case CallRecord::PUSH_CONSTANTS: {
+            VkShaderStageFlags stages = command.read<VkShaderStageFlags>();
+            uint32_t offset = command.read<uint32_t>();
+            uint32_t size = command.read<uint32_t>();
+            vkCmdPushConstants(commandBuffer,
+                               pipelineLayout_,
+                               stages,
+                               offset,
+                               size,
+                               command.bytes(size));
+            break;
+        }
+        case CallRecord::BIND_INDEX_BUFFER: {
+            VkBuffer buffer = at(buffers_, command.read<uint32_t>()).buffer;
+            VkDeviceSize offset = command.read<VkDeviceSize>();
+            VkIndexType indexType = command.read<VkIndexType>();
+            vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+            break;
+        }
+        case CallRecord::DRAW: {
+            uint32_t vertexCount = command.read<uint32_t>();
+            uint32_t instanceCount = command.read<uint32_t>();
+            uint32_t firstVertex = command.read<uint32_t>();
+            uint32_t firstInstance = command.read<uint32_t>();
+            vkCmdDraw(commandBuffer,
+                      vertexCount,
+                      instanceCount,
+                      firstVertex,
+                      firstInstance);
+            break;
+        }
+        case CallRecord::DRAW_INDEXED: {
+            uint32_t indexCount = command.read<uint32_t>();
+            uint32_t instanceCount = command.read<uint32_t>();
+            uint32_t firstIndex = command.read<uint32_t>();
+            int32_t vertexOffset = command.read<int32_t>();
+            uint32_t firstInstance = command.read<uint32_t>();
+            vkCmdDrawIndexed(commandBuffer,
+                             indexCount,
+                             instanceCount,
+                             firstIndex,
+                             vertexOffset,
+                             firstInstance);
+            break;
+        }
+
+        default:
+            throw std::runtime_error("unexpected command in call trace!");
+        }
+    }
+
+    // GPU time of the frame the slot ran last, now complete
+    void collectTimestamps(uint32_t slot)
+    {
+        size_t frame = slotFrames_[slot];
+        slotFrames_[slot] = NO_FRAME;
+        if (frame == NO_FRAME || queryPool_ == VK_NULL_HANDLE)
+            return;
+
+        uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+        if (vkGetQueryPoolResults(device_,
+                                  queryPool_,
+                                  slot * TIMESTAMPS_PER_FRAME,
+                                  TIMESTAMPS_PER_FRAME,
+                                  sizeof(timestamps),
+                                  timestamps,
+                                  sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT)
+            != VK_SUCCESS)
+            return;
+
+        uint64_t mask = timestampValidBits_ >= 64
+            ? ~0ull
+            : (1ull << timestampValidBits_) - 1;
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+        timings_[frame].gpu = double(ticks) * timestampPeriod_ / 1e6;
+    }
+
+    DrawStateRecorder::Support support_;
+    VkInstance instance_ = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+    std::string deviceName_;
+    uint32_t queueFamily_ = 0;
+    uint32_t timestampValidBits_ = 0;
+    double timestampPeriod_ = 1.0;
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkQueue queue_ = VK_NULL_HANDLE;
+    VkCommandPool commandPool_ = VK_NULL_HANDLE;
+    std::unique_ptr<DrawStateRecorder> recorder_;
+    std::unique_ptr<BindlessHeap> heap_;
+    std::unique_ptr<UniformRing> ring_;
+    VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+    // Indexed by their number in the trace
+    std::vector<VkShaderModule> shaderModules_;
+    std::vector<VkRenderPass> renderPasses_;
+    std::vector<VkPipeline> pipelines_;
+    std::vector<Buffer> buffers_;
+    std::vector<Image> images_;
+    std::vector<VkImageView> imageViews_;
+    std::vector<Framebuffer> framebuffers_;
+    // One per frame in flight of the capture
+    std::vector<VkCommandBuffer> commandBuffers_;
+    std::vector<VkFence> fences_;
+    // Frame each slot ran last, whose timestamps are not collected yet
+    std::vector<size_t> slotFrames_;
+    VkQueryPool queryPool_ = VK_NULL_HANDLE;
+    std::vector<FrameTiming> timings_;
+};
+
+void printSummary(const char *name, const TimingSummary &summary)
+{
+    std::cout << "  " << name << ": mean " << summary.mean << " ms, median "
+              << summary.median << " ms, p95 " << summary.p95 << " ms, max "
+              << summary.max << " ms\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try {
+        uint32_t loops = 1;
+        bool perFrame = false;
+        std::string jsonPath;
+        std::string tracePath;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--loops" && i + 1 < argc) {
+                loops = std::max(
+                    1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+            }
+            else if (arg == "--frames") {
+                perFrame = true;
+            }
+            else if (arg == "--json" && i + 1 < argc) {
+                jsonPath = argv[++i];
+            }
+            else if (!arg.empty() && arg[0] != '-' && tracePath.empty()) {
+                tracePath = arg;
+            }
+            else {
+                throw std::runtime_error("unknown option: " + arg);
+            }
+        }
+        if (tracePath.empty())
+            throw std::runtime_error("usage: vulkanReplay [--loops N] "
+                                     "[--frames] [--json PATH] TRACE");
+
+        MappedFile trace(tracePath);
+        CallTraceReader reader(trace.data(), trace.size());
+        CallTraceHeader header = reader.read<CallTraceHeader>();
+        if (header.magic != CALL_TRACE_MAGIC
+            || header.version != CALL_TRACE_VERSION)
+            throw std::runtime_error(tracePath
+                                     + " is not a call trace of this version!");
+        Replayer replayer(header);
+
+        // Objects are created on the first pass, frames replayed on each
+        auto replayStart = std::chrono::steady_clock::now();
+        for (uint32_t loop = 0; loop < loops; loop++) {
+            CallTraceReader records = reader;
+            while (!records.atEnd()) {
+                CallRecord type;
+                CallTraceReader record = records.record(type);
+                if (type == CallRecord::FRAME)
+                    replayer.frame(record);
+                else if (loop == 0)
+                    replayer.object(type, record);
+            }
+        }
+        const std::vector<FrameTiming> &timings = replayer.finish();
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - replayStart)
+                             .count();
+
+        std::vector<double> cpu;
+        std::vector<double> gpu;
+        for (size_t i = 0; i < timings.size(); i++) {
+            cpu.push_back(timings[i].cpu);
+            gpu.push_back(timings[i].gpu);
+            if (perFrame) {
+                std::cout << "frame " << i << ": cpu " << timings[i].cpu
+                          << " ms";
+                if (replayer.gpuTimed())
+                    std::cout << ", gpu " << timings[i].gpu << " ms";
+                std::cout << "\n";
+            }
+        }
+        TimingSummary cpuSummary = summarizeTimings(cpu);
+        TimingSummary gpuSummary = summarizeTimings(gpu);
+
+        std::cout << tracePath << ": " << timings.size() << " frames on "
+                  << replayer.deviceName() << " in " << seconds << " s, "
+                  << double(timings.size()) / seconds << " frames/s\n";
+        printSummary("cpu (record + submit)", cpuSummary);
+        if (replayer.gpuTimed())
+            printSummary("gpu", gpuSummary);
+
+        if (!jsonPath.empty()) {
+            std::ofstream json(jsonPath);
+            json << "{\n  \"device\": \"" << replayer.deviceName()
+                 << "\",\n  \"frames\": " << timings.size()
+                 << ",\n  \"seconds\": " << seconds << ",\n  \"cpu\": ";
+            writeJson(json, cpuSummary);
+            if (replayer.gpuTimed()) {
+                json << ",\n  \"gpu\": ";
+                writeJson(json, gpuSummary);
+            }
+            json << "\n}\n";
+            if (!json)
+                throw std::runtime_error("failed to write " + jsonPath + "!");
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+// Performance regression check of one scenario:
+//
+//   perfCheck [--tolerance T] [--update PATH] [--report PATH]
+//             --metrics A,B,... BASELINE RESULTS
+//
+// RESULTS is the JSON written by drawTriangle --results or vulkanReplay
+// --json. Each metric is a dotted path into it, such as frameMs.median,
+// naming a time where lower is better. BASELINE holds the accepted value of
+// each metric by name. The check fails when a metric exceeds its baseline
+// by more than the tolerance, a fraction (0.25 allows 25% slower), and on
+// a metric of 0 on either side: a time that was never measured would
+// otherwise pass against anything.
+//
+// A missing baseline skips the check: perfCheck exits with NO_BASELINE,
+// which CTest reports as skipped. --update writes the results to PATH
+// as a new baseline instead of checking them, to be reviewed and committed
+// as BASELINE: baselines are recorded on the machine the checks run on.
+// --report writes each metric's value, baseline and ratio, for trend
+// tracking.
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hh"
+#include "mappedFile.hh"
+
+namespace {
+
+// The automake skip code, add_perf_scenario's SKIP_RETURN_CODE
+const int NO_BASELINE = 77;
+
+struct Metric {
+    std::string name;
+    double value = 0.0;
+    double baseline = 0.0;
+};
+
+JsonValue parseFile(const std::filesystem::path &path)
+{
+    MappedFile file(path);
+    return JsonValue::parse(std::string_view(
+        reinterpret_cast<const char *>(file.data()), file.size()));
+}
+
+std::vector<std::string> split(const std::string &text, char separator)
+{
+    std::vector<std::string> parts;
+    std::istringstream in(text);
+    std::string part;
+    while (std::getline(in, part, separator)) {
+        if (!part.empty())
+            parts.push_back(part);
+    }
+    return parts;
+}
+
+double lookUp(const JsonValue &results, const std::string &metric)
+{
+    const JsonValue *value = &results;
+    for (const std::string &key : split(metric, '.')) {
+        value = value->type() == JsonValue::Type::OBJECT ? value->find(key)
+                                                         : nullptr;
+        if (value == nullptr)
+            throw std::runtime_error("results have no " + metric + "!");
+    }
+    return value->asNumber();
+}
+
+void writeBaseline(const std::filesystem::path &path,
+                   const std::vector<Metric> &metrics)
+{
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path());
+    std::ofstream out(path);
+    out << "{\n";
+    for (size_t i = 0; i < metrics.size(); i++) {
+        out << "  \"" << metrics[i].name << "\": " << metrics[i].value
+            << (i + 1 < metrics.size() ? ",\n" : "\n");
+    }
+    out << "}\n";
+    if (!out)
+        throw std::runtime_error("failed to write " + path.string() + "!");
+}
+
+void writeReport(const std::filesystem::path &path,
+                 const std::vector<Metric> &metrics,
+                 double tolerance,
+                 bool passed)
+{
+    std::ofstream out(path);
+    out << "{\n  \"passed\": " << (passed ? "true" : "false")
+        << ",\n  \"tolerance\": " << tolerance << ",\n  \"metrics\": {\n";
+    for (size_t i = 0; i < metrics.size(); i++) {
+        const Metric &metric = metrics[i];
+        out << "    \"" << metric.name << "\": { \"value\": " << metric.value
+            << ", \"baseline\": " << metric.baseline << ", \"ratio\": "
+            << (metric.baseline > 0.0 ? metric.value / metric.baseline : 1.0)
+            << " }" << (i + 1 < metrics.size() ? ",\n" : "\n");
+    }
+    out << "  }\n}\n";
+    if (!out)
+        throw std::runtime_error("failed to write " + path.string() + "!");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try {
+        double tolerance = 0.25;
+        std::string updatePath;
+        std::string reportPath;
+        std::vector<std::string> names;
+        std::vector<std::string> paths;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--tolerance" && i + 1 < argc) {
+                tolerance = std::stod(argv[++i]);
+            }
+            else if (arg == "--update" && i + 1 < argc) {
+                updatePath = argv[++i];
+            }
+            else if (arg == "--report" && i + 1 < argc) {
+                reportPath = argv[++i];
+            }
+            else if (arg == "--metrics" && i + 1 < argc) {
+                names = split(argv[++i], ',');
+            }
+            else if (!arg.empty() && arg[0] != '-') {
+                paths.push_back(arg);
+            }
+            else {
+                throw std::runtime_error("unknown option: " + arg);
+            }
+        }
+        if (paths.size() != 2 || names.empty())
+            throw std::runtime_error(
+                "usage: perfCheck [--tolerance T] [--update PATH] "
+                "[--report PATH] --metrics A,B,... BASELINE RESULTS");
+
+        std::filesystem::path baselinePath = paths[0];
+        JsonValue results = parseFile(paths[1]);
+        std::vector<Metric> metrics;
+        for (const std::string &name : names) {
+            Metric metric;
+            metric.name = name;
+            metric.value = lookUp(results, name);
+            metrics.push_back(metric);
+        }
+
+        for (const Metric &metric : metrics) {
+            if (metric.value <= 0.0)
+                throw std::runtime_error(metric.name + " was not measured!");
+        }
+
+        if (!updatePath.empty()) {
+            for (Metric &metric : metrics) {
+                metric.baseline = metric.value;
+            }
+            writeBaseline(updatePath, metrics);
+            std::cout << "baseline written to " << updatePath << "\n";
+            if (!reportPath.empty())
+                writeReport(reportPath, metrics, tolerance, true);
+            return EXIT_SUCCESS;
+        }
+
+        if (!std::filesystem::exists(baselinePath)) {
+            std::cout << "no baseline " << baselinePath.string()
+                      << ", record one with --update\n";
+            return NO_BASELINE;
+        }
+        JsonValue baseline = parseFile(baselinePath);
+        bool passed = true;
+        for (Metric &metric : metrics) {
+            const JsonValue *value = baseline.find(metric.name);
+            if (value == nullptr)
+                throw std::runtime_error(baselinePath.string() + " has no "
+                                         + metric.name
+                                         + ", record it again with --update!");
+            metric.baseline = value->asNumber();
+            if (metric.baseline <= 0.0)
+                throw std::runtime_error(baselinePath.string() + " has no "
+                                         + "measurement of " + metric.name
+                                         + ", record it again with --update!");
+
+            bool regressed = metric.value > metric.baseline * (1.0 + tolerance);
+            passed = passed && !regressed;
+            std::cout << metric.name << ": " << metric.value << " ms against "
+                      << metric.baseline << " ms"
+                      << (regressed ? ", REGRESSED" : "") << "\n";
+        }
+
+        if (!reportPath.empty())
+            writeReport(reportPath, metrics, tolerance, passed);
+        if (!passed) {
+            std::cerr << "regressed by more than " << tolerance * 100.0
+                      << "% over " << baselinePath.string() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
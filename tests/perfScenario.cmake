@@ -0,0 +1,20 @@
+# Runs one performance scenario, the setup of the check of its results
+# against the baseline (cmake -P, from add_perf_scenario in CMakeLists.txt):
+#
+#   cmake -DNAME=... -DCOMMAND=a|b|... -DRESULTS=... -P perfScenario.cmake
+#
+# COMMAND is '|'-separated, as lists do not survive the test command line.
+
+string(REPLACE "|" ";" COMMAND "${COMMAND}")
+
+get_filename_component(RESULTS_DIR ${RESULTS} DIRECTORY)
+file(MAKE_DIRECTORY ${RESULTS_DIR})
+file(REMOVE ${RESULTS})
+
+execute_process(COMMAND ${COMMAND} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "${NAME}: scenario failed (${result})")
+endif()
+if(NOT EXISTS ${RESULTS})
+	message(FATAL_ERROR "${NAME}: scenario wrote no ${RESULTS}")
+endif()